@@ -23,9 +23,15 @@ struct EffectTemplate {
   TransparencyMode transparency;
 };
 
+// Pass that draws a material's surfaces in the main view, transparent ones are blended after the opaque geometry
+inline MeshPassType main_pass(const EffectTemplate &effectTemplate) {
+  return effectTemplate.transparency == TransparencyMode::Transparent ? MeshPassType::Transparency : MeshPassType::Forward;
+}
+
 struct Material {
   std::shared_ptr<EffectTemplate> original;
-  EnumAccessArray<VkDescriptorSet, MeshPassType, static_cast<size_t>(MeshPassType::Count)> passSets;
+  // Slot in the bindless material buffer
+  uint32_t materialIndex{0};
 
   std::vector<Texture> textures;
 
@@ -33,7 +39,7 @@ struct Material {
 };
 
 struct MaterialInfo {
-  VkDescriptorSet materialSet;
+  uint32_t materialIndex;
   TransparencyMode transparency;
 };
 
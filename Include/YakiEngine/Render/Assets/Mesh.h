@@ -1,12 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "../../Core/Assets/Asset.h"
 #include "Vulkan/VkTypes.h"
 
+// Never handed out twice, unlike the address a freed mesh leaves behind
+inline uint32_t next_mesh_id() {
+  static std::atomic<uint32_t> nextId{0};
+  return nextId++;
+}
+
 struct Mesh : Asset {
+  // Keys the renderer's per mesh data, a mesh allocated where a freed one lived must not inherit it
+  uint32_t id{next_mesh_id()};
   std::string name;
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
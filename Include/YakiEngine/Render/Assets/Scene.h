@@ -29,7 +29,4 @@ private:
   std::unordered_map<std::string, std::shared_ptr<Material>> m_materials;
 
   std::vector<VkSampler> m_samplers;
-
-  DescriptorAllocator m_descriptorAllocator;
-  std::shared_ptr<Buffer> m_materialDataBuffer;
 };
\ No newline at end of file
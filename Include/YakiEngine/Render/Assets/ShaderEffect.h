@@ -4,12 +4,13 @@
 #include "Shader.h"
 #include "Texture.h"
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <vector>
-#include <spirv_cross/spirv_cross.hpp>
 
 #include "Vulkan/VkUtils.h"
 #include "vulkan/vulkan.h"
@@ -36,7 +37,8 @@ struct ShaderEffect {
   std::array<VkDescriptorSetLayout, 4> descriptorSetLayouts;
   EnumAccessArray<ShaderStage, ShaderStageType, static_cast<size_t>(ShaderStageType::Count)> stages;
 
-  ShaderEffect(std::shared_ptr<VulkanContext> ctx, std::shared_ptr<Shader> vertShader, std::shared_ptr<Shader> fragShader)
+  // Sets in externalSetLayouts (scene data, bindless resources) are owned by the renderer and not reflected
+  ShaderEffect(std::shared_ptr<VulkanContext> ctx, std::shared_ptr<Shader> vertShader, std::shared_ptr<Shader> fragShader, const std::map<uint32_t, VkDescriptorSetLayout> &externalSetLayouts = {})
     : m_ctx{ctx} {
     std::array<DescriptorLayoutBuilder, 4> builders;
 
@@ -45,18 +47,18 @@ struct ShaderEffect {
 
     // TODO: Dont assume whats below
     // Assume that descriptor sets are shared for vertex and fragment shader
-    for (const auto &[set, binding] : vertShader->ubos | std::views::keys) {
-      builders[set].AddBinding(binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    }
-    for (const auto &[set, binding] : vertShader->ssbos | std::views::keys) {
-      builders[set].AddBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    }
-    for (const auto &[set, binding] : vertShader->sampledImages | std::views::keys) {
-      builders[set].AddBinding(binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    // Runtime sized arrays only appear in the renderer's external sets, elsewhere they get a single descriptor
+    for (const auto &binding : vertShader->bindings | std::views::values) {
+      builders[binding.set].AddBinding(binding.binding, static_cast<VkDescriptorType>(binding.descriptorType), std::max(binding.descriptorCount, 1u));
     }
 
-    for (const auto& [descSetLayouts, builder] : std::views::zip(descriptorSetLayouts, builders)) {
-      descSetLayouts = builder.Build(m_ctx->GetDevice(), VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+    for (uint32_t set = 0; set < descriptorSetLayouts.size(); set++) {
+      if (auto external = externalSetLayouts.find(set); external != externalSetLayouts.end()) {
+        descriptorSetLayouts[set] = external->second;
+        continue;
+      }
+      descriptorSetLayouts[set] = builders[set].Build(m_ctx->GetDevice(), VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+      m_ownedSetLayouts[set] = true;
     }
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = VkInit::pipeline_layout_create_info();
@@ -70,11 +72,13 @@ struct ShaderEffect {
 
   ~ShaderEffect() {
       vkDestroyPipelineLayout(m_ctx->GetDevice(), pipelineLayout, nullptr);
-      for (auto& descSetLayout : descriptorSetLayouts) {
-        vkDestroyDescriptorSetLayout(m_ctx->GetDevice(), descSetLayout, nullptr);
+      for (const auto& [descSetLayout, owned] : std::views::zip(descriptorSetLayouts, m_ownedSetLayouts)) {
+        if (owned)
+          vkDestroyDescriptorSetLayout(m_ctx->GetDevice(), descSetLayout, nullptr);
       }
   }
 
 private:
   std::shared_ptr<VulkanContext> m_ctx;
+  std::array<bool, 4> m_ownedSetLayouts{};
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "ShaderEffect.h"
 #include "Vulkan/PipelineBuilder.h"
 #include "Vulkan/Swapchain.h"
@@ -8,7 +10,9 @@ struct ShaderPass {
   std::shared_ptr<ShaderEffect> effect{nullptr};
   VkPipeline pipeline{VK_NULL_HANDLE};
 
-  ShaderPass(std::shared_ptr<VulkanContext> ctx, Swapchain &swapchain, std::shared_ptr<ShaderEffect> effect)
+  // Transparent passes write the accumulation and revealage targets of weighted blended transparency, they test
+  // against the opaque depth without writing it
+  ShaderPass(std::shared_ptr<VulkanContext> ctx, Swapchain &swapchain, std::shared_ptr<ShaderEffect> effect, TransparencyMode mode = TransparencyMode::Opaque)
     : effect{effect},
       m_ctx{ctx} {
     PipelineBuilder pipelineBuilder(m_ctx);
@@ -17,27 +21,42 @@ struct ShaderPass {
     pipelineBuilder.SetPolygonMode(VK_POLYGON_MODE_FILL);
     pipelineBuilder.SetCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
     pipelineBuilder.SetMultisamplingNone();
-    pipelineBuilder.DisableBlending();
-    pipelineBuilder.EnableDepthTest(true);
-    pipelineBuilder.SetColorAttachmentFormat(swapchain.GetDrawTexture()->GetFormat());
-    pipelineBuilder.SetDepthFormat(swapchain.GetDepthTexture()->GetFormat());
+    pipelineBuilder.SetDepthFormat(swapchain.GetDepthFormat());
     pipelineBuilder.SetLayout(effect->pipelineLayout);
 
-    std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments;
-    blendAttachments[0] = {
-        .blendEnable = VK_FALSE,
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
-    };
-    blendAttachments[1] = {
-        .blendEnable = VK_FALSE,
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-    };
-
-    std::array<VkFormat, 2> colorFormats{
-        VK_FORMAT_R16G16B16A16_SFLOAT,
-        VK_FORMAT_R32_UINT
-    };
+    if (mode == TransparencyMode::Opaque) {
+      pipelineBuilder.DisableBlending();
+      pipelineBuilder.EnableDepthTest(true);
+      pipelineBuilder.SetColorAttachmentFormat(swapchain.GetDrawFormat());
+      pipeline = pipelineBuilder.CreatePipeline();
+      return;
+    }
 
+    // Accumulation adds up, revealage multiplies by (1 - alpha), neither depends on the order of the fragments
+    pipelineBuilder.EnableDepthTest(false);
+    std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments{{
+        {
+            .blendEnable = VK_TRUE,
+            .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        },
+        {
+            .blendEnable = VK_TRUE,
+            .srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT,
+        },
+    }};
+    std::array<VkFormat, 2> colorFormats{OIT_ACCUMULATION_FORMAT, OIT_REVEALAGE_FORMAT};
     pipeline = pipelineBuilder.CreateMRTPipeline(blendAttachments, colorFormats);
   }
 
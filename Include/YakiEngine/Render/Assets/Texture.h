@@ -41,7 +41,7 @@ private:
 
   void createTexture(void *data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped);
   void createTexture(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped);
-  void createImage(VkImageUsageFlags usage);
+  void createImage(VkImageUsageFlags usage, bool mipmapped);
   void generateMipMaps(VkCommandBuffer cmd);
 
   VkImageLayout getFinalLayout(VkFormat format, VkImageUsageFlags usage);
@@ -4,6 +4,7 @@
 #include "Components/CoreComponents.h"
 #include "Components/DynamicObject.h"
 #include "Components/StaticObject.h"
+#include "Vulkan/Renderer.h"
 
 inline void register_dynamic_object(Hori::Entity e, DynamicObject object, Translation pos = {}) {
   auto &ecs = Ecs::GetInstance();
@@ -17,7 +18,7 @@ inline void register_static_object(Hori::Entity e, StaticObject object, Translat
   ecs.AddComponents(e, Rotation{}, Scale{{1.f, 1.f, 1.f}}, LocalToWorld{}, LocalToParent{}, ParentToLocal{}, Children{}, Parent{}, DirtyTransform{});
 }
 
-inline void init_default_data(std::shared_ptr<VulkanContext> ctx, Swapchain& swapchain, DeletionQueue& deletionQueue) {
+inline void init_default_data(std::shared_ptr<VulkanContext> ctx, Renderer& renderer, DeletionQueue& deletionQueue) {
   auto& ecs = Ecs::GetInstance();
 
   DefaultData data {};
@@ -51,10 +52,14 @@ inline void init_default_data(std::shared_ptr<VulkanContext> ctx, Swapchain& swa
   });
 
   // Initialize default shader passes
-  auto vertShader = std::make_shared<Shader>(ctx, "../Shaders/Vertex/instanced.vert.spv");
-  auto fragShader = std::make_shared<Shader>(ctx, "../Shaders/Fragment/instanced.frag.spv");
-  auto effect = std::make_shared<ShaderEffect>(ctx, vertShader, fragShader);
-  auto forwardPass = std::make_shared<ShaderPass>(ctx, swapchain, effect);
+  auto vertShader = std::make_shared<Shader>(ctx, "vertex/instanced.vert");
+  auto fragShader = std::make_shared<Shader>(ctx, "fragment/instanced.frag");
+  std::map<uint32_t, VkDescriptorSetLayout> rendererSetLayouts{
+    {0, renderer.GetSceneDataDescriptorLayout()},
+    {1, renderer.GetBindlessRegistry().GetLayout()},
+  };
+  auto effect = std::make_shared<ShaderEffect>(ctx, vertShader, fragShader, rendererSetLayouts);
+  auto forwardPass = std::make_shared<ShaderPass>(ctx, renderer.GetSwapchain(), effect);
   auto shaderParams = std::make_shared<ShaderParameters>(glm::vec4{0.1f}, glm::vec4{0.1f}, glm::vec4{0.1f});
   auto effectTemplate = std::make_shared<EffectTemplate>();
   effectTemplate->passShaders[MeshPassType::Forward] = forwardPass;
@@ -63,5 +68,16 @@ inline void init_default_data(std::shared_ptr<VulkanContext> ctx, Swapchain& swa
 
   data.opaqueEffectTemplate = std::move(effectTemplate);
 
+  // Blended materials share the vertex stage, only the fragment stage and the targets differ
+  auto transparentFragShader = std::make_shared<Shader>(ctx, "fragment/transparent.frag");
+  auto transparentEffect = std::make_shared<ShaderEffect>(ctx, vertShader, transparentFragShader, rendererSetLayouts);
+  auto transparentTemplate = std::make_shared<EffectTemplate>();
+  transparentTemplate->passShaders[MeshPassType::Transparency] = std::make_shared<ShaderPass>(ctx, renderer.GetSwapchain(), transparentEffect, TransparencyMode::Transparent);
+  transparentTemplate->defaultParameters = shaderParams;
+  transparentTemplate->transparency = TransparencyMode::Transparent;
+
+  data.transparentEffectTemplate = std::move(transparentTemplate);
+  data.bindlessRegistry = &renderer.GetBindlessRegistry();
+
   ecs.AddSingletonComponent(std::move(data));
 }
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #include "Assets/Material.h"
 #include "Assets/Texture.h"
+#include "Vulkan/BindlessRegistry.h"
 
 struct DefaultData {
   std::shared_ptr<Texture> errorTexture;
   VkSampler samplerNearest;
   VkSampler samplerLinear;
   std::shared_ptr<EffectTemplate> opaqueEffectTemplate;
+  std::shared_ptr<EffectTemplate> transparentEffectTemplate;
+  BindlessRegistry *bindlessRegistry;
 };
\ No newline at end of file
@@ -6,4 +6,5 @@ struct PointLight
 {
     glm::vec4 color;
     glm::vec4 position;
+    float range{25.f}; // Distance at which the light fades out completely
 };
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <glm/glm.hpp>
+
 struct SpotLight
 {
-
-};
\ No newline at end of file
+    glm::vec4 color;
+    glm::vec4 direction;
+    float range{25.f};
+    // Half angles in degrees, the light fades out between the inner and the outer cone
+    float innerConeAngle{20.f};
+    float outerConeAngle{30.f};
+};
@@ -9,7 +9,8 @@ struct StaticObject {
   glm::mat4 transform;
 };
 
-// Used to tag static objects that need an update
+// Used to tag static objects that were added or moved. A moved object only uploads its transforms,
+// a new or changed mesh reallocates its instance slots and rebuilds the batches
 struct DirtyStaticObject {
   
 };
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/VkTypes.h"
+#include "Vulkan/VulkanContext.h"
+
+// Storage of the keys RadixSort orders, 64-bit keys are two 32-bit words each, low word first
+enum class RadixKeyWidth : uint8_t {
+  Bits32,
+  Bits64,
+};
+
+// What RadixSort does with the value of every key
+enum class SortValues : uint8_t {
+  Keep,    // Read and moved along with their keys
+  Indices, // Never read, each ends up holding the position its key had before sorting
+};
+
+// Prefix sums, stream compaction and radix sort over device buffers of 32-bit unsigned values, passed by device
+// address. Calls only record dispatches and the barriers between their own steps, inputs must already be visible
+// to compute shaders and readers of the outputs wait for compute shader writes. Temporary data goes to a scratch
+// buffer owned by the caller, at least as large as the matching Get*ScratchSize
+class GpuPrimitives {
+public:
+  explicit GpuPrimitives(std::shared_ptr<VulkanContext> ctx);
+  ~GpuPrimitives();
+
+  GpuPrimitives(const GpuPrimitives &) = delete;
+  GpuPrimitives &operator=(const GpuPrimitives &) = delete;
+
+  [[nodiscard]] static VkDeviceSize GetScanScratchSize(uint32_t count);
+  [[nodiscard]] static VkDeviceSize GetCompactScratchSize(uint32_t count);
+  [[nodiscard]] static VkDeviceSize GetSortScratchSize(uint32_t count, RadixKeyWidth width);
+
+  // destination may be source
+  void ExclusiveScan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, VkDeviceAddress scratch) const;
+  void InclusiveScan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, VkDeviceAddress scratch) const;
+  // Copies the values with a non zero flag to destination, keeping their order, and writes how many there are to
+  // keptCount. Nothing is recorded without values, keptCount then stays as it is
+  void Compact(VkCommandBuffer cmd, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress destination, VkDeviceAddress keptCount, uint32_t count, VkDeviceAddress scratch) const;
+  // Stable sort of the keys and their values, in place. Only the low keyBits bits of the keys are compared, all of
+  // them when it is zero. Fewer bits mean fewer passes
+  void RadixSort(VkCommandBuffer cmd, VkDeviceAddress keys, VkDeviceAddress values, uint32_t count, RadixKeyWidth width, SortValues valueMode, VkDeviceAddress scratch, uint32_t keyBits = 0) const;
+
+private:
+  std::shared_ptr<VulkanContext> m_ctx;
+
+  ComputePipeline m_scanPipeline{};
+  ComputePipeline m_scanAddPipeline{};
+  ComputePipeline m_compactPipeline{};
+  ComputePipeline m_histogramPipeline{};
+  ComputePipeline m_scatterPipeline{};
+
+  void scan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, bool inclusive, bool countFlags, VkDeviceAddress scratch) const;
+};
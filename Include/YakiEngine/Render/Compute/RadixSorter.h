@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort of 64-bit keys carrying a 32-bit payload, one byte per pass. Bytes every key shares are
+// skipped, so keys packing a few small ids cost only the passes their varying bytes need. Each pass counts and
+// scatters in parallel chunks
+class RadixSorter {
+public:
+  static constexpr uint32_t RADIX = 256;
+  static constexpr uint32_t PASS_COUNT = 8;
+
+  // Sorts both vectors by keys, in place. They may come back holding other allocations of the same size
+  void Sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &payloads);
+
+private:
+  using Histogram = std::array<uint32_t, RADIX>;
+
+  // Double buffers the passes write into
+  std::vector<uint64_t> m_keys;
+  std::vector<uint32_t> m_payloads;
+  std::vector<size_t> m_chunks;
+  // Digit counts of every chunk for every pass, then the chunk's write offsets of the pass being scattered
+  std::vector<std::array<Histogram, PASS_COUNT>> m_chunkCounts;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+constexpr uint32_t INVALID_PRIMITIVE = std::numeric_limits<uint32_t>::max();
+
+struct Aabb {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  void Grow(const glm::vec3 &point);
+  void Grow(const Aabb &other);
+  [[nodiscard]] glm::vec3 Center() const;
+  [[nodiscard]] float HalfArea() const;
+  [[nodiscard]] bool Empty() const;
+
+  // Box of a local space box after an affine transform
+  static Aabb Transform(const glm::vec3 &center, const glm::vec3 &extents, const glm::mat4 &transform);
+};
+
+struct Ray {
+  glm::vec3 origin;
+  float tMax{std::numeric_limits<float>::max()};
+  glm::vec3 direction;
+};
+
+// Nearest primitive along a ray, primitive is INVALID_PRIMITIVE on a miss
+struct RayHit {
+  uint32_t primitive{INVALID_PRIMITIVE};
+  float t{std::numeric_limits<float>::max()};
+};
+
+// Exact distance along the ray to a primitive whose box it reaches, infinity on a miss. Called from the worker
+// threads, it may only read shared state
+using RayPrimitiveTest = std::function<float(uint32_t primitive, const Ray &ray, float tMax)>;
+
+struct BoundingSphere {
+  glm::vec3 center;
+  float radius;
+};
+
+// Leaves have a nonzero count and own the primitive order range [first, first + count),
+// inner nodes store their left child and the right child follows it
+struct BvhNode {
+  glm::vec3 min;
+  uint32_t leftOrFirst;
+  glm::vec3 max;
+  uint32_t count;
+};
+
+// Bounding volume hierarchy over primitive boxes, split with binned SAH. Large nodes bin their primitives in
+// parallel chunks and the subtrees below them are built in parallel. Queries only read the tree, every batch
+// call spreads its queries over the worker threads
+class Bvh {
+public:
+  void Build(std::span<const Aabb> primitives);
+  void Clear();
+
+  // hits must hold one entry per ray. Without a test a hit is the entry into a primitive's box, boxes around the
+  // ray origin are passed through. With one, every box the ray reaches is a candidate for the test
+  void IntersectRays(std::span<const Ray> rays, std::span<RayHit> hits, const RayPrimitiveTest &test = {}) const;
+  // results gets one list of overlapping primitives per query, in ascending order
+  void OverlapSpheres(std::span<const BoundingSphere> spheres, std::vector<std::vector<uint32_t>> &results) const;
+  void OverlapFrustums(std::span<const Frustum> frustums, std::vector<std::vector<uint32_t>> &results) const;
+
+  [[nodiscard]] uint32_t GetPrimitiveCount() const;
+  [[nodiscard]] uint32_t GetNodeCount() const;
+
+private:
+  std::vector<BvhNode> m_nodes;
+  // Primitive ids and boxes in leaf order, so a leaf reads one contiguous run
+  std::vector<uint32_t> m_primitiveIndices;
+  std::vector<Aabb> m_primitiveBounds;
+
+  template <typename Overlaps>
+  void overlap(const Overlaps &overlaps, std::vector<uint32_t> &result) const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/VkTypes.h"
+#include "Vulkan/VulkanContext.h"
+
+// Hierarchical depth buffer, each texel of a mip holds the farthest depth of the texels it covers
+class DepthPyramid {
+public:
+  DepthPyramid(std::shared_ptr<VulkanContext> ctx, VkExtent2D depthExtent);
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid &) = delete;
+  DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+  void Resize(VkExtent2D depthExtent);
+  // The depth image changes with the render graph's transients, the view is kept across resizes
+  void SetDepthView(VkImageView depthView);
+
+  // Expects the depth image in VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL
+  void Build(VkCommandBuffer cmd);
+
+  [[nodiscard]] VkImageView GetView() const;
+  [[nodiscard]] VkSampler GetSampler() const;
+  [[nodiscard]] VkExtent2D GetExtent() const;
+
+private:
+  std::shared_ptr<VulkanContext> m_ctx;
+  VkExtent2D m_depthExtent{};
+  VkImageView m_depthView{};
+
+  VkImage m_image{};
+  VmaAllocation m_allocation{};
+  VkImageView m_view{};
+  std::vector<VkImageView> m_mipViews;
+  VkExtent2D m_extent{};
+  uint32_t m_mipLevels{0};
+
+  VkSampler m_reductionSampler{};
+  VkDescriptorSetLayout m_descriptorLayout{};
+  DescriptorAllocator m_descriptorAllocator{};
+  std::vector<VkDescriptorSet> m_descriptorSets;
+  ComputePipeline m_reducePipeline{};
+
+  void createPipeline();
+  void createImage();
+  void destroyImage();
+  void writeDepthDescriptor();
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+
+struct Frustum {
+  // Inward facing planes (xyz = normal, w = distance): left, right, bottom, top, near, far
+  std::array<glm::vec4, 6> planes;
+
+  // Gribb-Hartmann extraction, expects a projection with depth in [0, 1]
+  static Frustum FromMatrix(const glm::mat4 &viewProj) {
+    const glm::mat4 rows = glm::transpose(viewProj);
+
+    Frustum frustum{
+        .planes{
+            rows[3] + rows[0],
+            rows[3] - rows[0],
+            rows[3] + rows[1],
+            rows[3] - rows[1],
+            rows[2],
+            rows[3] - rows[2],
+        }
+    };
+
+    for (auto &plane : frustum.planes)
+      plane /= glm::length(glm::vec3(plane));
+
+    return frustum;
+  }
+
+  [[nodiscard]] bool IntersectsSphere(const glm::vec3 &center, float radius) const {
+    for (const auto &plane : planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+        return false;
+    }
+    return true;
+  }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+
+// Nearest object along a ray, objectId is 0 on a miss
+struct SpatialRayHit {
+  uint32_t objectId{0};
+  float t{std::numeric_limits<float>::max()};
+};
+
+// Exact distance along the ray to an object, infinity on a miss
+using SpatialRayTest = std::function<float(uint32_t objectId, const Ray &ray, float tMax)>;
+
+// World space object boxes of the scene behind one tree for static and one for dynamic objects. Kept as a
+// singleton component, so picking, AI and gameplay systems query it without touching the GPU. The render
+// system rebuilds the static tree when static objects change and the dynamic tree every frame
+class SpatialIndex {
+public:
+  void SetStaticObjects(std::span<const Aabb> bounds, std::span<const uint32_t> objectIds);
+  void SetDynamicObjects(std::span<const Aabb> bounds, std::span<const uint32_t> objectIds);
+
+  // hits must hold one entry per ray. The optional test refines the object boxes the ray reaches, see Bvh
+  void CastRays(std::span<const Ray> rays, std::span<SpatialRayHit> hits, const SpatialRayTest &test = {}) const;
+  // results gets one list of object ids per query, static objects first
+  void OverlapSpheres(std::span<const BoundingSphere> spheres, std::vector<std::vector<uint32_t>> &results) const;
+  void OverlapFrustums(std::span<const Frustum> frustums, std::vector<std::vector<uint32_t>> &results) const;
+
+  // Ray through the center of a viewport pixel, from the near plane. Expects a projection with depth in [0, 1]
+  static Ray ScreenRay(glm::vec2 pixel, glm::vec2 viewportSize, const glm::mat4 &viewProj);
+
+private:
+  Bvh m_staticBvh;
+  std::vector<uint32_t> m_staticObjectIds;
+  Bvh m_dynamicBvh;
+  std::vector<uint32_t> m_dynamicObjectIds;
+
+  void mergeResults(std::vector<std::vector<uint32_t>> &results, const std::vector<std::vector<uint32_t>> &dynamicResults) const;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+// World space bounding spheres stored per component, so consecutive spheres load straight into SIMD lanes
+struct SphereBoundsSoA {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+
+  void Clear();
+  void Resize(size_t count);
+  void Set(size_t idx, const glm::vec3 &center, float sphereRadius);
+  [[nodiscard]] size_t Size() const;
+};
+
+// Frustum culls sphere bounds in parallel chunks, 8 spheres per iteration when built with AVX2
+class SphereCuller {
+public:
+  // Fills visible with the indices of the spheres intersecting the frustum, in ascending order
+  void Cull(const Frustum &frustum, const SphereBoundsSoA &bounds, std::vector<uint32_t> &visible);
+
+private:
+  std::vector<size_t> m_chunks;
+  std::vector<std::vector<uint32_t>> m_chunkResults;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "Components/Camera.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/Descriptors/DescriptorAllocator.h"
+#include "Vulkan/RenderGraph.h"
+#include "Vulkan/VkTypes.h"
+#include "Vulkan/VulkanContext.h"
+
+constexpr uint32_t SHADOW_MAP_RESOLUTION = 2048;
+constexpr VkFormat SHADOW_MAP_FORMAT = VK_FORMAT_D32_SFLOAT;
+// Layouts the sampled maps and the static cache are kept in between frames, the render graph hands them back in these
+constexpr VkImageLayout SHADOW_MAP_LAYOUT = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+constexpr VkImageLayout SHADOW_CACHE_LAYOUT = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+struct ShadowCascade {
+  glm::mat4 viewProj;
+  float splitDepth; // Far view depth covered by the cascade
+  float texelSize;  // World size of a shadow map texel
+};
+
+// Depth maps of the shadowing directional light, one array layer per cascade. Static casters are rendered into a
+// cached copy that is only redrawn when its cascade moves or static geometry changes. Every frame with dynamic
+// casters starts from that copy, so their cost never includes the static scene.
+// Both images are imported into the render graph, which derives every barrier from the uses of the passes
+class CascadedShadowMap {
+public:
+  // The depth pass binds the frame set for the instance transforms, followed by its own caster set
+  CascadedShadowMap(std::shared_ptr<VulkanContext> ctx, VkDescriptorSetLayout frameSetLayout, uint32_t frameCount);
+  ~CascadedShadowMap();
+
+  CascadedShadowMap(const CascadedShadowMap &) = delete;
+  CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+  // Fits the cascades to the camera. They move in coarse steps, so the static cache survives small camera motion
+  void Update(const Camera &camera, const glm::vec3 &lightDirection);
+  // Static geometry changed, every cascade redraws its static casters
+  void InvalidateStatic();
+  [[nodiscard]] bool NeedsStaticRender(uint32_t cascade) const;
+  // The sampled layer is copied from the cache again when the cache was redrawn, dynamic casters go on top of it
+  // or the last ones drawn there have to go
+  [[nodiscard]] bool NeedsCompose(uint32_t cascade, bool renderStatic, bool dynamicCasters) const;
+  [[nodiscard]] const ShadowCascade &GetCascade(uint32_t cascade) const;
+
+  // Must only run once the frame's previous submission completed. Writes the caster instances of every cascade of
+  // this frame and returns the offset of every list in the caster buffer
+  std::vector<uint32_t> UploadCasters(uint32_t frame, std::span<const std::span<const uint32_t>> casterLists);
+  void SetPositionBuffer(uint32_t frame, VkBuffer positionBuffer, VkDeviceSize size);
+
+  // Until the maps were cleared once their contents and layouts are undefined, they start out fully lit
+  [[nodiscard]] bool IsCleared() const;
+  // Expects the sampled maps as transfer destination
+  void Clear(VkCommandBuffer cmd);
+  // draw records the depth draws with the shadow pipeline bound, its push constants hold the cascade matrix.
+  // Expects the cache as depth attachment
+  void RenderStatic(VkCommandBuffer cmd, uint32_t cascade, const std::function<void(VkCommandBuffer)> &draw);
+  // Expects the cache as transfer source and the sampled maps as transfer destination
+  void Compose(VkCommandBuffer cmd, uint32_t cascade, bool dynamicCasters);
+  // Expects the sampled maps as depth attachment, after the cascade was composed
+  void RenderDynamic(VkCommandBuffer cmd, uint32_t cascade, const std::function<void(VkCommandBuffer)> &draw);
+
+  [[nodiscard]] VkPipelineLayout GetPipelineLayout() const;
+  [[nodiscard]] VkDescriptorSet GetCasterSet(uint32_t frame) const;
+  [[nodiscard]] VkImage GetImage() const;
+  [[nodiscard]] VkImageView GetView() const;
+  [[nodiscard]] VkImage GetStaticImage() const;
+  // What earlier frames left the maps and the cache in, for importing them into the frame's graph
+  [[nodiscard]] ImportedImageState GetImportState() const;
+  [[nodiscard]] ImportedImageState GetStaticImportState() const;
+  [[nodiscard]] VkSampler GetSampler() const;
+
+private:
+  struct CascadeState {
+    ShadowCascade cascade{};
+    glm::mat4 cachedViewProj{0.0f};
+    uint32_t cachedStaticVersion{UINT32_MAX};
+    // The sampled layer holds dynamic casters on top of the static cache
+    bool hasDynamicCasters{false};
+  };
+
+  struct FrameResources {
+    std::unique_ptr<Buffer> casterBuffer;
+    uint32_t casterCapacity{0};
+    VkBuffer positionBuffer{};
+    VkDeviceSize positionSize{0};
+    VkDescriptorSet descriptorSet{};
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  std::array<CascadeState, SHADOW_CASCADE_COUNT> m_cascades{};
+  std::vector<FrameResources> m_frames;
+  uint32_t m_staticVersion{0};
+  bool m_cleared{false};
+
+  // Sampled maps and the cached static depth
+  VkImage m_shadowImage{};
+  VmaAllocation m_shadowAllocation{};
+  VkImage m_staticImage{};
+  VmaAllocation m_staticAllocation{};
+  VkImageView m_view{};
+  std::array<VkImageView, SHADOW_CASCADE_COUNT> m_shadowLayerViews{};
+  std::array<VkImageView, SHADOW_CASCADE_COUNT> m_staticLayerViews{};
+  VkSampler m_sampler{};
+
+  VkDescriptorSetLayout m_descriptorLayout{};
+  DescriptorAllocator m_descriptorAllocator{};
+  VkPipelineLayout m_pipelineLayout{};
+  VkPipeline m_pipeline{};
+
+  void createPipeline(VkDescriptorSetLayout frameSetLayout);
+  void createImages();
+  void createCasterBuffer(FrameResources &frame, uint32_t capacity);
+  void updateDescriptors(FrameResources &frame) const;
+  void renderLayer(VkCommandBuffer cmd, VkImageView view, uint32_t cascade, bool clear, const std::function<void(VkCommandBuffer)> &draw);
+};
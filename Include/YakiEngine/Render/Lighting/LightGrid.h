@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Components/Camera.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/VkTypes.h"
+#include "Vulkan/VulkanContext.h"
+
+// Froxel grid over the view frustum, tiles split the screen and depth is sliced exponentially
+constexpr uint32_t CLUSTER_GRID_X = 16;
+constexpr uint32_t CLUSTER_GRID_Y = 9;
+constexpr uint32_t CLUSTER_GRID_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+
+// Bins the local lights of a frame into the clusters they touch. Every cluster gets a range in one compact
+// index list, so shading only loops over the lights of the fragment's cluster
+class LightGrid {
+public:
+  LightGrid(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount);
+  ~LightGrid();
+
+  LightGrid(const LightGrid &) = delete;
+  LightGrid &operator=(const LightGrid &) = delete;
+
+  // Must only run once the frame's previous submission completed. Returns true when the light buffer was
+  // reallocated to fit and descriptors pointing at it must be written again
+  bool Upload(uint32_t frame, std::span<const GPULocalLight> lights);
+  // Rebuilds the frame's grid once per frame. Records no barrier after the dispatch, shading passes declare a
+  // render graph dependency on the pass recording it, which may run on the compute queue
+  void Build(VkCommandBuffer cmd, uint32_t frame, const Camera &camera);
+
+  [[nodiscard]] VkBuffer GetLightBuffer(uint32_t frame) const;
+  [[nodiscard]] VkDeviceSize GetLightBufferSize(uint32_t frame) const;
+  [[nodiscard]] VkBuffer GetGridBuffer(uint32_t frame) const;
+  [[nodiscard]] VkDeviceSize GetGridBufferSize() const;
+  [[nodiscard]] VkBuffer GetIndexBuffer(uint32_t frame) const;
+  [[nodiscard]] VkDeviceSize GetIndexBufferSize() const;
+
+private:
+  struct FrameResources {
+    std::unique_ptr<Buffer> lightBuffer;
+    std::unique_ptr<Buffer> gridBuffer;
+    std::unique_ptr<Buffer> indexBuffer;
+    uint32_t lightCapacity{0};
+    uint32_t lightCount{0};
+    VkDescriptorSet descriptorSet{};
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  std::vector<FrameResources> m_frames;
+
+  VkDescriptorSetLayout m_descriptorLayout{};
+  DescriptorAllocator m_descriptorAllocator{};
+  ComputePipeline m_buildPipeline{};
+
+  void createPipeline();
+  void createLightBuffer(FrameResources &frame, uint32_t capacity);
+  void updateDescriptors(FrameResources &frame) const;
+};
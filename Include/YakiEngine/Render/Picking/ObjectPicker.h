@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/Descriptors/DescriptorAllocator.h"
+#include "Vulkan/VulkanContext.h"
+
+// Queries served by one frame, later requests wait for the following frames
+constexpr uint32_t MAX_PICKS_PER_FRAME = 4;
+// Every query renders into a tile of this many pixels centred on its pixel, which bounds the search radius
+constexpr uint32_t PICK_TILE_SIZE = 16;
+constexpr uint32_t MAX_PICK_RADIUS = PICK_TILE_SIZE / 2 - 1;
+// One tile per request of a frame, side by side
+constexpr VkExtent2D PICK_TILES_EXTENT{PICK_TILE_SIZE * MAX_PICKS_PER_FRAME, PICK_TILE_SIZE};
+constexpr VkFormat PICK_ID_FORMAT = VK_FORMAT_R32_UINT;
+constexpr VkFormat PICK_DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+struct PickRequest {
+  uint32_t id;
+  glm::ivec2 pixel;
+  uint32_t radius;
+  glm::mat4 viewProj; // Scene view projection narrowed to the query's tile
+};
+
+struct PickResult {
+  uint32_t requestId;
+  uint32_t objectId; // 0 when nothing was found
+};
+
+// Object id queries rendered on demand. Each query draws only the candidates under its pixel into a small tile,
+// scissored to its search radius. The ids are copied into a readback buffer of the recording frame, which is
+// read once that frame's fence signals again, so results arrive frames later without a stall. The tiles are
+// render graph images, the picker only renders into them and copies out of them
+class ObjectPicker {
+public:
+  // Candidates are drawn with the frame set for transforms and object ids, followed by the picker's own set
+  ObjectPicker(std::shared_ptr<VulkanContext> ctx, VkDescriptorSetLayout frameSetLayout, uint32_t frameCount);
+  ~ObjectPicker();
+
+  ObjectPicker(const ObjectPicker &) = delete;
+  ObjectPicker &operator=(const ObjectPicker &) = delete;
+
+  // pixel is in viewport pixels. A radius above 0 falls back to the nearest object within it
+  uint32_t Request(glm::ivec2 pixel, uint32_t radius);
+  // Must only run once the frame's previous submission completed. Reads the queries the frame recorded last time
+  // and takes the next queued ones, their matrices map the viewport of the given size to their tiles
+  void BeginFrame(uint32_t frame, const glm::mat4 &viewProj, VkExtent2D viewportExtent);
+  [[nodiscard]] std::span<const PickRequest> GetFrameRequests(uint32_t frame) const;
+  // Returns the results completed since the last call, in request order
+  std::vector<PickResult> TakeResults();
+
+  // Same contract as the shadow casters, see CascadedShadowMap::UploadCasters
+  std::vector<uint32_t> UploadCandidates(uint32_t frame, std::span<const std::span<const uint32_t>> candidateLists);
+  void SetPositionBuffer(uint32_t frame, VkBuffer positionBuffer, VkDeviceSize size);
+  // Expects the id tiles as color attachment and the depth tiles as depth attachment. draw records the candidate
+  // draws of one request with the picking pipeline bound, its push constants hold the request's matrix
+  void Render(VkCommandBuffer cmd, uint32_t frame, VkImageView idView, VkImageView depthView, const std::function<void(VkCommandBuffer, uint32_t request)> &draw);
+  // Expects the rendered id tiles as transfer source, copies every request's search square to the readback buffer
+  void CopyResults(VkCommandBuffer cmd, uint32_t frame, VkImage idImage);
+
+  [[nodiscard]] VkPipelineLayout GetPipelineLayout() const;
+  [[nodiscard]] VkDescriptorSet GetCandidateSet(uint32_t frame) const;
+
+private:
+  struct FrameResources {
+    std::vector<PickRequest> requests;
+    std::unique_ptr<Buffer> readbackBuffer;
+    std::unique_ptr<Buffer> candidateBuffer;
+    uint32_t candidateCapacity{0};
+    VkBuffer positionBuffer{};
+    VkDeviceSize positionSize{0};
+    VkDescriptorSet descriptorSet{};
+    bool recorded{false};
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  std::vector<FrameResources> m_frames;
+  std::deque<PickRequest> m_pendingRequests;
+  std::vector<PickResult> m_results;
+  uint32_t m_nextRequestId{1};
+
+  VkDescriptorSetLayout m_descriptorLayout{};
+  DescriptorAllocator m_descriptorAllocator{};
+  VkPipelineLayout m_pipelineLayout{};
+  VkPipeline m_pipeline{};
+
+  void createPipeline(VkDescriptorSetLayout frameSetLayout);
+  void createCandidateBuffer(FrameResources &frame, uint32_t capacity);
+  void updateDescriptors(FrameResources &frame) const;
+  void readResults(FrameResources &frame);
+};
@@ -2,11 +2,17 @@
 
 #include <bitset>
 #include <HECS/Core/System.h>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 #include <glm/glm.hpp>
 
 #include "Ecs.h"
+#include "Components/Camera.h"
 #include "Components/StaticObject.h"
+#include "Compute/RadixSorter.h"
+#include "Culling/SpatialIndex.h"
+#include "Culling/SphereCuller.h"
 #include "Vulkan/Renderer.h"
 #include "Vulkan/VkTypes.h"
 
@@ -15,6 +21,94 @@ enum class ShowImGui : std::uint8_t {
   DirectionalLights
 };
 
+enum class CullingMode : std::uint8_t {
+  Gpu,
+  Cpu
+};
+
+// What an instance's batch draws. Batches are ordered by the instances' 64-bit draw keys, built from stable ids
+// instead of these pointers, so the order is the same on every run
+struct BatchKey {
+  bool transparent;
+  VkPipeline pipeline;
+  Material *material;
+  Mesh *mesh;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+
+  bool operator==(const BatchKey &) const = default;
+};
+
+// Draw key ids of pipelines or meshes, handed out in the order keys first show up. Once the field runs out, ids no
+// static instance holds and nothing drew this frame are reclaimed. Keys beyond that share the last id, batches
+// still split where their BatchKey differs, only their order suffers
+template <typename Key>
+class DrawKeyIds {
+public:
+  explicit DrawKeyIds(uint32_t bits)
+      : m_limit(1u << bits) {
+  }
+
+  uint32_t Get(Key key, uint64_t frame) {
+    auto [entry, inserted] = m_entries.try_emplace(key);
+    entry->second.lastFrame = frame;
+    if (inserted)
+      assign(entry->second, frame);
+    return entry->second.id;
+  }
+
+  // Static instances keep their keys across frames, their ids stay while any of them holds one
+  void Retain(Key key) {
+    m_entries.at(key).staticUses++;
+  }
+
+  void Release(Key key) {
+    m_entries.at(key).staticUses--;
+  }
+
+private:
+  struct Entry {
+    uint32_t id{0};
+    uint32_t staticUses{0};
+    uint64_t lastFrame{0};
+    bool shared{false};
+  };
+
+  uint32_t m_limit;
+  uint32_t m_nextId{0};
+  std::unordered_map<Key, Entry> m_entries;
+  std::vector<uint32_t> m_freeIds;
+
+  void assign(Entry &entry, uint64_t frame) {
+    if (m_nextId < m_limit) {
+      entry.id = m_nextId++;
+      return;
+    }
+    if (m_freeIds.empty()) {
+      std::erase_if(m_entries, [&](const auto &other) {
+        if (other.second.staticUses != 0 || other.second.lastFrame == frame)
+          return false;
+        if (!other.second.shared)
+          m_freeIds.push_back(other.second.id);
+        return true;
+      });
+    }
+    if (m_freeIds.empty()) {
+      entry.id = m_limit - 1;
+      entry.shared = true;
+      return;
+    }
+    entry.id = m_freeIds.back();
+    m_freeIds.pop_back();
+  }
+};
+
+// Instance table slots of a registered static object, one per mesh surface
+struct StaticInstances {
+  std::shared_ptr<Mesh> mesh;
+  std::vector<uint32_t> slots;
+};
+
 class RenderSystem : public Hori::System {
 public:
   explicit RenderSystem(Renderer *renderer);
@@ -26,10 +120,73 @@ private:
 
   std::bitset<8> m_showElements;
   std::vector<IndirectBatch> m_indirectBatches;
+  std::unordered_map<uint32_t, StaticInstances> m_staticInstances;
+  // Entities still holding a StaticObject, gathered when the map outgrows them
+  std::vector<uint32_t> m_liveStaticIds;
+  // Free slots have no material
+  std::vector<BatchKey> m_slotKeys;
+  std::vector<uint64_t> m_slotDrawKeys;
 
-  void renderStaticObjects(const glm::mat4 &viewProj);
-  void renderGui(float dt);
+  DrawKeyIds<VkPipeline> m_pipelineIds;
+  // Keyed on the mesh id, a mesh allocated where a freed one lived gets an id of its own
+  DrawKeyIds<uint32_t> m_meshIds;
+  // Tells the dynamic objects' draw key ids in use from the stale ones
+  uint64_t m_frameIndex{0};
+  RadixSorter m_radixSorter;
+  std::vector<uint64_t> m_sortKeys;
+  std::vector<uint32_t> m_sortPayloads;
+
+  // Rebuilt every frame from all dynamic objects, the renderer streams them into its ring buffer
+  std::vector<BatchKey> m_dynamicKeys;
+  std::vector<glm::mat4> m_dynamicTransforms;
+  std::vector<uint32_t> m_dynamicObjectIds;
+  std::vector<IndirectBatch> m_dynamicBatches;
+  // World spheres and batch ids of the dynamic instances in submission order, the shadow cascades cull them
+  std::vector<std::pair<glm::vec3, float>> m_dynamicSpheres;
+  SphereBoundsSoA m_dynamicBounds;
+  std::vector<uint32_t> m_dynamicBatchIds;
+  // Batch id and depth bucket of every instance, the GPU orders the instances by them
+  std::vector<uint32_t> m_dynamicSortKeys;
 
-  static RenderIndirectObjects sortObjects(RenderIndirectObjects &objects);
-  static std::vector<IndirectBatch> packObjects(RenderIndirectObjects &objects);
+  CullingMode m_cullingMode{CullingMode::Gpu};
+  RenderPath m_renderPath{RenderPath::Forward};
+  SphereCuller m_sphereCuller;
+  SphereBoundsSoA m_staticBounds;
+  std::vector<uint32_t> m_visibleSlots;
+  std::vector<uint32_t> m_visibleInstances;
+  std::vector<IndirectBatch> m_visibleBatches;
+  std::vector<uint32_t> m_casterIndices;
+  std::vector<CulledInstances> m_staticShadowCasters;
+  std::vector<CulledInstances> m_dynamicShadowCasters;
+  std::vector<CulledInstances> m_staticPickCandidates;
+  std::vector<CulledInstances> m_dynamicPickCandidates;
+  // Hover query in flight, a new one is only sent once it resolved and the mouse moved
+  std::optional<uint32_t> m_pendingHoverPick;
+  glm::ivec2 m_lastHoverPixel{-1};
+  // Per object world boxes fed to the SpatialIndex singleton, the static ones only when a static object changed
+  bool m_staticSpatialDirty{false};
+  std::vector<Aabb> m_objectBounds;
+  std::vector<uint32_t> m_objectIds;
+  std::vector<Aabb> m_dynamicObjectBounds;
+  std::vector<uint32_t> m_dynamicObjectEntityIds;
+  bool m_selectButtonWasPressed{false};
+
+  void updateStaticObjects();
+  // Both return whether the batches have to be rebuilt
+  bool updateDirtyStaticObjects();
+  bool releaseRemovedStaticObjects();
+  void addStaticInstance(uint32_t slot, Mesh *mesh, uint32_t surfaceIndex, const glm::mat4 &transform, uint32_t objectId);
+  void releaseStaticInstances(StaticInstances &instances);
+  void rebuildStaticBatches();
+  void updateDynamicObjects(const Camera &camera);
+  // Every field of the draw key but the depth bucket
+  uint64_t batchDrawKey(const BatchKey &key, uint32_t surfaceIndex);
+  void updateSpatialIndex();
+  void selectClickedObject(const Camera &camera);
+  void cullStaticObjects(const Camera &camera);
+  void renderShadows();
+  void requestHoverPick();
+  void renderPicks();
+  void applyPickResults();
+  void renderGui(float dt);
 };
\ No newline at end of file
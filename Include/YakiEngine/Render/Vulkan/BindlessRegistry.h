@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+#include "VkTypes.h"
+#include "VulkanContext.h"
+
+constexpr uint32_t MAX_BINDLESS_MATERIALS = 4096;
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+constexpr uint32_t MAX_BINDLESS_SAMPLERS = 64;
+
+constexpr uint32_t BINDLESS_MATERIALS_BINDING = 0;
+constexpr uint32_t BINDLESS_TEXTURES_BINDING = 1;
+constexpr uint32_t BINDLESS_SAMPLERS_BINDING = 2;
+
+// Single descriptor set holding every material, texture and sampler, shaders select them by index.
+// Texture and sampler arrays are partially bound, so only the registered slots need to be valid
+class BindlessRegistry {
+public:
+  explicit BindlessRegistry(std::shared_ptr<VulkanContext> ctx);
+  ~BindlessRegistry();
+
+  BindlessRegistry(const BindlessRegistry &) = delete;
+  BindlessRegistry &operator=(const BindlessRegistry &) = delete;
+
+  // Registering the same view or sampler twice returns the slot it already has
+  uint32_t AddTexture(VkImageView view);
+  uint32_t AddSampler(VkSampler sampler);
+  uint32_t AddMaterial(const GPUMaterialData &material);
+
+  [[nodiscard]] VkDescriptorSetLayout GetLayout() const;
+  [[nodiscard]] VkDescriptorSet GetSet() const;
+
+private:
+  std::shared_ptr<VulkanContext> m_ctx;
+
+  VkDescriptorPool m_pool{};
+  VkDescriptorSetLayout m_layout{};
+  VkDescriptorSet m_set{};
+  std::unique_ptr<Buffer> m_materialBuffer;
+
+  std::unordered_map<VkImageView, uint32_t> m_textureSlots;
+  std::unordered_map<VkSampler, uint32_t> m_samplerSlots;
+  uint32_t m_materialCount{0};
+};
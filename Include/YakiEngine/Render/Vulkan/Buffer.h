@@ -2,10 +2,12 @@
 
 #include "VkCheck.h"
 
+#include <span>
 #include <vk_mem_alloc.h>
 
 struct Buffer {
-  Buffer(VmaAllocator allocator, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+  // Buffers used by more than one queue family list them all and are shared concurrently
+  Buffer(VmaAllocator allocator, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, std::span<const uint32_t> queueFamilies = {})
     : allocator(allocator) {
     VkBufferCreateInfo bufferInfo{
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -13,6 +15,11 @@ struct Buffer {
         .size = allocSize,
         .usage = usage
     };
+    if (queueFamilies.size() > 1) {
+      bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+      bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+      bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
 
     VmaAllocationCreateInfo vmaAllocInfo{
         .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
@@ -20,13 +27,18 @@ struct Buffer {
     };
 
     VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer, &allocation, &info));
+
+    VkMemoryPropertyFlags memoryFlags;
+    vmaGetAllocationMemoryProperties(allocator, allocation, &memoryFlags);
+    hostCoherent = (memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
   }
 
   Buffer(Buffer &&other) noexcept
     : buffer(other.buffer)
       , allocator(other.allocator)
       , allocation(other.allocation)
-      , info(other.info) {
+      , info(other.info)
+      , hostCoherent(other.hostCoherent) {
     other.buffer = VK_NULL_HANDLE;
     other.allocation = nullptr;
     other.allocator = nullptr;
@@ -42,6 +54,7 @@ struct Buffer {
       allocator = other.allocator;
       allocation = other.allocation;
       info = other.info;
+      hostCoherent = other.hostCoherent;
 
       other.buffer = VK_NULL_HANDLE;
       other.allocation = nullptr;
@@ -63,12 +76,28 @@ struct Buffer {
     Cleanup();
   }
 
+  // Host visible buffers stay mapped for their whole lifetime, so writes are a plain copy
   void MapMemoryFromBytes(const void *src, size_t sizeBytes, size_t dstOffset = 0) {
-    void *dst = nullptr;
-    vmaMapMemory(allocator, allocation, &dst);
-    std::memcpy(static_cast<char *>(dst) + dstOffset, src, sizeBytes);
-    vmaFlushAllocation(allocator, allocation, dstOffset, sizeBytes);
-    vmaUnmapMemory(allocator, allocation);
+    if (info.pMappedData != nullptr) {
+      std::memcpy(static_cast<char *>(info.pMappedData) + dstOffset, src, sizeBytes);
+    } else {
+      void *dst = nullptr;
+      vmaMapMemory(allocator, allocation, &dst);
+      std::memcpy(static_cast<char *>(dst) + dstOffset, src, sizeBytes);
+      vmaUnmapMemory(allocator, allocation);
+    }
+    Flush(dstOffset, sizeBytes);
+  }
+
+  // Only non coherent memory needs host writes flushed and device writes invalidated
+  void Flush(size_t offset, size_t sizeBytes) {
+    if (!hostCoherent)
+      vmaFlushAllocation(allocator, allocation, offset, sizeBytes);
+  }
+
+  void Invalidate(size_t offset, size_t sizeBytes) {
+    if (!hostCoherent)
+      vmaInvalidateAllocation(allocator, allocation, offset, sizeBytes);
   }
 
   template <typename T>
@@ -85,6 +114,12 @@ struct Buffer {
 
   template <typename T>
   void MapMemoryToScalar(T &value) {
+    Invalidate(0, sizeof(T));
+    if (info.pMappedData != nullptr) {
+      std::memcpy(&value, info.pMappedData, sizeof(T));
+      return;
+    }
+
     T *data;
     vmaMapMemory(allocator, allocation, reinterpret_cast<void **>(&data));
     value = *data;
@@ -95,4 +130,5 @@ struct Buffer {
   VmaAllocator allocator;
   VmaAllocation allocation;
   VmaAllocationInfo info{};
+  bool hostCoherent{false};
 };
\ No newline at end of file
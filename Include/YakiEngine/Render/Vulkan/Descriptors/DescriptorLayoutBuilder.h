@@ -10,6 +10,6 @@ public:
 
     DescriptorLayoutBuilder();
     VkDescriptorSetLayout Build(VkDevice device, VkShaderStageFlags shaderStages, void* pNext = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
-    void AddBinding(uint32_t binding, VkDescriptorType type);
+    void AddBinding(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
     void Clear();
 };
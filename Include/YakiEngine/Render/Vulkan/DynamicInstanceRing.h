@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+#include "DeletionQueue.h"
+#include "VkTypes.h"
+#include "VulkanContext.h"
+
+// Offsets of the per-frame arrays, relative to the start of a frame's section
+struct DynamicSectionLayout {
+  VkDeviceSize transforms;
+  VkDeviceSize objectIds;
+  VkDeviceSize instanceIndices;
+  VkDeviceSize drawIndices;
+  VkDeviceSize sortKeys;
+  VkDeviceSize drawData;
+  VkDeviceSize drawCommands;
+  VkDeviceSize size;
+};
+
+// Persistently mapped buffer split into one section per frame in flight. Every frame rewrites its own
+// section with the transforms and draws of all dynamic objects, the other sections are still read by the GPU
+class DynamicInstanceRing {
+public:
+  DynamicInstanceRing(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount);
+
+  DynamicInstanceRing(const DynamicInstanceRing &) = delete;
+  DynamicInstanceRing &operator=(const DynamicInstanceRing &) = delete;
+
+  // Reallocates every section when the data does not fit, the replaced buffer goes to deletionQueue.
+  // Returns true when that happened and the sections must be bound again
+  bool Reserve(uint32_t instanceCount, uint32_t drawCount, DeletionQueue &deletionQueue);
+  // drawIndices maps every instance to its draw, the visibility resolve reads it to find a pixel's draw. The instance
+  // indices are not written here, the GPU sorts the instances by sortKeys into them
+  void Write(uint32_t frame, std::span<const glm::mat4> transforms, std::span<const uint32_t> objectIds, std::span<const uint32_t> drawIndices, std::span<const uint32_t> sortKeys, std::span<const GPUDrawData> drawData, std::span<const VkDrawIndexedIndirectCommand> drawCommands);
+
+  [[nodiscard]] VkBuffer GetBuffer() const;
+  [[nodiscard]] VkDeviceAddress GetDeviceAddress() const;
+  [[nodiscard]] VkDeviceSize GetSectionOffset(uint32_t frame) const;
+  [[nodiscard]] const DynamicSectionLayout &GetLayout() const;
+  [[nodiscard]] uint32_t GetInstanceCapacity() const;
+  [[nodiscard]] uint32_t GetDrawCapacity() const;
+
+private:
+  std::shared_ptr<VulkanContext> m_ctx;
+  uint32_t m_frameCount;
+
+  std::unique_ptr<Buffer> m_buffer;
+  DynamicSectionLayout m_layout{};
+  uint32_t m_instanceCapacity{0};
+  uint32_t m_drawCapacity{0};
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+struct DynamicResolutionSettings {
+  bool enabled{true};
+  double targetMilliseconds{1000.0 / 60.0};
+  float minScale{0.5f};
+  float maxScale{1.0f};
+};
+
+// Picks the fraction of the draw image the 3D passes render to, so the GPU frame time stays under the target.
+// The cost of a frame is taken as proportional to its pixel count. Timings arrive latencyFrames after the frame
+// was recorded, a change waits that long before it is judged, drops react faster than recoveries
+class DynamicResolution {
+public:
+  explicit DynamicResolution(uint32_t latencyFrames);
+
+  // Takes the GPU time of the newest completed frame, zero when none was measured. Returns the scale to use next
+  float Update(double gpuMilliseconds);
+  // Region of a target of the given size the scene is rendered into, never empty
+  [[nodiscard]] VkExtent2D ScaleExtent(VkExtent2D extent) const;
+
+  void SetSettings(const DynamicResolutionSettings &settings);
+  [[nodiscard]] const DynamicResolutionSettings &GetSettings() const;
+  [[nodiscard]] float GetScale() const;
+  [[nodiscard]] double GetFilteredMilliseconds() const;
+
+private:
+  DynamicResolutionSettings m_settings;
+  uint32_t m_latencyFrames;
+  float m_scale{1.0f};
+  double m_filteredMilliseconds{0.0};
+  uint32_t m_cooldown{0};
+
+  void setScale(float scale);
+};
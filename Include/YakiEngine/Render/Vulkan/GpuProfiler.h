@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "VulkanContext.h"
+
+constexpr uint32_t MAX_GPU_SCOPES = 32;
+constexpr uint32_t INVALID_GPU_SCOPE = std::numeric_limits<uint32_t>::max();
+
+struct GpuScopeTiming {
+  std::string_view name;
+  uint32_t depth; // Number of scopes the scope is nested in
+  double milliseconds;
+};
+
+// Timestamp pairs around named scopes of a frame, one query pool per frame in flight. A frame's timings are read
+// when its slot comes around again, its fence has signaled by then, so reading never stalls
+class GpuProfiler {
+public:
+  GpuProfiler(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount);
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  // Collects the timings of the frame's previous submission and resets its queries. Must run at the start of the
+  // frame's command buffer, after its fence signaled
+  void BeginFrame(VkCommandBuffer cmd, uint32_t frame);
+  // Scope names must outlive the profiler. Returns INVALID_GPU_SCOPE once the frame ran out of queries,
+  // EndScope ignores it
+  uint32_t BeginScope(VkCommandBuffer cmd, std::string_view name);
+  void EndScope(VkCommandBuffer cmd, uint32_t scope);
+
+  // Scopes of the most recent completed frame, in the order they were opened
+  [[nodiscard]] std::span<const GpuScopeTiming> GetTimings() const;
+  [[nodiscard]] bool IsSupported() const;
+
+private:
+  struct FrameResources {
+    VkQueryPool queryPool{VK_NULL_HANDLE};
+    std::vector<std::string_view> names;
+    std::vector<uint32_t> depths;
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  std::vector<FrameResources> m_frames;
+  uint32_t m_currentFrame{0};
+  uint32_t m_openScopes{0};
+  bool m_supported;
+  double m_nanosecondsPerTick;
+
+  std::vector<uint64_t> m_timestamps;
+  std::vector<GpuScopeTiming> m_timings;
+
+  void readTimings(FrameResources &frame);
+};
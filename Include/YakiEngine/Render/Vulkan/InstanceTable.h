@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+#include "DeletionQueue.h"
+#include "UploadAllocator.h"
+#include "VkTypes.h"
+#include "VulkanContext.h"
+
+constexpr uint32_t INVALID_BATCH = UINT32_MAX;
+
+// Persistent per-instance GPU data. Every renderable keeps its slot until it is freed, edits go to a CPU
+// mirror and only the touched slot ranges are uploaded. Transforms are tracked apart from the rest,
+// so moving an instance uploads a single matrix
+class InstanceTable {
+public:
+  explicit InstanceTable(std::shared_ptr<VulkanContext> ctx);
+
+  InstanceTable(const InstanceTable &) = delete;
+  InstanceTable &operator=(const InstanceTable &) = delete;
+
+  [[nodiscard]] uint32_t Allocate();
+  // The slot is kept in the tables with an invalid batch, the culling pass skips it
+  void Free(uint32_t slot);
+
+  void SetTransform(uint32_t slot, const glm::mat4 &transform);
+  void SetInstance(uint32_t slot, const glm::vec4 &localSphere, uint32_t batchId, uint32_t objectId);
+  void SetBatch(uint32_t slot, uint32_t batchId);
+
+  // Records the uploads of all dirty slots into cmd, growing the GPU buffers first when the slots outgrew them.
+  // Dirty ranges are staged in uploadAllocator, replaced buffers go to deletionQueue.
+  // Returns true when buffers were replaced and descriptors must be rewritten
+  bool Flush(VkCommandBuffer cmd, UploadAllocator &uploadAllocator, DeletionQueue &deletionQueue);
+  // True when the next Flush has anything to upload
+  [[nodiscard]] bool HasPendingChanges() const;
+
+  // Slots past the slot count were never allocated, the culling pass dispatches over this many
+  [[nodiscard]] uint32_t GetSlotCount() const;
+  [[nodiscard]] uint32_t GetInstanceCount() const;
+  [[nodiscard]] uint32_t GetCapacity() const;
+  [[nodiscard]] uint32_t GetBatchId(uint32_t slot) const;
+
+  [[nodiscard]] VkBuffer GetTransformBuffer() const;
+  [[nodiscard]] VkBuffer GetCullDataBuffer() const;
+  [[nodiscard]] VkBuffer GetObjectIdBuffer() const;
+  [[nodiscard]] VkBuffer GetVisibilityBuffer() const;
+
+private:
+  std::shared_ptr<VulkanContext> m_ctx;
+
+  std::vector<glm::mat4> m_transforms;
+  std::vector<GPUInstanceCullData> m_cullData;
+  std::vector<uint32_t> m_objectIds;
+  std::vector<uint32_t> m_freeSlots;
+
+  // May hold duplicates, they are sorted and merged into ranges on flush
+  std::vector<uint32_t> m_dirtyTransforms;
+  std::vector<uint32_t> m_dirtyInstances;
+
+  std::unique_ptr<Buffer> m_transformBuffer;
+  std::unique_ptr<Buffer> m_cullDataBuffer;
+  std::unique_ptr<Buffer> m_objectIdBuffer;
+  std::unique_ptr<Buffer> m_visibilityBuffer;
+  uint32_t m_capacity{0};
+
+  void grow(VkCommandBuffer cmd, DeletionQueue &deletionQueue);
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+#include "DeletionQueue.h"
+#include "UploadAllocator.h"
+#include "VulkanContext.h"
+
+struct Mesh;
+
+// First fit over [0, end). Freed ranges merge with their neighbours, a range freed at the end moves the end back
+class RangeAllocator {
+public:
+  [[nodiscard]] uint32_t Allocate(uint32_t count);
+  void Free(uint32_t offset, uint32_t count);
+
+  [[nodiscard]] uint32_t GetEnd() const;
+
+private:
+  // Offset to count of every free range below the end
+  std::map<uint32_t, uint32_t> m_freeRanges;
+  uint32_t m_end{0};
+};
+
+// Where a mesh's indices and vertex positions live in the merged buffers, the indices stay relative to the mesh
+struct MeshGeometryRange {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t vertexOffset;
+  uint32_t vertexCount;
+};
+
+// Indices and vertex positions of every mesh the batches draw, merged into one index and one position buffer so
+// position only passes and the visibility resolve reach any mesh through one binding. Meshes are counted by their
+// id, the last release frees their ranges for reuse once the frames recorded until then completed
+class MeshGeometryPool {
+public:
+  explicit MeshGeometryPool(std::shared_ptr<VulkanContext> ctx);
+
+  MeshGeometryPool(const MeshGeometryPool &) = delete;
+  MeshGeometryPool &operator=(const MeshGeometryPool &) = delete;
+
+  // The first reference allocates the mesh's ranges and stages its geometry for the next Flush
+  void Acquire(const Mesh &mesh);
+  // The ranges return to the pool when deletionQueue is flushed
+  void Release(uint32_t meshId, DeletionQueue &deletionQueue);
+
+  // Records the uploads of newly acquired meshes into cmd, growing the buffers first when the ranges outgrew them.
+  // Staging comes from uploadAllocator, replaced buffers go to deletionQueue.
+  // Returns true when buffers were replaced and descriptors must be rewritten
+  bool Flush(VkCommandBuffer cmd, UploadAllocator &uploadAllocator, DeletionQueue &deletionQueue);
+
+  [[nodiscard]] const MeshGeometryRange &GetRange(uint32_t meshId) const;
+  // False until the first mesh was flushed, the buffers do not exist before
+  [[nodiscard]] bool HasBuffers() const;
+  [[nodiscard]] VkBuffer GetIndexBuffer() const;
+  [[nodiscard]] VkDeviceSize GetIndexBufferSize() const;
+  [[nodiscard]] VkBuffer GetPositionBuffer() const;
+  [[nodiscard]] VkDeviceSize GetPositionBufferSize() const;
+
+private:
+  struct Entry {
+    MeshGeometryRange range;
+    uint32_t references{0};
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  std::unordered_map<uint32_t, Entry> m_meshes;
+  RangeAllocator m_indexRanges;
+  RangeAllocator m_vertexRanges;
+
+  // Geometry of the meshes acquired since the last flush, the copies' source offsets are relative to these
+  std::vector<uint32_t> m_pendingIndices;
+  std::vector<glm::vec3> m_pendingPositions;
+  std::vector<VkBufferCopy> m_indexCopies;
+  std::vector<VkBufferCopy> m_positionCopies;
+
+  std::unique_ptr<Buffer> m_indexBuffer;
+  std::unique_ptr<Buffer> m_positionBuffer;
+  uint32_t m_indexCapacity{0};
+  uint32_t m_vertexCapacity{0};
+
+  void grow(VkCommandBuffer cmd, DeletionQueue &deletionQueue);
+};
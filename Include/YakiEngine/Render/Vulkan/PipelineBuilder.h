@@ -19,9 +19,12 @@ public:
 
     void SetLayout(VkPipelineLayout layout);
     void SetShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+    // Depth only passes run without a fragment stage and without color attachments
+    void SetVertexShader(VkShaderModule vertexShader);
     void SetInputTopology(VkPrimitiveTopology topology);
     void SetPolygonMode(VkPolygonMode mode);
     void SetCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace);
+    void SetDepthBias(float constantFactor, float slopeFactor);
     void SetMultisamplingNone();
     void SetColorAttachmentFormat(VkFormat format);
     void SetDepthFormat(VkFormat format);
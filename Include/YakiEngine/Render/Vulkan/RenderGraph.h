@@ -0,0 +1,209 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "DeletionQueue.h"
+#include "VulkanContext.h"
+
+using RenderGraphImage = uint32_t;
+constexpr RenderGraphImage INVALID_GRAPH_IMAGE = std::numeric_limits<uint32_t>::max();
+using RenderGraphPass = uint32_t;
+constexpr RenderGraphPass INVALID_GRAPH_PASS = std::numeric_limits<uint32_t>::max();
+
+// Decides the shader stage of Sampled and Storage uses, and the queue the pass runs on
+enum class PassType : uint8_t {
+  Graphics,
+  Compute,
+  // Runs on the async compute queue when the device has one and on the graphics queue otherwise. Barriers the
+  // pass records itself may only name compute and transfer stages
+  AsyncCompute,
+  Transfer,
+};
+
+enum class RenderQueue : uint8_t {
+  Graphics,
+  Compute,
+};
+
+// Returns a primary command buffer for the queue that is already recording, the graph ends it
+using CommandBufferSource = std::function<VkCommandBuffer(RenderQueue)>;
+
+// Binary semaphores and fence of the frame around the graph's submissions
+struct FrameSubmitSync {
+  // Waited on by the submission holding the first use of an acquired image, work before it does not wait
+  VkSemaphore waitSemaphore{VK_NULL_HANDLE};
+  VkPipelineStageFlags2 waitStages{VK_PIPELINE_STAGE_2_NONE};
+  // Signaled by the last graphics submission, which runs after all work of the frame on both queues
+  VkSemaphore signalSemaphore{VK_NULL_HANDLE};
+  VkFence fence{VK_NULL_HANDLE};
+};
+
+// How a pass touches an image. Color, depth attachment, storage and transfer destination uses write it, the others only read
+enum class ImageAccess : uint8_t {
+  ColorAttachment,
+  DepthAttachment,
+  DepthRead, // Sampled depth, the image stays a read only depth attachment
+  DepthTest, // Depth tested without writes, bound as a read only depth attachment
+  Sampled,
+  Storage,
+  TransferSrc,
+  TransferDst,
+};
+
+struct ImageUse {
+  RenderGraphImage image;
+  ImageAccess access;
+};
+
+// Layout and pending work of an imported image when the frame starts
+struct ImportedImageState {
+  VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+  VkPipelineStageFlags2 stages{VK_PIPELINE_STAGE_2_NONE};
+  VkAccessFlags2 access{VK_ACCESS_2_NONE};
+  // Its first use waits for the frame's wait semaphore, like a swapchain image. Other imports, kept by the
+  // renderer across frames, are ordered by the submissions themselves
+  bool acquired{false};
+};
+
+// Frame graph rebuilt every frame. Passes declare the images they use and are recorded later by Execute, in the
+// order they were added, with the barriers between them derived from those uses. All barriers a pass needs go
+// into one call, and an image only gets one when its layout changes or a write is involved.
+// Transient images only live inside the frame, the graph creates them and places those whose lifetimes do not
+// overlap in the same memory. Buffer hazards are not tracked, passes keep synchronizing their buffers themselves
+// and declare dependencies for buffers written by one pass and read by a later one.
+// Async compute passes split the frame into one submission per run of passes on the same queue. A submission
+// waits on the other queue's timeline semaphore when one of its passes depends on work recorded there
+class RenderGraph {
+public:
+  explicit RenderGraph(std::shared_ptr<VulkanContext> ctx);
+  ~RenderGraph();
+
+  RenderGraph(const RenderGraph &) = delete;
+  RenderGraph &operator=(const RenderGraph &) = delete;
+
+  // Drops the previous frame's passes and images, the physical transient images are kept for reuse
+  void Reset();
+  // An image owned elsewhere, finalLayout is left undefined when the frame does not care how it ends
+  RenderGraphImage ImportImage(VkImage image, VkImageView view, VkFormat format, const ImportedImageState &initialState, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+  // Usage flags are collected from the passes, the contents are undefined at the first use of every frame
+  RenderGraphImage CreateImage(VkExtent2D extent, VkFormat format);
+  RenderGraphPass AddPass(std::string_view name, PassType type, std::initializer_list<ImageUse> uses, std::function<void(VkCommandBuffer)> &&execute);
+  // The consumer sees every write of the producer, added earlier. A semaphore wait when they run on different
+  // queues and a memory barrier otherwise. Image uses need no declared dependency
+  void AddDependency(RenderGraphPass producer, RenderGraphPass consumer);
+
+  // Places the transient images, returns true when they were recreated and views taken from the graph are stale.
+  // That only happens when the transients or the order of their lifetimes change, not when passes in between
+  // come and go. Frames in flight keep the replaced images, they go to deletionQueue
+  bool Compile(DeletionQueue &deletionQueue);
+  // cmd is the frame's first graphics command buffer and may already hold commands, async passes wait for them.
+  // Later submissions take their command buffers from the source, every command buffer is ended on return
+  void Execute(VkCommandBuffer cmd, const CommandBufferSource &nextCommandBuffer);
+  // Submits what Execute recorded, in recording order
+  void Submit(const FrameSubmitSync &sync);
+
+  // Valid from Compile until the next Reset
+  [[nodiscard]] VkImage GetImage(RenderGraphImage image) const;
+  [[nodiscard]] VkImageView GetView(RenderGraphImage image) const;
+  [[nodiscard]] VkExtent2D GetExtent(RenderGraphImage image) const;
+  // Bytes of device memory behind the transient images and what they would take without aliasing
+  [[nodiscard]] VkDeviceSize GetTransientMemorySize() const;
+  [[nodiscard]] VkDeviceSize GetUnaliasedMemorySize() const;
+
+private:
+  struct ImageResource {
+    VkImage image{};
+    VkImageView view{};
+    VkFormat format{};
+    VkExtent2D extent{};
+    bool transient{false};
+    // Used on both queues, transients are then created concurrent
+    bool shared{false};
+    VkImageUsageFlags usage{0};
+    ImportedImageState initialState{};
+    VkImageLayout finalLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+    uint32_t firstPass{std::numeric_limits<uint32_t>::max()};
+    uint32_t lastPass{0};
+    // Last pass of the frame that used memory of a transient before it, it may run on the other queue
+    uint32_t aliasPass{std::numeric_limits<uint32_t>::max()};
+    // Every stage and write the image sees in the frame, the first use of an aliased image waits on them
+    VkPipelineStageFlags2 useStages{VK_PIPELINE_STAGE_2_NONE};
+    VkAccessFlags2 writeAccess{VK_ACCESS_2_NONE};
+    VkPipelineStageFlags2 aliasWaitStages{VK_PIPELINE_STAGE_2_NONE};
+    VkAccessFlags2 aliasWaitAccess{VK_ACCESS_2_NONE};
+    uint32_t physical{0};
+  };
+
+  struct Pass {
+    std::string_view name;
+    PassType type;
+    RenderQueue queue;
+    std::vector<ImageUse> uses;
+    std::vector<RenderGraphPass> dependencies;
+    std::function<void(VkCommandBuffer)> execute;
+    uint32_t batch{0};
+  };
+
+  // Passes recorded into one command buffer and submitted together
+  struct Batch {
+    RenderQueue queue;
+    VkCommandBuffer cmd;
+    // Value of the other queue's timeline waited on first, zero when nothing is
+    uint64_t waitValue;
+    // Value of the own queue's timeline signaled at the end, assigned when the batch is closed
+    uint64_t signalValue;
+  };
+
+  // Transient image backed by a range of a shared allocation
+  struct PhysicalImage {
+    VkImage image{};
+    VkImageView view{};
+    uint32_t heap{0};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
+  };
+
+  // What the physical images were created for, a frame with the same shape reuses them. Lifetimes are ranks among
+  // the transients' first and last passes, which is all the placement depends on
+  struct TransientKey {
+    VkExtent2D extent;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    uint32_t firstRank;
+    uint32_t lastRank;
+    bool shared;
+
+    bool operator==(const TransientKey &other) const;
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+
+  std::vector<ImageResource> m_images;
+  std::vector<Pass> m_passes;
+  std::vector<Batch> m_batches;
+  uint32_t m_importBatch{0};
+
+  // One timeline per queue, only created with async compute. Values only grow, across frames too
+  std::array<VkSemaphore, 2> m_timelines{};
+  std::array<uint64_t, 2> m_timelineValues{};
+
+  std::vector<TransientKey> m_transientKeys;
+  std::vector<PhysicalImage> m_physicalImages;
+  std::vector<VmaAllocation> m_heaps;
+  VkDeviceSize m_transientMemorySize{0};
+  VkDeviceSize m_unaliasedMemorySize{0};
+
+  void createTransientImages(std::span<const uint32_t> transients);
+  void retireTransientImages(DeletionQueue &deletionQueue);
+  void destroyTransientImages();
+};
@@ -19,12 +19,3 @@ struct RenderObject {
   glm::mat4 transform;
   VkDeviceAddress vertexBufferAddress;
 };
-
-struct RenderIndirectObjects {
-  std::vector<uint32_t> firstIndices;
-  std::vector<uint32_t> indexCounts;
-  std::vector<uint32_t> objectIds;
-  std::vector<glm::mat4> transforms;
-  std::vector<Mesh *> meshes;
-  std::vector<Material *> materials;
-};
@@ -1,25 +1,48 @@
 #pragma once
 
 #include <array>
+#include <functional>
+#include <span>
+#include <unordered_map>
 
+#include "BindlessRegistry.h"
+#include "DynamicInstanceRing.h"
+#include "DynamicResolution.h"
+#include "GpuProfiler.h"
+#include "InstanceTable.h"
+#include "MeshGeometryPool.h"
+#include "RenderGraph.h"
+#include "UploadAllocator.h"
 #include "Swapchain.h"
 #include "VkTypes.h"
 #include "VulkanContext.h"
+#include "Components/Camera.h"
 #include "Components/DefaultData.h"
+#include "Compute/GpuPrimitives.h"
+#include "Culling/DepthPyramid.h"
+#include "Lighting/CascadedShadowMap.h"
+#include "Lighting/LightGrid.h"
+#include "Picking/ObjectPicker.h"
 #include "RenderObject.h"
 
-constexpr uint32_t FRAME_OVERLAP = 2;
+// Frames the CPU may record ahead of the GPU, set through the YAKI_FRAMES_IN_FLIGHT CMake option
+#ifndef YAKI_FRAMES_IN_FLIGHT
+#define YAKI_FRAMES_IN_FLIGHT 2
+#endif
+
+constexpr uint32_t FRAME_OVERLAP = YAKI_FRAMES_IN_FLIGHT;
+static_assert(FRAME_OVERLAP == 2 || FRAME_OVERLAP == 3, "YAKI_FRAMES_IN_FLIGHT must be 2 or 3");
 
 struct RenderingStats {
   uint32_t triangleCount;
   uint32_t drawcallCount;
+  // Milliseconds of CPU time
   float sceneUpdateTime;
-};
-
-struct PickingResources {
-  std::shared_ptr<Texture> texture;
-  std::shared_ptr<Buffer> stagingBuffer;
-  uint32_t entityId;
+  uint32_t visibleInstanceCount;
+  uint32_t culledInstanceCount;
+  // Memory behind the frame's transient images, and what it would take without aliasing
+  VkDeviceSize transientMemorySize;
+  VkDeviceSize unaliasedMemorySize;
 };
 
 struct IndirectBatch {
@@ -30,28 +53,102 @@ struct IndirectBatch {
   Material *material;
 };
 
+// Instances that passed a CPU cull for a shadow cascade or a pick query, batch instance ranges index instances
+struct CulledInstances {
+  std::vector<uint32_t> instances;
+  std::vector<IndirectBatch> batches;
+};
+
+// Consecutive batches sharing a pipeline, drawn by one multi draw indirect call
+struct DrawGroup {
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+  uint32_t firstDraw;
+  uint32_t drawCount;
+  uint32_t triangleCount;
+  // Entry of the frame's draw count buffer, only culled static groups are drawn with a count
+  uint32_t countIndex;
+};
+
+enum class RenderPath : uint8_t {
+  Forward,    // Every fragment is shaded with its material
+  Visibility, // The geometry pass only writes instance and triangle ids, a compute pass shades each pixel once
+};
+
+// Passes are declared into a render graph between BeginRendering and EndRendering and recorded by EndRendering,
+// spans handed to the pass functions must stay valid until then. Stats therefore describe the previous frame
 class Renderer {
 public:
   Renderer(SDL_Window *window, std::shared_ptr<VulkanContext> ctx);
+  // Headless, frames end in offscreen images of the given size and ImGui is never initialized
+  Renderer(std::shared_ptr<VulkanContext> ctx, VkExtent2D extent);
   ~Renderer();
 
-  void BeginRendering();
-  void Begin3DRendering();
-  void RenderStaticObjects(std::vector<IndirectBatch>& batches);
+  // Returns false when no swapchain image could be acquired, the frame must then be skipped
+  [[nodiscard]] bool BeginRendering();
+  void CullStaticObjects(const Camera &camera, CullPhase phase);
+  void UploadVisibleStaticObjects(std::span<const uint32_t> visibleInstances, std::span<const IndirectBatch> batches);
+  void Begin3DRendering(bool clearDepth = true);
+  void RenderStaticObjects();
+  void RenderDynamicObjects();
+  void Suspend3DRendering();
+  void BuildDepthPyramid();
+  // Bins this frame's local lights into the cluster grid, must run before any pass that shades
+  void BuildLightClusters(const Camera &camera);
+  // Fits the cascades of the first directional light to the camera, must run before BeginRendering
+  void UpdateShadowCascades(const Camera &camera);
+  // Takes one caster list per cascade. Static instances are table slots and only read for cascades that need a
+  // static render, dynamic instances index this frame's dynamic objects. Must run before any pass that shades
+  void RenderShadows(std::span<const CulledInstances> staticCasters, std::span<const CulledInstances> dynamicCasters);
+  // Queues an object id query at a viewport pixel, see ObjectPicker. Returns the id its result will carry
+  uint32_t RequestPick(glm::ivec2 pixel, uint32_t radius = 0);
+  // Queries this frame serves, valid after BeginRendering. Their matrices cover only the queried tile
+  [[nodiscard]] std::span<const PickRequest> GetFramePickRequests() const;
+  // Takes one candidate list per frame query, in the order of GetFramePickRequests. Called every frame, also
+  // without queries
+  void RenderPicks(std::span<const CulledInstances> staticCandidates, std::span<const CulledInstances> dynamicCandidates);
+  // Results completed since the last call, they arrive FRAME_OVERLAP frames after their query was rendered
+  [[nodiscard]] std::vector<PickResult> TakePickResults();
   void End3DRendering();
+  // Headless renderers only blit the scene to the final image, there is no GUI to draw
   void RenderImGui();
   void EndRendering();
   void WaitIdle();
+  // Copies the final image of the frame being recorded to host memory, headless renderers only
+  void CaptureFrame();
+  // Waits for the GPU, returns the captured frame as tightly packed RGBA rows of the swapchain extent.
+  // Empty when no frame was captured
+  [[nodiscard]] std::vector<uint8_t> ReadCapture();
 
-  void UpdateStaticObjects(RenderIndirectObjects& objects);
+  // Batches must be sorted by pipeline with the transparent ones last, instances refer to them through their batch id
+  void UpdateStaticBatches(std::span<const IndirectBatch> batches);
+  // Records the instance table edits made since the last frame, must run before culling
+  void UploadStaticInstances();
+  // Streams this frame's dynamic objects. drawIndices holds the batch of every transform, the instances are sorted on
+  // the GPU by the low sortKeyBits bits of sortKeys, which must order them by batch first. Batches must be sorted
+  // like the static ones
+  void UploadDynamicObjects(std::span<const IndirectBatch> batches, std::span<const glm::mat4> transforms, std::span<const uint32_t> objectIds, std::span<const uint32_t> drawIndices, std::span<const uint32_t> sortKeys, uint32_t sortKeyBits);
+  // Takes effect with the next BeginRendering, a frame is recorded with a single path
+  void SetRenderPath(RenderPath path);
 
   [[nodiscard]] Swapchain &GetSwapchain();
+  [[nodiscard]] bool IsHeadless() const;
+  [[nodiscard]] BindlessRegistry &GetBindlessRegistry();
+  [[nodiscard]] InstanceTable &GetInstanceTable();
   [[nodiscard]] VkBuffer GetMaterialConstantsBuffer();
   [[nodiscard]] VkDescriptorSetLayout GetSceneDataDescriptorLayout();
-  [[nodiscard]] uint32_t GetHoveredEntityId();
   [[nodiscard]] RenderingStats GetRenderingStats();
+  // Measured by the render system, which owns the scene update
+  void SetSceneUpdateTime(float milliseconds);
+  // GPU time of each pass, from the newest frame whose timestamps are available
+  [[nodiscard]] std::span<const GpuScopeTiming> GetGpuTimings() const;
+  [[nodiscard]] DynamicResolution &GetDynamicResolution();
   [[nodiscard]] GPUSceneData &GetGpuSceneData();
   [[nodiscard]] GPULightData &GetGpuLightData();
+  // Point and spot lights of the next frame, uploaded by BeginRendering
+  [[nodiscard]] std::vector<GPULocalLight> &GetLocalLights();
+  [[nodiscard]] bool ShadowCascadeNeedsStaticRender(uint32_t cascade) const;
+  [[nodiscard]] const ShadowCascade &GetShadowCascade(uint32_t cascade) const;
 
 private:
   SDL_Window *m_window;
@@ -63,33 +160,141 @@ private:
 
   std::array<FrameData, FRAME_OVERLAP> m_frames;
   uint32_t m_currentFrame;
-  uint32_t m_currentImageIndex;
+  uint32_t m_currentImageIndex{0};
 
-  DescriptorAllocator m_descriptorAllocator;
+  std::unique_ptr<BindlessRegistry> m_bindlessRegistry;
 
-  std::unique_ptr<Buffer> m_objectIdsBuffer;
-  std::unique_ptr<Buffer> m_transformsBuffer;
+  std::unique_ptr<InstanceTable> m_instanceTable;
+  std::unique_ptr<Buffer> m_drawTemplateBuffer;
+  std::unique_ptr<Buffer> m_drawDataBuffer;
+  std::unique_ptr<Buffer> m_batchGroupBuffer;
+  std::unique_ptr<MeshGeometryPool> m_meshGeometry;
+  std::unique_ptr<DepthPyramid> m_depthPyramid;
+  std::unique_ptr<DynamicInstanceRing> m_dynamicRing;
+  std::unique_ptr<GpuPrimitives> m_primitives;
+  std::unique_ptr<LightGrid> m_lightGrid;
+  std::unique_ptr<CascadedShadowMap> m_shadowMap;
+  std::unique_ptr<ObjectPicker> m_picker;
+  std::unique_ptr<GpuProfiler> m_profiler;
+  std::unique_ptr<RenderGraph> m_graph;
+  RenderGraphImage m_drawImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_depthImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_visibilityImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_accumulationImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_revealageImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_swapchainImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_shadowImage{INVALID_GRAPH_IMAGE};
+  RenderGraphImage m_shadowCacheImage{INVALID_GRAPH_IMAGE};
+  // Passes writing buffers read by later passes, which declare a dependency on them. Light clusters are read by
+  // every shading pass, the culling results by the next geometry pass and the geometry by late culling
+  RenderGraphPass m_lightClusterPass{INVALID_GRAPH_PASS};
+  RenderGraphPass m_cullPass{INVALID_GRAPH_PASS};
+  RenderGraphPass m_dynamicSortPass{INVALID_GRAPH_PASS};
+  RenderGraphPass m_geometryPass{INVALID_GRAPH_PASS};
+  // The 3D passes render into the top left corner of the draw targets, the present blit scales it up
+  DynamicResolution m_dynamicResolution{FRAME_OVERLAP};
+  VkExtent2D m_renderExtent{};
+  // Draws of the geometry pass being declared, it is added to the graph once rendering is suspended or ended
+  std::vector<std::function<void(VkCommandBuffer)>> m_geometryDraws;
+  bool m_geometryClear{true};
+  uint32_t m_frameScope{INVALID_GPU_SCOPE};
+  uint32_t m_3dScope{INVALID_GPU_SCOPE};
+  uint32_t m_staticBatchCount{0};
+  uint32_t m_firstTransparentBatch{0};
+  // Static groups count their draws at their own index, all opaque groups merged count at this one
+  uint32_t m_mergedCountIndex{0};
+  uint32_t m_staticDataVersion{0};
+  uint32_t m_dynamicDataVersion{0};
+  std::vector<VkDrawIndexedIndirectCommand> m_drawTemplates;
+  // Static groups index the compacted draws culling writes after the per batch ones
+  std::vector<DrawGroup> m_drawGroups;
+  std::vector<DrawGroup> m_dynamicDrawGroups;
+  // Drawn by the transparency pass after the opaque geometry, their draws follow the opaque ones
+  std::vector<DrawGroup> m_transparentDrawGroups;
+  std::vector<DrawGroup> m_dynamicTransparentDrawGroups;
+  // Ids of the meshes the static and dynamic batches hold in the geometry pool, one reference each
+  std::vector<uint32_t> m_staticMeshIds;
+  std::vector<uint32_t> m_dynamicMeshIds;
+
+  RenderPath m_renderPath{RenderPath::Forward};
+  RenderPath m_requestedRenderPath{RenderPath::Forward};
+  VkSampler m_visibilitySampler{};
+  VkPipelineLayout m_visibilityLayout{};
+  VkPipeline m_visibilityPipeline{};
+  ComputePipeline m_resolvePipeline{};
+  ComputePipeline m_compositePipeline{};
+  // Bound in place of the instance buffers that do not exist yet, resolve reads both frame sets
+  std::unique_ptr<Buffer> m_nullBuffer;
+  uint32_t m_visibilityDataVersion{0};
+  uint32_t m_compositeDataVersion{0};
+
+  std::unique_ptr<Buffer> m_captureBuffer;
+  bool m_captureRequested{false};
+  bool m_captureRecorded{false};
 
-  VkDescriptorSetLayout m_drawImageDescriptorLayout{};
   VkDescriptorSetLayout m_singleImageDescriptorLayout{};
   VkDescriptorSetLayout m_gpuSceneDataDescriptorLayout{};
+  VkDescriptorSetLayout m_cullDescriptorLayout{};
+  VkDescriptorSetLayout m_resolveDescriptorLayout{};
+  VkDescriptorSetLayout m_compositeDescriptorLayout{};
+
+  ComputePipeline m_cullPipeline{};
+  // Shares the culling layout and push constants
+  VkPipeline m_cullDrawsPipeline{};
 
   VkDescriptorSet m_frameDescriptor;
-  VkDescriptorSet m_drawImageDescriptors{};
 
   GPUSceneData m_gpuSceneData;
   GPULightData m_gpuLightData;
-  PickingResources m_pickingResources;
+  std::vector<GPULocalLight> m_localLights;
   RenderingStats m_stats;
 
   Buffer m_materialConstantsBuffer;
 
+  void init();
   void initCommands();
+  void initProfiler();
   void initImgui();
   void initSyncObjects();
-  void initDescriptorAllocator();
   void initDescriptors();
+  void initBindless();
   void initPicking();
+  void initCulling();
+  void initVisibility();
+  void initTransparency();
+  void initLighting();
+  void initRenderGraph();
+  void updateDepthPyramidDescriptors();
+  void updateUploadDescriptors(FrameData &frame);
+  void updateLightDescriptors(uint32_t frameIndex);
+  void syncStaticResources(FrameData &frame);
+  void syncDynamicResources(FrameData &frame);
+  void syncVisibilityResources(FrameData &frame);
+  void syncCompositeResources(FrameData &frame);
+  void addGeometryPass();
+  // Producers that were never added this frame are skipped
+  void addDependency(RenderGraphPass producer, RenderGraphPass consumer);
+  void addTransparencyPasses();
+  void addCapturePass();
+  void recordCulling(VkCommandBuffer cmd, CullPhase phase);
+  // Expects the draw counts cleared and the batches' instance counts written
+  void recordDrawCompaction(VkCommandBuffer cmd, const GPUCullPushConstants &pushConstants);
+  void resolveVisibility(VkCommandBuffer cmd);
+  void compositeTransparency(VkCommandBuffer cmd);
+  // Acquires the batches' meshes before releasing meshIds, which it replaces, and uploads the new ones into the frame
+  void acquireMeshGeometry(FrameData &frame, std::span<const IndirectBatch> batches, std::vector<uint32_t> &meshIds);
+  // Returns true when the frame's draw buffers were recreated, their descriptors have to be written again
+  bool reserveStaticDrawBuffers(FrameData &frame, uint32_t batchCount);
+  void reserveDynamicSortBuffer(FrameData &frame, uint32_t instanceCount);
+  void sortDynamicInstances(VkCommandBuffer cmd, uint32_t instanceCount, uint32_t keyBits);
+  void drawCulledInstances(VkCommandBuffer cmd, const CulledInstances &culled, uint32_t listOffset, VkDescriptorSet frameSet, VkPipelineLayout layout, VkDescriptorSet instanceSet);
+  void buildDraws(std::span<const IndirectBatch> batches, std::vector<VkDrawIndexedIndirectCommand> &draws, std::vector<GPUDrawData> &drawData, std::vector<DrawGroup> &groups, std::vector<DrawGroup> &transparentGroups);
+  // Groups are drawn with their entry of countBuffer as the draw count when it is given, and are never split
+  // between workers then
+  void recordDrawGroups(VkCommandBuffer primary, MeshPassType pass, std::span<const DrawGroup> groups, VkDescriptorSet frameSet, VkBuffer drawBuffer, VkDeviceSize drawOffset, VkBuffer countBuffer, uint32_t instanceTag);
+  VkCommandBuffer beginSecondaryCommands(CommandBufferPool &pool, MeshPassType pass) const;
+  VkCommandBuffer beginQueueCommands(RenderQueue queue);
+  void retireBuffer(std::unique_ptr<Buffer> &buffer);
 
   VkCommandBuffer beginSingleTimeCommands(VkCommandPool &commandPool) const;
   void endSingleTimeCommands(VkCommandPool &commandPool, VkCommandBuffer &commandBuffer) const;
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "ShaderBundleFormat.h"
+
+// One shader of the bundle, the spans point into the bundle's memory
+struct BundledShader {
+  VkShaderStageFlagBits stage;
+  std::span<const uint32_t> code;
+  std::span<const ShaderBundleBinding> bindings;
+  std::span<const ShaderBundlePushConstantRange> pushConstantRanges;
+};
+
+// Optimized SPIR-V of every shader together with its reflection, written by the YakiShaderBundler build step.
+// The whole file is read once, shaders are then looked up by name without touching the disk
+class ShaderBundle {
+public:
+  explicit ShaderBundle(const std::filesystem::path &path);
+
+  ShaderBundle(const ShaderBundle &) = delete;
+  ShaderBundle &operator=(const ShaderBundle &) = delete;
+
+  // Throws when the bundle has no shader with that name
+  [[nodiscard]] const BundledShader &Get(std::string_view name) const;
+  [[nodiscard]] bool LoadModule(std::string_view name, VkDevice device, VkShaderModule *outShaderModule) const;
+
+private:
+  std::vector<uint32_t> m_data;
+  std::unordered_map<std::string, BundledShader> m_shaders;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of shaders.bundle, shared by the offline bundler and the runtime loader. Every field is a
+// 32-bit word, so the whole file can be read as one uint32_t array
+constexpr uint32_t SHADER_BUNDLE_MAGIC = 0x59534842; // "YSHB"
+constexpr uint32_t SHADER_BUNDLE_VERSION = 1;
+constexpr uint32_t SHADER_BUNDLE_NAME_SIZE = 64;
+
+struct ShaderBundleHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t shaderCount;
+};
+
+// Followed by codeWordCount SPIR-V words, bindingCount ShaderBundleBinding and pushConstantRangeCount
+// ShaderBundlePushConstantRange. name is the source path relative to the shader directory, e.g. "vertex/instanced.vert"
+struct ShaderBundleEntryHeader {
+  char name[SHADER_BUNDLE_NAME_SIZE];
+  uint32_t stage; // VkShaderStageFlagBits
+  uint32_t codeWordCount;
+  uint32_t bindingCount;
+  uint32_t pushConstantRangeCount;
+};
+
+struct ShaderBundleBinding {
+  uint32_t set;
+  uint32_t binding;
+  uint32_t descriptorType; // VkDescriptorType
+  uint32_t descriptorCount; // 0 for runtime sized arrays
+};
+
+struct ShaderBundlePushConstantRange {
+  uint32_t offset;
+  uint32_t size;
+};
+
+static_assert(sizeof(ShaderBundleHeader) % sizeof(uint32_t) == 0);
+static_assert(sizeof(ShaderBundleEntryHeader) % sizeof(uint32_t) == 0);
@@ -7,9 +7,22 @@
 #include "Vulkan/VkTypes.h"
 #include "../Assets/Texture.h"
 
+// Formats of the frame's offscreen targets, the render graph creates them every frame
+constexpr VkFormat DRAW_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+// Weighted blended transparency, premultiplied color sums with their weights and the product of (1 - alpha)
+constexpr VkFormat OIT_ACCUMULATION_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr VkFormat OIT_REVEALAGE_FORMAT = VK_FORMAT_R16_SFLOAT;
+// Final images of a headless swapchain, sRGB like the surface format windows prefer so both look the same
+constexpr VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+// Enough for every frame in flight to own an image, a frame renders into the image of its frame slot
+constexpr uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+
 class Swapchain {
 public:
   Swapchain(std::shared_ptr<VulkanContext> ctx, SDL_Window *window);
+  // Headless, the images are plain offscreen images of a fixed size that are never presented
+  Swapchain(std::shared_ptr<VulkanContext> ctx, VkExtent2D extent);
   ~Swapchain();
 
   void RecreateSwapchain();
@@ -18,11 +31,14 @@ public:
   [[nodiscard]] VkExtent2D GetExtent() const;
   [[nodiscard]] VkFormat &GetImageFormat();
   [[nodiscard]] VkImage GetImage(uint32_t idx) const;
-  [[nodiscard]] std::shared_ptr<Texture> GetDrawTexture();
-  [[nodiscard]] std::shared_ptr<Texture> GetDepthTexture();
+  [[nodiscard]] VkFormat GetDrawFormat() const;
+  [[nodiscard]] VkFormat GetDepthFormat() const;
+  // Size of the offscreen targets the scene is drawn into
+  [[nodiscard]] VkExtent2D GetDrawExtent() const;
   [[nodiscard]] VkImageView GetImageView(uint32_t idx) const;
+  [[nodiscard]] uint32_t GetImageCount() const;
+  [[nodiscard]] bool IsHeadless() const;
   [[nodiscard]] bool IsResized() const;
-  [[nodiscard]] float GetRenderScale() const;
   [[nodiscard]] SwapChainSupportDetails GetSwapchainSupport() const;
 
   void SetResized(bool resized);
@@ -39,14 +55,13 @@ private:
   VkSwapchainKHR m_swapchain{};
   SwapChainSupportDetails m_swapchainSupport;
 
-  std::shared_ptr<Texture> m_drawImage{};
-  std::shared_ptr<Texture> m_depthImage{};
   std::vector<VkImage> m_images;
   std::vector<VkImageView> m_imageViews;
+  // Only owned by a headless swapchain
+  std::vector<VmaAllocation> m_imageAllocations;
 
   VkFormat m_format{};
   VkExtent2D m_extent{};
-  float m_renderScale;
   bool m_resized;
 
   VmaAllocator m_allocator{};
@@ -55,8 +70,7 @@ private:
 private:
   void createSwapchain();
   void createImageViews();
-  void createDrawImage();
-  void createDepthImage();
+  void createOffscreenImages();
   VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) const;
 
   void cleanupSwapchain();
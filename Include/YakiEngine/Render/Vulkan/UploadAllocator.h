@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+#include "VulkanContext.h"
+
+struct UploadAllocation {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  void *data;
+};
+
+// Linear allocator over one persistently mapped buffer, owned by a single frame in flight.
+// Allocations live until the next Reset, which must only run once the frame's previous submission completed.
+// Requests that do not fit spill into a temporary block, the main block grows to the peak use on the next Reset
+class UploadAllocator {
+public:
+  UploadAllocator(std::shared_ptr<VulkanContext> ctx, VkDeviceSize capacity);
+
+  UploadAllocator(const UploadAllocator &) = delete;
+  UploadAllocator &operator=(const UploadAllocator &) = delete;
+
+  // Returns true when the main block was replaced and descriptors bound to it must be written again
+  bool Reset();
+  UploadAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
+  // Makes everything written since the last call visible to the device
+  void Flush();
+
+  template <typename T>
+  UploadAllocation Push(const T &value, VkDeviceSize alignment = alignof(T)) {
+    UploadAllocation allocation = Allocate(sizeof(T), alignment);
+    std::memcpy(allocation.data, &value, sizeof(T));
+    return allocation;
+  }
+
+  template <typename T>
+  UploadAllocation PushSpan(std::span<const T> values, VkDeviceSize alignment = alignof(T)) {
+    UploadAllocation allocation = Allocate(values.size_bytes(), alignment);
+    std::memcpy(allocation.data, values.data(), values.size_bytes());
+    return allocation;
+  }
+
+  // Alignment that satisfies both uniform and storage buffer dynamic offsets
+  [[nodiscard]] VkDeviceSize GetDescriptorAlignment() const;
+  // Main block, the only one dynamic offset descriptors may point into
+  [[nodiscard]] VkBuffer GetBuffer() const;
+
+private:
+  struct Block {
+    std::unique_ptr<Buffer> buffer;
+    VkDeviceSize head;
+  };
+
+  std::shared_ptr<VulkanContext> m_ctx;
+  Block m_block;
+  std::vector<Block> m_overflowBlocks;
+  VkDeviceSize m_frameUsage{0};
+  VkDeviceSize m_descriptorAlignment;
+
+  [[nodiscard]] std::unique_ptr<Buffer> createBuffer(VkDeviceSize size) const;
+  static UploadAllocation allocateFrom(Block &block, VkDeviceSize size, VkDeviceSize alignment);
+};
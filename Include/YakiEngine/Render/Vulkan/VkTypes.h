@@ -3,19 +3,51 @@
 #include <vulkan/vulkan_core.h>
 #include <glm/glm.hpp>
 #include <array>
+#include <vector>
 
 #include "Buffer.h"
 #include "Descriptors/DescriptorAllocator.h"
 #include "DeletionQueue.h"
 #include "Components/DirectionalLight.h"
-#include "Components/PointLight.h"
+
+class UploadAllocator;
+
+// Command pool with buffers allocated on demand, they are reused once the pool is reset after the frame's fence
+struct CommandBufferPool {
+  VkCommandPool pool{};
+  std::vector<VkCommandBuffer> buffers;
+  uint32_t usedCount{0};
+};
 
 struct FrameData {
   VkCommandPool commandPool{};
   VkCommandBuffer commandBuffer{};
+  // One per recording worker, holding secondary buffers
+  std::vector<CommandBufferPool> secondaryPools;
+  // Primaries of the submissions the render graph adds after commandBuffer, the compute one only exists with
+  // async compute
+  CommandBufferPool graphicsCommands;
+  CommandBufferPool computeCommands;
+  // One draw per static batch followed by the compacted draws of every group, drawDataBuffer has the same layout
   std::unique_ptr<Buffer> indirectDrawBuffer;
-  std::unique_ptr<Buffer> gpuSceneDataBuffer;
-  std::unique_ptr<Buffer> lightBuffer;
+  std::unique_ptr<Buffer> drawDataBuffer;
+  // Compacted draws of every static group, then of all opaque groups merged
+  std::unique_ptr<Buffer> drawCountBuffer;
+  // Batches the draw buffers above hold slots for, grown when the static batches outnumber it
+  uint32_t staticDrawCapacity{0};
+  std::unique_ptr<Buffer> compactedInstanceBuffer;
+  std::unique_ptr<Buffer> cullDataBuffer;
+  // Sort keys of the dynamic instances followed by the sort scratch, sized for dynamicSortCapacity instances
+  std::unique_ptr<Buffer> dynamicSortBuffer;
+  uint32_t dynamicSortCapacity{0};
+  // Per-frame uniforms and staging data, scene and light data are bound through dynamic offsets into it
+  std::unique_ptr<UploadAllocator> uploadAllocator;
+  uint32_t sceneDataOffset{0};
+  uint32_t lightDataOffset{0};
+  uint32_t staticDataVersion{0};
+  uint32_t dynamicDataVersion{0};
+  uint32_t visibilityDataVersion{0};
+  uint32_t compositeDataVersion{0};
 
   VkSemaphore swapchainSemaphore{}, renderSemaphore{};
   VkFence renderFence{};
@@ -23,6 +55,11 @@ struct FrameData {
   DeletionQueue deletionQueue;
   DescriptorAllocator frameDescriptorAllocator{};
   VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VkDescriptorSet cullDescriptorSet = VK_NULL_HANDLE;
+  // Same layout as descriptorSet, with the instance bindings pointing into the frame's dynamic ring section
+  VkDescriptorSet dynamicDescriptorSet = VK_NULL_HANDLE;
+  VkDescriptorSet resolveDescriptorSet = VK_NULL_HANDLE;
+  VkDescriptorSet compositeDescriptorSet = VK_NULL_HANDLE;
 };
 
 struct Vertex {
@@ -64,7 +101,73 @@ struct GPUDrawPushConstants {
 static_assert(sizeof(GPUDrawPushConstants) == 80);
 
 struct GPUIndirectPushConstants {
+  uint32_t drawOffset;
+  uint32_t instanceTag; // Or-ed into the instance ids the visibility pass writes
+};
+
+struct GPUDrawData {
   VkDeviceAddress vertexBuffer;
+  uint32_t materialIndex;
+  uint32_t padding;
+};
+static_assert(sizeof(GPUDrawData) == 16);
+
+// Entry of the bindless material buffer, texture and sampler fields index the bindless arrays
+struct GPUMaterialData {
+  glm::vec4 colorFactors;
+  glm::vec4 metalRoughFactors;
+  glm::vec4 specularColorFactors;
+  uint32_t colorTexture;
+  uint32_t colorSampler;
+  uint32_t metalRoughTexture;
+  uint32_t metalRoughSampler;
+};
+static_assert(sizeof(GPUMaterialData) == 64);
+
+struct GPUInstanceCullData {
+  glm::vec4 sphere; // Local space bounding sphere, radius in w
+  uint32_t batchId;
+  uint32_t padding[3];
+};
+static_assert(sizeof(GPUInstanceCullData) == 32);
+
+struct GPUCullData {
+  glm::mat4 view;
+  std::array<glm::vec4, 6> frustumPlanes;
+  glm::vec4 projection; // P00, P11, P22, P32
+  glm::vec2 pyramidSize;
+  float znear;
+  uint32_t occlusionEnabled;
+  // Part of the depth image the frame rendered to, with dynamic resolution
+  glm::vec2 uvScale;
+  glm::vec2 padding;
+};
+static_assert(sizeof(GPUCullData) == 208);
+
+enum class CullPhase : uint32_t {
+  Early, // Instances visible last frame
+  Late,  // Everything else, tested against this frame's depth pyramid
+};
+
+struct GPUCullPushConstants {
+  uint32_t instanceCount;
+  CullPhase phase;
+  // Batches from here on are transparent, they are drawn once by the late phase and never write depth
+  uint32_t firstTransparentBatch;
+  uint32_t batchCount;
+  // Count of all opaque groups merged, used instead of their own counts when mergeOpaque is set
+  uint32_t mergedCountIndex;
+  uint32_t mergeOpaque;
+};
+
+// Where culling moves a batch's draw when it has visible instances
+struct GPUBatchGroup {
+  uint32_t countIndex;
+  uint32_t firstDraw; // First compacted draw of the group
+};
+
+struct GPUResolvePushConstants {
+  glm::uvec2 renderSize;
 };
 
 struct GPUSceneData {
@@ -76,15 +179,32 @@ struct GPUSceneData {
 };
 
 static constexpr uint32_t MAX_DIRECTIONAL_LIGHTS = 10;
-static constexpr uint32_t MAX_POINT_LIGHTS = 10;
+static constexpr uint32_t SHADOW_CASCADE_COUNT = 4;
 
+// Directional lights reach every pixel and stay in the light data, local lights are binned into clusters.
+// The first directional light casts the cascaded shadows
 struct GPULightData {
   uint32_t numDirectionalLights;
-  uint32_t numPointLights;
-  glm::uvec2 padding;
+  uint32_t numLocalLights;
+  uint32_t shadowsEnabled;
+  uint32_t padding;
   std::array<DirectionalLight, MAX_DIRECTIONAL_LIGHTS> directionalLights;
-  std::array<PointLight, MAX_POINT_LIGHTS> pointLights;
+  std::array<glm::mat4, SHADOW_CASCADE_COUNT> cascadeViewProj;
+  glm::vec4 cascadeSplits;     // Far view depth of every cascade
+  glm::vec4 cascadeTexelSizes; // World size of a shadow map texel in every cascade
+};
+
+// Point or spot light, point lights have a cosOuterAngle below -1 so every direction passes the cone test
+struct GPULocalLight {
+  glm::vec4 color;
+  glm::vec3 position;
+  float range;
+  glm::vec3 direction;
+  float cosOuterAngle;
+  float cosInnerAngle;
+  float padding[3];
 };
+static_assert(sizeof(GPULocalLight) == 64);
 
 struct Bounds {
   glm::vec3 origin;
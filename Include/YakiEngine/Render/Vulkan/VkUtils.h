@@ -1,6 +1,7 @@
 #pragma once
 #include <filesystem>
 #include <optional>
+#include <span>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -27,6 +28,8 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // A family with compute but no graphics, its queue runs next to the graphics one. Not required
+    std::optional<uint32_t> computeFamily;
 
     [[nodiscard]] bool isComplete() const
     {
@@ -46,8 +49,11 @@ namespace VkUtil
 
     void copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
     void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
-
-    bool load_shader_module(const std::filesystem::path& filePath, VkDevice device, VkShaderModule* outShaderModule);
+    void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+    // Makes the image concurrent between the families when there is more than one, the span must outlive the creation
+    void set_queue_families(VkImageCreateInfo& info, std::span<const uint32_t> queueFamilies);
+    // The buffer must have been created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    VkDeviceAddress get_buffer_address(VkDevice device, VkBuffer buffer);
 }
 
 
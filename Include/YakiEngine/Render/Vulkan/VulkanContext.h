@@ -1,14 +1,19 @@
 #pragma once
 
 #include <functional>
+#include <memory>
+#include <span>
 #include <vector>
 #include <SDL3/SDL_video.h>
 
+#include "ShaderBundle.h"
 #include "VkTypes.h"
+#include "VkUtils.h"
 
 class VulkanContext {
 public:
-    VulkanContext(SDL_Window* window);
+    // A null window gives a headless context, it has no surface and never touches SDL video
+    explicit VulkanContext(SDL_Window* window);
     ~VulkanContext();
 
     [[nodiscard]] VkInstance GetInstance() const;
@@ -18,7 +23,22 @@ public:
     [[nodiscard]] VmaAllocator GetAllocator() const;
     [[nodiscard]] VkQueue GetGraphicsQueue() const;
     [[nodiscard]] VkQueue GetPresentQueue() const;
+    [[nodiscard]] uint32_t GetGraphicsQueueFamily() const;
+    // True when the device has a compute only queue family, compute work submitted there overlaps with graphics
+    [[nodiscard]] bool HasAsyncCompute() const;
+    // Only valid with async compute
+    [[nodiscard]] VkQueue GetComputeQueue() const;
+    [[nodiscard]] uint32_t GetComputeQueueFamily() const;
+    // Families that buffers and images used on both the graphics and the compute queue are shared between,
+    // empty without async compute. Such resources are created concurrent instead of changing owners every frame
+    [[nodiscard]] std::span<const uint32_t> GetSharedQueueFamilies() const;
     [[nodiscard]] VkPhysicalDeviceProperties GetGpuProperties() const;
+    // Shared by every pipeline creation, loaded from the previous run and written back on destruction
+    [[nodiscard]] VkPipelineCache GetPipelineCache() const;
+    // Every shader module is created from this bundle, which the build writes next to the executable
+    [[nodiscard]] const ShaderBundle &GetShaderBundle() const;
+    // The present queue is then the graphics queue
+    [[nodiscard]] bool IsHeadless() const;
 
     void ImmediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function) const;
 
@@ -32,6 +52,9 @@ private:
 
     VkQueue m_graphicsQueue{};
     VkQueue m_presentQueue{};
+    VkQueue m_computeQueue{};
+    QueueFamilyIndices m_queueFamilies{};
+    std::vector<uint32_t> m_sharedQueueFamilies;
 
     DeletionQueue m_deletionQueue;
 
@@ -40,18 +63,24 @@ private:
     VkCommandPool m_immCommandPool{};
 
     VkPhysicalDeviceProperties m_gpuProperties{};
+    VkPipelineCache m_pipelineCache{};
+    std::unique_ptr<ShaderBundle> m_shaderBundle;
     VkDebugUtilsMessengerEXT m_debugMessenger{};
+    bool m_headless;
 
     void createInstance();
     void createLogicalDevice();
     void createSurface(SDL_Window* window);
+    void createPipelineCache();
+    void savePipelineCache() const;
 
     void setupDebugMessenger();
 
     void pickPhysicalDevice();
     bool isDeviceSuitable(VkPhysicalDevice device) const;
 
-    static bool checkDeviceExtensionsSupport(VkPhysicalDevice device);
+    std::vector<const char*> getDeviceExtensions() const;
+    bool checkDeviceExtensionsSupport(VkPhysicalDevice device) const;
     static bool checkValidationLayerSupport(std::vector<const char*>& validationLayers);
     static VkResult createDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger);
     static void destroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
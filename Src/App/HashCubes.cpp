@@ -14,7 +14,6 @@
 #include <imgui_impl_sdl3.h>
 
 constexpr uint32_t numDirectionalLights = 1;
-constexpr uint32_t numPointLights = 0;
 
 HashCubes::HashCubes()
   : m_ctx{std::make_shared<VulkanContext>(m_window.window())},
@@ -23,7 +22,7 @@ HashCubes::HashCubes()
 
   auto &ecs = Ecs::GetInstance();
 
-  init_default_data(m_ctx, m_renderer.GetSwapchain(), m_deletionQueue);
+  init_default_data(m_ctx, m_renderer, m_deletionQueue);
   m_allMeshes = std::make_shared<Scene>(m_ctx, m_deletionQueue, "Assets/meshes/basicmesh.glb");
   m_cubeMesh = std::next(m_allMeshes->m_meshes.begin(), 1)->second;
 
@@ -39,10 +38,6 @@ HashCubes::HashCubes()
   ecs.AddComponents(camera, Camera{}, Controller{});
   ecs.AddComponents(camera, Translation{{0, -10.f, -10.f}}, Rotation{}, Scale{}, LocalToWorld{}, LocalToParent{}, ParentToLocal{}, Parent{}, Children{});
 
-  auto &lightData = m_renderer.GetGpuLightData();
-  lightData.numDirectionalLights = numDirectionalLights;
-  lightData.numPointLights = numPointLights;
-
   // Create directional lights
   std::array<Hori::Entity, numDirectionalLights> directionalLights;
   for (auto &e : directionalLights) {
@@ -58,6 +53,7 @@ HashCubes::HashCubes()
 
 HashCubes::~HashCubes() {
   auto &ecs = Ecs::GetInstance();
+  m_renderer.WaitIdle();
   m_deletionQueue.Flush();
   ecs.Destroy();
 }
@@ -99,7 +95,6 @@ void HashCubes::Run() {
     }
 
     ecs.UpdateSystems(dt);
-    m_renderer.WaitIdle();
     prevTime = currentTime;
     std::cout.flush();
   }
@@ -118,6 +113,7 @@ void HashCubes::initEcs() {
 
   ecs.AddSingletonComponent(FramesPerSecond{});
   ecs.AddSingletonComponent(MouseMode{});
+  ecs.AddSingletonComponent(SpatialIndex{});
 
   ecs.AddSingletonComponent(InputQueue<SDL_KeyboardEvent>());
   ecs.AddSingletonComponent(InputQueue<SDL_MouseButtonEvent>());
@@ -0,0 +1,126 @@
+#include "Headless.h"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <print>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+// Takes WIDTHxHEIGHT
+VkExtent2D parse_extent(std::string_view text) {
+  const size_t separator = text.find('x');
+  if (separator == std::string_view::npos)
+    throw std::runtime_error(std::format("invalid size '{}', expected WIDTHxHEIGHT", text));
+
+  const VkExtent2D extent{parse_uint(text.substr(0, separator), "--size"), parse_uint(text.substr(separator + 1), "--size")};
+  if (extent.width == 0 || extent.height == 0)
+    throw std::runtime_error(std::format("invalid size '{}', both sides must be positive", text));
+  return extent;
+}
+
+} // namespace
+
+uint32_t parse_uint(std::string_view text, std::string_view option) {
+  uint32_t value = 0;
+  const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc{} || end != text.data() + text.size())
+    throw std::runtime_error(std::format("invalid value '{}' for {}", text, option));
+  return value;
+}
+
+std::optional<HeadlessOptions> parse_headless_options(std::span<char *const> args) {
+  if (std::ranges::none_of(args, [](const char *arg) { return std::string_view(arg) == "--headless"; }))
+    return std::nullopt;
+
+  HeadlessOptions options;
+  for (size_t i = 1; i < args.size(); i++) {
+    const std::string_view arg = args[i];
+    if (arg == "--headless") {
+      continue;
+    }
+    if (arg == "--dynamic-resolution") {
+      options.dynamicResolution = true;
+      continue;
+    }
+
+    if (i + 1 == args.size())
+      throw std::runtime_error(std::format("missing value for {}", arg));
+    const std::string_view value = args[++i];
+    if (arg == "--frames")
+      options.frameCount = parse_uint(value, arg);
+    else if (arg == "--warmup")
+      options.warmupFrames = parse_uint(value, arg);
+    else if (arg == "--size")
+      options.extent = parse_extent(value);
+    else if (arg == "--output")
+      options.outputPath = value;
+    else
+      throw std::runtime_error(std::format("unknown option {}", arg));
+  }
+
+  if (options.frameCount == 0)
+    throw std::runtime_error("--frames must be positive");
+  return options;
+}
+
+void write_ppm(const std::filesystem::path &path, VkExtent2D extent, std::span<const uint8_t> rgbaPixels) {
+  if (rgbaPixels.size() != static_cast<size_t>(extent.width) * extent.height * 4) {
+    std::println("No captured frame to write to {}", path.string());
+    return;
+  }
+
+  std::vector<uint8_t> rgb(static_cast<size_t>(extent.width) * extent.height * 3);
+  for (size_t pixel = 0; pixel < rgb.size() / 3; pixel++)
+    std::copy_n(rgbaPixels.data() + pixel * 4, 3, rgb.data() + pixel * 3);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << std::format("P6\n{} {}\n255\n", extent.width, extent.height);
+  file.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+  if (!file.flush())
+    throw std::runtime_error(std::format("failed to write {}!", path.string()));
+  std::println("Wrote the last frame to {}", path.string());
+}
+
+HeadlessReport::HeadlessReport(const HeadlessOptions &options)
+  : m_options{options} {
+}
+
+void HeadlessReport::AddFrame(double cpuMilliseconds, std::span<const GpuScopeTiming> gpuTimings) {
+  if (m_frame++ < m_options.warmupFrames)
+    return;
+
+  m_cpuMilliseconds.push_back(cpuMilliseconds);
+  for (const auto &timing : gpuTimings) {
+    auto scope = std::ranges::find(m_scopes, timing.name, &ScopeTotal::name);
+    if (scope == m_scopes.end()) {
+      m_scopes.push_back({.name = std::string(timing.name), .depth = timing.depth, .milliseconds = 0.0, .count = 0});
+      scope = std::prev(m_scopes.end());
+    }
+    scope->milliseconds += timing.milliseconds;
+    scope->count++;
+  }
+}
+
+void HeadlessReport::Print(const RenderingStats &stats) const {
+  std::println("Rendered {} frames at {}x{}, {} measured after {} warmup frames", m_frame, m_options.extent.width, m_options.extent.height, m_cpuMilliseconds.size(), std::min(m_frame, m_options.warmupFrames));
+  if (!m_cpuMilliseconds.empty()) {
+    std::vector<double> sorted = m_cpuMilliseconds;
+    std::ranges::sort(sorted);
+    const double average = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+    std::println("CPU frame: {:.3f} ms average, {:.3f} ms median, {:.3f} ms min, {:.3f} ms max", average, sorted[sorted.size() / 2], sorted.front(), sorted.back());
+  }
+
+  std::println("GPU time per frame:");
+  for (const auto &scope : m_scopes)
+    std::println("{:{}}{}: {:.3f} ms", "", 2 + 2 * scope.depth, scope.name, scope.milliseconds / static_cast<double>(scope.count));
+
+  std::println("Draw calls: {}", stats.drawcallCount);
+  std::println("Triangles: {}", stats.triangleCount);
+  std::println("Transient memory: {:.1f} MB ({:.1f} MB unaliased)", static_cast<double>(stats.transientMemorySize) / (1024.0 * 1024.0), static_cast<double>(stats.unaliasedMemorySize) / (1024.0 * 1024.0));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/GpuProfiler.h"
+#include "Vulkan/Renderer.h"
+
+// Every headless frame advances the scene by the same time, so runs animate identically
+constexpr float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+
+struct HeadlessOptions {
+  uint32_t frameCount{300};
+  // Leading frames left out of the averages, pipelines and caches are still warming up
+  uint32_t warmupFrames{30};
+  VkExtent2D extent{1600, 900};
+  // The last frame is written here as a binary PPM, nothing is written when empty
+  std::filesystem::path outputPath;
+  bool dynamicResolution{false};
+};
+
+// Throws when text is not a plain unsigned number, option names the argument in the message
+uint32_t parse_uint(std::string_view text, std::string_view option);
+
+// Returns the options when --headless is among the arguments, throws on malformed ones
+std::optional<HeadlessOptions> parse_headless_options(std::span<char *const> args);
+
+void write_ppm(const std::filesystem::path &path, VkExtent2D extent, std::span<const uint8_t> rgbaPixels);
+
+// Averages the CPU time of each frame and the GPU time of each profiler scope
+class HeadlessReport {
+public:
+  explicit HeadlessReport(const HeadlessOptions &options);
+
+  // GPU timings are those of the newest completed frame, they trail the CPU frame by the frames in flight
+  void AddFrame(double cpuMilliseconds, std::span<const GpuScopeTiming> gpuTimings);
+  void Print(const RenderingStats &stats) const;
+
+private:
+  struct ScopeTotal {
+    std::string name;
+    uint32_t depth;
+    double milliseconds;
+    uint32_t count;
+  };
+
+  HeadlessOptions m_options;
+  uint32_t m_frame{0};
+  std::vector<double> m_cpuMilliseconds;
+  // In the order the scopes were first seen, which keeps the nesting of the first measured frame
+  std::vector<ScopeTotal> m_scopes;
+};
@@ -0,0 +1,295 @@
+#include "PrimitivesBench.h"
+
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <print>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "Headless.h"
+#include "Compute/GpuPrimitives.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/GpuProfiler.h"
+#include "Vulkan/VkUtils.h"
+#include "Vulkan/VulkanContext.h"
+
+namespace {
+
+constexpr VkBufferUsageFlags WORK_BUFFER_USAGE = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+constexpr VkDeviceSize WORK_ALIGNMENT = 16;
+
+VkDeviceSize align_up(VkDeviceSize value) {
+  return (value + WORK_ALIGNMENT - 1) & ~(WORK_ALIGNMENT - 1);
+}
+
+// The input is restored to the start of the work buffer before every run, the primitive writes its output right
+// behind it. Both are read back after the last run and checked against the pristine input
+struct BenchCase {
+  std::string_view name;
+  std::vector<uint32_t> input;
+  uint32_t outputWords;
+  VkDeviceSize scratchSize;
+  std::function<void(VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress scratch)> record;
+  std::function<bool(std::span<const uint32_t> input, std::span<const uint32_t> result)> verify;
+};
+
+// Device side of a case, the pristine input stays host visible
+struct CaseBuffers {
+  std::unique_ptr<Buffer> pristine;
+  std::unique_ptr<Buffer> work;
+  std::unique_ptr<Buffer> readback;
+  VkDeviceAddress address;
+  VkDeviceSize dataSize;
+};
+
+struct CaseTimes {
+  double total{0.0};
+  double min{0.0};
+  uint32_t count{0};
+};
+
+std::vector<BenchCase> make_cases(const GpuPrimitives &primitives, uint32_t count) {
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<uint32_t> anyValue;
+  std::uniform_int_distribution<uint32_t> smallValue(0, 255);
+  std::bernoulli_distribution keep(0.5);
+
+  std::vector<uint32_t> scanValues(count);
+  std::ranges::generate(scanValues, [&] { return smallValue(random); });
+
+  std::vector<BenchCase> cases;
+  cases.push_back({
+      .name = "Exclusive scan",
+      .input = scanValues,
+      .outputWords = count,
+      .scratchSize = GpuPrimitives::GetScanScratchSize(count),
+      .record = [&primitives, count](VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress scratch) {
+        primitives.ExclusiveScan(cmd, input, output, count, scratch);
+      },
+      .verify = [count](std::span<const uint32_t> input, std::span<const uint32_t> result) {
+        std::vector<uint32_t> expected(count);
+        std::exclusive_scan(input.begin(), input.end(), expected.begin(), 0u);
+        return std::ranges::equal(result.subspan(count), expected);
+      },
+  });
+  cases.push_back({
+      .name = "Inclusive scan",
+      .input = scanValues,
+      .outputWords = count,
+      .scratchSize = GpuPrimitives::GetScanScratchSize(count),
+      .record = [&primitives, count](VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress scratch) {
+        primitives.InclusiveScan(cmd, input, output, count, scratch);
+      },
+      .verify = [count](std::span<const uint32_t> input, std::span<const uint32_t> result) {
+        std::vector<uint32_t> expected(count);
+        std::inclusive_scan(input.begin(), input.end(), expected.begin());
+        return std::ranges::equal(result.subspan(count), expected);
+      },
+  });
+
+  // Values are their own positions followed by the flags, the kept count lands behind the destination
+  std::vector<uint32_t> compactInput(count * 2);
+  std::iota(compactInput.begin(), compactInput.begin() + count, 0u);
+  std::generate(compactInput.begin() + count, compactInput.end(), [&] { return keep(random) ? 1u : 0u; });
+  cases.push_back({
+      .name = "Compact",
+      .input = std::move(compactInput),
+      .outputWords = count + 1,
+      .scratchSize = GpuPrimitives::GetCompactScratchSize(count),
+      .record = [&primitives, count](VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress scratch) {
+        primitives.Compact(cmd, input, input + count * sizeof(uint32_t), output, output + count * sizeof(uint32_t), count, scratch);
+      },
+      .verify = [count](std::span<const uint32_t> input, std::span<const uint32_t> result) {
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < count; i++) {
+          if (input[count + i] != 0)
+            expected.push_back(input[i]);
+        }
+        const std::span<const uint32_t> destination = result.subspan(count * 2, count);
+        return result[count * 3] == expected.size() && std::ranges::equal(destination.first(expected.size()), expected);
+      },
+  });
+
+  // Keys followed by the values the sort fills with their original positions
+  std::vector<uint32_t> sort32Input(count * 2, 0);
+  std::generate(sort32Input.begin(), sort32Input.begin() + count, [&] { return anyValue(random); });
+  cases.push_back({
+      .name = "Radix sort 32-bit keys",
+      .input = std::move(sort32Input),
+      .outputWords = 0,
+      .scratchSize = GpuPrimitives::GetSortScratchSize(count, RadixKeyWidth::Bits32),
+      .record = [&primitives, count](VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress, VkDeviceAddress scratch) {
+        primitives.RadixSort(cmd, input, input + count * sizeof(uint32_t), count, RadixKeyWidth::Bits32, SortValues::Indices, scratch);
+      },
+      .verify = [count](std::span<const uint32_t> input, std::span<const uint32_t> result) {
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::stable_sort(order, {}, [&](uint32_t i) { return input[i]; });
+        for (uint32_t i = 0; i < count; i++) {
+          if (result[i] != input[order[i]] || result[count + i] != order[i])
+            return false;
+        }
+        return true;
+      },
+  });
+
+  // Keys of two words each, low word first, followed by values carried along
+  std::vector<uint32_t> sort64Input(count * 3);
+  std::ranges::generate(sort64Input, [&] { return anyValue(random); });
+  cases.push_back({
+      .name = "Radix sort 64-bit keys",
+      .input = std::move(sort64Input),
+      .outputWords = 0,
+      .scratchSize = GpuPrimitives::GetSortScratchSize(count, RadixKeyWidth::Bits64),
+      .record = [&primitives, count](VkCommandBuffer cmd, VkDeviceAddress input, VkDeviceAddress, VkDeviceAddress scratch) {
+        primitives.RadixSort(cmd, input, input + count * sizeof(uint64_t), count, RadixKeyWidth::Bits64, SortValues::Keep, scratch);
+      },
+      .verify = [count](std::span<const uint32_t> input, std::span<const uint32_t> result) {
+        auto key = [&](std::span<const uint32_t> words, uint32_t i) {
+          return static_cast<uint64_t>(words[i * 2 + 1]) << 32 | words[i * 2];
+        };
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::stable_sort(order, {}, [&](uint32_t i) { return key(input, i); });
+        for (uint32_t i = 0; i < count; i++) {
+          if (key(result, i) != key(input, order[i]) || result[count * 2 + i] != input[count * 2 + order[i]])
+            return false;
+        }
+        return true;
+      },
+  });
+  return cases;
+}
+
+CaseBuffers create_buffers(const std::shared_ptr<VulkanContext> &ctx, const BenchCase &benchCase) {
+  const VkDeviceSize inputSize = benchCase.input.size() * sizeof(uint32_t);
+  const VkDeviceSize dataSize = inputSize + benchCase.outputWords * sizeof(uint32_t);
+  const VkDeviceSize workSize = align_up(dataSize) + std::max<VkDeviceSize>(benchCase.scratchSize, WORK_ALIGNMENT);
+
+  CaseBuffers buffers{
+      .pristine = std::make_unique<Buffer>(ctx->GetAllocator(), inputSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU),
+      .work = std::make_unique<Buffer>(ctx->GetAllocator(), workSize, WORK_BUFFER_USAGE, VMA_MEMORY_USAGE_GPU_ONLY),
+      .readback = std::make_unique<Buffer>(ctx->GetAllocator(), dataSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU),
+      .address = 0,
+      .dataSize = dataSize,
+  };
+  buffers.pristine->MapMemoryFromVector(benchCase.input);
+  buffers.address = VkUtil::get_buffer_address(ctx->GetDevice(), buffers.work->buffer);
+  return buffers;
+}
+
+void record_run(VkCommandBuffer cmd, GpuProfiler &profiler, std::span<const BenchCase> cases, std::span<const CaseBuffers> buffers, bool readBack) {
+  for (const auto &[benchCase, caseBuffers] : std::views::zip(cases, buffers)) {
+    const VkBufferCopy restore{.srcOffset = 0, .dstOffset = 0, .size = benchCase.input.size() * sizeof(uint32_t)};
+    vkCmdCopyBuffer(cmd, caseBuffers.pristine->buffer, caseBuffers.work->buffer, 1, &restore);
+  }
+  // Also orders this run's writes after the reads of the previous one
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  for (const auto &[benchCase, caseBuffers] : std::views::zip(cases, buffers)) {
+    const uint32_t scope = profiler.BeginScope(cmd, benchCase.name);
+    const VkDeviceAddress output = caseBuffers.address + benchCase.input.size() * sizeof(uint32_t);
+    benchCase.record(cmd, caseBuffers.address, output, caseBuffers.address + align_up(caseBuffers.dataSize));
+    profiler.EndScope(cmd, scope);
+  }
+  if (!readBack)
+    return;
+
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+  for (const auto &caseBuffers : buffers) {
+    const VkBufferCopy copy{.srcOffset = 0, .dstOffset = 0, .size = caseBuffers.dataSize};
+    vkCmdCopyBuffer(cmd, caseBuffers.work->buffer, caseBuffers.readback->buffer, 1, &copy);
+  }
+}
+
+void add_times(std::span<const GpuScopeTiming> timings, std::span<const BenchCase> cases, std::vector<CaseTimes> &times) {
+  for (const auto &timing : timings) {
+    const auto benchCase = std::ranges::find(cases, timing.name, &BenchCase::name);
+    if (benchCase == cases.end())
+      continue;
+
+    CaseTimes &caseTimes = times[std::distance(cases.begin(), benchCase)];
+    caseTimes.min = caseTimes.count == 0 ? timing.milliseconds : std::min(caseTimes.min, timing.milliseconds);
+    caseTimes.total += timing.milliseconds;
+    caseTimes.count++;
+  }
+}
+
+} // namespace
+
+std::optional<PrimitivesBenchOptions> parse_primitives_bench_options(std::span<char *const> args) {
+  if (std::ranges::none_of(args, [](const char *arg) { return std::string_view(arg) == "--bench-primitives"; }))
+    return std::nullopt;
+
+  PrimitivesBenchOptions options;
+  for (size_t i = 1; i < args.size(); i++) {
+    const std::string_view arg = args[i];
+    if (arg == "--bench-primitives")
+      continue;
+
+    if (i + 1 == args.size())
+      throw std::runtime_error(std::format("missing value for {}", arg));
+    const std::string_view value = args[++i];
+    if (arg == "--count")
+      options.count = parse_uint(value, arg);
+    else if (arg == "--iterations")
+      options.iterations = parse_uint(value, arg);
+    else
+      throw std::runtime_error(std::format("unknown option {}", arg));
+  }
+
+  if (options.count == 0 || options.iterations == 0)
+    throw std::runtime_error("--count and --iterations must be positive");
+  return options;
+}
+
+bool RunPrimitivesBench(const PrimitivesBenchOptions &options) {
+  std::shared_ptr<VulkanContext> ctx = std::make_shared<VulkanContext>(nullptr);
+  GpuPrimitives primitives(ctx);
+  GpuProfiler profiler(ctx, 1);
+
+  const std::vector<BenchCase> cases = make_cases(primitives, options.count);
+  std::vector<CaseBuffers> buffers;
+  for (const auto &benchCase : cases)
+    buffers.push_back(create_buffers(ctx, benchCase));
+
+  // Every run collects the timings of the one before, the extra pass at the end only collects
+  std::vector<CaseTimes> times(cases.size());
+  for (uint32_t run = 0; run <= options.iterations; run++) {
+    ctx->ImmediateSubmit([&](VkCommandBuffer cmd) {
+      profiler.BeginFrame(cmd, 0);
+      if (run > 1)
+        add_times(profiler.GetTimings(), cases, times);
+      if (run < options.iterations)
+        record_run(cmd, profiler, cases, buffers, run + 1 == options.iterations);
+    });
+  }
+
+  std::println("GPU primitives on {} values, {} runs", options.count, options.iterations);
+  if (!profiler.IsSupported())
+    std::println("Timestamps are not supported, only the results are checked");
+
+  bool passed = true;
+  for (const auto &[benchCase, caseBuffers, caseTimes] : std::views::zip(cases, buffers, times)) {
+    caseBuffers.readback->Invalidate(0, caseBuffers.dataSize);
+    const std::span<const uint32_t> result(static_cast<const uint32_t *>(caseBuffers.readback->info.pMappedData), caseBuffers.dataSize / sizeof(uint32_t));
+    const bool correct = benchCase.verify(benchCase.input, result);
+    passed = passed && correct;
+
+    if (caseTimes.count == 0)
+      std::println("{}: {}", benchCase.name, correct ? "PASS" : "FAIL");
+    else
+      std::println("{}: {:.3f} ms average, {:.3f} ms min, {}", benchCase.name, caseTimes.total / caseTimes.count, caseTimes.min, correct ? "PASS" : "FAIL");
+  }
+  return passed;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+
+struct PrimitivesBenchOptions {
+  uint32_t count{1 << 20};
+  // The first run of every primitive is left out of the times, it pays for the caches warming up
+  uint32_t iterations{20};
+};
+
+// Returns the options when --bench-primitives is among the arguments, throws on malformed ones
+std::optional<PrimitivesBenchOptions> parse_primitives_bench_options(std::span<char *const> args);
+
+// Times the GPU scans, compaction and radix sorts on random data and checks their results against the standard
+// library. Returns false when any result differs
+bool RunPrimitivesBench(const PrimitivesBenchOptions &options);
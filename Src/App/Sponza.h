@@ -5,6 +5,7 @@
 #include <tracy/Tracy.hpp>
 
 #include "Ecs.h"
+#include "Headless.h"
 #include "Vulkan/Renderer.h"
 #include "SDL/Window.h"
 #include "Systems/RendererSystem.h"
@@ -25,15 +26,16 @@
 constexpr uint32_t numDirectionalLights = 1;
 constexpr uint32_t numPointLights = 1;
 
-inline void RunSponza() {
-  auto &ecs = Ecs::GetInstance();
+// Loaded scenes, they must outlive the frames that draw them
+struct SponzaScene {
+  std::shared_ptr<Scene> allMeshes;
+  std::shared_ptr<Scene> scene;
+};
 
-  Window mainWindow;
-  std::shared_ptr<VulkanContext> ctx = std::make_shared<VulkanContext>(mainWindow.window());
-  Renderer renderer(mainWindow.window(), ctx);
-  DeletionQueue deletionQueue;
+// Everything but input, a headless run has no window to read it from
+inline SponzaScene init_sponza(std::shared_ptr<VulkanContext> ctx, Renderer &renderer, DeletionQueue &deletionQueue) {
+  auto &ecs = Ecs::GetInstance();
 
-  ecs.AddSystem<InputSystem>(InputSystem(mainWindow.window()));
   ecs.AddSystem<CameraSystem>(CameraSystem());
   ecs.AddSystem<MovementSystem>(MovementSystem());
   ecs.AddSystem<TransformSystem>(TransformSystem());
@@ -43,7 +45,8 @@ inline void RunSponza() {
 
   ecs.AddSingletonComponent(FramesPerSecond{});
   ecs.AddSingletonComponent(MouseMode{});
-  init_default_data(ctx, renderer.GetSwapchain(), deletionQueue);
+  ecs.AddSingletonComponent(SpatialIndex{});
+  init_default_data(ctx, renderer, deletionQueue);
 
   // Create object entities
   auto allMeshes = std::make_shared<Scene>(ctx, deletionQueue, "Assets/meshes/basicmesh.glb");
@@ -56,11 +59,6 @@ inline void RunSponza() {
   ecs.AddComponents(camera, Camera{}, Controller{});
   ecs.AddComponents(camera, Translation{{0, -10.f, -10.f}}, Rotation{}, Scale{}, LocalToWorld{}, LocalToParent{}, ParentToLocal{}, Parent{}, Children{});
 
-  // Init lights data
-  auto &lightData = renderer.GetGpuLightData();
-  lightData.numDirectionalLights = numDirectionalLights;
-  lightData.numPointLights = numPointLights;
-
   // Create point lights
   std::array<Hori::Entity, numPointLights> pointLights;
   for (auto &e : pointLights) {
@@ -88,6 +86,20 @@ inline void RunSponza() {
   ecs.AddSingletonComponent(InputQueue<SDL_MouseButtonEvent>());
   ecs.AddSingletonComponent(InputQueue<SDL_MouseMotionEvent>());
 
+  return {allMeshes, scene};
+}
+
+inline void RunSponza() {
+  auto &ecs = Ecs::GetInstance();
+
+  Window mainWindow;
+  std::shared_ptr<VulkanContext> ctx = std::make_shared<VulkanContext>(mainWindow.window());
+  Renderer renderer(mainWindow.window(), ctx);
+  DeletionQueue deletionQueue;
+
+  ecs.AddSystem<InputSystem>(InputSystem(mainWindow.window()));
+  SponzaScene scene = init_sponza(ctx, renderer, deletionQueue);
+
   auto prevTime = std::chrono::high_resolution_clock::now();
   bool running = true;
   SDL_Event event;
@@ -123,12 +135,52 @@ inline void RunSponza() {
     }
 
     ecs.UpdateSystems(dt);
-    renderer.WaitIdle();
     prevTime = currentTime;
     std::cout.flush();
     FrameMark;
   }
 
+  renderer.WaitIdle();
+  deletionQueue.Flush();
+  ecs.Destroy();
+}
+
+// Renders a fixed number of frames with a fixed time step, without a window or SDL video, then prints the
+// averaged timings and optionally writes the last frame
+inline void RunSponzaHeadless(const HeadlessOptions &options) {
+  auto &ecs = Ecs::GetInstance();
+
+  std::shared_ptr<VulkanContext> ctx = std::make_shared<VulkanContext>(nullptr);
+  Renderer renderer(ctx, options.extent);
+  DeletionQueue deletionQueue;
+
+  // Runs are compared with each other, the render size must not follow the frame time
+  DynamicResolutionSettings resolutionSettings = renderer.GetDynamicResolution().GetSettings();
+  resolutionSettings.enabled = options.dynamicResolution;
+  renderer.GetDynamicResolution().SetSettings(resolutionSettings);
+
+  SponzaScene scene = init_sponza(ctx, renderer, deletionQueue);
+  ecs.Each<Camera>([&options](Hori::Entity, Camera &camera) {
+    camera.aspectRatio = glm::ivec2(options.extent.width, options.extent.height);
+  });
+
+  HeadlessReport report(options);
+  for (uint32_t frame = 0; frame < options.frameCount; frame++) {
+    if (frame + 1 == options.frameCount && !options.outputPath.empty())
+      renderer.CaptureFrame();
+
+    const auto frameStart = std::chrono::high_resolution_clock::now();
+    ecs.UpdateSystems(HEADLESS_FRAME_TIME);
+    const auto frameEnd = std::chrono::high_resolution_clock::now();
+    report.AddFrame(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count(), renderer.GetGpuTimings());
+    FrameMark;
+  }
+
+  renderer.WaitIdle();
+  report.Print(renderer.GetRenderingStats());
+  if (!options.outputPath.empty())
+    write_ppm(options.outputPath, options.extent, renderer.ReadCapture());
+
   deletionQueue.Flush();
   ecs.Destroy();
-}
\ No newline at end of file
+}
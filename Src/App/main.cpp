@@ -1,7 +1,33 @@
+#include <print>
+#include <stdexcept>
+
 #include "HashCubes.h"
+#include "PrimitivesBench.h"
 #include "Sponza.h"
 
-int main() {
+// Without arguments the scene opens in a window, --headless renders offscreen:
+// --frames N, --warmup N, --size WIDTHxHEIGHT, --output frame.ppm, --dynamic-resolution
+// --bench-primitives times and checks the GPU scans, compaction and sorts instead: --count N, --iterations N
+int main(int argc, char **argv) {
+    std::optional<HeadlessOptions> headlessOptions;
+    std::optional<PrimitivesBenchOptions> benchOptions;
+    try {
+        benchOptions = parse_primitives_bench_options(std::span(argv, argc));
+        if (!benchOptions)
+            headlessOptions = parse_headless_options(std::span(argv, argc));
+    } catch (const std::runtime_error &error) {
+        std::println("{}", error.what());
+        return 1;
+    }
+
+    if (benchOptions)
+        return RunPrimitivesBench(*benchOptions) ? 0 : 1;
+
+    if (headlessOptions) {
+        RunSponzaHeadless(*headlessOptions);
+        return 0;
+    }
+
     //HashCubes app{};
     //app.Run();
     RunSponza();
@@ -0,0 +1,44 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "../shared/input_structures_indirect.glsl"
+#include "../shared/lighting.glsl"
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 vPosition;
+layout (location = 4) in flat uint inMaterialIndex;
+
+layout (location = 0) out vec4 outAccumulation;
+layout (location = 1) out float outRevealage;
+
+// Weighted blended order-independent transparency. Morgan McGuire, Louis Bavoil. 2013
+// Closer and more opaque fragments weigh more, depth is the standard [0, 1] window depth
+float oit_weight(float alpha, float depth)
+{
+  float a = min(1.0, alpha * 10.0) + 0.01;
+  float d = 1.0 - depth * 0.9;
+  return clamp(a * a * a * 1e8 * d * d * d, 1e-2, 3e3);
+}
+
+void main()
+{
+  vec3 n = normalize(inNormal);
+
+  MaterialData material = materials[inMaterialIndex];
+  vec4 texel = texture(sampler2D(textures[nonuniformEXT(material.colorTexture)], samplers[nonuniformEXT(material.colorSampler)]), inUV);
+  vec3 color = inColor * texel.xyz;
+  float alpha = clamp(material.colorFactors.a * texel.a, 0.0, 1.0);
+
+  // Fully clear fragments would still darken the revealage through the weight floor
+  if (alpha <= 0.0)
+    discard;
+
+  vec3 shaded = shade_surface(material, color, n, vPosition);
+  float w = oit_weight(alpha, gl_FragCoord.z);
+  outAccumulation = vec4(shaded * alpha, alpha) * w;
+  outRevealage = alpha;
+}
@@ -0,0 +1,10 @@
+#version 460
+
+layout (location = 0) in flat uint inInstanceId;
+
+layout (location = 0) out uvec2 outVisibility;
+
+void main()
+{
+    outVisibility = uvec2(inInstanceId, gl_PrimitiveID);
+}
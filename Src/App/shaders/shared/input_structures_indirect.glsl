@@ -1,14 +1,21 @@
 #define MAX_DIRECTIONAL 10
-#define MAX_POINT 10
+#define SHADOW_CASCADES 4
 
 struct DirectionalLight {
     vec4 color;
     vec4 direction;
 };
 
-struct PointLight {
+struct LocalLight {
     vec4 color;
-    vec4 position;
+    vec3 position;
+    float range;
+    vec3 direction;
+    float cosOuterAngle; // Below -1 for point lights
+    float cosInnerAngle;
+    float pad0;
+    float pad1;
+    float pad2;
 };
 
 layout(set = 0, binding = 0) uniform  SceneData {
@@ -21,17 +28,48 @@ layout(set = 0, binding = 0) uniform  SceneData {
 
 layout (set = 0, binding = 1, std430) readonly buffer LightBuffer {
     uint numDirectionalLights;
-    uint numPointLights;
-    uvec2 padding;
+    uint numLocalLights;
+    uint shadowsEnabled;
+    uint padding;
     DirectionalLight directionalLights[MAX_DIRECTIONAL];
-    PointLight pointLights[MAX_POINT];
+    mat4 cascadeViewProj[SHADOW_CASCADES]; // The first directional light casts the cascaded shadows
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
 } lightBuffer;
 
-layout(set = 1, binding = 0) uniform GLTFMaterialData{
+// Point and spot lights binned into view space clusters, see light_cluster.comp
+layout(set = 0, binding = 6, std430) readonly buffer LocalLightBuffer {
+    LocalLight localLights[];
+};
+
+layout(set = 0, binding = 7, std430) readonly buffer ClusterGrid {
+    vec4 params; // znear, zfar, slices / log(zfar / znear)
+    uvec4 dims;
+    uvec2 clusters[]; // Offset and count in the index list
+} clusterGrid;
+
+layout(set = 0, binding = 8, std430) readonly buffer ClusterLightIndices {
+    uint count;
+    uint indices[];
+} clusterLightIndices;
+
+// One layer per cascade, see CascadedShadowMap
+layout(set = 0, binding = 9) uniform sampler2DArrayShadow shadowMap;
+
+// Bindless set, materials pick their textures and samplers by index
+struct MaterialData {
     vec4 colorFactors;
     vec4 metal_rough_factors;
     vec4 specular_color_factors;
-} materialData;
+    uint colorTexture;
+    uint colorSampler;
+    uint metalRoughTexture;
+    uint metalRoughSampler;
+};
+
+layout(set = 1, binding = 0, std430) readonly buffer MaterialBuffer {
+    MaterialData materials[];
+};
 
-layout(set = 1, binding = 1) uniform sampler2D colorTex;
-layout(set = 1, binding = 2) uniform sampler2D metalRoughTex;
\ No newline at end of file
+layout(set = 1, binding = 1) uniform texture2D textures[];
+layout(set = 1, binding = 2) uniform sampler samplers[];
\ No newline at end of file
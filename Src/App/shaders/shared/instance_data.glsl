@@ -0,0 +1,40 @@
+// Instance and draw data of a frame set, either the culled static instances or the frame's dynamic ring section.
+// Requires GL_EXT_buffer_reference
+
+struct Vertex {
+  vec3  position;
+  float uv_x;
+  vec3  normal;
+  float uv_y;
+  vec4  color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer { 
+  Vertex vertices[];
+};
+
+struct DrawData {
+  VertexBuffer vertexBuffer;
+  uint materialIndex;
+  uint padding;
+};
+
+// Filled by the culling pass, holds indices of visible instances grouped per batch
+layout(std430, set = 0, binding = 2) readonly buffer CompactedInstances {
+  uint instanceIndex[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer ObjectData {
+  mat4 model[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer ObjectIds {
+  uint objectId[];
+};
+
+layout(std430, set = 0, binding = 5) readonly buffer DrawDataBuffer {
+  DrawData draws[];
+};
+
+// Marks visibility buffer ids that refer to the dynamic ring instead of the static instance table
+const uint DYNAMIC_INSTANCE_BIT = 0x80000000u;
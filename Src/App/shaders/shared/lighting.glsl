@@ -0,0 +1,85 @@
+// Lighting shared by the forward fragment shader and the visibility resolve, include after input_structures_indirect.glsl
+
+vec3 highlight(MaterialData material, vec3 l, vec3 n, vec3 v) {
+    vec3 r_l = reflect(-l, n);
+    float s = clamp(100.0 * dot(r_l, v) - 97.0, 0.0, 1.0);
+    vec3 highlightColor = (material.specular_color_factors.xyz * material.specular_color_factors.w);
+    return highlightColor * s;
+}
+
+// Fraction of the shadowing directional light that reaches the position, 1 past the last cascade
+float directional_shadow(vec3 position, vec3 n, vec3 l) {
+    float depth = -(sceneData.view * vec4(position, 1.0)).z;
+    uint cascade = 0u;
+    while (cascade < SHADOW_CASCADES && depth > lightBuffer.cascadeSplits[cascade])
+        cascade++;
+    if (cascade == SHADOW_CASCADES)
+        return 1.0;
+
+    // Pushing the lookup along the normal by a texel keeps grazing surfaces from shadowing themselves
+    float texelSize = lightBuffer.cascadeTexelSizes[cascade];
+    vec3 offsetPosition = position + n * texelSize * (1.0 - clamp(dot(n, l), 0.0, 1.0) * 0.5);
+    vec4 clip = lightBuffer.cascadeViewProj[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coords = vec3(clip.xy * 0.5 + 0.5, clip.z);
+
+    // Every tap is already a bilinear 2x2 comparison, 3x3 of them soften the edge further
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    return lit / 9.0;
+}
+
+vec3 shade_surface(MaterialData material, vec3 color, vec3 n, vec3 position) {
+    vec3 v = normalize(sceneData.eyePosition.xyz - position);
+    vec3 result = color * (sceneData.ambientColor.xyz * sceneData.ambientColor.w);
+
+    // Only the lights binned into this position's cluster can reach it
+    uvec4 dims = clusterGrid.dims;
+    if (dims.z != 0u) {
+        vec4 clip = sceneData.viewproj * vec4(position, 1.0);
+        vec2 ndc = clamp(clip.xy / clip.w, vec2(-1.0), vec2(0.999999));
+        float depth = -(sceneData.view * vec4(position, 1.0)).z;
+        float slice = log(max(depth, clusterGrid.params.x) / clusterGrid.params.x) * clusterGrid.params.z;
+        uvec3 cell = min(uvec3(uvec2((ndc * 0.5 + 0.5) * vec2(dims.xy)), uint(slice)), dims.xyz - 1u);
+        uvec2 cluster = clusterGrid.clusters[cell.x + (cell.y + cell.z * dims.y) * dims.x];
+
+        for (uint i = 0u; i < cluster.y; i++) {
+            LocalLight light = localLights[clusterLightIndices.indices[cluster.x + i]];
+
+            vec3 toLight = light.position - position;
+            float distance = length(toLight);
+            vec3 l = toLight / max(distance, 1e-4);
+
+            // Smooth window so the light reaches exactly zero at its range
+            float falloff = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+            float attenuation = falloff * falloff;
+            if (light.cosOuterAngle >= -1.0)
+                attenuation *= smoothstep(light.cosOuterAngle, light.cosInnerAngle, dot(-l, light.direction));
+
+            float NdL = clamp(dot(n, l), 0.0f, 1.0f);
+
+            vec3 diffuse = NdL * light.color.rgb * color;
+            vec3 specular = light.color.rgb * highlight(material, l, n, v);
+
+            result += (diffuse + specular) * attenuation;
+        }
+    }
+
+    for (uint i = 0u; i < lightBuffer.numDirectionalLights; i++) {
+        vec3 lightDir = lightBuffer.directionalLights[i].direction.xyz;
+        vec3 lightColor = lightBuffer.directionalLights[i].color.rgb;
+
+        vec3 l = normalize(lightDir);
+        float NdL = clamp(dot(n, l), 0.0f, 1.0f);
+
+        vec3 diffuse = NdL * lightColor * color;
+        vec3 specular = lightColor * highlight(material, l, n, v);
+
+        float shadow = (i == 0u && lightBuffer.shadowsEnabled != 0u && NdL > 0.0) ? directional_shadow(position, n, l) : 1.0;
+        result += (diffuse + specular) * shadow;
+    }
+
+    return result;
+}
@@ -0,0 +1,45 @@
+// Shared by the parallel primitive kernels, all of them run GROUP_SIZE invocations per workgroup.
+// Requires GL_EXT_buffer_reference
+
+const uint GROUP_SIZE = 256;
+// Values scan.comp and scan_add.comp handle per invocation, a block is GROUP_SIZE times as many
+const uint SCAN_VALUES_PER_INVOCATION = 4;
+// Radix sort digits, one pass sorts by RADIX_BITS bits of the keys
+const uint RADIX_BITS = 8;
+const uint RADIX = 1 << RADIX_BITS;
+
+layout(buffer_reference, std430) buffer UintArray {
+  uint values[];
+};
+
+shared uint scanShared[GROUP_SIZE];
+
+// Inclusive scan of one value per invocation across the workgroup, Hillis-Steele in log2(GROUP_SIZE) steps.
+// Must be reached by every invocation of the workgroup
+uint workgroup_inclusive_scan(uint value)
+{
+  uint lid = gl_LocalInvocationIndex;
+  // Readers of the previous total must be done before it is overwritten
+  barrier();
+  scanShared[lid] = value;
+  barrier();
+  for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1) {
+    uint add = lid >= offset ? scanShared[lid - offset] : 0;
+    barrier();
+    scanShared[lid] += add;
+    barrier();
+  }
+  return scanShared[lid];
+}
+
+// Sum over the whole workgroup of the last scan, valid until the next one starts
+uint workgroup_scan_total()
+{
+  return scanShared[GROUP_SIZE - 1];
+}
+
+// 64-bit keys are two words, low word first. Shifts are multiples of RADIX_BITS, so a digit never spans both
+uint key_digit(UintArray keys, uint index, uint keyWords, uint shift)
+{
+  return (keys.values[index * keyWords + shift / 32] >> (shift % 32)) & (RADIX - 1);
+}
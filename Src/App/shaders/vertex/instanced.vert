@@ -1,54 +1,40 @@
 #version 460
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_nonuniform_qualifier : require
 
 #include "../shared/input_structures_indirect.glsl"
+#include "../shared/instance_data.glsl"
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec3 vPosition;
-layout (location = 4) out flat uint outObjectId;
-
-struct Vertex {
-  vec3  position;
-  float uv_x;
-  vec3  normal;
-  float uv_y;
-  vec4  color;
-};
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer { 
-  Vertex vertices[];
-};
-
-layout(std430, set = 0, binding = 2) readonly buffer CompactedInstances {
-  uint objectId[];
-};
-
-layout(std430, set = 0, binding = 3) readonly buffer ObjectData {
-  mat4 model[];
-};
+layout (location = 4) out flat uint outMaterialIndex;
 
+// Index of the group's first draw, gl_DrawID counts from zero within every multi draw.
+// The instance tag is only read by the visibility pass, both share the push constant layout
 layout(push_constant) uniform PC {
-  VertexBuffer vertexBuffer;
+  uint drawOffset;
+  uint instanceTag;
 } pc;
 
 void main()
 {
-  uint globalInstance = gl_BaseInstance + gl_InstanceIndex;
-  uint obj = objectId[globalInstance];
-  mat4 M = model[obj];
+  // gl_InstanceIndex already includes the draw's firstInstance
+  uint instance = instanceIndex[gl_InstanceIndex];
+  mat4 M = model[instance];
 
-  Vertex v = pc.vertexBuffer.vertices[gl_VertexIndex];
+  DrawData draw = draws[pc.drawOffset + gl_DrawID];
+  Vertex v = draw.vertexBuffer.vertices[gl_VertexIndex];
 
   vec4 position = vec4(v.position, 1.0);
 
   gl_Position = sceneData.viewproj * M * position;
 
   outNormal   = normalize((M * vec4(v.normal, 0.0)).xyz);
-  outColor    = v.color.xyz * materialData.colorFactors.xyz;
+  outColor    = v.color.xyz * materials[draw.materialIndex].colorFactors.xyz;
   outUV       = vec2(v.uv_x, v.uv_y);
   vPosition   = (M * position).xyz;
-  outObjectId = obj;
-}
\ No newline at end of file
+  outMaterialIndex = draw.materialIndex;
+}
@@ -1,37 +1,31 @@
 #version 460
-
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
 
-#include "../shared/input_structures.glsl"
+#include "../shared/instance_data.glsl"
 
 layout (location = 0) flat out uint outObjectId;
 
-struct Vertex {
-    vec3 position;
-    float uv_x;
-    vec3 normal;
-    float uv_y;
-    vec4 color;
+// Merged vertex positions, shared with the shadow depth pass
+layout(std430, set = 1, binding = 0) readonly buffer Positions {
+  float positions[];
 };
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-    Vertex vertices[];
+// Instances whose bounds touch the query's tile, grouped per draw
+layout(std430, set = 1, binding = 1) readonly buffer Candidates {
+  uint candidateInstances[];
 };
 
-layout(push_constant) uniform constants
-{
-    mat4 render_matrix;
-    VertexBuffer vertexBuffer;
-    uint objectId;
-} PushConstants;
+layout(push_constant) uniform PC {
+  mat4 viewProj;
+} pc;
 
 void main()
 {
-    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
-
-    vec4 position = vec4(v.position, 1.0f);
-    gl_Position =  sceneData.viewproj * PushConstants.render_matrix * position;
+  uint base = gl_VertexIndex * 3;
+  vec3 position = vec3(positions[base], positions[base + 1], positions[base + 2]);
 
-    outObjectId = PushConstants.objectId;
+  uint instance = candidateInstances[gl_InstanceIndex];
+  gl_Position = pc.viewProj * model[instance] * vec4(position, 1.0);
+  outObjectId = objectId[instance];
 }
@@ -0,0 +1,29 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "../shared/instance_data.glsl"
+
+// Positions of every merged mesh, tightly packed so the depth pass reads 12 bytes per vertex
+layout(std430, set = 1, binding = 0) readonly buffer Positions {
+  float positions[];
+};
+
+// Instance slots that cast into the cascade, grouped per draw
+layout(std430, set = 1, binding = 1) readonly buffer Casters {
+  uint casterInstances[];
+};
+
+layout(push_constant) uniform PC {
+  mat4 viewProj;
+} pc;
+
+void main()
+{
+  // gl_VertexIndex already includes the draw's vertexOffset into the merged stream
+  uint base = gl_VertexIndex * 3;
+  vec3 position = vec3(positions[base], positions[base + 1], positions[base + 2]);
+
+  uint instance = casterInstances[gl_InstanceIndex];
+  gl_Position = pc.viewProj * model[instance] * vec4(position, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "../shared/input_structures_indirect.glsl"
+#include "../shared/instance_data.glsl"
+
+layout (location = 0) out flat uint outInstanceId;
+
+layout(push_constant) uniform PC {
+  uint drawOffset;
+  uint instanceTag;
+} pc;
+
+// Geometry only, attributes are fetched again by the resolve pass for the one triangle left in each pixel
+void main()
+{
+  uint instance = instanceIndex[gl_InstanceIndex];
+  DrawData draw = draws[pc.drawOffset + gl_DrawID];
+  Vertex v = draw.vertexBuffer.vertices[gl_VertexIndex];
+
+  gl_Position = sceneData.viewproj * model[instance] * vec4(v.position, 1.0);
+  outInstanceId = instance | pc.instanceTag;
+}
@@ -17,7 +17,7 @@
 #include "Assets/utils.h"
 #include "Components/DefaultData.h"
 #include "Vulkan/VkTypes.h"
-#include "Vulkan/Descriptors/DescriptorWriter.h"
+#include "Vulkan/BindlessRegistry.h"
 
 Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, const std::filesystem::path &path)
   : m_ctx{ctx} {
@@ -54,14 +54,6 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
     return;
   }
 
-  std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}
-  };
-
-  m_descriptorAllocator.Init(m_ctx->GetDevice(), gltf.materials.size(), sizes);
-
   for (fastgltf::Sampler &sampler : gltf.samplers) {
     VkSamplerCreateInfo samplerCreateInfo = {
       .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -99,9 +91,7 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
     }
   }
 
-  m_materialDataBuffer = std::make_shared<Buffer>(m_ctx->GetAllocator(), sizeof(ShaderParameters) * gltf.materials.size(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-  int data_index = 0;
-  ShaderParameters *shaderParams = static_cast<ShaderParameters *>(m_materialDataBuffer->info.pMappedData);
+  BindlessRegistry *bindless = defaultData->bindlessRegistry;
   for (fastgltf::Material &mat : gltf.materials) {
     auto newMat = std::make_shared<Material>();
     materials.push_back(newMat);
@@ -115,9 +105,6 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
     if (mat.specular)
       newMat->parameters.specularColorFactors = {mat.specular->specularColorFactor.x(), mat.specular->specularColorFactor.y(), mat.specular->specularColorFactor.z(), mat.specular->specularFactor};
 
-    // write material parameters to buffer
-    shaderParams[data_index] = newMat->parameters;
-
     TransparencyMode passType = TransparencyMode::Opaque;
     if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
       passType = TransparencyMode::Transparent;
@@ -128,17 +115,13 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
       VkSampler colorSampler;
       std::shared_ptr<Texture> metalRoughImage;
       VkSampler metalRoughSampler;
-      VkBuffer dataBuffer;
-      uint32_t dataBufferOffset;
     };
 
     MaterialResources materialResources {
         .colorImage = defaultData->errorTexture,
         .colorSampler = defaultData->samplerLinear,
         .metalRoughImage = defaultData->errorTexture,
-        .metalRoughSampler = defaultData->samplerLinear,
-        .dataBuffer = m_materialDataBuffer->buffer,
-        .dataBufferOffset = static_cast<uint32_t>(data_index * sizeof(ShaderParameters))
+        .metalRoughSampler = defaultData->samplerLinear
     };
 
     if (mat.pbrData.baseColorTexture.has_value()) {
@@ -151,17 +134,19 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
       materialResources.colorSampler = m_samplers[sampler];
     }
 
-    newMat->original = defaultData->opaqueEffectTemplate;
-    newMat->passSets[MeshPassType::Forward] = m_descriptorAllocator.Allocate(m_ctx->GetDevice(), newMat->original->passShaders[MeshPassType::Forward]->effect->descriptorSetLayouts[1]); // Possibly needs a fix here
-
-    DescriptorWriter writer{};
-    writer.Clear();
-    writer.WriteBuffer(0, materialResources.dataBuffer, sizeof(ShaderParameters), materialResources.dataBufferOffset, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.WriteImage(1, materialResources.colorImage->GetView(), materialResources.colorSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.WriteImage(2, materialResources.metalRoughImage->GetView(), materialResources.metalRoughSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.UpdateSet(m_ctx->GetDevice(), newMat->passSets[MeshPassType::Forward]);
-
-    data_index++;
+    newMat->original = passType == TransparencyMode::Transparent ? defaultData->transparentEffectTemplate : defaultData->opaqueEffectTemplate;
+
+    // Textures and samplers shared between materials are registered only once
+    GPUMaterialData materialData{
+        .colorFactors = newMat->parameters.colorFactors,
+        .metalRoughFactors = newMat->parameters.metalRoughFactors,
+        .specularColorFactors = newMat->parameters.specularColorFactors,
+        .colorTexture = bindless->AddTexture(materialResources.colorImage->GetView()),
+        .colorSampler = bindless->AddSampler(materialResources.colorSampler),
+        .metalRoughTexture = bindless->AddTexture(materialResources.metalRoughImage->GetView()),
+        .metalRoughSampler = bindless->AddSampler(materialResources.metalRoughSampler),
+    };
+    newMat->materialIndex = bindless->AddMaterial(materialData);
   }
 
   std::vector<uint32_t> indices;
@@ -318,6 +303,4 @@ Scene::Scene(std::shared_ptr<VulkanContext> ctx, DeletionQueue& deletionQueue, c
   }
 }
 
-Scene::~Scene() {
-  m_descriptorAllocator.DestroyPools(m_ctx->GetDevice());
-}
\ No newline at end of file
+Scene::~Scene() = default;
\ No newline at end of file
@@ -138,7 +138,7 @@ void Texture::createTexture(void *data, VkExtent3D size, VkFormat format, VkImag
   Buffer uploadBuffer(m_allocator, data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
   memcpy(uploadBuffer.info.pMappedData, data, data_size);
-  createImage(usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+  createImage(usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mipmapped);
 
   m_ctx->ImmediateSubmit([&](VkCommandBuffer cmd) {
     VkUtil::transition_image(cmd, m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
@@ -169,7 +169,7 @@ void Texture::createTexture(VkExtent3D size, VkFormat format, VkImageUsageFlags
   m_format = format;
   m_extent = size;
 
-  createImage(usage);
+  createImage(usage, mipmapped);
 
   m_ctx->ImmediateSubmit([&](VkCommandBuffer cmd) {
     VkImageLayout finalLayout = getFinalLayout(format, usage);
@@ -177,8 +177,11 @@ void Texture::createTexture(VkExtent3D size, VkFormat format, VkImageUsageFlags
   });
 }
 
-void Texture::createImage(VkImageUsageFlags usage) {
-  m_mipLevels = static_cast<int>(std::floor(std::log2(std::max(m_extent.width, m_extent.height)))) + 1;
+void Texture::createImage(VkImageUsageFlags usage, bool mipmapped) {
+  // Attachment views must reference a single mip, only allocate the chain when it gets generated
+  m_mipLevels = 1;
+  if (mipmapped)
+    m_mipLevels = static_cast<int>(std::floor(std::log2(std::max(m_extent.width, m_extent.height)))) + 1;
   VkImageCreateInfo imgInfo = VkInit::image_create_info(m_format, usage, m_extent, m_mipLevels);
 
   VmaAllocationCreateInfo allocInfo{
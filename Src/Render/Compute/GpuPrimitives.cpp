@@ -0,0 +1,279 @@
+#include "Compute/GpuPrimitives.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+#include "Vulkan/ComputePipelineBuilder.h"
+#include "Vulkan/VkInit.h"
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+// Must match primitives.glsl
+constexpr uint32_t GROUP_SIZE = 256;
+constexpr uint32_t SCAN_BLOCK_SIZE = GROUP_SIZE * 4;
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX = 1 << RADIX_BITS;
+
+// Keeps every scratch range aligned for 64-bit keys
+constexpr VkDeviceSize SCRATCH_ALIGNMENT = 16;
+
+struct ScanPushConstants {
+  VkDeviceAddress source;
+  VkDeviceAddress destination;
+  VkDeviceAddress blockSums;
+  uint32_t count;
+  uint32_t inclusive;
+  uint32_t countFlags;
+  uint32_t writeBlockSums;
+};
+
+struct ScanAddPushConstants {
+  VkDeviceAddress values;
+  VkDeviceAddress blockOffsets;
+  uint32_t count;
+};
+
+struct CompactPushConstants {
+  VkDeviceAddress values;
+  VkDeviceAddress flags;
+  VkDeviceAddress positions;
+  VkDeviceAddress destination;
+  VkDeviceAddress keptCount;
+  uint32_t count;
+};
+
+struct HistogramPushConstants {
+  VkDeviceAddress keys;
+  VkDeviceAddress histogram;
+  uint32_t count;
+  uint32_t shift;
+  uint32_t keyWords;
+  uint32_t tileCount;
+};
+
+struct ScatterPushConstants {
+  VkDeviceAddress sourceKeys;
+  VkDeviceAddress sourceValues;
+  VkDeviceAddress destinationKeys;
+  VkDeviceAddress destinationValues;
+  VkDeviceAddress offsets;
+  uint32_t count;
+  uint32_t shift;
+  uint32_t keyWords;
+  uint32_t tileCount;
+  uint32_t indexValues;
+};
+
+uint32_t div_up(uint32_t value, uint32_t divisor) {
+  return (value + divisor - 1) / divisor;
+}
+
+VkDeviceSize scratch_range(VkDeviceSize size) {
+  return (size + SCRATCH_ALIGNMENT - 1) & ~(SCRATCH_ALIGNMENT - 1);
+}
+
+uint32_t key_words(RadixKeyWidth width) {
+  return width == RadixKeyWidth::Bits64 ? 2 : 1;
+}
+
+// The kernels take everything through push constants, no descriptor sets
+ComputePipeline create_pipeline(const std::shared_ptr<VulkanContext> &ctx, std::string_view shaderPath, uint32_t pushConstantSize) {
+  VkDevice device = ctx->GetDevice();
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = pushConstantSize,
+  };
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  ComputePipeline pipeline{};
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipeline.layout));
+
+  VkShaderModule shader;
+  if (!ctx->GetShaderBundle().LoadModule(shaderPath, device, &shader))
+    throw std::runtime_error("failed to load parallel primitive shader!");
+
+  ComputePipelineBuilder pipelineBuilder(ctx);
+  pipelineBuilder.SetLayout(pipeline.layout);
+  pipelineBuilder.SetShaders(shader);
+  pipeline.pipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(device, shader, nullptr);
+  return pipeline;
+}
+
+void destroy_pipeline(VkDevice device, const ComputePipeline &pipeline) {
+  vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
+}
+
+template <typename T>
+void dispatch(VkCommandBuffer cmd, const ComputePipeline &pipeline, const T &pushConstants, uint32_t groupCount) {
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+  vkCmdPushConstants(cmd, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(T), &pushConstants);
+  vkCmdDispatch(cmd, groupCount, 1, 1);
+}
+
+void compute_barrier(VkCommandBuffer cmd) {
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
+
+} // namespace
+
+GpuPrimitives::GpuPrimitives(std::shared_ptr<VulkanContext> ctx)
+  : m_ctx{ctx} {
+  m_scanPipeline = create_pipeline(m_ctx, "compute/scan.comp", sizeof(ScanPushConstants));
+  m_scanAddPipeline = create_pipeline(m_ctx, "compute/scan_add.comp", sizeof(ScanAddPushConstants));
+  m_compactPipeline = create_pipeline(m_ctx, "compute/compact.comp", sizeof(CompactPushConstants));
+  m_histogramPipeline = create_pipeline(m_ctx, "compute/radix_histogram.comp", sizeof(HistogramPushConstants));
+  m_scatterPipeline = create_pipeline(m_ctx, "compute/radix_scatter.comp", sizeof(ScatterPushConstants));
+}
+
+GpuPrimitives::~GpuPrimitives() {
+  VkDevice device = m_ctx->GetDevice();
+  destroy_pipeline(device, m_scanPipeline);
+  destroy_pipeline(device, m_scanAddPipeline);
+  destroy_pipeline(device, m_compactPipeline);
+  destroy_pipeline(device, m_histogramPipeline);
+  destroy_pipeline(device, m_scatterPipeline);
+}
+
+// Block totals of every level but the last, each level is scanned like the values above it
+VkDeviceSize GpuPrimitives::GetScanScratchSize(uint32_t count) {
+  const uint32_t blockCount = div_up(count, SCAN_BLOCK_SIZE);
+  if (blockCount <= 1)
+    return 0;
+  return scratch_range(blockCount * sizeof(uint32_t)) + GetScanScratchSize(blockCount);
+}
+
+// Output position of every value, followed by the scan's scratch
+VkDeviceSize GpuPrimitives::GetCompactScratchSize(uint32_t count) {
+  return scratch_range(count * sizeof(uint32_t)) + GetScanScratchSize(count);
+}
+
+// Second copy of the keys and values to sort into, the digit counts of every tile and the scan's scratch for them
+VkDeviceSize GpuPrimitives::GetSortScratchSize(uint32_t count, RadixKeyWidth width) {
+  const uint32_t histogramSize = div_up(count, GROUP_SIZE) * RADIX;
+  return scratch_range(static_cast<VkDeviceSize>(count) * key_words(width) * sizeof(uint32_t)) +
+         scratch_range(count * sizeof(uint32_t)) +
+         scratch_range(histogramSize * sizeof(uint32_t)) +
+         GetScanScratchSize(histogramSize);
+}
+
+void GpuPrimitives::ExclusiveScan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, VkDeviceAddress scratch) const {
+  scan(cmd, source, destination, count, false, false, scratch);
+}
+
+void GpuPrimitives::InclusiveScan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, VkDeviceAddress scratch) const {
+  scan(cmd, source, destination, count, true, false, scratch);
+}
+
+void GpuPrimitives::Compact(VkCommandBuffer cmd, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress destination, VkDeviceAddress keptCount, uint32_t count, VkDeviceAddress scratch) const {
+  if (count == 0)
+    return;
+
+  const VkDeviceAddress positions = scratch;
+  scan(cmd, flags, positions, count, false, true, scratch + scratch_range(count * sizeof(uint32_t)));
+  compute_barrier(cmd);
+
+  const CompactPushConstants pushConstants{
+      .values = values,
+      .flags = flags,
+      .positions = positions,
+      .destination = destination,
+      .keptCount = keptCount,
+      .count = count,
+  };
+  dispatch(cmd, m_compactPipeline, pushConstants, div_up(count, GROUP_SIZE));
+}
+
+void GpuPrimitives::RadixSort(VkCommandBuffer cmd, VkDeviceAddress keys, VkDeviceAddress values, uint32_t count, RadixKeyWidth width, SortValues valueMode, VkDeviceAddress scratch, uint32_t keyBits) const {
+  if (count == 0)
+    return;
+
+  const uint32_t keyWords = key_words(width);
+  const uint32_t tileCount = div_up(count, GROUP_SIZE);
+  const uint32_t histogramSize = tileCount * RADIX;
+
+  const VkDeviceAddress otherKeys = scratch;
+  const VkDeviceAddress otherValues = otherKeys + scratch_range(static_cast<VkDeviceSize>(count) * keyWords * sizeof(uint32_t));
+  const VkDeviceAddress histogram = otherValues + scratch_range(count * sizeof(uint32_t));
+  const VkDeviceAddress scanScratch = histogram + scratch_range(histogramSize * sizeof(uint32_t));
+
+  // Passes alternate between the caller's buffers and the scratch copies, an even count ends in the caller's
+  const uint32_t bitCount = keyBits == 0 ? keyWords * 32 : std::min(keyBits, keyWords * 32);
+  uint32_t passCount = div_up(bitCount, RADIX_BITS);
+  passCount += passCount % 2;
+
+  for (uint32_t pass = 0; pass < passCount; pass++) {
+    const bool fromCaller = pass % 2 == 0;
+    const uint32_t shift = pass * RADIX_BITS;
+
+    const HistogramPushConstants histogramConstants{
+        .keys = fromCaller ? keys : otherKeys,
+        .histogram = histogram,
+        .count = count,
+        .shift = shift,
+        .keyWords = keyWords,
+        .tileCount = tileCount,
+    };
+    dispatch(cmd, m_histogramPipeline, histogramConstants, tileCount);
+    compute_barrier(cmd);
+
+    scan(cmd, histogram, histogram, histogramSize, false, false, scanScratch);
+    compute_barrier(cmd);
+
+    const ScatterPushConstants scatterConstants{
+        .sourceKeys = fromCaller ? keys : otherKeys,
+        .sourceValues = fromCaller ? values : otherValues,
+        .destinationKeys = fromCaller ? otherKeys : keys,
+        .destinationValues = fromCaller ? otherValues : values,
+        .offsets = histogram,
+        .count = count,
+        .shift = shift,
+        .keyWords = keyWords,
+        .tileCount = tileCount,
+        .indexValues = pass == 0 && valueMode == SortValues::Indices ? 1u : 0u,
+    };
+    dispatch(cmd, m_scatterPipeline, scatterConstants, tileCount);
+    if (pass + 1 < passCount)
+      compute_barrier(cmd);
+  }
+}
+
+void GpuPrimitives::scan(VkCommandBuffer cmd, VkDeviceAddress source, VkDeviceAddress destination, uint32_t count, bool inclusive, bool countFlags, VkDeviceAddress scratch) const {
+  if (count == 0)
+    return;
+
+  const uint32_t blockCount = div_up(count, SCAN_BLOCK_SIZE);
+  const ScanPushConstants scanConstants{
+      .source = source,
+      .destination = destination,
+      .blockSums = scratch,
+      .count = count,
+      .inclusive = inclusive ? 1u : 0u,
+      .countFlags = countFlags ? 1u : 0u,
+      .writeBlockSums = blockCount > 1 ? 1u : 0u,
+  };
+  dispatch(cmd, m_scanPipeline, scanConstants, blockCount);
+  if (blockCount == 1)
+    return;
+
+  // The block totals become the offsets of their blocks, their own block totals go to the scratch behind them
+  compute_barrier(cmd);
+  scan(cmd, scratch, scratch, blockCount, false, false, scratch + scratch_range(blockCount * sizeof(uint32_t)));
+  compute_barrier(cmd);
+
+  const ScanAddPushConstants addConstants{
+      .values = destination,
+      .blockOffsets = scratch,
+      .count = count,
+  };
+  dispatch(cmd, m_scanAddPipeline, addConstants, blockCount);
+}
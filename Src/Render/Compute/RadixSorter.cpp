@@ -0,0 +1,92 @@
+#include "Compute/RadixSorter.h"
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+// Large enough that a chunk's counting outweighs handing it to a worker, small enough to spread a frame's draws
+constexpr size_t CHUNK_SIZE = 16384;
+
+uint32_t digit(uint64_t key, uint32_t pass) {
+  return static_cast<uint32_t>(key >> (pass * 8)) & 0xff;
+}
+
+} // namespace
+
+void RadixSorter::Sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &payloads) {
+  const size_t count = keys.size();
+  if (count < 2)
+    return;
+
+  const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  m_chunks.resize(chunkCount);
+  std::iota(m_chunks.begin(), m_chunks.end(), 0);
+  m_chunkCounts.resize(chunkCount);
+  m_keys.resize(count);
+  m_payloads.resize(count);
+
+  // Counts of every byte in one read, they only decide which passes run, later passes recount their chunks
+  std::for_each(std::execution::par, m_chunks.begin(), m_chunks.end(), [&](size_t chunk) {
+    auto &counts = m_chunkCounts[chunk];
+    for (auto &histogram : counts)
+      histogram.fill(0);
+
+    const size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+    for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+      for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+        counts[pass][digit(keys[i], pass)]++;
+    }
+  });
+
+  std::array<bool, PASS_COUNT> skipPass{};
+  for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+    const uint32_t firstDigit = digit(keys[0], pass);
+    uint32_t sharing = 0;
+    for (const auto &counts : m_chunkCounts)
+      sharing += counts[pass][firstDigit];
+    skipPass[pass] = sharing == count;
+  }
+
+  bool countsCurrent = true;
+  for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+    if (skipPass[pass])
+      continue;
+
+    // Every scatter moves elements between chunks, only the first pass can reuse the counts made above
+    if (!countsCurrent) {
+      std::for_each(std::execution::par, m_chunks.begin(), m_chunks.end(), [&](size_t chunk) {
+        auto &histogram = m_chunkCounts[chunk][pass];
+        histogram.fill(0);
+        const size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; i++)
+          histogram[digit(keys[i], pass)]++;
+      });
+    }
+    countsCurrent = false;
+
+    // A chunk writes each digit right after the same digit of the chunks before it, which keeps the sort stable
+    uint32_t offset = 0;
+    for (uint32_t d = 0; d < RADIX; d++) {
+      for (auto &counts : m_chunkCounts) {
+        const uint32_t digitCount = counts[pass][d];
+        counts[pass][d] = offset;
+        offset += digitCount;
+      }
+    }
+
+    std::for_each(std::execution::par, m_chunks.begin(), m_chunks.end(), [&](size_t chunk) {
+      auto &offsets = m_chunkCounts[chunk][pass];
+      const size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+      for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+        const uint32_t destination = offsets[digit(keys[i], pass)]++;
+        m_keys[destination] = keys[i];
+        m_payloads[destination] = payloads[i];
+      }
+    });
+    std::swap(keys, m_keys);
+    std::swap(payloads, m_payloads);
+  }
+}
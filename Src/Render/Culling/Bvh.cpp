@@ -0,0 +1,446 @@
+#include "Culling/Bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <execution>
+#include <numeric>
+#include <ranges>
+
+namespace {
+
+constexpr uint32_t BIN_COUNT = 16;
+constexpr uint32_t MAX_LEAF_SIZE = 4;
+// Nodes above this size bin in parallel chunks, nodes at or below it become one serial subtree build each
+constexpr uint32_t SUBTREE_SIZE = 4096;
+constexpr uint32_t BIN_CHUNK_SIZE = 16384;
+// Traversal stacks start at this size and only grow for unusually deep trees
+constexpr uint32_t STACK_SIZE = 64;
+
+struct Bin {
+  Aabb bounds;
+  uint32_t count{0};
+};
+
+using AxisBins = std::array<std::array<Bin, BIN_COUNT>, 3>;
+
+struct SplitCandidate {
+  uint32_t axis;
+  uint32_t bin;
+  float cost;
+};
+
+struct BuildTask {
+  uint32_t node;
+  uint32_t first;
+  uint32_t count;
+};
+
+class BvhBuilder {
+public:
+  BvhBuilder(std::span<const Aabb> primitives, std::vector<uint32_t> &indices)
+    : m_primitives{primitives},
+      m_indices{indices} {
+    m_centers.resize(primitives.size());
+    std::transform(std::execution::par, primitives.begin(), primitives.end(), m_centers.begin(), [](const Aabb &box) { return box.Center(); });
+  }
+
+  // Splits the node until its children are small enough for a subtree task, those are collected in tasks
+  void BuildTop(std::vector<BvhNode> &nodes, uint32_t nodeIdx, uint32_t first, uint32_t count, std::vector<BuildTask> &tasks) const {
+    if (count <= SUBTREE_SIZE) {
+      tasks.push_back({nodeIdx, first, count});
+      return;
+    }
+
+    const auto [bounds, centerBounds] = computeBounds(first, count, true);
+    setBounds(nodes[nodeIdx], bounds);
+    const uint32_t mid = split(first, count, bounds, centerBounds, true);
+    if (mid == first || mid == first + count) {
+      makeLeaf(nodes[nodeIdx], first, count);
+      return;
+    }
+
+    const auto left = static_cast<uint32_t>(nodes.size());
+    nodes[nodeIdx].leftOrFirst = left;
+    nodes[nodeIdx].count = 0;
+    nodes.resize(nodes.size() + 2);
+    BuildTop(nodes, left, first, mid - first, tasks);
+    BuildTop(nodes, left + 1, mid, first + count - mid, tasks);
+  }
+
+  // Builds a whole subtree into nodes, its root is nodes[0]. Subtrees over disjoint ranges may build concurrently
+  void BuildSubtree(std::vector<BvhNode> &nodes, uint32_t first, uint32_t count) const {
+    nodes.clear();
+    nodes.emplace_back();
+
+    std::vector<BuildTask> stack;
+    stack.reserve(STACK_SIZE);
+    stack.push_back({0, first, count});
+    while (!stack.empty()) {
+      const BuildTask task = stack.back();
+      stack.pop_back();
+      const auto [bounds, centerBounds] = computeBounds(task.first, task.count, false);
+      setBounds(nodes[task.node], bounds);
+
+      const uint32_t mid = task.count <= MAX_LEAF_SIZE ? task.first : split(task.first, task.count, bounds, centerBounds, false);
+      if (mid == task.first || mid == task.first + task.count) {
+        makeLeaf(nodes[task.node], task.first, task.count);
+        continue;
+      }
+
+      const auto left = static_cast<uint32_t>(nodes.size());
+      nodes[task.node].leftOrFirst = left;
+      nodes[task.node].count = 0;
+      nodes.resize(nodes.size() + 2);
+      stack.push_back({left, task.first, mid - task.first});
+      stack.push_back({left + 1, mid, task.first + task.count - mid});
+    }
+  }
+
+private:
+  std::span<const Aabb> m_primitives;
+  std::vector<uint32_t> &m_indices;
+  std::vector<glm::vec3> m_centers;
+
+  static void setBounds(BvhNode &node, const Aabb &bounds) {
+    node.min = bounds.min;
+    node.max = bounds.max;
+  }
+
+  static void makeLeaf(BvhNode &node, uint32_t first, uint32_t count) {
+    node.leftOrFirst = first;
+    node.count = count;
+  }
+
+  // Runs body over [first, first + count) in chunks, each chunk reduces into its own copy of T
+  template <typename T, typename Body, typename Merge>
+  T reduceChunks(uint32_t first, uint32_t count, bool parallel, Body body, Merge merge) const {
+    if (!parallel || count <= BIN_CHUNK_SIZE) {
+      T result{};
+      body(first, first + count, result);
+      return result;
+    }
+
+    const uint32_t chunkCount = (count + BIN_CHUNK_SIZE - 1) / BIN_CHUNK_SIZE;
+    std::vector<uint32_t> chunks(chunkCount);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    std::vector<T> chunkResults(chunkCount);
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32_t chunk) {
+      const uint32_t begin = first + chunk * BIN_CHUNK_SIZE;
+      body(begin, std::min(begin + BIN_CHUNK_SIZE, first + count), chunkResults[chunk]);
+    });
+
+    T result = chunkResults[0];
+    for (uint32_t chunk = 1; chunk < chunkCount; chunk++)
+      merge(result, chunkResults[chunk]);
+    return result;
+  }
+
+  [[nodiscard]] std::pair<Aabb, Aabb> computeBounds(uint32_t first, uint32_t count, bool parallel) const {
+    return reduceChunks<std::pair<Aabb, Aabb>>(first, count, parallel,
+        [&](uint32_t begin, uint32_t end, std::pair<Aabb, Aabb> &bounds) {
+          for (uint32_t i = begin; i < end; i++) {
+            bounds.first.Grow(m_primitives[m_indices[i]]);
+            bounds.second.Grow(m_centers[m_indices[i]]);
+          }
+        },
+        [](std::pair<Aabb, Aabb> &bounds, const std::pair<Aabb, Aabb> &other) {
+          bounds.first.Grow(other.first);
+          bounds.second.Grow(other.second);
+        });
+  }
+
+  // Partitions the range on the cheapest SAH plane and returns the first index of the right side. Returns
+  // first when a leaf is cheaper, a range too large for a leaf is split at its middle instead
+  uint32_t split(uint32_t first, uint32_t count, const Aabb &bounds, const Aabb &centerBounds, bool parallel) const {
+    const glm::vec3 extent = centerBounds.max - centerBounds.min;
+    const glm::vec3 binScale{
+        extent.x > 0.0f ? BIN_COUNT / extent.x : 0.0f,
+        extent.y > 0.0f ? BIN_COUNT / extent.y : 0.0f,
+        extent.z > 0.0f ? BIN_COUNT / extent.z : 0.0f,
+    };
+    auto binOf = [&](uint32_t primitive, uint32_t axis) {
+      const auto bin = static_cast<uint32_t>((m_centers[primitive][axis] - centerBounds.min[axis]) * binScale[axis]);
+      return std::min(bin, BIN_COUNT - 1);
+    };
+
+    const AxisBins bins = reduceChunks<AxisBins>(first, count, parallel,
+        [&](uint32_t begin, uint32_t end, AxisBins &bins) {
+          for (uint32_t i = begin; i < end; i++) {
+            for (uint32_t axis = 0; axis < 3; axis++) {
+              Bin &bin = bins[axis][binOf(m_indices[i], axis)];
+              bin.bounds.Grow(m_primitives[m_indices[i]]);
+              bin.count++;
+            }
+          }
+        },
+        [](AxisBins &bins, const AxisBins &other) {
+          for (uint32_t axis = 0; axis < 3; axis++) {
+            for (uint32_t bin = 0; bin < BIN_COUNT; bin++) {
+              bins[axis][bin].bounds.Grow(other[axis][bin].bounds);
+              bins[axis][bin].count += other[axis][bin].count;
+            }
+          }
+        });
+
+    // Sweeps the planes between bins, the cost of a side is its box area times its primitive count
+    SplitCandidate best{0, 0, std::numeric_limits<float>::max()};
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      if (binScale[axis] == 0.0f)
+        continue;
+
+      std::array<float, BIN_COUNT - 1> leftCosts;
+      Aabb leftBounds;
+      uint32_t leftCount = 0;
+      for (uint32_t plane = 0; plane < BIN_COUNT - 1; plane++) {
+        leftBounds.Grow(bins[axis][plane].bounds);
+        leftCount += bins[axis][plane].count;
+        leftCosts[plane] = leftCount > 0 ? leftBounds.HalfArea() * leftCount : 0.0f;
+      }
+
+      Aabb rightBounds;
+      uint32_t rightCount = 0;
+      for (uint32_t plane = BIN_COUNT - 1; plane > 0; plane--) {
+        rightBounds.Grow(bins[axis][plane].bounds);
+        rightCount += bins[axis][plane].count;
+        const float cost = leftCosts[plane - 1] + (rightCount > 0 ? rightBounds.HalfArea() * rightCount : 0.0f);
+        if (rightCount > 0 && rightCount < count && cost < best.cost)
+          best = {axis, plane, cost};
+      }
+    }
+
+    auto *begin = m_indices.data() + first;
+    auto *end = begin + count;
+    if (best.cost == std::numeric_limits<float>::max()) {
+      // Every center coincides, only a forced split keeps the leaves small
+      return count <= MAX_LEAF_SIZE ? first : first + count / 2;
+    }
+    if (count <= MAX_LEAF_SIZE * 4 && best.cost >= bounds.HalfArea() * count)
+      return first;
+
+    auto *mid = std::partition(begin, end, [&](uint32_t primitive) { return binOf(primitive, best.axis) < best.bin; });
+    return first + static_cast<uint32_t>(mid - begin);
+  }
+};
+
+// Slab test, returns the entry distance or infinity on a miss
+float intersect_box(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax) {
+  const glm::vec3 t0 = (min - origin) * invDirection;
+  const glm::vec3 t1 = (max - origin) * invDirection;
+  const glm::vec3 tNear = glm::min(t0, t1);
+  const glm::vec3 tFar = glm::max(t0, t1);
+  const float entry = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+  const float exit = std::min({tFar.x, tFar.y, tFar.z, tMax});
+  return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+}
+
+bool contains_point(const Aabb &box, const glm::vec3 &point) {
+  return glm::all(glm::greaterThanEqual(point, box.min)) && glm::all(glm::lessThanEqual(point, box.max));
+}
+
+bool sphere_overlaps_box(const BoundingSphere &sphere, const glm::vec3 &min, const glm::vec3 &max) {
+  const glm::vec3 closest = glm::clamp(sphere.center, min, max);
+  const glm::vec3 delta = closest - sphere.center;
+  return glm::dot(delta, delta) <= sphere.radius * sphere.radius;
+}
+
+// A box is outside when its corner furthest along a plane normal is still behind the plane
+bool frustum_overlaps_box(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max) {
+  for (const auto &plane : frustum.planes) {
+    const glm::vec3 corner{plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+template <typename Query>
+void for_each_query(size_t queryCount, Query query) {
+  std::vector<uint32_t> queries(queryCount);
+  std::iota(queries.begin(), queries.end(), 0);
+  std::for_each(std::execution::par, queries.begin(), queries.end(), query);
+}
+
+} // namespace
+
+void Aabb::Grow(const glm::vec3 &point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void Aabb::Grow(const Aabb &other) {
+  min = glm::min(min, other.min);
+  max = glm::max(max, other.max);
+}
+
+glm::vec3 Aabb::Center() const {
+  return (min + max) * 0.5f;
+}
+
+float Aabb::HalfArea() const {
+  const glm::vec3 extent = max - min;
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+bool Aabb::Empty() const {
+  return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+Aabb Aabb::Transform(const glm::vec3 &center, const glm::vec3 &extents, const glm::mat4 &transform) {
+  // Each world axis extent is the sum of the local extents projected on it
+  const glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+  const glm::mat3 absolute{glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2]))};
+  const glm::vec3 worldExtents = absolute * extents;
+  return {worldCenter - worldExtents, worldCenter + worldExtents};
+}
+
+void Bvh::Build(std::span<const Aabb> primitives) {
+  Clear();
+  if (primitives.empty())
+    return;
+
+  const auto primitiveCount = static_cast<uint32_t>(primitives.size());
+  m_primitiveIndices.resize(primitiveCount);
+  std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+
+  BvhBuilder builder(primitives, m_primitiveIndices);
+  std::vector<BuildTask> tasks;
+  m_nodes.resize(1);
+  builder.BuildTop(m_nodes, 0, 0, primitiveCount, tasks);
+
+  // Subtrees own disjoint index ranges, they are built side by side and appended in task order
+  std::vector<std::vector<BvhNode>> subtrees(tasks.size());
+  std::vector<uint32_t> taskIndices(tasks.size());
+  std::iota(taskIndices.begin(), taskIndices.end(), 0);
+  std::for_each(std::execution::par, taskIndices.begin(), taskIndices.end(), [&](uint32_t task) {
+    builder.BuildSubtree(subtrees[task], tasks[task].first, tasks[task].count);
+  });
+
+  for (const auto &[task, subtree] : std::views::zip(tasks, subtrees)) {
+    // The subtree root replaces the placeholder, its other nodes move to the end
+    const auto base = static_cast<uint32_t>(m_nodes.size()) - 1;
+    auto relocate = [base](BvhNode node) {
+      if (node.count == 0)
+        node.leftOrFirst += base;
+      return node;
+    };
+    m_nodes[task.node] = relocate(subtree[0]);
+    std::transform(subtree.begin() + 1, subtree.end(), std::back_inserter(m_nodes), relocate);
+  }
+
+  m_primitiveBounds.resize(primitiveCount);
+  std::transform(m_primitiveIndices.begin(), m_primitiveIndices.end(), m_primitiveBounds.begin(), [&](uint32_t primitive) { return primitives[primitive]; });
+}
+
+void Bvh::Clear() {
+  m_nodes.clear();
+  m_primitiveIndices.clear();
+  m_primitiveBounds.clear();
+}
+
+void Bvh::IntersectRays(std::span<const Ray> rays, std::span<RayHit> hits, const RayPrimitiveTest &test) const {
+  for_each_query(rays.size(), [&](uint32_t query) {
+    const Ray &ray = rays[query];
+    RayHit &hit = hits[query];
+    hit = {};
+    if (m_nodes.empty())
+      return;
+
+    const glm::vec3 invDirection = 1.0f / ray.direction;
+    if (intersect_box(m_nodes[0].min, m_nodes[0].max, ray.origin, invDirection, ray.tMax) == std::numeric_limits<float>::infinity())
+      return;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(STACK_SIZE);
+    uint32_t nodeIdx = 0;
+    while (true) {
+      const BvhNode &node = m_nodes[nodeIdx];
+      if (node.count > 0) {
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+          const Aabb &box = m_primitiveBounds[i];
+          const float tMax = std::min(ray.tMax, hit.t);
+          float t = intersect_box(box.min, box.max, ray.origin, invDirection, tMax);
+          if (t == std::numeric_limits<float>::infinity())
+            continue;
+          // The entry is clamped to the origin, a box around it would always be the nearest
+          if (test)
+            t = test(m_primitiveIndices[i], ray, tMax);
+          else if (contains_point(box, ray.origin))
+            continue;
+          if (t < hit.t)
+            hit = {m_primitiveIndices[i], t};
+        }
+      } else {
+        // The nearer child is visited first, the other one is skipped once a closer hit exists
+        uint32_t nearIdx = node.leftOrFirst;
+        uint32_t farIdx = node.leftOrFirst + 1;
+        const float tMax = std::min(ray.tMax, hit.t);
+        float tNear = intersect_box(m_nodes[nearIdx].min, m_nodes[nearIdx].max, ray.origin, invDirection, tMax);
+        float tFar = intersect_box(m_nodes[farIdx].min, m_nodes[farIdx].max, ray.origin, invDirection, tMax);
+        if (tFar < tNear) {
+          std::swap(nearIdx, farIdx);
+          std::swap(tNear, tFar);
+        }
+
+        if (tNear != std::numeric_limits<float>::infinity()) {
+          if (tFar != std::numeric_limits<float>::infinity())
+            stack.push_back(farIdx);
+          nodeIdx = nearIdx;
+          continue;
+        }
+      }
+
+      // Popped nodes may lie behind a hit found since they were pushed
+      do {
+        if (stack.empty())
+          return;
+        nodeIdx = stack.back();
+        stack.pop_back();
+      } while (intersect_box(m_nodes[nodeIdx].min, m_nodes[nodeIdx].max, ray.origin, invDirection, std::min(ray.tMax, hit.t)) == std::numeric_limits<float>::infinity());
+    }
+  });
+}
+
+void Bvh::OverlapSpheres(std::span<const BoundingSphere> spheres, std::vector<std::vector<uint32_t>> &results) const {
+  results.resize(spheres.size());
+  for_each_query(spheres.size(), [&](uint32_t query) {
+    overlap([&](const glm::vec3 &min, const glm::vec3 &max) { return sphere_overlaps_box(spheres[query], min, max); }, results[query]);
+  });
+}
+
+void Bvh::OverlapFrustums(std::span<const Frustum> frustums, std::vector<std::vector<uint32_t>> &results) const {
+  results.resize(frustums.size());
+  for_each_query(frustums.size(), [&](uint32_t query) {
+    overlap([&](const glm::vec3 &min, const glm::vec3 &max) { return frustum_overlaps_box(frustums[query], min, max); }, results[query]);
+  });
+}
+
+uint32_t Bvh::GetPrimitiveCount() const { return static_cast<uint32_t>(m_primitiveIndices.size()); }
+uint32_t Bvh::GetNodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+
+template <typename Overlaps>
+void Bvh::overlap(const Overlaps &overlaps, std::vector<uint32_t> &result) const {
+  result.clear();
+  if (m_nodes.empty())
+    return;
+
+  std::vector<uint32_t> stack;
+  stack.reserve(STACK_SIZE);
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const BvhNode &node = m_nodes[stack.back()];
+    stack.pop_back();
+    if (!overlaps(node.min, node.max))
+      continue;
+
+    if (node.count == 0) {
+      stack.push_back(node.leftOrFirst);
+      stack.push_back(node.leftOrFirst + 1);
+      continue;
+    }
+    for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+      if (overlaps(m_primitiveBounds[i].min, m_primitiveBounds[i].max))
+        result.push_back(m_primitiveIndices[i]);
+    }
+  }
+  std::ranges::sort(result);
+}
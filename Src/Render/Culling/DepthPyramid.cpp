@@ -0,0 +1,200 @@
+#include "Culling/DepthPyramid.h"
+
+#include <bit>
+#include <stdexcept>
+
+#include "Vulkan/ComputePipelineBuilder.h"
+#include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
+#include "Vulkan/Descriptors/DescriptorWriter.h"
+#include "Vulkan/VkInit.h"
+#include "Vulkan/VkUtils.h"
+
+struct DepthReducePushConstants {
+  glm::vec2 outSize;
+};
+
+DepthPyramid::DepthPyramid(std::shared_ptr<VulkanContext> ctx, VkExtent2D depthExtent)
+  : m_ctx{ctx},
+    m_depthExtent{depthExtent} {
+  createPipeline();
+  createImage();
+}
+
+DepthPyramid::~DepthPyramid() {
+  destroyImage();
+
+  VkDevice device = m_ctx->GetDevice();
+  m_descriptorAllocator.DestroyPools(device);
+  vkDestroyPipeline(device, m_reducePipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(device, m_reducePipeline.layout, nullptr);
+  vkDestroyDescriptorSetLayout(device, m_descriptorLayout, nullptr);
+  vkDestroySampler(device, m_reductionSampler, nullptr);
+}
+
+void DepthPyramid::Resize(VkExtent2D depthExtent) {
+  destroyImage();
+  m_depthExtent = depthExtent;
+  createImage();
+}
+
+void DepthPyramid::SetDepthView(VkImageView depthView) {
+  m_depthView = depthView;
+  writeDepthDescriptor();
+}
+
+void DepthPyramid::Build(VkCommandBuffer cmd) {
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipeline.pipeline);
+
+  for (uint32_t mip = 0; mip < m_mipLevels; mip++) {
+    const uint32_t width = std::max(m_extent.width >> mip, 1u);
+    const uint32_t height = std::max(m_extent.height >> mip, 1u);
+
+    DepthReducePushConstants pushConstants{
+        .outSize = glm::vec2(width, height),
+    };
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipeline.layout, 0, 1, &m_descriptorSets[mip], 0, nullptr);
+    vkCmdPushConstants(cmd, m_reducePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &pushConstants);
+    vkCmdDispatch(cmd, (width + 31) / 32, (height + 31) / 32, 1);
+
+    VkUtil::memory_barrier(cmd,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+  }
+}
+
+VkImageView DepthPyramid::GetView() const { return m_view; }
+VkSampler DepthPyramid::GetSampler() const { return m_reductionSampler; }
+VkExtent2D DepthPyramid::GetExtent() const { return m_extent; }
+
+void DepthPyramid::createPipeline() {
+  VkDevice device = m_ctx->GetDevice();
+
+  // Linear filtering with a max reduction returns the farthest of the 2x2 texels under the sample
+  VkSamplerReductionModeCreateInfo reductionInfo{
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO,
+      .reductionMode = VK_SAMPLER_REDUCTION_MODE_MAX,
+  };
+
+  VkSamplerCreateInfo samplerInfo{
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      .pNext = &reductionInfo,
+      .magFilter = VK_FILTER_LINEAR,
+      .minFilter = VK_FILTER_LINEAR,
+      .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+      .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .minLod = 0.0f,
+      .maxLod = 16.0f,
+  };
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_reductionSampler));
+
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    m_descriptorLayout = builder.Build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+  }
+
+  std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+  };
+  m_descriptorAllocator.Init(device, 16, sizes);
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(DepthReducePushConstants),
+  };
+
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &m_descriptorLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_reducePipeline.layout));
+
+  VkShaderModule reduceShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("compute/depth_reduce.comp", device, &reduceShader))
+    throw std::runtime_error("failed to load depth reduce shader!");
+
+  ComputePipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetLayout(m_reducePipeline.layout);
+  pipelineBuilder.SetShaders(reduceShader);
+  m_reducePipeline.pipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(device, reduceShader, nullptr);
+}
+
+void DepthPyramid::createImage() {
+  VkDevice device = m_ctx->GetDevice();
+
+  // Power of two size so every level halves exactly and a 2x2 footprint never misses a texel
+  m_extent = {
+      .width = std::bit_floor(m_depthExtent.width),
+      .height = std::bit_floor(m_depthExtent.height),
+  };
+  m_mipLevels = std::bit_width(std::max(m_extent.width, m_extent.height));
+
+  VkImageCreateInfo imgInfo = VkInit::image_create_info(VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, {m_extent.width, m_extent.height, 1}, m_mipLevels);
+  // Built and read by culling, which runs on the compute queue when the device has one
+  VkUtil::set_queue_families(imgInfo, m_ctx->GetSharedQueueFamilies());
+  VmaAllocationCreateInfo allocInfo{
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  VK_CHECK(vmaCreateImage(m_ctx->GetAllocator(), &imgInfo, &allocInfo, &m_image, &m_allocation, nullptr));
+
+  VkImageViewCreateInfo viewInfo = VkInit::imageview_create_info(VK_FORMAT_R32_SFLOAT, m_image, VK_IMAGE_ASPECT_COLOR_BIT);
+  viewInfo.subresourceRange.levelCount = m_mipLevels;
+  VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &m_view));
+
+  m_mipViews.resize(m_mipLevels);
+  for (uint32_t mip = 0; mip < m_mipLevels; mip++) {
+    VkImageViewCreateInfo mipViewInfo = VkInit::imageview_create_info(VK_FORMAT_R32_SFLOAT, m_image, VK_IMAGE_ASPECT_COLOR_BIT);
+    mipViewInfo.subresourceRange.baseMipLevel = mip;
+    VK_CHECK(vkCreateImageView(device, &mipViewInfo, nullptr, &m_mipViews[mip]));
+  }
+
+  // Mip 0 reduces the depth attachment once its view is known, every other mip reduces the previous one
+  m_descriptorSets.resize(m_mipLevels);
+  for (uint32_t mip = 0; mip < m_mipLevels; mip++) {
+    m_descriptorSets[mip] = m_descriptorAllocator.Allocate(device, m_descriptorLayout);
+
+    DescriptorWriter writer;
+    if (mip > 0)
+      writer.WriteImage(0, m_mipViews[mip - 1], m_reductionSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.WriteImage(1, m_mipViews[mip], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.UpdateSet(device, m_descriptorSets[mip]);
+  }
+  if (m_depthView != VK_NULL_HANDLE)
+    writeDepthDescriptor();
+
+  // The pyramid stays in GENERAL, it is both written as storage and sampled
+  m_ctx->ImmediateSubmit([&](VkCommandBuffer cmd) {
+    VkUtil::transition_image(cmd, m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  });
+}
+
+void DepthPyramid::destroyImage() {
+  VkDevice device = m_ctx->GetDevice();
+
+  for (auto view : m_mipViews)
+    vkDestroyImageView(device, view, nullptr);
+  m_mipViews.clear();
+
+  vkDestroyImageView(device, m_view, nullptr);
+  vmaDestroyImage(m_ctx->GetAllocator(), m_image, m_allocation);
+  m_view = VK_NULL_HANDLE;
+  m_image = VK_NULL_HANDLE;
+
+  m_descriptorAllocator.ClearPools(device);
+  m_descriptorSets.clear();
+}
+
+void DepthPyramid::writeDepthDescriptor() {
+  DescriptorWriter writer;
+  writer.WriteImage(0, m_depthView, m_reductionSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  writer.UpdateSet(m_ctx->GetDevice(), m_descriptorSets[0]);
+}
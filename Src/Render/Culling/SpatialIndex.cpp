@@ -0,0 +1,75 @@
+#include "Culling/SpatialIndex.h"
+
+#include <ranges>
+
+void SpatialIndex::SetStaticObjects(std::span<const Aabb> bounds, std::span<const uint32_t> objectIds) {
+  m_staticBvh.Build(bounds);
+  m_staticObjectIds.assign(objectIds.begin(), objectIds.end());
+}
+
+void SpatialIndex::SetDynamicObjects(std::span<const Aabb> bounds, std::span<const uint32_t> objectIds) {
+  m_dynamicBvh.Build(bounds);
+  m_dynamicObjectIds.assign(objectIds.begin(), objectIds.end());
+}
+
+void SpatialIndex::CastRays(std::span<const Ray> rays, std::span<SpatialRayHit> hits, const SpatialRayTest &test) const {
+  // Each tree hands the test its own primitives, both are mapped to object ids first
+  auto objectTest = [&test](const std::vector<uint32_t> &objectIds) -> RayPrimitiveTest {
+    if (!test)
+      return {};
+    return [&test, &objectIds](uint32_t primitive, const Ray &ray, float tMax) { return test(objectIds[primitive], ray, tMax); };
+  };
+
+  std::vector<RayHit> staticHits(rays.size());
+  std::vector<RayHit> dynamicHits(rays.size());
+  m_staticBvh.IntersectRays(rays, staticHits, objectTest(m_staticObjectIds));
+  m_dynamicBvh.IntersectRays(rays, dynamicHits, objectTest(m_dynamicObjectIds));
+
+  for (const auto &[hit, staticHit, dynamicHit] : std::views::zip(hits, staticHits, dynamicHits)) {
+    hit = {};
+    if (staticHit.primitive != INVALID_PRIMITIVE)
+      hit = {m_staticObjectIds[staticHit.primitive], staticHit.t};
+    if (dynamicHit.primitive != INVALID_PRIMITIVE && dynamicHit.t < hit.t)
+      hit = {m_dynamicObjectIds[dynamicHit.primitive], dynamicHit.t};
+  }
+}
+
+void SpatialIndex::OverlapSpheres(std::span<const BoundingSphere> spheres, std::vector<std::vector<uint32_t>> &results) const {
+  std::vector<std::vector<uint32_t>> dynamicResults;
+  m_staticBvh.OverlapSpheres(spheres, results);
+  m_dynamicBvh.OverlapSpheres(spheres, dynamicResults);
+  mergeResults(results, dynamicResults);
+}
+
+void SpatialIndex::OverlapFrustums(std::span<const Frustum> frustums, std::vector<std::vector<uint32_t>> &results) const {
+  std::vector<std::vector<uint32_t>> dynamicResults;
+  m_staticBvh.OverlapFrustums(frustums, results);
+  m_dynamicBvh.OverlapFrustums(frustums, dynamicResults);
+  mergeResults(results, dynamicResults);
+}
+
+Ray SpatialIndex::ScreenRay(glm::vec2 pixel, glm::vec2 viewportSize, const glm::mat4 &viewProj) {
+  // Vulkan clip space, y points down like the pixel rows
+  const glm::vec2 ndc = (pixel + 0.5f) / viewportSize * 2.0f - 1.0f;
+  const glm::mat4 invViewProj = glm::inverse(viewProj);
+  const glm::vec4 nearPoint = invViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+  const glm::vec4 farPoint = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+
+  const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+  const glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+  return {
+      .origin = origin,
+      .tMax = glm::length(target - origin),
+      .direction = glm::normalize(target - origin),
+  };
+}
+
+void SpatialIndex::mergeResults(std::vector<std::vector<uint32_t>> &results, const std::vector<std::vector<uint32_t>> &dynamicResults) const {
+  // Trees report primitives, both are mapped to the object ids they were built with
+  for (const auto &[objects, dynamicPrimitives] : std::views::zip(results, dynamicResults)) {
+    for (uint32_t &object : objects)
+      object = m_staticObjectIds[object];
+    for (uint32_t primitive : dynamicPrimitives)
+      objects.push_back(m_dynamicObjectIds[primitive]);
+  }
+}
@@ -0,0 +1,113 @@
+#include "Culling/SphereCuller.h"
+
+#include <algorithm>
+#include <bit>
+#include <execution>
+#include <numeric>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t CHUNK_SIZE = 4096;
+
+void cull_range_scalar(const Frustum &frustum, const SphereBoundsSoA &bounds, size_t begin, size_t end, std::vector<uint32_t> &out) {
+  for (size_t i = begin; i < end; i++) {
+    glm::vec3 center{bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]};
+    if (frustum.IntersectsSphere(center, bounds.radius[i]))
+      out.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+#if defined(__AVX2__)
+void cull_range_avx2(const Frustum &frustum, const SphereBoundsSoA &bounds, size_t begin, size_t end, std::vector<uint32_t> &out) {
+  __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (size_t p = 0; p < frustum.planes.size(); p++) {
+    planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+    __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+    __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+    __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.radius[i]));
+
+    // A sphere is outside when it lies fully behind any plane
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (size_t p = 0; p < 6; p++) {
+      __m256 dist = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)),
+          _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negRadius, _CMP_GE_OQ));
+    }
+
+    auto mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+    while (mask != 0) {
+      out.push_back(static_cast<uint32_t>(i + std::countr_zero(mask)));
+      mask &= mask - 1;
+    }
+  }
+
+  cull_range_scalar(frustum, bounds, i, end, out);
+}
+#endif
+
+}
+
+void SphereBoundsSoA::Clear() {
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  radius.clear();
+}
+
+void SphereBoundsSoA::Resize(size_t count) {
+  centerX.resize(count);
+  centerY.resize(count);
+  centerZ.resize(count);
+  radius.resize(count);
+}
+
+void SphereBoundsSoA::Set(size_t idx, const glm::vec3 &center, float sphereRadius) {
+  centerX[idx] = center.x;
+  centerY[idx] = center.y;
+  centerZ[idx] = center.z;
+  radius[idx] = sphereRadius;
+}
+
+size_t SphereBoundsSoA::Size() const {
+  return radius.size();
+}
+
+void SphereCuller::Cull(const Frustum &frustum, const SphereBoundsSoA &bounds, std::vector<uint32_t> &visible) {
+  const size_t count = bounds.Size();
+  const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+  m_chunks.resize(chunkCount);
+  std::iota(m_chunks.begin(), m_chunks.end(), 0);
+  m_chunkResults.resize(chunkCount);
+
+  std::for_each(std::execution::par, m_chunks.begin(), m_chunks.end(), [&](size_t chunk) {
+    const size_t begin = chunk * CHUNK_SIZE;
+    const size_t end = std::min(begin + CHUNK_SIZE, count);
+
+    auto &out = m_chunkResults[chunk];
+    out.clear();
+#if defined(__AVX2__)
+    cull_range_avx2(frustum, bounds, begin, end, out);
+#else
+    cull_range_scalar(frustum, bounds, begin, end, out);
+#endif
+  });
+
+  // Chunks cover ascending ranges, concatenating them keeps the batch order intact
+  visible.clear();
+  for (const auto &chunkResult : m_chunkResults)
+    visible.insert(visible.end(), chunkResult.begin(), chunkResult.end());
+}
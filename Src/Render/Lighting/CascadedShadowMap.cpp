@@ -0,0 +1,380 @@
+#include "Lighting/CascadedShadowMap.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
+#include "Vulkan/Descriptors/DescriptorWriter.h"
+#include "Vulkan/PipelineBuilder.h"
+#include "Vulkan/VkInit.h"
+
+namespace {
+
+// Shadows end here even when the camera sees farther, the cascades would get too coarse otherwise
+constexpr float MAX_SHADOW_DISTANCE = 200.0f;
+// Blend between uniform and logarithmic splits, higher values give the near cascades more resolution
+constexpr float SPLIT_LAMBDA = 0.75f;
+// Extra cascade size around the camera slice, the cascade only moves once the slice leaves it
+constexpr float CACHE_MARGIN = 0.25f;
+// Casters this far towards the light from a cascade still land in its depth range
+constexpr float SHADOW_CASTER_DISTANCE = 250.0f;
+constexpr uint32_t MIN_CASTER_CAPACITY = 1024;
+
+} // namespace
+
+struct ShadowPushConstants {
+  glm::mat4 viewProj;
+};
+
+CascadedShadowMap::CascadedShadowMap(std::shared_ptr<VulkanContext> ctx, VkDescriptorSetLayout frameSetLayout, uint32_t frameCount)
+  : m_ctx{ctx},
+    m_frames(frameCount) {
+  createPipeline(frameSetLayout);
+  createImages();
+
+  for (auto &frame : m_frames) {
+    createCasterBuffer(frame, MIN_CASTER_CAPACITY);
+    frame.descriptorSet = m_descriptorAllocator.Allocate(m_ctx->GetDevice(), m_descriptorLayout);
+  }
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+  m_frames.clear();
+
+  VkDevice device = m_ctx->GetDevice();
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    vkDestroyImageView(device, m_shadowLayerViews[cascade], nullptr);
+    vkDestroyImageView(device, m_staticLayerViews[cascade], nullptr);
+  }
+  vkDestroyImageView(device, m_view, nullptr);
+  vmaDestroyImage(m_ctx->GetAllocator(), m_shadowImage, m_shadowAllocation);
+  vmaDestroyImage(m_ctx->GetAllocator(), m_staticImage, m_staticAllocation);
+  vkDestroySampler(device, m_sampler, nullptr);
+
+  m_descriptorAllocator.DestroyPools(device);
+  vkDestroyPipeline(device, m_pipeline, nullptr);
+  vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, m_descriptorLayout, nullptr);
+}
+
+void CascadedShadowMap::Update(const Camera &camera, const glm::vec3 &lightDirection) {
+  const float nearDepth = camera.near;
+  const float farDepth = std::min(camera.far, MAX_SHADOW_DISTANCE);
+  const glm::mat4 cameraToWorld = glm::inverse(camera.view);
+  const float projX = camera.projection[0][0];
+  const float projY = std::abs(camera.projection[1][1]);
+
+  // The light basis does not depend on the camera, turning the camera keeps the light space of static casters
+  const glm::vec3 forward = -glm::normalize(lightDirection);
+  const glm::vec3 up = std::abs(forward.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), forward, up);
+
+  float sliceNear = nearDepth;
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    const float t = static_cast<float>(cascade + 1) / SHADOW_CASCADE_COUNT;
+    const float uniformSplit = nearDepth + (farDepth - nearDepth) * t;
+    const float logSplit = nearDepth * std::pow(farDepth / nearDepth, t);
+    const float sliceFar = glm::mix(uniformSplit, logSplit, SPLIT_LAMBDA);
+
+    std::array<glm::vec3, 8> corners;
+    for (uint32_t corner = 0; corner < corners.size(); corner++) {
+      const float depth = corner < 4 ? sliceNear : sliceFar;
+      const float scale = camera.isPerspective ? depth : 1.0f;
+      const glm::vec3 viewCorner((corner & 1 ? 1.0f : -1.0f) * scale / projX, (corner & 2 ? 1.0f : -1.0f) * scale / projY, -depth);
+      corners[corner] = glm::vec3(cameraToWorld * glm::vec4(viewCorner, 1.0f));
+    }
+
+    // A sphere keeps the same size under camera rotation, rounding it absorbs float noise
+    const glm::vec3 center = std::accumulate(corners.begin(), corners.end(), glm::vec3(0.0f)) / static_cast<float>(corners.size());
+    float radius = 0.0f;
+    for (const auto &corner : corners)
+      radius = std::max(radius, glm::length(corner - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // Snapping to a multiple of the texel size keeps edges from crawling, the coarser step keeps the static cache
+    // valid until the slice leaves the margin
+    const float extent = radius * (1.0f + CACHE_MARGIN);
+    const float texelSize = 2.0f * extent / SHADOW_MAP_RESOLUTION;
+    const float step = texelSize * std::max(1.0f, std::floor(radius * CACHE_MARGIN * 0.5f / texelSize));
+    const glm::vec3 lightCenter = glm::floor(glm::vec3(lightView * glm::vec4(center, 1.0f)) / step) * step;
+
+    const float nearPlane = -lightCenter.z - extent - SHADOW_CASTER_DISTANCE;
+    const float farPlane = -lightCenter.z + extent;
+    glm::mat4 projection(0.0f);
+    projection[0][0] = 1.0f / extent;
+    projection[1][1] = 1.0f / extent;
+    projection[2][2] = -1.0f / (farPlane - nearPlane);
+    projection[3] = {-lightCenter.x / extent, -lightCenter.y / extent, -nearPlane / (farPlane - nearPlane), 1.0f};
+
+    m_cascades[cascade].cascade = {
+        .viewProj = projection * lightView,
+        .splitDepth = sliceFar,
+        .texelSize = texelSize,
+    };
+    sliceNear = sliceFar;
+  }
+}
+
+void CascadedShadowMap::InvalidateStatic() {
+  m_staticVersion++;
+}
+
+bool CascadedShadowMap::NeedsStaticRender(uint32_t cascade) const {
+  const auto &state = m_cascades[cascade];
+  return state.cachedStaticVersion != m_staticVersion || state.cachedViewProj != state.cascade.viewProj;
+}
+
+bool CascadedShadowMap::NeedsCompose(uint32_t cascade, bool renderStatic, bool dynamicCasters) const {
+  // A layer without dynamic casters is a plain copy of the cache, it is only refreshed when it differs
+  return renderStatic || dynamicCasters || m_cascades[cascade].hasDynamicCasters;
+}
+
+const ShadowCascade &CascadedShadowMap::GetCascade(uint32_t cascade) const {
+  return m_cascades[cascade].cascade;
+}
+
+std::vector<uint32_t> CascadedShadowMap::UploadCasters(uint32_t frameIndex, std::span<const std::span<const uint32_t>> casterLists) {
+  auto &frame = m_frames[frameIndex];
+
+  std::vector<uint32_t> offsets(casterLists.size());
+  uint32_t casterCount = 0;
+  for (auto &&[offset, casters] : std::views::zip(offsets, casterLists)) {
+    offset = casterCount;
+    casterCount += static_cast<uint32_t>(casters.size());
+  }
+
+  // The frame's previous submission completed and the set is not bound yet, so both can be replaced
+  if (casterCount > frame.casterCapacity) {
+    createCasterBuffer(frame, std::bit_ceil(casterCount));
+    updateDescriptors(frame);
+  }
+
+  auto *dst = static_cast<uint32_t *>(frame.casterBuffer->info.pMappedData);
+  for (const auto &[offset, casters] : std::views::zip(offsets, casterLists))
+    std::ranges::copy(casters, dst + offset);
+  frame.casterBuffer->Flush(0, casterCount * sizeof(uint32_t));
+
+  return offsets;
+}
+
+void CascadedShadowMap::SetPositionBuffer(uint32_t frameIndex, VkBuffer positionBuffer, VkDeviceSize size) {
+  auto &frame = m_frames[frameIndex];
+  if (frame.positionBuffer == positionBuffer)
+    return;
+
+  frame.positionBuffer = positionBuffer;
+  frame.positionSize = size;
+  updateDescriptors(frame);
+}
+
+bool CascadedShadowMap::IsCleared() const {
+  return m_cleared;
+}
+
+void CascadedShadowMap::Clear(VkCommandBuffer cmd) {
+  VkClearDepthStencilValue clearValue{.depth = 1.0f};
+  VkImageSubresourceRange range = VkInit::image_subresource_range(VK_IMAGE_ASPECT_DEPTH_BIT);
+  vkCmdClearDepthStencilImage(cmd, m_shadowImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearValue, 1, &range);
+  m_cleared = true;
+}
+
+void CascadedShadowMap::RenderStatic(VkCommandBuffer cmd, uint32_t cascade, const std::function<void(VkCommandBuffer)> &draw) {
+  auto &state = m_cascades[cascade];
+  renderLayer(cmd, m_staticLayerViews[cascade], cascade, true, draw);
+
+  state.cachedViewProj = state.cascade.viewProj;
+  state.cachedStaticVersion = m_staticVersion;
+}
+
+void CascadedShadowMap::Compose(VkCommandBuffer cmd, uint32_t cascade, bool dynamicCasters) {
+  VkImageCopy copy{
+      .srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1},
+      .dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1},
+      .extent = {SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 1},
+  };
+  vkCmdCopyImage(cmd, m_staticImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_shadowImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+  m_cascades[cascade].hasDynamicCasters = dynamicCasters;
+}
+
+void CascadedShadowMap::RenderDynamic(VkCommandBuffer cmd, uint32_t cascade, const std::function<void(VkCommandBuffer)> &draw) {
+  renderLayer(cmd, m_shadowLayerViews[cascade], cascade, false, draw);
+}
+
+VkPipelineLayout CascadedShadowMap::GetPipelineLayout() const { return m_pipelineLayout; }
+VkDescriptorSet CascadedShadowMap::GetCasterSet(uint32_t frame) const { return m_frames[frame].descriptorSet; }
+VkImage CascadedShadowMap::GetImage() const { return m_shadowImage; }
+VkImageView CascadedShadowMap::GetView() const { return m_view; }
+VkImage CascadedShadowMap::GetStaticImage() const { return m_staticImage; }
+
+ImportedImageState CascadedShadowMap::GetImportState() const {
+  // Earlier frames may still sample the maps, before the first clear nothing ever touched them
+  if (!m_cleared)
+    return {};
+  return {
+      .layout = SHADOW_MAP_LAYOUT,
+      .stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+  };
+}
+
+ImportedImageState CascadedShadowMap::GetStaticImportState() const {
+  // Earlier frames may still copy out of the cache. The frame clearing the maps already hands it back in its layout
+  if (!m_cleared)
+    return {};
+  return {
+      .layout = SHADOW_CACHE_LAYOUT,
+      .stages = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+  };
+}
+VkSampler CascadedShadowMap::GetSampler() const { return m_sampler; }
+
+void CascadedShadowMap::createPipeline(VkDescriptorSetLayout frameSetLayout) {
+  VkDevice device = m_ctx->GetDevice();
+
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_descriptorLayout = builder.Build(device, VK_SHADER_STAGE_VERTEX_BIT);
+  }
+
+  std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+  };
+  m_descriptorAllocator.Init(device, static_cast<uint32_t>(m_frames.size()), sizes);
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(ShadowPushConstants),
+  };
+
+  std::array<VkDescriptorSetLayout, 2> setLayouts{frameSetLayout, m_descriptorLayout};
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = setLayouts.size();
+  layoutInfo.pSetLayouts = setLayouts.data();
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+  VkShaderModule shadowShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("vertex/shadow.vert", device, &shadowShader))
+    throw std::runtime_error("failed to load shadow vertex shader!");
+
+  // Both faces cast, the slope scaled bias keeps lit surfaces from shadowing themselves
+  PipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetVertexShader(shadowShader);
+  pipelineBuilder.SetInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  pipelineBuilder.SetPolygonMode(VK_POLYGON_MODE_FILL);
+  pipelineBuilder.SetCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+  pipelineBuilder.SetDepthBias(1.25f, 1.75f);
+  pipelineBuilder.SetMultisamplingNone();
+  pipelineBuilder.DisableBlending();
+  pipelineBuilder.EnableDepthTest(true);
+  pipelineBuilder.SetDepthFormat(SHADOW_MAP_FORMAT);
+  pipelineBuilder.SetLayout(m_pipelineLayout);
+  m_pipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(device, shadowShader, nullptr);
+}
+
+void CascadedShadowMap::createImages() {
+  VkDevice device = m_ctx->GetDevice();
+
+  VmaAllocationCreateInfo allocInfo{
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  const VkExtent3D extent{SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 1};
+
+  VkImageCreateInfo shadowInfo = VkInit::image_create_info(SHADOW_MAP_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, extent, 1);
+  shadowInfo.arrayLayers = SHADOW_CASCADE_COUNT;
+  VK_CHECK(vmaCreateImage(m_ctx->GetAllocator(), &shadowInfo, &allocInfo, &m_shadowImage, &m_shadowAllocation, nullptr));
+
+  VkImageCreateInfo staticInfo = VkInit::image_create_info(SHADOW_MAP_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, extent, 1);
+  staticInfo.arrayLayers = SHADOW_CASCADE_COUNT;
+  VK_CHECK(vmaCreateImage(m_ctx->GetAllocator(), &staticInfo, &allocInfo, &m_staticImage, &m_staticAllocation, nullptr));
+
+  VkImageViewCreateInfo viewInfo = VkInit::imageview_create_info(SHADOW_MAP_FORMAT, m_shadowImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  viewInfo.subresourceRange.layerCount = SHADOW_CASCADE_COUNT;
+  VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &m_view));
+
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    VkImageViewCreateInfo layerInfo = VkInit::imageview_create_info(SHADOW_MAP_FORMAT, m_shadowImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+    layerInfo.subresourceRange.baseArrayLayer = cascade;
+    VK_CHECK(vkCreateImageView(device, &layerInfo, nullptr, &m_shadowLayerViews[cascade]));
+
+    layerInfo.image = m_staticImage;
+    VK_CHECK(vkCreateImageView(device, &layerInfo, nullptr, &m_staticLayerViews[cascade]));
+  }
+
+  // Hardware comparison with bilinear filtering gives every tap a 2x2 percentage closer filter.
+  // Outside the map nothing is shadowed
+  VkSamplerCreateInfo samplerInfo{
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      .magFilter = VK_FILTER_LINEAR,
+      .minFilter = VK_FILTER_LINEAR,
+      .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+      .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER,
+      .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER,
+      .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER,
+      .compareEnable = VK_TRUE,
+      .compareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+      .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+  };
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_sampler));
+}
+
+void CascadedShadowMap::createCasterBuffer(FrameResources &frame, uint32_t capacity) {
+  frame.casterCapacity = std::max(capacity, MIN_CASTER_CAPACITY);
+  frame.casterBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), frame.casterCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+}
+
+void CascadedShadowMap::updateDescriptors(FrameResources &frame) const {
+  // Nothing can be drawn before the first meshes are merged, the set is written once they are
+  if (frame.positionBuffer == VK_NULL_HANDLE)
+    return;
+
+  DescriptorWriter writer;
+  writer.WriteBuffer(0, frame.positionBuffer, frame.positionSize, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(1, frame.casterBuffer->buffer, frame.casterCapacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+}
+
+void CascadedShadowMap::renderLayer(VkCommandBuffer cmd, VkImageView view, uint32_t cascade, bool clear, const std::function<void(VkCommandBuffer)> &draw) {
+  VkRenderingAttachmentInfo depthAttachment = VkInit::depth_attachment_info(view, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  if (!clear)
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+  const VkExtent2D extent{SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION};
+  VkRenderingInfo renderInfo = VkInit::rendering_info(extent, {}, &depthAttachment);
+  vkCmdBeginRendering(cmd, &renderInfo);
+
+  VkViewport viewport{
+      .x = 0.0f,
+      .y = 0.0f,
+      .width = static_cast<float>(SHADOW_MAP_RESOLUTION),
+      .height = static_cast<float>(SHADOW_MAP_RESOLUTION),
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f,
+  };
+  VkRect2D scissor{
+      .offset = {0, 0},
+      .extent = extent,
+  };
+  vkCmdSetViewport(cmd, 0, 1, &viewport);
+  vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+  ShadowPushConstants pushConstants{
+      .viewProj = m_cascades[cascade].cascade.viewProj,
+  };
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+  vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &pushConstants);
+  draw(cmd);
+
+  vkCmdEndRendering(cmd);
+}
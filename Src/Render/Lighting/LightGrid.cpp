@@ -0,0 +1,178 @@
+#include "Lighting/LightGrid.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+#include "Vulkan/ComputePipelineBuilder.h"
+#include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
+#include "Vulkan/Descriptors/DescriptorWriter.h"
+#include "Vulkan/VkInit.h"
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr uint32_t MIN_LIGHT_CAPACITY = 256;
+// Clusters overflowing the index list lose their extra lights, so the budget is generous
+constexpr uint32_t AVERAGE_LIGHTS_PER_CLUSTER = 32;
+constexpr uint32_t INDEX_CAPACITY = CLUSTER_COUNT * AVERAGE_LIGHTS_PER_CLUSTER;
+
+// Header read by the shading code to map a position to its cluster, followed by one range per cluster
+struct GPUClusterGridHeader {
+  glm::vec4 params; // znear, zfar, slices / log(zfar / znear)
+  glm::uvec4 dims;
+};
+static_assert(sizeof(GPUClusterGridHeader) == 32);
+
+constexpr VkDeviceSize GRID_BUFFER_SIZE = sizeof(GPUClusterGridHeader) + CLUSTER_COUNT * sizeof(glm::uvec2);
+// A counter used to allocate the ranges, followed by the light indices
+constexpr VkDeviceSize INDEX_BUFFER_SIZE = sizeof(uint32_t) + INDEX_CAPACITY * sizeof(uint32_t);
+
+} // namespace
+
+struct LightClusterPushConstants {
+  glm::mat4 view;
+  glm::vec4 projection; // P00, P11, znear, zfar
+  glm::uvec4 grid;      // Cluster counts, light count in w
+  uint32_t indexCapacity;
+  uint32_t isPerspective;
+  glm::uvec2 padding;
+};
+static_assert(sizeof(LightClusterPushConstants) == 112);
+
+LightGrid::LightGrid(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount)
+  : m_ctx{ctx},
+    m_frames(frameCount) {
+  createPipeline();
+
+  // Binning may run on the compute queue while shading reads the grid on the graphics one
+  VkDevice device = m_ctx->GetDevice();
+  VmaAllocator allocator = m_ctx->GetAllocator();
+  const std::span<const uint32_t> queueFamilies = m_ctx->GetSharedQueueFamilies();
+  for (auto &frame : m_frames) {
+    frame.gridBuffer = std::make_unique<Buffer>(allocator, GRID_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, queueFamilies);
+    frame.indexBuffer = std::make_unique<Buffer>(allocator, INDEX_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, queueFamilies);
+    createLightBuffer(frame, MIN_LIGHT_CAPACITY);
+    frame.descriptorSet = m_descriptorAllocator.Allocate(device, m_descriptorLayout);
+    updateDescriptors(frame);
+  }
+
+  // An empty grid until the first build, shading then sees zero clusters and skips the local lights
+  m_ctx->ImmediateSubmit([&](VkCommandBuffer cmd) {
+    for (auto &frame : m_frames) {
+      vkCmdFillBuffer(cmd, frame.gridBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+      vkCmdFillBuffer(cmd, frame.indexBuffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+  });
+}
+
+LightGrid::~LightGrid() {
+  m_frames.clear();
+
+  VkDevice device = m_ctx->GetDevice();
+  m_descriptorAllocator.DestroyPools(device);
+  vkDestroyPipeline(device, m_buildPipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(device, m_buildPipeline.layout, nullptr);
+  vkDestroyDescriptorSetLayout(device, m_descriptorLayout, nullptr);
+}
+
+bool LightGrid::Upload(uint32_t frameIndex, std::span<const GPULocalLight> lights) {
+  auto &frame = m_frames[frameIndex];
+  const auto lightCount = static_cast<uint32_t>(lights.size());
+
+  // The frame's previous submission completed, so the old buffer can go right away
+  const bool reallocate = lightCount > frame.lightCapacity;
+  if (reallocate) {
+    createLightBuffer(frame, std::bit_ceil(lightCount));
+    updateDescriptors(frame);
+  }
+
+  frame.lightCount = lightCount;
+  if (lightCount != 0)
+    frame.lightBuffer->MapMemoryFromBytes(lights.data(), lights.size_bytes());
+  return reallocate;
+}
+
+void LightGrid::Build(VkCommandBuffer cmd, uint32_t frameIndex, const Camera &camera) {
+  auto &frame = m_frames[frameIndex];
+
+  // The previous reader of this frame's grid finished with the frame's fence, only the fill needs ordering
+  vkCmdFillBuffer(cmd, frame.indexBuffer->buffer, 0, sizeof(uint32_t), 0);
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  LightClusterPushConstants pushConstants{
+      .view = camera.view,
+      .projection = glm::vec4(camera.projection[0][0], camera.projection[1][1], camera.near, camera.far),
+      .grid = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, frame.lightCount),
+      .indexCapacity = INDEX_CAPACITY,
+      .isPerspective = camera.isPerspective,
+  };
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_buildPipeline.pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_buildPipeline.layout, 0, 1, &frame.descriptorSet, 0, nullptr);
+  vkCmdPushConstants(cmd, m_buildPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LightClusterPushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (CLUSTER_COUNT + 63) / 64, 1, 1);
+}
+
+VkBuffer LightGrid::GetLightBuffer(uint32_t frame) const { return m_frames[frame].lightBuffer->buffer; }
+VkDeviceSize LightGrid::GetLightBufferSize(uint32_t frame) const { return m_frames[frame].lightCapacity * sizeof(GPULocalLight); }
+VkBuffer LightGrid::GetGridBuffer(uint32_t frame) const { return m_frames[frame].gridBuffer->buffer; }
+VkDeviceSize LightGrid::GetGridBufferSize() const { return GRID_BUFFER_SIZE; }
+VkBuffer LightGrid::GetIndexBuffer(uint32_t frame) const { return m_frames[frame].indexBuffer->buffer; }
+VkDeviceSize LightGrid::GetIndexBufferSize() const { return INDEX_BUFFER_SIZE; }
+
+void LightGrid::createPipeline() {
+  VkDevice device = m_ctx->GetDevice();
+
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_descriptorLayout = builder.Build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+  }
+
+  std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
+  };
+  m_descriptorAllocator.Init(device, static_cast<uint32_t>(m_frames.size()), sizes);
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(LightClusterPushConstants),
+  };
+
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &m_descriptorLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_buildPipeline.layout));
+
+  VkShaderModule clusterShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("compute/light_cluster.comp", device, &clusterShader))
+    throw std::runtime_error("failed to load light cluster shader!");
+
+  ComputePipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetLayout(m_buildPipeline.layout);
+  pipelineBuilder.SetShaders(clusterShader);
+  m_buildPipeline.pipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(device, clusterShader, nullptr);
+}
+
+void LightGrid::createLightBuffer(FrameResources &frame, uint32_t capacity) {
+  frame.lightCapacity = std::max(capacity, MIN_LIGHT_CAPACITY);
+  frame.lightBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), frame.lightCapacity * sizeof(GPULocalLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, m_ctx->GetSharedQueueFamilies());
+}
+
+void LightGrid::updateDescriptors(FrameResources &frame) const {
+  DescriptorWriter writer;
+  writer.WriteBuffer(0, frame.lightBuffer->buffer, frame.lightCapacity * sizeof(GPULocalLight), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(1, frame.gridBuffer->buffer, GRID_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(2, frame.indexBuffer->buffer, INDEX_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+}
@@ -0,0 +1,300 @@
+#include "Picking/ObjectPicker.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+
+#include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
+#include "Vulkan/Descriptors/DescriptorWriter.h"
+#include "Vulkan/PipelineBuilder.h"
+#include "Vulkan/VkInit.h"
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr VkDeviceSize TILE_READBACK_SIZE = PICK_TILE_SIZE * PICK_TILE_SIZE * sizeof(uint32_t);
+constexpr uint32_t MIN_CANDIDATE_CAPACITY = 256;
+
+// Maps the viewport to a tile centred on pixel at the same pixel scale, like gluPickMatrix. Depth is untouched
+glm::mat4 pick_matrix(glm::ivec2 pixel, VkExtent2D viewportExtent) {
+  const auto tileSize = static_cast<float>(PICK_TILE_SIZE);
+  glm::mat4 pick(1.0f);
+  pick[0][0] = static_cast<float>(viewportExtent.width) / tileSize;
+  pick[1][1] = static_cast<float>(viewportExtent.height) / tileSize;
+  pick[3][0] = (static_cast<float>(viewportExtent.width) - 2.0f * static_cast<float>(pixel.x)) / tileSize;
+  pick[3][1] = (static_cast<float>(viewportExtent.height) - 2.0f * static_cast<float>(pixel.y)) / tileSize;
+  return pick;
+}
+
+// Top left corner of a request's search square inside the tiles image
+VkOffset2D search_offset(uint32_t requestIndex, uint32_t radius) {
+  return {
+      static_cast<int32_t>(requestIndex * PICK_TILE_SIZE + PICK_TILE_SIZE / 2 - radius),
+      static_cast<int32_t>(PICK_TILE_SIZE / 2 - radius),
+  };
+}
+
+} // namespace
+
+struct PickPushConstants {
+  glm::mat4 viewProj;
+};
+
+ObjectPicker::ObjectPicker(std::shared_ptr<VulkanContext> ctx, VkDescriptorSetLayout frameSetLayout, uint32_t frameCount)
+  : m_ctx{ctx},
+    m_frames(frameCount) {
+  createPipeline(frameSetLayout);
+
+  for (auto &frame : m_frames) {
+    frame.readbackBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), MAX_PICKS_PER_FRAME * TILE_READBACK_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+    createCandidateBuffer(frame, MIN_CANDIDATE_CAPACITY);
+    frame.descriptorSet = m_descriptorAllocator.Allocate(m_ctx->GetDevice(), m_descriptorLayout);
+  }
+}
+
+ObjectPicker::~ObjectPicker() {
+  m_frames.clear();
+
+  VkDevice device = m_ctx->GetDevice();
+  m_descriptorAllocator.DestroyPools(device);
+  vkDestroyPipeline(device, m_pipeline, nullptr);
+  vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, m_descriptorLayout, nullptr);
+}
+
+uint32_t ObjectPicker::Request(glm::ivec2 pixel, uint32_t radius) {
+  const uint32_t id = m_nextRequestId++;
+  m_pendingRequests.push_back({
+      .id = id,
+      .pixel = pixel,
+      .radius = std::min(radius, MAX_PICK_RADIUS),
+  });
+  return id;
+}
+
+void ObjectPicker::BeginFrame(uint32_t frameIndex, const glm::mat4 &viewProj, VkExtent2D viewportExtent) {
+  auto &frame = m_frames[frameIndex];
+  if (frame.recorded) {
+    readResults(frame);
+    frame.recorded = false;
+  } else {
+    // Taken by a frame that never rendered them, they go first again
+    m_pendingRequests.insert(m_pendingRequests.begin(), frame.requests.begin(), frame.requests.end());
+  }
+  frame.requests.clear();
+
+  while (!m_pendingRequests.empty() && frame.requests.size() < MAX_PICKS_PER_FRAME) {
+    PickRequest request = m_pendingRequests.front();
+    m_pendingRequests.pop_front();
+
+    request.pixel = glm::clamp(request.pixel, glm::ivec2(0), glm::ivec2(viewportExtent.width, viewportExtent.height) - 1);
+    request.viewProj = pick_matrix(request.pixel, viewportExtent) * viewProj;
+    frame.requests.push_back(request);
+  }
+}
+
+std::span<const PickRequest> ObjectPicker::GetFrameRequests(uint32_t frame) const {
+  return m_frames[frame].requests;
+}
+
+std::vector<PickResult> ObjectPicker::TakeResults() {
+  return std::exchange(m_results, {});
+}
+
+std::vector<uint32_t> ObjectPicker::UploadCandidates(uint32_t frameIndex, std::span<const std::span<const uint32_t>> candidateLists) {
+  auto &frame = m_frames[frameIndex];
+
+  std::vector<uint32_t> offsets(candidateLists.size());
+  uint32_t candidateCount = 0;
+  for (auto &&[offset, candidates] : std::views::zip(offsets, candidateLists)) {
+    offset = candidateCount;
+    candidateCount += static_cast<uint32_t>(candidates.size());
+  }
+
+  if (candidateCount > frame.candidateCapacity) {
+    createCandidateBuffer(frame, std::bit_ceil(candidateCount));
+    updateDescriptors(frame);
+  }
+
+  auto *dst = static_cast<uint32_t *>(frame.candidateBuffer->info.pMappedData);
+  for (const auto &[offset, candidates] : std::views::zip(offsets, candidateLists))
+    std::ranges::copy(candidates, dst + offset);
+  frame.candidateBuffer->Flush(0, candidateCount * sizeof(uint32_t));
+
+  return offsets;
+}
+
+void ObjectPicker::SetPositionBuffer(uint32_t frameIndex, VkBuffer positionBuffer, VkDeviceSize size) {
+  auto &frame = m_frames[frameIndex];
+  if (frame.positionBuffer == positionBuffer)
+    return;
+
+  frame.positionBuffer = positionBuffer;
+  frame.positionSize = size;
+  updateDescriptors(frame);
+}
+
+void ObjectPicker::Render(VkCommandBuffer cmd, uint32_t frameIndex, VkImageView idView, VkImageView depthView, const std::function<void(VkCommandBuffer, uint32_t)> &draw) {
+  auto &frame = m_frames[frameIndex];
+  if (frame.requests.empty())
+    return;
+
+  // The tiles only live for this frame, both are cleared
+  VkClearValue emptyId{.color = {.uint32 = {0, 0, 0, 0}}};
+  std::array colorAttachments{VkInit::color_attachment_info(idView, &emptyId, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)};
+  VkRenderingAttachmentInfo depthAttachment = VkInit::depth_attachment_info(depthView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  VkRenderingInfo renderInfo = VkInit::rendering_info(PICK_TILES_EXTENT, colorAttachments, &depthAttachment);
+  vkCmdBeginRendering(cmd, &renderInfo);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+
+  // Fragments outside the search square are never shaded, a single pixel query shades one pixel per candidate
+  for (const auto &[requestIndex, request] : std::views::enumerate(frame.requests)) {
+    VkViewport viewport{
+        .x = static_cast<float>(requestIndex * PICK_TILE_SIZE),
+        .y = 0.0f,
+        .width = static_cast<float>(PICK_TILE_SIZE),
+        .height = static_cast<float>(PICK_TILE_SIZE),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    const uint32_t searchSize = 2 * request.radius + 1;
+    VkRect2D scissor{
+        .offset = search_offset(static_cast<uint32_t>(requestIndex), request.radius),
+        .extent = {searchSize, searchSize},
+    };
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    PickPushConstants pushConstants{
+        .viewProj = request.viewProj,
+    };
+    vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PickPushConstants), &pushConstants);
+    draw(cmd, static_cast<uint32_t>(requestIndex));
+  }
+
+  vkCmdEndRendering(cmd);
+}
+
+void ObjectPicker::CopyResults(VkCommandBuffer cmd, uint32_t frameIndex, VkImage idImage) {
+  auto &frame = m_frames[frameIndex];
+  if (frame.requests.empty())
+    return;
+
+  std::vector<VkBufferImageCopy> regions;
+  for (const auto &[requestIndex, request] : std::views::enumerate(frame.requests)) {
+    const uint32_t searchSize = 2 * request.radius + 1;
+    const VkOffset2D offset = search_offset(static_cast<uint32_t>(requestIndex), request.radius);
+    regions.push_back({
+        .bufferOffset = requestIndex * TILE_READBACK_SIZE,
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageOffset = {offset.x, offset.y, 0},
+        .imageExtent = {searchSize, searchSize, 1},
+    });
+  }
+  vkCmdCopyImageToBuffer(cmd, idImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readbackBuffer->buffer, static_cast<uint32_t>(regions.size()), regions.data());
+
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+  frame.recorded = true;
+}
+
+VkPipelineLayout ObjectPicker::GetPipelineLayout() const { return m_pipelineLayout; }
+VkDescriptorSet ObjectPicker::GetCandidateSet(uint32_t frame) const { return m_frames[frame].descriptorSet; }
+
+void ObjectPicker::createPipeline(VkDescriptorSetLayout frameSetLayout) {
+  VkDevice device = m_ctx->GetDevice();
+
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_descriptorLayout = builder.Build(device, VK_SHADER_STAGE_VERTEX_BIT);
+  }
+
+  std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+  };
+  m_descriptorAllocator.Init(device, static_cast<uint32_t>(m_frames.size()), sizes);
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(PickPushConstants),
+  };
+
+  std::array<VkDescriptorSetLayout, 2> setLayouts{frameSetLayout, m_descriptorLayout};
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = setLayouts.size();
+  layoutInfo.pSetLayouts = setLayouts.data();
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+  VkShaderModule vertShader, fragShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("vertex/picking.vert", device, &vertShader))
+    throw std::runtime_error("failed to load picking vertex shader!");
+  if (!m_ctx->GetShaderBundle().LoadModule("fragment/picking.frag", device, &fragShader))
+    throw std::runtime_error("failed to load picking fragment shader!");
+
+  PipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetShaders(vertShader, fragShader);
+  pipelineBuilder.SetInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  pipelineBuilder.SetPolygonMode(VK_POLYGON_MODE_FILL);
+  pipelineBuilder.SetCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+  pipelineBuilder.SetMultisamplingNone();
+  pipelineBuilder.DisableBlending();
+  pipelineBuilder.EnableDepthTest(true);
+  pipelineBuilder.SetColorAttachmentFormat(PICK_ID_FORMAT);
+  pipelineBuilder.SetDepthFormat(PICK_DEPTH_FORMAT);
+  pipelineBuilder.SetLayout(m_pipelineLayout);
+  m_pipeline = pipelineBuilder.CreatePipeline();
+
+  vkDestroyShaderModule(device, vertShader, nullptr);
+  vkDestroyShaderModule(device, fragShader, nullptr);
+}
+
+void ObjectPicker::createCandidateBuffer(FrameResources &frame, uint32_t capacity) {
+  frame.candidateCapacity = std::max(capacity, MIN_CANDIDATE_CAPACITY);
+  frame.candidateBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), frame.candidateCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+}
+
+void ObjectPicker::updateDescriptors(FrameResources &frame) const {
+  if (frame.positionBuffer == VK_NULL_HANDLE)
+    return;
+
+  DescriptorWriter writer;
+  writer.WriteBuffer(0, frame.positionBuffer, frame.positionSize, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(1, frame.candidateBuffer->buffer, frame.candidateCapacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+}
+
+void ObjectPicker::readResults(FrameResources &frame) {
+  frame.readbackBuffer->Invalidate(0, frame.requests.size() * TILE_READBACK_SIZE);
+  const auto *tiles = static_cast<const uint32_t *>(frame.readbackBuffer->info.pMappedData);
+
+  // The pixel itself wins, otherwise the closest id inside the search square
+  for (const auto &[requestIndex, request] : std::views::enumerate(frame.requests)) {
+    const auto searchSize = static_cast<int32_t>(2 * request.radius + 1);
+    const auto radius = static_cast<int32_t>(request.radius);
+    const uint32_t *ids = tiles + requestIndex * TILE_READBACK_SIZE / sizeof(uint32_t);
+
+    uint32_t objectId = 0;
+    int32_t closest = std::numeric_limits<int32_t>::max();
+    for (int32_t y = 0; y < searchSize; y++) {
+      for (int32_t x = 0; x < searchSize; x++) {
+        const uint32_t id = ids[y * searchSize + x];
+        const int32_t distance = (x - radius) * (x - radius) + (y - radius) * (y - radius);
+        if (id != 0 && distance < closest) {
+          objectId = id;
+          closest = distance;
+        }
+      }
+    }
+
+    m_results.push_back({.requestId = request.id, .objectId = objectId});
+  }
+}
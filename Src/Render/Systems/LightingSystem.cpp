@@ -1,7 +1,11 @@
 #include "../../../Include/YakiEngine/Render/Systems/LightingSystem.h"
 
+#include <cmath>
+
 #include "Ecs.h"
 #include "Components/DirectionalLight.h"
+#include "Components/PointLight.h"
+#include "Components/SpotLight.h"
 #include "Vulkan/VkTypes.h"
 #include "Components/Translation.h"
 
@@ -17,16 +21,33 @@ void LightingSystem::Update(float dt)
     // TODO: This shouldn't be done every frame, its inefficient
     auto& lightData = m_renderer->GetGpuLightData();
     auto& directionalLights = lightData.directionalLights;
-    auto& pointLights = lightData.pointLights;
     assert(ecs.GetComponentArray<DirectionalLight>().Size() <= directionalLights.size());
-    size_t idx = 0;
+    uint32_t idx = 0;
     ecs.Each<DirectionalLight>([&directionalLights, &idx](Hori::Entity, DirectionalLight& dirLight) {
         directionalLights[idx++] = dirLight;
     });
-    idx = 0;
-    ecs.Each<PointLight, Translation>([&pointLights, &idx](Hori::Entity, PointLight& pointLight, Translation& pos) {
-        pointLights[idx].color = pointLight.color;
-        pointLights[idx].position = glm::vec4(pos.value, 1.f);
-        idx++;
+    lightData.numDirectionalLights = idx;
+
+    // Local lights have no upper bound, the renderer grows their storage and bins them into clusters
+    auto& localLights = m_renderer->GetLocalLights();
+    localLights.clear();
+    ecs.Each<PointLight, Translation>([&localLights](Hori::Entity, PointLight& pointLight, Translation& pos) {
+        localLights.push_back({
+            .color = pointLight.color,
+            .position = pos.value,
+            .range = pointLight.range,
+            .cosOuterAngle = -2.f,
+            .cosInnerAngle = -1.f,
+        });
+    });
+    ecs.Each<SpotLight, Translation>([&localLights](Hori::Entity, SpotLight& spotLight, Translation& pos) {
+        localLights.push_back({
+            .color = spotLight.color,
+            .position = pos.value,
+            .range = spotLight.range,
+            .direction = glm::normalize(glm::vec3(spotLight.direction)),
+            .cosOuterAngle = std::cos(glm::radians(spotLight.outerConeAngle)),
+            .cosInnerAngle = std::cos(glm::radians(spotLight.innerConeAngle)),
+        });
     });
 }
@@ -6,20 +6,149 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <SDL3/SDL_mouse.h>
 #include <imgui.h>
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_vulkan.h>
-#include <numeric>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <ranges>
+#include <span>
 
 #include "Components/CoreComponents.h"
 #include "Components/DirectionalLight.h"
 #include "Components/DynamicObject.h"
 #include "Components/RayTagged.h"
 #include "Components/RenderComponents.h"
+#include "Culling/Frustum.h"
 #include "Gui/ItemList.h"
 
+namespace {
+
+// Pixels around the cursor searched for an object, small gaps between meshes still hover their neighbour
+constexpr uint32_t HOVER_PICK_RADIUS = 2;
+
+// Draw key fields from the low bits up, above them the pipeline and the transparency bit. Sorted keys give batches
+// grouped per pipeline with the transparent ones last, each batch's instances nearest first
+constexpr uint32_t DEPTH_BUCKET_BITS = 8;
+constexpr uint32_t SURFACE_BITS = 12;
+constexpr uint32_t MESH_BITS = 24;
+constexpr uint32_t MATERIAL_BITS = 12;
+constexpr uint32_t PIPELINE_BITS = 7;
+static_assert(DEPTH_BUCKET_BITS + SURFACE_BITS + MESH_BITS + MATERIAL_BITS + PIPELINE_BITS + 1 == 64, "draw key fields must fill 64 bits");
+static_assert(MAX_BINDLESS_MATERIALS <= 1u << MATERIAL_BITS, "material slots must fit the draw key");
+
+// Log spaced view depth, near and far objects get the same share of the buckets per distance ratio
+uint64_t depth_bucket(const Camera &camera, const glm::vec3 &center) {
+  const float depth = std::max(-(camera.view * glm::vec4(center, 1.0f)).z, camera.near);
+  const float t = std::log(depth / camera.near) / std::log(camera.far / camera.near);
+  return static_cast<uint64_t>(std::clamp(t, 0.0f, 1.0f) * ((1 << DEPTH_BUCKET_BITS) - 1));
+}
+
+// World space bounding sphere, scaled by the largest axis so it stays conservative under non uniform scale
+std::pair<glm::vec3, float> world_sphere(const Bounds &bounds, const glm::mat4 &transform) {
+  const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+  return {glm::vec3(transform * glm::vec4(bounds.origin, 1.0f)), bounds.sphereRadius * scale};
+}
+
+// World space box around every surface of a mesh
+Aabb world_box(const Mesh &mesh, const glm::mat4 &transform) {
+  Aabb box;
+  for (const auto &surface : mesh.surfaces)
+    box.Grow(Aabb::Transform(surface.bounds.origin, surface.bounds.extents, transform));
+  return box;
+}
+
+// Two sided, returns the distance along direction or infinity on a miss
+float intersect_triangle(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+  const glm::vec3 edge1 = p1 - p0;
+  const glm::vec3 edge2 = p2 - p0;
+  const glm::vec3 p = glm::cross(direction, edge2);
+  const float det = glm::dot(edge1, p);
+  if (det == 0.0f)
+    return std::numeric_limits<float>::infinity();
+
+  const float invDet = 1.0f / det;
+  const glm::vec3 s = origin - p0;
+  const float u = glm::dot(s, p) * invDet;
+  if (u < 0.0f || u > 1.0f)
+    return std::numeric_limits<float>::infinity();
+  const glm::vec3 q = glm::cross(s, edge1);
+  const float v = glm::dot(direction, q) * invDet;
+  if (v < 0.0f || u + v > 1.0f)
+    return std::numeric_limits<float>::infinity();
+
+  const float t = glm::dot(edge2, q) * invDet;
+  return t >= 0.0f ? t : std::numeric_limits<float>::infinity();
+}
+
+// Nearest triangle of a mesh along a world space ray, infinity on a miss. The ray goes into mesh space without
+// being normalized, so distances stay in world units
+float intersect_mesh(const Mesh &mesh, const glm::mat4 &transform, const Ray &ray, float tMax) {
+  const glm::mat4 toMesh = glm::inverse(transform);
+  const glm::vec3 origin = glm::vec3(toMesh * glm::vec4(ray.origin, 1.0f));
+  const glm::vec3 direction = glm::vec3(toMesh * glm::vec4(ray.direction, 0.0f));
+
+  float nearest = tMax;
+  bool hit = false;
+  for (const auto &surface : mesh.surfaces) {
+    // Surfaces the ray passes wide of skip their triangles
+    const glm::vec3 toCenter = surface.bounds.origin - origin;
+    const glm::vec3 offset = toCenter - direction * (glm::dot(toCenter, direction) / glm::dot(direction, direction));
+    if (glm::dot(offset, offset) > surface.bounds.sphereRadius * surface.bounds.sphereRadius)
+      continue;
+
+    for (uint32_t i = surface.startIndex; i + 2 < surface.startIndex + surface.count; i += 3) {
+      const float t = intersect_triangle(origin, direction, mesh.vertices[mesh.indices[i]].position, mesh.vertices[mesh.indices[i + 1]].position, mesh.vertices[mesh.indices[i + 2]].position);
+      if (t < nearest) {
+        nearest = t;
+        hit = true;
+      }
+    }
+  }
+  return hit ? nearest : std::numeric_limits<float>::infinity();
+}
+
+// Counting sort of culled instances by batch, every batch gets one contiguous run. Batches keep their draw slot
+// even when empty, the multi draw ranges are fixed per pipeline
+template <typename BatchOf>
+void group_by_batch(std::span<const uint32_t> culled, std::span<const IndirectBatch> allBatches, BatchOf batchOf, std::vector<uint32_t> &instances, std::vector<IndirectBatch> &batches) {
+  batches.assign(allBatches.begin(), allBatches.end());
+  for (auto &batch : batches)
+    batch.instanceCount = 0;
+  for (uint32_t idx : culled) {
+    const uint32_t batchId = batchOf(idx);
+    if (batchId != INVALID_BATCH)
+      batches[batchId].instanceCount++;
+  }
+
+  uint32_t instanceCount = 0;
+  for (auto &batch : batches) {
+    batch.firstInstance = instanceCount;
+    instanceCount += batch.instanceCount;
+    batch.instanceCount = 0;
+  }
+
+  instances.resize(instanceCount);
+  for (uint32_t idx : culled) {
+    const uint32_t batchId = batchOf(idx);
+    if (batchId == INVALID_BATCH)
+      continue;
+
+    auto &batch = batches[batchId];
+    instances[batch.firstInstance + batch.instanceCount++] = idx;
+  }
+}
+
+} // namespace
+
 RenderSystem::RenderSystem(Renderer *renderer)
-    : m_renderer(renderer) {
+    : m_renderer(renderer),
+      m_pipelineIds(PIPELINE_BITS),
+      m_meshIds(MESH_BITS) {
 }
 
 void RenderSystem::Update(float dt) {
@@ -33,46 +162,414 @@ void RenderSystem::Update(float dt) {
   sceneData.proj = camera.projection;
   sceneData.view = camera.view;
   sceneData.viewproj = camera.viewProjection;
-
-  m_renderer->BeginRendering();
-  m_renderer->Begin3DRendering();
-  renderStaticObjects(camera.viewProjection);
+  m_renderer->UpdateShadowCascades(camera);
+
+  if (!m_renderer->BeginRendering())
+    return;
+  m_frameIndex++;
+  // CPU time spent turning the scene's objects into instances and batches
+  const auto sceneUpdateStart = std::chrono::high_resolution_clock::now();
+  updateStaticObjects();
+  m_renderer->UploadStaticInstances();
+  updateDynamicObjects(camera);
+  const auto sceneUpdateEnd = std::chrono::high_resolution_clock::now();
+  m_renderer->SetSceneUpdateTime(std::chrono::duration<float, std::milli>(sceneUpdateEnd - sceneUpdateStart).count());
+  updateSpatialIndex();
+  selectClickedObject(camera);
+  m_renderer->BuildLightClusters(camera);
+  // Added ahead of shadows and picking so it overlaps them when compute has its own queue
+  if (m_cullingMode == CullingMode::Gpu)
+    m_renderer->CullStaticObjects(camera, CullPhase::Early);
+  renderShadows();
+  requestHoverPick();
+  renderPicks();
+
+  if (m_cullingMode == CullingMode::Gpu) {
+    // Draw what was visible last frame, then test the rest against the depth it produced
+    m_renderer->Begin3DRendering();
+    m_renderer->RenderStaticObjects();
+    m_renderer->RenderDynamicObjects();
+    m_renderer->Suspend3DRendering();
+    m_renderer->BuildDepthPyramid();
+    m_renderer->CullStaticObjects(camera, CullPhase::Late);
+    m_renderer->Begin3DRendering(false);
+    m_renderer->RenderStaticObjects();
+  } else {
+    cullStaticObjects(camera);
+    m_renderer->Begin3DRendering();
+    m_renderer->RenderStaticObjects();
+    m_renderer->RenderDynamicObjects();
+  }
   m_renderer->End3DRendering();
   renderGui(dt);
   m_renderer->EndRendering();
-
-  Hori::Entity selectedEntity{m_renderer->GetHoveredEntityId()};
-  if (selectedEntity.Valid())
-    ecs.AddComponents(selectedEntity, Hovered{});
+  applyPickResults();
 }
 
-void RenderSystem::renderStaticObjects(const glm::mat4 &viewProj) {
+void RenderSystem::updateStaticObjects() {
   auto &ecs = Ecs::GetInstance();
+  bool batchesChanged = false;
+  if (ecs.GetComponentArray<DirtyStaticObject>().Size() != 0)
+    batchesChanged = updateDirtyStaticObjects();
+  // After the dirty ones, so objects created this frame already hold their entries
+  if (m_staticInstances.size() > ecs.GetComponentArray<StaticObject>().Size())
+    batchesChanged |= releaseRemovedStaticObjects();
+
+  if (batchesChanged)
+    rebuildStaticBatches();
+}
 
-  if (ecs.GetComponentArray<DirtyStaticObject>().Size() != 0) {
-    RenderIndirectObjects objects;
-    ecs.Each<DirtyStaticObject, StaticObject, LocalToWorld>([&](Hori::Entity e, DirtyStaticObject, StaticObject &drawable, LocalToWorld &localToWorld) {
-      for (auto &[startIndex, count, bounds, material] : drawable.mesh->surfaces) {
-        objects.firstIndices.push_back(startIndex);
-        objects.indexCounts.push_back(count);
-        objects.objectIds.push_back(e.id);
-        objects.transforms.push_back(localToWorld.value);
-        objects.meshes.push_back(drawable.mesh.get());
-        objects.materials.push_back(material.get());
+bool RenderSystem::updateDirtyStaticObjects() {
+  auto &ecs = Ecs::GetInstance();
+  auto &table = m_renderer->GetInstanceTable();
+  bool batchesChanged = false;
+  m_staticSpatialDirty = true;
+  ecs.Each<DirtyStaticObject, StaticObject, LocalToWorld>([&](Hori::Entity e, DirtyStaticObject, StaticObject &drawable, LocalToWorld &localToWorld) {
+    auto &instances = m_staticInstances[e.id];
+
+    // A moved object keeps its slots and batches, only its transforms are uploaded
+    if (instances.mesh == drawable.mesh) {
+      for (const auto &[slot, surface] : std::views::zip(instances.slots, drawable.mesh->surfaces)) {
+        table.SetTransform(slot, localToWorld.value);
+        const auto [center, radius] = world_sphere(surface.bounds, localToWorld.value);
+        m_staticBounds.Set(slot, center, radius);
       }
+      return;
+    }
+
+    releaseStaticInstances(instances);
+    instances.mesh = drawable.mesh;
+    for (uint32_t surfaceIndex = 0; surfaceIndex < drawable.mesh->surfaces.size(); surfaceIndex++) {
+      const uint32_t slot = table.Allocate();
+      addStaticInstance(slot, drawable.mesh.get(), surfaceIndex, localToWorld.value, e.id);
+      instances.slots.push_back(slot);
+    }
+    batchesChanged = true;
+  });
+  ecs.Each<DirtyStaticObject>([&](Hori::Entity e, DirtyStaticObject) {
+    ecs.RemoveComponents<DirtyStaticObject>(e);
+  });
+  return batchesChanged;
+}
+
+bool RenderSystem::releaseRemovedStaticObjects() {
+  // Destroyed entities and ones that lost their StaticObject leave entries no component accounts for
+  m_liveStaticIds.clear();
+  Ecs::GetInstance().Each<StaticObject>([&](Hori::Entity e, StaticObject &) {
+    m_liveStaticIds.push_back(e.id);
+  });
+  std::ranges::sort(m_liveStaticIds);
+
+  const size_t released = std::erase_if(m_staticInstances, [&](auto &entry) {
+    if (std::ranges::binary_search(m_liveStaticIds, entry.first))
+      return false;
+    releaseStaticInstances(entry.second);
+    return true;
+  });
+  if (released != 0)
+    m_staticSpatialDirty = true;
+  return released != 0;
+}
+
+void RenderSystem::addStaticInstance(uint32_t slot, Mesh *mesh, uint32_t surfaceIndex, const glm::mat4 &transform, uint32_t objectId) {
+  if (slot >= m_slotKeys.size()) {
+    m_slotKeys.resize(slot + 1);
+    m_slotDrawKeys.resize(slot + 1);
+    m_staticBounds.Resize(slot + 1);
+  }
+
+  const GeoSurface &surface = mesh->surfaces[surfaceIndex];
+  Material *material = surface.material.get();
+  const MeshPassType pass = main_pass(*material->original);
+  const BatchKey key{
+      .transparent = pass == MeshPassType::Transparency,
+      .pipeline = material->original->passShaders[pass]->pipeline,
+      .material = material,
+      .mesh = mesh,
+      .firstIndex = surface.startIndex,
+      .indexCount = surface.count,
+  };
+  m_slotKeys[slot] = key;
+  // Static batches do not follow the view, their instances keep the order of their slots
+  m_slotDrawKeys[slot] = batchDrawKey(key, surfaceIndex);
+  m_pipelineIds.Retain(key.pipeline);
+  m_meshIds.Retain(key.mesh->id);
+
+  // The batch id is assigned once all new instances are known
+  auto &table = m_renderer->GetInstanceTable();
+  table.SetInstance(slot, glm::vec4(surface.bounds.origin, surface.bounds.sphereRadius), INVALID_BATCH, objectId);
+  table.SetTransform(slot, transform);
+
+  const auto [center, radius] = world_sphere(surface.bounds, transform);
+  m_staticBounds.Set(slot, center, radius);
+}
+
+void RenderSystem::releaseStaticInstances(StaticInstances &instances) {
+  auto &table = m_renderer->GetInstanceTable();
+  for (uint32_t slot : instances.slots) {
+    m_pipelineIds.Release(m_slotKeys[slot].pipeline);
+    m_meshIds.Release(m_slotKeys[slot].mesh->id);
+    m_slotKeys[slot] = {};
+    table.Free(slot);
+  }
+  instances.slots.clear();
+}
+
+void RenderSystem::rebuildStaticBatches() {
+  m_sortKeys.clear();
+  m_sortPayloads.clear();
+  for (const auto &[slot, key] : std::views::enumerate(m_slotKeys)) {
+    if (key.material == nullptr)
+      continue;
+    m_sortKeys.push_back(m_slotDrawKeys[slot]);
+    m_sortPayloads.push_back(static_cast<uint32_t>(slot));
+  }
+  m_radixSorter.Sort(m_sortKeys, m_sortPayloads);
+
+  // Batches own contiguous ranges of the compacted instance list, one per run of equal keys.
+  // Only slots whose batch id moved are uploaded again
+  auto &table = m_renderer->GetInstanceTable();
+  m_indirectBatches.clear();
+  for (const auto &[pos, slot] : std::views::enumerate(m_sortPayloads)) {
+    if (pos == 0 || m_sortKeys[pos] != m_sortKeys[pos - 1] || m_slotKeys[slot] != m_slotKeys[m_sortPayloads[pos - 1]]) {
+      const BatchKey &key = m_slotKeys[slot];
+      m_indirectBatches.push_back({
+          .indexCount = key.indexCount,
+          .firstIndex = key.firstIndex,
+          .firstInstance = static_cast<uint32_t>(pos),
+          .instanceCount = 0,
+          .mesh = key.mesh,
+          .material = key.material,
+      });
+    }
+    m_indirectBatches.back().instanceCount++;
+    table.SetBatch(slot, static_cast<uint32_t>(m_indirectBatches.size() - 1));
+  }
+
+  m_renderer->UpdateStaticBatches(m_indirectBatches);
+}
+
+uint64_t RenderSystem::batchDrawKey(const BatchKey &key, uint32_t surfaceIndex) {
+  // Surfaces past the field share its last value, their BatchKeys still tell them apart
+  surfaceIndex = std::min(surfaceIndex, (1u << SURFACE_BITS) - 1);
+
+  uint64_t drawKey = key.transparent ? 1 : 0;
+  drawKey = drawKey << PIPELINE_BITS | m_pipelineIds.Get(key.pipeline, m_frameIndex);
+  drawKey = drawKey << MATERIAL_BITS | key.material->materialIndex;
+  drawKey = drawKey << MESH_BITS | m_meshIds.Get(key.mesh->id, m_frameIndex);
+  drawKey = drawKey << SURFACE_BITS | surfaceIndex;
+  return drawKey << DEPTH_BUCKET_BITS;
+}
+
+void RenderSystem::updateDynamicObjects(const Camera &camera) {
+  auto &ecs = Ecs::GetInstance();
+
+  m_dynamicKeys.clear();
+  m_dynamicTransforms.clear();
+  m_dynamicObjectIds.clear();
+  m_dynamicSpheres.clear();
+  m_dynamicObjectBounds.clear();
+  m_dynamicObjectEntityIds.clear();
+  m_sortKeys.clear();
+  m_sortPayloads.clear();
+  ecs.Each<DynamicObject, LocalToWorld>([&](Hori::Entity e, DynamicObject &drawable, LocalToWorld &localToWorld) {
+    m_dynamicObjectBounds.push_back(world_box(*drawable.mesh, localToWorld.value));
+    m_dynamicObjectEntityIds.push_back(e.id);
+    for (const auto &[surfaceIndex, surface] : std::views::enumerate(drawable.mesh->surfaces)) {
+      Material *material = surface.material.get();
+      const MeshPassType pass = main_pass(*material->original);
+      const BatchKey &key = m_dynamicKeys.emplace_back(BatchKey{
+          .transparent = pass == MeshPassType::Transparency,
+          .pipeline = material->original->passShaders[pass]->pipeline,
+          .material = material,
+          .mesh = drawable.mesh.get(),
+          .firstIndex = surface.startIndex,
+          .indexCount = surface.count,
+      });
+      const auto &sphere = m_dynamicSpheres.emplace_back(world_sphere(surface.bounds, localToWorld.value));
+      m_sortKeys.push_back(batchDrawKey(key, static_cast<uint32_t>(surfaceIndex)) | depth_bucket(camera, sphere.first));
+      m_sortPayloads.push_back(static_cast<uint32_t>(m_dynamicTransforms.size()));
+      m_dynamicTransforms.push_back(localToWorld.value);
+      m_dynamicObjectIds.push_back(e.id);
+    }
+  });
+
+  // The instances stay in submission order, the sorted keys only give the batches. The GPU sorts the instances
+  // themselves by batch and depth bucket
+  m_radixSorter.Sort(m_sortKeys, m_sortPayloads);
+
+  m_dynamicBatches.clear();
+  m_dynamicBounds.Resize(m_dynamicKeys.size());
+  m_dynamicBatchIds.resize(m_dynamicKeys.size());
+  m_dynamicSortKeys.resize(m_dynamicKeys.size());
+  for (const auto &[pos, idx] : std::views::enumerate(m_sortPayloads)) {
+    if (pos == 0 || m_sortKeys[pos] >> DEPTH_BUCKET_BITS != m_sortKeys[pos - 1] >> DEPTH_BUCKET_BITS || m_dynamicKeys[idx] != m_dynamicKeys[m_sortPayloads[pos - 1]]) {
+      const BatchKey &key = m_dynamicKeys[idx];
+      m_dynamicBatches.push_back({
+          .indexCount = key.indexCount,
+          .firstIndex = key.firstIndex,
+          .firstInstance = static_cast<uint32_t>(pos),
+          .instanceCount = 0,
+          .mesh = key.mesh,
+          .material = key.material,
+      });
+    }
+    m_dynamicBatches.back().instanceCount++;
+
+    const auto batchId = static_cast<uint32_t>(m_dynamicBatches.size() - 1);
+    const auto depthBucket = static_cast<uint32_t>(m_sortKeys[pos] & ((1 << DEPTH_BUCKET_BITS) - 1));
+    m_dynamicBounds.Set(idx, m_dynamicSpheres[idx].first, m_dynamicSpheres[idx].second);
+    m_dynamicBatchIds[idx] = batchId;
+    m_dynamicSortKeys[idx] = batchId << DEPTH_BUCKET_BITS | depthBucket;
+  }
+
+  const auto sortKeyBits = static_cast<uint32_t>(std::bit_width(m_dynamicBatches.size())) + DEPTH_BUCKET_BITS;
+  m_renderer->UploadDynamicObjects(m_dynamicBatches, m_dynamicTransforms, m_dynamicObjectIds, m_dynamicBatchIds, m_dynamicSortKeys, sortKeyBits);
+}
+
+void RenderSystem::updateSpatialIndex() {
+  auto &ecs = Ecs::GetInstance();
+  auto *spatialIndex = ecs.GetSingletonComponent<SpatialIndex>();
+
+  if (m_staticSpatialDirty) {
+    m_objectBounds.clear();
+    m_objectIds.clear();
+    ecs.Each<StaticObject, LocalToWorld>([&](Hori::Entity e, StaticObject &drawable, LocalToWorld &localToWorld) {
+      m_objectBounds.push_back(world_box(*drawable.mesh, localToWorld.value));
+      m_objectIds.push_back(e.id);
     });
-    ecs.Each<DirtyStaticObject>([&](Hori::Entity e, DirtyStaticObject) {
-      ecs.RemoveComponents<DirtyStaticObject>(e);
-    });
-    objects = sortObjects(objects);
-    m_renderer->UpdateStaticObjects(objects);
-    m_indirectBatches = packObjects(objects);
+    spatialIndex->SetStaticObjects(m_objectBounds, m_objectIds);
+    m_staticSpatialDirty = false;
+  }
+  spatialIndex->SetDynamicObjects(m_dynamicObjectBounds, m_dynamicObjectEntityIds);
+}
+
+void RenderSystem::selectClickedObject(const Camera &camera) {
+  auto &ecs = Ecs::GetInstance();
+  bool pressed = false;
+  ecs.Each<Controller>([&pressed](Hori::Entity, Controller &controller) {
+    pressed = controller.mouseButtonLeftPressed && controller.mouseMode == MouseMode::EDITOR;
+  });
+
+  // Selection happens on the press itself, a held button does not keep tagging
+  const bool clicked = pressed && !m_selectButtonWasPressed;
+  m_selectButtonWasPressed = pressed;
+  if (!clicked)
+    return;
+
+  float x, y;
+  SDL_GetMouseState(&x, &y);
+  const VkExtent2D extent = m_renderer->GetSwapchain().GetExtent();
+  const glm::vec2 viewportSize{static_cast<float>(extent.width), static_cast<float>(extent.height)};
+  const Ray ray = SpatialIndex::ScreenRay({x, y}, viewportSize, camera.viewProjection);
+
+  // Object boxes are loose and a level's box holds the camera, the triangles decide which object was clicked
+  std::unordered_map<uint32_t, std::pair<const Mesh *, glm::mat4>> objectMeshes;
+  ecs.Each<StaticObject, LocalToWorld>([&](Hori::Entity e, StaticObject &drawable, LocalToWorld &localToWorld) {
+    objectMeshes.emplace(e.id, std::pair{drawable.mesh.get(), localToWorld.value});
+  });
+  ecs.Each<DynamicObject, LocalToWorld>([&](Hori::Entity e, DynamicObject &drawable, LocalToWorld &localToWorld) {
+    objectMeshes.emplace(e.id, std::pair{drawable.mesh.get(), localToWorld.value});
+  });
+
+  SpatialRayHit hit;
+  ecs.GetSingletonComponent<SpatialIndex>()->CastRays({&ray, 1}, {&hit, 1}, [&objectMeshes](uint32_t objectId, const Ray &objectRay, float tMax) {
+    const auto &[mesh, transform] = objectMeshes.at(objectId);
+    return intersect_mesh(*mesh, transform, objectRay, tMax);
+  });
+  Hori::Entity selectedEntity{hit.objectId};
+  if (selectedEntity.Valid())
+    ecs.AddComponents(selectedEntity, RayTagged{});
+}
+
+void RenderSystem::cullStaticObjects(const Camera &camera) {
+  m_sphereCuller.Cull(Frustum::FromMatrix(camera.viewProjection), m_staticBounds, m_visibleSlots);
+
+  const auto &table = m_renderer->GetInstanceTable();
+  group_by_batch(m_visibleSlots, m_indirectBatches, [&](uint32_t slot) { return table.GetBatchId(slot); }, m_visibleInstances, m_visibleBatches);
+  m_renderer->UploadVisibleStaticObjects(m_visibleInstances, m_visibleBatches);
+}
+
+void RenderSystem::renderShadows() {
+  if (m_renderer->GetGpuLightData().shadowsEnabled == 0)
+    return;
+
+  // Each cascade volume reaches back towards the light, so casters outside the view still land in it
+  const auto &table = m_renderer->GetInstanceTable();
+  m_staticShadowCasters.resize(SHADOW_CASCADE_COUNT);
+  m_dynamicShadowCasters.resize(SHADOW_CASCADE_COUNT);
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    const Frustum frustum = Frustum::FromMatrix(m_renderer->GetShadowCascade(cascade).viewProj);
+
+    // Static casters are only needed when the cached cascade is drawn again
+    auto &staticCasters = m_staticShadowCasters[cascade];
+    staticCasters.instances.clear();
+    staticCasters.batches.clear();
+    if (m_renderer->ShadowCascadeNeedsStaticRender(cascade)) {
+      m_sphereCuller.Cull(frustum, m_staticBounds, m_casterIndices);
+      group_by_batch(m_casterIndices, m_indirectBatches, [&](uint32_t slot) { return table.GetBatchId(slot); }, staticCasters.instances, staticCasters.batches);
+    }
+
+    auto &dynamicCasters = m_dynamicShadowCasters[cascade];
+    m_sphereCuller.Cull(frustum, m_dynamicBounds, m_casterIndices);
+    group_by_batch(m_casterIndices, m_dynamicBatches, [&](uint32_t idx) { return m_dynamicBatchIds[idx]; }, dynamicCasters.instances, dynamicCasters.batches);
+  }
+
+  m_renderer->RenderShadows(m_staticShadowCasters, m_dynamicShadowCasters);
+}
+
+void RenderSystem::requestHoverPick() {
+  // A headless renderer has neither a cursor nor an ImGui context
+  if (m_renderer->IsHeadless() || m_pendingHoverPick.has_value() || ImGui::GetIO().WantCaptureMouse)
+    return;
+
+  float x, y;
+  SDL_GetMouseState(&x, &y);
+  const glm::ivec2 pixel{static_cast<int>(x), static_cast<int>(y)};
+  if (pixel == m_lastHoverPixel)
+    return;
+
+  m_lastHoverPixel = pixel;
+  m_pendingHoverPick = m_renderer->RequestPick(pixel, HOVER_PICK_RADIUS);
+}
+
+void RenderSystem::renderPicks() {
+  // Called without queries too, the renderer declares the picking passes every frame. Only objects inside a
+  // query's few pixel frustum are drawn for it
+  const std::span<const PickRequest> requests = m_renderer->GetFramePickRequests();
+  const auto &table = m_renderer->GetInstanceTable();
+  m_staticPickCandidates.resize(requests.size());
+  m_dynamicPickCandidates.resize(requests.size());
+  for (const auto &[request, staticCandidates, dynamicCandidates] : std::views::zip(requests, m_staticPickCandidates, m_dynamicPickCandidates)) {
+    const Frustum frustum = Frustum::FromMatrix(request.viewProj);
+    m_sphereCuller.Cull(frustum, m_staticBounds, m_casterIndices);
+    group_by_batch(m_casterIndices, m_indirectBatches, [&](uint32_t slot) { return table.GetBatchId(slot); }, staticCandidates.instances, staticCandidates.batches);
+    m_sphereCuller.Cull(frustum, m_dynamicBounds, m_casterIndices);
+    group_by_batch(m_casterIndices, m_dynamicBatches, [&](uint32_t idx) { return m_dynamicBatchIds[idx]; }, dynamicCandidates.instances, dynamicCandidates.batches);
   }
 
-  m_renderer->RenderStaticObjects(m_indirectBatches);
+  m_renderer->RenderPicks(std::span(m_staticPickCandidates).first(requests.size()), std::span(m_dynamicPickCandidates).first(requests.size()));
+}
+
+void RenderSystem::applyPickResults() {
+  auto &ecs = Ecs::GetInstance();
+  for (const auto &result : m_renderer->TakePickResults()) {
+    if (m_pendingHoverPick != result.requestId)
+      continue;
+
+    m_pendingHoverPick.reset();
+    Hori::Entity hoveredEntity{result.objectId};
+    if (hoveredEntity.Valid())
+      ecs.AddComponents(hoveredEntity, Hovered{});
+  }
 }
 
 void RenderSystem::renderGui(float dt) {
+  if (m_renderer->IsHeadless()) {
+    m_renderer->RenderImGui();
+    return;
+  }
+
   auto &ecs = Ecs::GetInstance();
 
   ImGui_ImplVulkan_NewFrame();
@@ -102,6 +599,46 @@ void RenderSystem::renderGui(float dt) {
   ImGui::Text("Frames per second: %d", static_cast<int>(ecs.GetSingletonComponent<FramesPerSecond>()->value));
   ImGui::Text("Draw calls count: %d", stats.drawcallCount);
   ImGui::Text("Triangle count: %d", stats.triangleCount);
+  ImGui::Text("Scene update: %.3f ms", stats.sceneUpdateTime);
+  ImGui::Text("Transient memory: %.1f MB (%.1f MB unaliased)", static_cast<double>(stats.transientMemorySize) / (1024.0 * 1024.0), static_cast<double>(stats.unaliasedMemorySize) / (1024.0 * 1024.0));
+  if (ImGui::CollapsingHeader("GPU time", ImGuiTreeNodeFlags_DefaultOpen)) {
+    for (const auto &timing : m_renderer->GetGpuTimings()) {
+      ImGui::Indent(static_cast<float>(timing.depth) * ImGui::GetStyle().IndentSpacing);
+      ImGui::Text("%.*s: %.3f ms", static_cast<int>(timing.name.size()), timing.name.data(), timing.milliseconds);
+      ImGui::Unindent(static_cast<float>(timing.depth) * ImGui::GetStyle().IndentSpacing);
+    }
+  }
+
+  auto cullingMode = static_cast<int>(m_cullingMode);
+  ImGui::RadioButton("GPU culling", &cullingMode, static_cast<int>(CullingMode::Gpu));
+  ImGui::SameLine();
+  ImGui::RadioButton("CPU culling", &cullingMode, static_cast<int>(CullingMode::Cpu));
+  m_cullingMode = static_cast<CullingMode>(cullingMode);
+  if (m_cullingMode == CullingMode::Cpu) {
+    ImGui::Text("Visible instances: %d", stats.visibleInstanceCount);
+    ImGui::Text("Culled instances: %d", stats.culledInstanceCount);
+  }
+
+  auto &dynamicResolution = m_renderer->GetDynamicResolution();
+  DynamicResolutionSettings resolutionSettings = dynamicResolution.GetSettings();
+  // Without the controller the scene renders at the max scale
+  ImGui::Checkbox("Dynamic resolution", &resolutionSettings.enabled);
+  ImGui::SliderFloat("Max render scale", &resolutionSettings.maxScale, 0.25f, 1.0f);
+  if (resolutionSettings.enabled) {
+    float targetMilliseconds = static_cast<float>(resolutionSettings.targetMilliseconds);
+    ImGui::SliderFloat("Target GPU time (ms)", &targetMilliseconds, 4.0f, 50.0f);
+    resolutionSettings.targetMilliseconds = targetMilliseconds;
+    ImGui::SliderFloat("Min render scale", &resolutionSettings.minScale, 0.25f, 1.0f);
+  }
+  dynamicResolution.SetSettings(resolutionSettings);
+  ImGui::Text("Render scale: %.2f (GPU %.2f ms)", dynamicResolution.GetScale(), dynamicResolution.GetFilteredMilliseconds());
+
+  auto renderPath = static_cast<int>(m_renderPath);
+  ImGui::RadioButton("Forward", &renderPath, static_cast<int>(RenderPath::Forward));
+  ImGui::SameLine();
+  ImGui::RadioButton("Visibility buffer", &renderPath, static_cast<int>(RenderPath::Visibility));
+  m_renderPath = static_cast<RenderPath>(renderPath);
+  m_renderer->SetRenderPath(m_renderPath);
   ImGui::End();
 
   if (m_showElements.test(static_cast<size_t>(ShowImGui::PointLights))) {
@@ -164,69 +701,3 @@ void RenderSystem::renderGui(float dt) {
   ImGui::Render();
   m_renderer->RenderImGui();
 }
-
-RenderIndirectObjects RenderSystem::sortObjects(RenderIndirectObjects &objects) {
-  std::vector<uint32_t> order(objects.objectIds.size());
-  std::iota(order.begin(), order.end(), 0);
-
-  std::ranges::sort(order, {}, [&](uint32_t i) {
-    return std::pair{objects.materials[i], objects.meshes[i]};
-  });
-
-  RenderIndirectObjects newObjects;
-  const auto n = static_cast<size_t>(order.size());
-
-  newObjects.firstIndices.resize(n);
-  newObjects.indexCounts.resize(n);
-  newObjects.objectIds.resize(n);
-  newObjects.transforms.resize(n);
-  newObjects.meshes.resize(n);
-  newObjects.materials.resize(n);
-
-  for (size_t pos = 0; pos < n; ++pos) {
-    const auto idx = order[pos];
-    newObjects.firstIndices[pos] = objects.firstIndices[idx];
-    newObjects.indexCounts[pos] = objects.indexCounts[idx];
-    newObjects.objectIds[pos] = objects.objectIds[idx];
-    newObjects.transforms[pos] = objects.transforms[idx];
-    newObjects.meshes[pos] = objects.meshes[idx];
-    newObjects.materials[pos] = objects.materials[idx];
-  }
-
-  return newObjects;
-}
-
-std::vector<IndirectBatch> RenderSystem::packObjects(RenderIndirectObjects &objects) {
-  auto sameKey = [&](size_t a, size_t b) {
-    return objects.meshes[a] == objects.meshes[b] &&
-           objects.materials[a] == objects.materials[b] &&
-           objects.firstIndices[a] == objects.firstIndices[b] &&
-           objects.indexCounts[a] == objects.indexCounts[b];
-  };
-
-  std::vector<IndirectBatch> draws;
-  draws.push_back({
-      .indexCount = objects.indexCounts[0],
-      .firstIndex = objects.firstIndices[0],
-      .firstInstance = 0,
-      .instanceCount = 1,
-      .mesh = objects.meshes[0],
-      .material = objects.materials[0],
-  });
-
-  for (uint32_t i = 1; i < objects.objectIds.size(); i++) {
-    if (!sameKey(i - 1, i)) {
-      draws.push_back({
-          .indexCount = objects.indexCounts[i],
-          .firstIndex = objects.firstIndices[i],
-          .firstInstance = i,
-          .instanceCount = 0,
-          .mesh = objects.meshes[i],
-          .material = objects.materials[i],
-      });
-    }
-    draws.back().instanceCount++;
-  }
-
-  return draws;
-}
\ No newline at end of file
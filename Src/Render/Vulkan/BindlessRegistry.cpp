@@ -0,0 +1,107 @@
+#include "Vulkan/BindlessRegistry.h"
+
+#include <array>
+#include <stdexcept>
+
+#include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
+#include "Vulkan/Descriptors/DescriptorWriter.h"
+
+BindlessRegistry::BindlessRegistry(std::shared_ptr<VulkanContext> ctx)
+  : m_ctx{ctx} {
+  VkDevice device = m_ctx->GetDevice();
+
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(BINDLESS_MATERIALS_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(BINDLESS_TEXTURES_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_BINDLESS_TEXTURES);
+    builder.AddBinding(BINDLESS_SAMPLERS_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, MAX_BINDLESS_SAMPLERS);
+
+    // New slots are written while frames that index older slots are still in flight
+    constexpr VkDescriptorBindingFlags arrayFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    std::array<VkDescriptorBindingFlags, 3> bindingFlags{0, arrayFlags, arrayFlags};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+        .pBindingFlags = bindingFlags.data(),
+    };
+    m_layout = builder.Build(device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+  }
+
+  std::array<VkDescriptorPoolSize, 3> poolSizes{{
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_BINDLESS_TEXTURES},
+      {VK_DESCRIPTOR_TYPE_SAMPLER, MAX_BINDLESS_SAMPLERS},
+  }};
+  VkDescriptorPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+      .maxSets = 1,
+      .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+      .pPoolSizes = poolSizes.data(),
+  };
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &m_pool));
+
+  VkDescriptorSetAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = m_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &m_layout,
+  };
+  VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &m_set));
+
+  m_materialBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), MAX_BINDLESS_MATERIALS * sizeof(GPUMaterialData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+  DescriptorWriter writer;
+  writer.WriteBuffer(BINDLESS_MATERIALS_BINDING, m_materialBuffer->buffer, MAX_BINDLESS_MATERIALS * sizeof(GPUMaterialData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(device, m_set);
+}
+
+BindlessRegistry::~BindlessRegistry() {
+  VkDevice device = m_ctx->GetDevice();
+  m_materialBuffer.reset();
+  vkDestroyDescriptorPool(device, m_pool, nullptr);
+  vkDestroyDescriptorSetLayout(device, m_layout, nullptr);
+}
+
+uint32_t BindlessRegistry::AddTexture(VkImageView view) {
+  if (auto it = m_textureSlots.find(view); it != m_textureSlots.end())
+    return it->second;
+
+  const auto slot = static_cast<uint32_t>(m_textureSlots.size());
+  if (slot >= MAX_BINDLESS_TEXTURES)
+    throw std::runtime_error("failed to register bindless texture, limit reached!");
+
+  DescriptorWriter writer;
+  writer.WriteImage(BINDLESS_TEXTURES_BINDING, view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, slot);
+  writer.UpdateSet(m_ctx->GetDevice(), m_set);
+
+  m_textureSlots.emplace(view, slot);
+  return slot;
+}
+
+uint32_t BindlessRegistry::AddSampler(VkSampler sampler) {
+  if (auto it = m_samplerSlots.find(sampler); it != m_samplerSlots.end())
+    return it->second;
+
+  const auto slot = static_cast<uint32_t>(m_samplerSlots.size());
+  if (slot >= MAX_BINDLESS_SAMPLERS)
+    throw std::runtime_error("failed to register bindless sampler, limit reached!");
+
+  DescriptorWriter writer;
+  writer.WriteImage(BINDLESS_SAMPLERS_BINDING, VK_NULL_HANDLE, sampler, VK_IMAGE_LAYOUT_UNDEFINED, VK_DESCRIPTOR_TYPE_SAMPLER, slot);
+  writer.UpdateSet(m_ctx->GetDevice(), m_set);
+
+  m_samplerSlots.emplace(sampler, slot);
+  return slot;
+}
+
+uint32_t BindlessRegistry::AddMaterial(const GPUMaterialData &material) {
+  if (m_materialCount >= MAX_BINDLESS_MATERIALS)
+    throw std::runtime_error("failed to register bindless material, limit reached!");
+
+  m_materialBuffer->MapMemoryFromScalar(material, m_materialCount * sizeof(GPUMaterialData));
+  return m_materialCount++;
+}
+
+VkDescriptorSetLayout BindlessRegistry::GetLayout() const { return m_layout; }
+VkDescriptorSet BindlessRegistry::GetSet() const { return m_set; }
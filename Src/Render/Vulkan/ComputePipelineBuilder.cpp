@@ -16,7 +16,7 @@ VkPipeline ComputePipelineBuilder::CreatePipeline() {
       .basePipelineHandle = VK_NULL_HANDLE
   };
 
-  if (vkCreateComputePipelines(m_ctx->GetDevice(), VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+  if (vkCreateComputePipelines(m_ctx->GetDevice(), m_ctx->GetPipelineCache(), 1, &pipelineCreateInfo, nullptr, &m_pipeline) != VK_SUCCESS)
     throw std::runtime_error("failed to create graphics pipeline!");
 
   return m_pipeline;
@@ -2,12 +2,12 @@
 
 DescriptorLayoutBuilder::DescriptorLayoutBuilder() = default;
 
-void DescriptorLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType type)
+void DescriptorLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType type, uint32_t count)
 {
     VkDescriptorSetLayoutBinding newbind {
         .binding = binding,
         .descriptorType = type,
-        .descriptorCount = 1,
+        .descriptorCount = count,
     };
 
     bindings.push_back(newbind);
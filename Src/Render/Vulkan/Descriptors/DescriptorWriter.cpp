@@ -2,7 +2,7 @@
 
 DescriptorWriter::DescriptorWriter() = default;
 
-void DescriptorWriter::WriteImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type)
+void DescriptorWriter::WriteImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t arrayElement)
 {
     VkDescriptorImageInfo& info = imageInfos.emplace_back(VkDescriptorImageInfo{
         .sampler = sampler,
@@ -14,6 +14,7 @@ void DescriptorWriter::WriteImage(uint32_t binding, VkImageView image, VkSampler
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = VK_NULL_HANDLE,
         .dstBinding = binding,
+        .dstArrayElement = arrayElement,
         .descriptorCount = 1,
         .descriptorType = type,
         .pImageInfo = &info
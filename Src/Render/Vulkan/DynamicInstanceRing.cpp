@@ -0,0 +1,76 @@
+#include "Vulkan/DynamicInstanceRing.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr uint32_t MIN_INSTANCE_CAPACITY = 1024;
+constexpr uint32_t MIN_DRAW_CAPACITY = 64;
+
+// Largest storage buffer offset alignment the spec allows, so any device can bind the sub ranges
+constexpr VkDeviceSize RANGE_ALIGNMENT = 256;
+
+VkDeviceSize align_up(VkDeviceSize value) {
+  return (value + RANGE_ALIGNMENT - 1) & ~(RANGE_ALIGNMENT - 1);
+}
+
+} // namespace
+
+DynamicInstanceRing::DynamicInstanceRing(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount)
+  : m_ctx{ctx},
+    m_frameCount{frameCount} {
+}
+
+bool DynamicInstanceRing::Reserve(uint32_t instanceCount, uint32_t drawCount, DeletionQueue &deletionQueue) {
+  if (m_buffer != nullptr && instanceCount <= m_instanceCapacity && drawCount <= m_drawCapacity)
+    return false;
+
+  m_instanceCapacity = std::max({std::bit_ceil(instanceCount), m_instanceCapacity, MIN_INSTANCE_CAPACITY});
+  m_drawCapacity = std::max({std::bit_ceil(drawCount), m_drawCapacity, MIN_DRAW_CAPACITY});
+
+  VkDeviceSize offset = 0;
+  auto reserve = [&](VkDeviceSize size) {
+    const VkDeviceSize rangeOffset = offset;
+    offset = align_up(offset + size);
+    return rangeOffset;
+  };
+  m_layout.transforms = reserve(m_instanceCapacity * sizeof(glm::mat4));
+  m_layout.objectIds = reserve(m_instanceCapacity * sizeof(uint32_t));
+  m_layout.instanceIndices = reserve(m_instanceCapacity * sizeof(uint32_t));
+  m_layout.drawIndices = reserve(m_instanceCapacity * sizeof(uint32_t));
+  m_layout.sortKeys = reserve(m_instanceCapacity * sizeof(uint32_t));
+  m_layout.drawData = reserve(m_drawCapacity * sizeof(GPUDrawData));
+  m_layout.drawCommands = reserve(m_drawCapacity * sizeof(VkDrawIndexedIndirectCommand));
+  m_layout.size = offset;
+
+  // Frames still in flight read the old sections, it is destroyed once the current frame completes
+  if (m_buffer != nullptr)
+    deletionQueue.PushBuffer(std::move(*m_buffer));
+  // The compute queue sorts the instance indices of a section, the graphics queue reads them
+  m_buffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), m_layout.size * m_frameCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, m_ctx->GetSharedQueueFamilies());
+
+  return true;
+}
+
+void DynamicInstanceRing::Write(uint32_t frame, std::span<const glm::mat4> transforms, std::span<const uint32_t> objectIds, std::span<const uint32_t> drawIndices, std::span<const uint32_t> sortKeys, std::span<const GPUDrawData> drawData, std::span<const VkDrawIndexedIndirectCommand> drawCommands) {
+  // The buffer stays mapped for its whole lifetime, writing a section is a plain copy
+  auto *section = static_cast<char *>(m_buffer->info.pMappedData) + GetSectionOffset(frame);
+  std::memcpy(section + m_layout.transforms, transforms.data(), transforms.size_bytes());
+  std::memcpy(section + m_layout.objectIds, objectIds.data(), objectIds.size_bytes());
+  std::memcpy(section + m_layout.drawIndices, drawIndices.data(), drawIndices.size_bytes());
+  std::memcpy(section + m_layout.sortKeys, sortKeys.data(), sortKeys.size_bytes());
+  std::memcpy(section + m_layout.drawData, drawData.data(), drawData.size_bytes());
+  std::memcpy(section + m_layout.drawCommands, drawCommands.data(), drawCommands.size_bytes());
+  m_buffer->Flush(GetSectionOffset(frame), m_layout.size);
+}
+
+VkBuffer DynamicInstanceRing::GetBuffer() const { return m_buffer->buffer; }
+VkDeviceAddress DynamicInstanceRing::GetDeviceAddress() const { return VkUtil::get_buffer_address(m_ctx->GetDevice(), m_buffer->buffer); }
+VkDeviceSize DynamicInstanceRing::GetSectionOffset(uint32_t frame) const { return frame * m_layout.size; }
+const DynamicSectionLayout &DynamicInstanceRing::GetLayout() const { return m_layout; }
+uint32_t DynamicInstanceRing::GetInstanceCapacity() const { return m_instanceCapacity; }
+uint32_t DynamicInstanceRing::GetDrawCapacity() const { return m_drawCapacity; }
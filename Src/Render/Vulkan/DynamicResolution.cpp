@@ -0,0 +1,82 @@
+#include "Vulkan/DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Spikes are followed within a few frames, the time only settles slowly once the load is gone
+constexpr double RISE_WEIGHT = 0.5;
+constexpr double FALL_WEIGHT = 0.1;
+// Scaling up only starts below this share of the budget, which keeps the scale from oscillating at the limit
+constexpr double RAISE_THRESHOLD = 0.85;
+// Aim a little under the target, the cost is not exactly proportional to the pixel count
+constexpr double HEADROOM = 0.95;
+constexpr float MAX_DROP = 0.75f;
+constexpr float MAX_RAISE = 1.05f;
+// Scales snap to this step so tiny corrections do not change the render size every frame
+constexpr float SCALE_STEP = 1.0f / 64.0f;
+
+} // namespace
+
+DynamicResolution::DynamicResolution(uint32_t latencyFrames)
+  : m_latencyFrames{latencyFrames} {
+}
+
+float DynamicResolution::Update(double gpuMilliseconds) {
+  if (!m_settings.enabled) {
+    setScale(m_settings.maxScale);
+    return m_scale;
+  }
+  if (gpuMilliseconds <= 0.0)
+    return m_scale;
+
+  if (m_filteredMilliseconds == 0.0)
+    m_filteredMilliseconds = gpuMilliseconds;
+  const double weight = gpuMilliseconds > m_filteredMilliseconds ? RISE_WEIGHT : FALL_WEIGHT;
+  m_filteredMilliseconds += (gpuMilliseconds - m_filteredMilliseconds) * weight;
+
+  // Frames recorded before the last change are still being measured
+  if (m_cooldown > 0) {
+    m_cooldown--;
+    return m_scale;
+  }
+
+  const double target = m_settings.targetMilliseconds;
+  if (m_filteredMilliseconds <= target && m_filteredMilliseconds >= target * RAISE_THRESHOLD)
+    return m_scale;
+
+  // Pixel count goes with the square of the scale
+  const auto ideal = static_cast<float>(m_scale * std::sqrt(target * HEADROOM / m_filteredMilliseconds));
+  const float scale = std::clamp(ideal, m_scale * MAX_DROP, m_scale * MAX_RAISE);
+  const float oldScale = m_scale;
+  setScale(std::round(scale / SCALE_STEP) * SCALE_STEP);
+  if (m_scale != oldScale) {
+    // Expected time at the new size, until measurements of it arrive
+    m_filteredMilliseconds *= (m_scale * m_scale) / (oldScale * oldScale);
+    m_cooldown = m_latencyFrames;
+  }
+  return m_scale;
+}
+
+VkExtent2D DynamicResolution::ScaleExtent(VkExtent2D extent) const {
+  return {
+      .width = std::max(static_cast<uint32_t>(static_cast<float>(extent.width) * m_scale), 1u),
+      .height = std::max(static_cast<uint32_t>(static_cast<float>(extent.height) * m_scale), 1u),
+  };
+}
+
+void DynamicResolution::SetSettings(const DynamicResolutionSettings &settings) {
+  m_settings = settings;
+  m_settings.maxScale = std::clamp(m_settings.maxScale, SCALE_STEP, 1.0f);
+  m_settings.minScale = std::clamp(m_settings.minScale, SCALE_STEP, m_settings.maxScale);
+  setScale(m_scale);
+}
+
+const DynamicResolutionSettings &DynamicResolution::GetSettings() const { return m_settings; }
+float DynamicResolution::GetScale() const { return m_scale; }
+double DynamicResolution::GetFilteredMilliseconds() const { return m_filteredMilliseconds; }
+
+void DynamicResolution::setScale(float scale) {
+  m_scale = std::clamp(scale, m_settings.minScale, m_settings.maxScale);
+}
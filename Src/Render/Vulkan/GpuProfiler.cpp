@@ -0,0 +1,84 @@
+#include "Vulkan/GpuProfiler.h"
+
+#include "Vulkan/VkCheck.h"
+
+GpuProfiler::GpuProfiler(std::shared_ptr<VulkanContext> ctx, uint32_t frameCount)
+  : m_ctx{ctx},
+    m_frames(frameCount) {
+  const VkPhysicalDeviceLimits limits = m_ctx->GetGpuProperties().limits;
+  m_supported = limits.timestampComputeAndGraphics == VK_TRUE && limits.timestampPeriod > 0.0f;
+  m_nanosecondsPerTick = limits.timestampPeriod;
+  if (!m_supported)
+    return;
+
+  VkQueryPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = MAX_GPU_SCOPES * 2,
+  };
+  for (auto &frame : m_frames)
+    VK_CHECK(vkCreateQueryPool(m_ctx->GetDevice(), &poolInfo, nullptr, &frame.queryPool));
+}
+
+GpuProfiler::~GpuProfiler() {
+  for (auto &frame : m_frames)
+    vkDestroyQueryPool(m_ctx->GetDevice(), frame.queryPool, nullptr);
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer cmd, uint32_t frameIndex) {
+  m_currentFrame = frameIndex;
+  m_openScopes = 0;
+  if (!m_supported)
+    return;
+
+  auto &frame = m_frames[frameIndex];
+  readTimings(frame);
+  frame.names.clear();
+  frame.depths.clear();
+  vkCmdResetQueryPool(cmd, frame.queryPool, 0, MAX_GPU_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::BeginScope(VkCommandBuffer cmd, std::string_view name) {
+  auto &frame = m_frames[m_currentFrame];
+  if (!m_supported || frame.names.size() == MAX_GPU_SCOPES)
+    return INVALID_GPU_SCOPE;
+
+  const auto scope = static_cast<uint32_t>(frame.names.size());
+  frame.names.push_back(name);
+  frame.depths.push_back(m_openScopes++);
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.queryPool, scope * 2);
+  return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer cmd, uint32_t scope) {
+  if (scope == INVALID_GPU_SCOPE)
+    return;
+
+  m_openScopes--;
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_frames[m_currentFrame].queryPool, scope * 2 + 1);
+}
+
+std::span<const GpuScopeTiming> GpuProfiler::GetTimings() const { return m_timings; }
+bool GpuProfiler::IsSupported() const { return m_supported; }
+
+void GpuProfiler::readTimings(FrameResources &frame) {
+  if (frame.names.empty())
+    return;
+
+  // Without the wait flag an unfinished or never closed query returns VK_NOT_READY, the last timings then stay
+  const auto queryCount = static_cast<uint32_t>(frame.names.size() * 2);
+  m_timestamps.resize(queryCount);
+  const VkResult result = vkGetQueryPoolResults(m_ctx->GetDevice(), frame.queryPool, 0, queryCount, m_timestamps.size() * sizeof(uint64_t), m_timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS)
+    return;
+
+  m_timings.clear();
+  for (uint32_t scope = 0; scope < frame.names.size(); scope++) {
+    const uint64_t ticks = m_timestamps[scope * 2 + 1] - m_timestamps[scope * 2];
+    m_timings.push_back({
+        .name = frame.names[scope],
+        .depth = frame.depths[scope],
+        .milliseconds = static_cast<double>(ticks) * m_nanosecondsPerTick / 1e6,
+    });
+  }
+}
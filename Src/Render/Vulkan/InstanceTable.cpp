@@ -0,0 +1,192 @@
+#include "Vulkan/InstanceTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr uint32_t MIN_CAPACITY = 1024;
+constexpr VkBufferUsageFlags TABLE_USAGE = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+struct SlotRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+// Sorts the dirty slots and merges neighbours, so a block of edited slots becomes a single copy region
+std::vector<SlotRange> merge_dirty_slots(std::vector<uint32_t> &slots) {
+  std::ranges::sort(slots);
+  const auto [first, last] = std::ranges::unique(slots);
+  slots.erase(first, last);
+
+  std::vector<SlotRange> ranges;
+  for (uint32_t slot : slots) {
+    if (!ranges.empty() && ranges.back().first + ranges.back().count == slot)
+      ranges.back().count++;
+    else
+      ranges.push_back({slot, 1});
+  }
+  slots.clear();
+  return ranges;
+}
+
+// Culling reads the table on the compute queue when the device has one, so the buffers are shared with it
+void grow_buffer(const VulkanContext &ctx, VkCommandBuffer cmd, std::unique_ptr<Buffer> &buffer, VkDeviceSize oldSize, VkDeviceSize newSize, DeletionQueue &deletionQueue) {
+  auto grown = std::make_unique<Buffer>(ctx.GetAllocator(), newSize, TABLE_USAGE, VMA_MEMORY_USAGE_GPU_ONLY, ctx.GetSharedQueueFamilies());
+  if (buffer != nullptr) {
+    VkBufferCopy copy{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = oldSize,
+    };
+    vkCmdCopyBuffer(cmd, buffer->buffer, grown->buffer, 1, &copy);
+    deletionQueue.PushBuffer(std::move(*buffer));
+  }
+  buffer = std::move(grown);
+}
+
+} // namespace
+
+InstanceTable::InstanceTable(std::shared_ptr<VulkanContext> ctx)
+  : m_ctx{ctx} {
+}
+
+uint32_t InstanceTable::Allocate() {
+  if (!m_freeSlots.empty()) {
+    const uint32_t slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    return slot;
+  }
+
+  const auto slot = static_cast<uint32_t>(m_transforms.size());
+  m_transforms.emplace_back(1.0f);
+  m_cullData.push_back({.batchId = INVALID_BATCH});
+  m_objectIds.push_back(0);
+  return slot;
+}
+
+void InstanceTable::Free(uint32_t slot) {
+  SetBatch(slot, INVALID_BATCH);
+  m_freeSlots.push_back(slot);
+}
+
+void InstanceTable::SetTransform(uint32_t slot, const glm::mat4 &transform) {
+  m_transforms[slot] = transform;
+  m_dirtyTransforms.push_back(slot);
+}
+
+void InstanceTable::SetInstance(uint32_t slot, const glm::vec4 &localSphere, uint32_t batchId, uint32_t objectId) {
+  m_cullData[slot] = {
+      .sphere = localSphere,
+      .batchId = batchId,
+  };
+  m_objectIds[slot] = objectId;
+  m_dirtyInstances.push_back(slot);
+}
+
+void InstanceTable::SetBatch(uint32_t slot, uint32_t batchId) {
+  if (m_cullData[slot].batchId == batchId)
+    return;
+
+  m_cullData[slot].batchId = batchId;
+  m_dirtyInstances.push_back(slot);
+}
+
+bool InstanceTable::Flush(VkCommandBuffer cmd, UploadAllocator &uploadAllocator, DeletionQueue &deletionQueue) {
+  if (!HasPendingChanges())
+    return false;
+  const bool reallocate = GetSlotCount() > m_capacity;
+
+  // Earlier submissions may still read the tables, the copies below must wait for them
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+  if (reallocate)
+    grow(cmd, deletionQueue);
+
+  const std::vector<SlotRange> transformRanges = merge_dirty_slots(m_dirtyTransforms);
+  const std::vector<SlotRange> instanceRanges = merge_dirty_slots(m_dirtyInstances);
+
+  VkDeviceSize uploadSize = 0;
+  for (const auto &range : transformRanges)
+    uploadSize += range.count * sizeof(glm::mat4);
+  for (const auto &range : instanceRanges)
+    uploadSize += range.count * (sizeof(GPUInstanceCullData) + sizeof(uint32_t));
+
+  if (uploadSize != 0) {
+    const UploadAllocation staging = uploadAllocator.Allocate(uploadSize, alignof(glm::mat4));
+
+    std::vector<VkBufferCopy> transformCopies, cullDataCopies, objectIdCopies;
+    VkDeviceSize offset = 0;
+    auto stage = [&](const void *src, VkDeviceSize elementSize, const SlotRange &range, std::vector<VkBufferCopy> &copies) {
+      const VkDeviceSize size = range.count * elementSize;
+      std::memcpy(static_cast<char *>(staging.data) + offset, static_cast<const char *>(src) + range.first * elementSize, size);
+      copies.push_back({.srcOffset = staging.offset + offset, .dstOffset = range.first * elementSize, .size = size});
+      offset += size;
+    };
+
+    for (const auto &range : transformRanges)
+      stage(m_transforms.data(), sizeof(glm::mat4), range, transformCopies);
+    for (const auto &range : instanceRanges) {
+      stage(m_cullData.data(), sizeof(GPUInstanceCullData), range, cullDataCopies);
+      stage(m_objectIds.data(), sizeof(uint32_t), range, objectIdCopies);
+    }
+
+    if (!transformCopies.empty())
+      vkCmdCopyBuffer(cmd, staging.buffer, m_transformBuffer->buffer, static_cast<uint32_t>(transformCopies.size()), transformCopies.data());
+    if (!cullDataCopies.empty()) {
+      vkCmdCopyBuffer(cmd, staging.buffer, m_cullDataBuffer->buffer, static_cast<uint32_t>(cullDataCopies.size()), cullDataCopies.data());
+      vkCmdCopyBuffer(cmd, staging.buffer, m_objectIdBuffer->buffer, static_cast<uint32_t>(objectIdCopies.size()), objectIdCopies.data());
+    }
+  }
+
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  return reallocate;
+}
+
+bool InstanceTable::HasPendingChanges() const {
+  return GetSlotCount() > m_capacity || !m_dirtyTransforms.empty() || !m_dirtyInstances.empty();
+}
+
+uint32_t InstanceTable::GetSlotCount() const { return static_cast<uint32_t>(m_transforms.size()); }
+uint32_t InstanceTable::GetInstanceCount() const { return GetSlotCount() - static_cast<uint32_t>(m_freeSlots.size()); }
+uint32_t InstanceTable::GetCapacity() const { return m_capacity; }
+uint32_t InstanceTable::GetBatchId(uint32_t slot) const { return m_cullData[slot].batchId; }
+
+VkBuffer InstanceTable::GetTransformBuffer() const { return m_transformBuffer->buffer; }
+VkBuffer InstanceTable::GetCullDataBuffer() const { return m_cullDataBuffer->buffer; }
+VkBuffer InstanceTable::GetObjectIdBuffer() const { return m_objectIdBuffer->buffer; }
+VkBuffer InstanceTable::GetVisibilityBuffer() const { return m_visibilityBuffer->buffer; }
+
+void InstanceTable::grow(VkCommandBuffer cmd, DeletionQueue &deletionQueue) {
+  // Doubling keeps the number of reallocations logarithmic in the instance count
+  const uint32_t oldCapacity = m_capacity;
+  m_capacity = std::max(std::bit_ceil(GetSlotCount()), MIN_CAPACITY);
+
+  grow_buffer(*m_ctx, cmd, m_transformBuffer, oldCapacity * sizeof(glm::mat4), m_capacity * sizeof(glm::mat4), deletionQueue);
+  grow_buffer(*m_ctx, cmd, m_cullDataBuffer, oldCapacity * sizeof(GPUInstanceCullData), m_capacity * sizeof(GPUInstanceCullData), deletionQueue);
+  grow_buffer(*m_ctx, cmd, m_objectIdBuffer, oldCapacity * sizeof(uint32_t), m_capacity * sizeof(uint32_t), deletionQueue);
+  grow_buffer(*m_ctx, cmd, m_visibilityBuffer, oldCapacity * sizeof(uint32_t), m_capacity * sizeof(uint32_t), deletionQueue);
+
+  // New slots start invisible, the late phase tests them in their first frame
+  const VkDeviceSize visibilityOffset = oldCapacity * sizeof(uint32_t);
+  vkCmdFillBuffer(cmd, m_visibilityBuffer->buffer, visibilityOffset, m_capacity * sizeof(uint32_t) - visibilityOffset, 0);
+
+  // The uploads that follow overwrite parts of the copied ranges
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+  // Slots allocated before the growth were never uploaded past the old capacity, they are all sent again
+  for (uint32_t slot = oldCapacity; slot < GetSlotCount(); slot++) {
+    m_dirtyTransforms.push_back(slot);
+    m_dirtyInstances.push_back(slot);
+  }
+}
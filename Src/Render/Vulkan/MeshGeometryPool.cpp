@@ -0,0 +1,189 @@
+#include "Vulkan/MeshGeometryPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+
+#include "Assets/Mesh.h"
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr uint32_t MIN_INDEX_CAPACITY = 1 << 16;
+constexpr uint32_t MIN_VERTEX_CAPACITY = 1 << 14;
+
+// Index input for the position only passes, storage reads for their vertex pulling and the visibility resolve
+constexpr VkPipelineStageFlags2 READ_STAGES = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+constexpr VkAccessFlags2 READ_ACCESS = VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+void grow_buffer(const VulkanContext &ctx, VkCommandBuffer cmd, std::unique_ptr<Buffer> &buffer, VkBufferUsageFlags usage, VkDeviceSize oldSize, VkDeviceSize newSize, DeletionQueue &deletionQueue) {
+  auto grown = std::make_unique<Buffer>(ctx.GetAllocator(), newSize, usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, ctx.GetSharedQueueFamilies());
+  if (buffer != nullptr) {
+    VkBufferCopy copy{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = oldSize,
+    };
+    vkCmdCopyBuffer(cmd, buffer->buffer, grown->buffer, 1, &copy);
+    deletionQueue.PushBuffer(std::move(*buffer));
+  }
+  buffer = std::move(grown);
+}
+
+} // namespace
+
+uint32_t RangeAllocator::Allocate(uint32_t count) {
+  if (count == 0)
+    return 0;
+
+  for (auto range = m_freeRanges.begin(); range != m_freeRanges.end(); ++range) {
+    if (range->second < count)
+      continue;
+
+    const auto [offset, size] = *range;
+    m_freeRanges.erase(range);
+    if (size > count)
+      m_freeRanges.emplace(offset + count, size - count);
+    return offset;
+  }
+
+  const uint32_t offset = m_end;
+  m_end += count;
+  return offset;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count) {
+  if (count == 0)
+    return;
+
+  auto next = m_freeRanges.lower_bound(offset);
+  if (next != m_freeRanges.end() && offset + count == next->first) {
+    count += next->second;
+    next = m_freeRanges.erase(next);
+  }
+  if (next != m_freeRanges.begin()) {
+    const auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      count += previous->second;
+      m_freeRanges.erase(previous);
+    }
+  }
+
+  if (offset + count == m_end)
+    m_end = offset;
+  else
+    m_freeRanges.emplace(offset, count);
+}
+
+uint32_t RangeAllocator::GetEnd() const { return m_end; }
+
+MeshGeometryPool::MeshGeometryPool(std::shared_ptr<VulkanContext> ctx)
+  : m_ctx{ctx} {
+}
+
+void MeshGeometryPool::Acquire(const Mesh &mesh) {
+  auto [entry, inserted] = m_meshes.try_emplace(mesh.id);
+  entry->second.references++;
+  if (!inserted)
+    return;
+
+  const auto indexCount = static_cast<uint32_t>(mesh.indices.size());
+  const auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  MeshGeometryRange &range = entry->second.range;
+  range = {
+      .firstIndex = m_indexRanges.Allocate(indexCount),
+      .indexCount = indexCount,
+      .vertexOffset = m_vertexRanges.Allocate(vertexCount),
+      .vertexCount = vertexCount,
+  };
+
+  if (indexCount != 0) {
+    m_indexCopies.push_back({.srcOffset = m_pendingIndices.size() * sizeof(uint32_t), .dstOffset = range.firstIndex * sizeof(uint32_t), .size = indexCount * sizeof(uint32_t)});
+    m_pendingIndices.insert(m_pendingIndices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+  if (vertexCount != 0) {
+    m_positionCopies.push_back({.srcOffset = m_pendingPositions.size() * sizeof(glm::vec3), .dstOffset = range.vertexOffset * sizeof(glm::vec3), .size = vertexCount * sizeof(glm::vec3)});
+    for (const auto &vertex : mesh.vertices)
+      m_pendingPositions.push_back(vertex.position);
+  }
+}
+
+void MeshGeometryPool::Release(uint32_t meshId, DeletionQueue &deletionQueue) {
+  auto entry = m_meshes.find(meshId);
+  if (--entry->second.references != 0)
+    return;
+
+  // Frames recorded so far may still draw the mesh, its ranges are only rewritten after they completed
+  const MeshGeometryRange range = entry->second.range;
+  m_meshes.erase(entry);
+  deletionQueue.PushFunction([this, range] {
+    m_indexRanges.Free(range.firstIndex, range.indexCount);
+    m_vertexRanges.Free(range.vertexOffset, range.vertexCount);
+  });
+}
+
+bool MeshGeometryPool::Flush(VkCommandBuffer cmd, UploadAllocator &uploadAllocator, DeletionQueue &deletionQueue) {
+  if (m_indexCopies.empty() && m_positionCopies.empty())
+    return false;
+  const bool reallocate = m_indexRanges.GetEnd() > m_indexCapacity || m_vertexRanges.GetEnd() > m_vertexCapacity || m_indexBuffer == nullptr;
+
+  // Earlier submissions may still read ranges freed since, the copies below must wait for them
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, READ_ACCESS,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+  if (reallocate)
+    grow(cmd, deletionQueue);
+
+  const VkDeviceSize indexSize = m_pendingIndices.size() * sizeof(uint32_t);
+  const VkDeviceSize positionSize = m_pendingPositions.size() * sizeof(glm::vec3);
+  const UploadAllocation staging = uploadAllocator.Allocate(indexSize + positionSize, alignof(glm::vec4));
+  std::memcpy(staging.data, m_pendingIndices.data(), indexSize);
+  std::memcpy(static_cast<char *>(staging.data) + indexSize, m_pendingPositions.data(), positionSize);
+
+  for (auto &copy : m_indexCopies)
+    copy.srcOffset += staging.offset;
+  for (auto &copy : m_positionCopies)
+    copy.srcOffset += staging.offset + indexSize;
+  if (!m_indexCopies.empty())
+    vkCmdCopyBuffer(cmd, staging.buffer, m_indexBuffer->buffer, static_cast<uint32_t>(m_indexCopies.size()), m_indexCopies.data());
+  if (!m_positionCopies.empty())
+    vkCmdCopyBuffer(cmd, staging.buffer, m_positionBuffer->buffer, static_cast<uint32_t>(m_positionCopies.size()), m_positionCopies.data());
+
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      READ_STAGES, READ_ACCESS);
+
+  m_pendingIndices.clear();
+  m_pendingPositions.clear();
+  m_indexCopies.clear();
+  m_positionCopies.clear();
+  return reallocate;
+}
+
+const MeshGeometryRange &MeshGeometryPool::GetRange(uint32_t meshId) const { return m_meshes.at(meshId).range; }
+bool MeshGeometryPool::HasBuffers() const { return m_indexBuffer != nullptr; }
+VkBuffer MeshGeometryPool::GetIndexBuffer() const { return m_indexBuffer->buffer; }
+VkDeviceSize MeshGeometryPool::GetIndexBufferSize() const { return m_indexCapacity * sizeof(uint32_t); }
+VkBuffer MeshGeometryPool::GetPositionBuffer() const { return m_positionBuffer->buffer; }
+VkDeviceSize MeshGeometryPool::GetPositionBufferSize() const { return m_vertexCapacity * sizeof(glm::vec3); }
+
+void MeshGeometryPool::grow(VkCommandBuffer cmd, DeletionQueue &deletionQueue) {
+  // Doubling keeps the number of reallocations logarithmic in the geometry, freed ranges are reused before it grows
+  const uint32_t oldIndexCapacity = m_indexCapacity;
+  const uint32_t oldVertexCapacity = m_vertexCapacity;
+  m_indexCapacity = std::max({std::bit_ceil(m_indexRanges.GetEnd()), m_indexCapacity, MIN_INDEX_CAPACITY});
+  m_vertexCapacity = std::max({std::bit_ceil(m_vertexRanges.GetEnd()), m_vertexCapacity, MIN_VERTEX_CAPACITY});
+
+  if (m_indexCapacity != oldIndexCapacity)
+    grow_buffer(*m_ctx, cmd, m_indexBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, oldIndexCapacity * sizeof(uint32_t), m_indexCapacity * sizeof(uint32_t), deletionQueue);
+  if (m_vertexCapacity != oldVertexCapacity)
+    grow_buffer(*m_ctx, cmd, m_positionBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, oldVertexCapacity * sizeof(glm::vec3), m_vertexCapacity * sizeof(glm::vec3), deletionQueue);
+
+  // The uploads that follow may land in freed ranges the copies above just wrote
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+}
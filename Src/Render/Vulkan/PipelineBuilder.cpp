@@ -27,7 +27,7 @@ VkPipeline PipelineBuilder::CreatePipeline()
         .pNext = nullptr,
         .logicOpEnable = VK_FALSE,
         .logicOp = VK_LOGIC_OP_COPY,
-        .attachmentCount = 1,
+        .attachmentCount = m_renderInfo.colorAttachmentCount,
         .pAttachments = &m_colorBlendAttachment,
     };
 
@@ -45,7 +45,7 @@ VkPipeline PipelineBuilder::CreatePipeline()
     VkGraphicsPipelineCreateInfo pipelineInfo {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = &m_renderInfo,
-        .stageCount = 2,
+        .stageCount = static_cast<uint32_t>(m_shaderStages.size()),
         .pStages = m_shaderStages.data(),
         .pVertexInputState = &vertexInputInfo,
         .pInputAssemblyState = &m_inputAssembly,
@@ -61,7 +61,7 @@ VkPipeline PipelineBuilder::CreatePipeline()
         .basePipelineHandle = VK_NULL_HANDLE,
     };
 
-    if (vkCreateGraphicsPipelines(m_ctx->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(m_ctx->GetDevice(), m_ctx->GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
         throw std::runtime_error("failed to create graphics pipeline!");
 
     return m_pipeline;
@@ -108,7 +108,7 @@ VkPipeline PipelineBuilder::CreateMRTPipeline(std::span<VkPipelineColorBlendAtta
     VkGraphicsPipelineCreateInfo pipelineInfo {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = &renderInfo,
-        .stageCount = 2,
+        .stageCount = static_cast<uint32_t>(m_shaderStages.size()),
         .pStages = m_shaderStages.data(),
         .pVertexInputState = &vertexInputInfo,
         .pInputAssemblyState = &m_inputAssembly,
@@ -124,7 +124,7 @@ VkPipeline PipelineBuilder::CreateMRTPipeline(std::span<VkPipelineColorBlendAtta
         .basePipelineHandle = VK_NULL_HANDLE,
     };
 
-    if (vkCreateGraphicsPipelines(m_ctx->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(m_ctx->GetDevice(), m_ctx->GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
         throw std::runtime_error("failed to create graphics pipeline!");
 
     return m_pipeline;
@@ -143,6 +143,12 @@ void PipelineBuilder::SetShaders(VkShaderModule vertexShader, VkShaderModule fra
     m_shaderStages.push_back(VkInit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
 
+void PipelineBuilder::SetVertexShader(VkShaderModule vertexShader)
+{
+    m_shaderStages.clear();
+    m_shaderStages.push_back(VkInit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
+}
+
 void PipelineBuilder::SetInputTopology(VkPrimitiveTopology topology)
 {
     m_inputAssembly.topology = topology;
@@ -161,6 +167,13 @@ void PipelineBuilder::SetCullMode(VkCullModeFlags cullMode, VkFrontFace frontFac
     m_rasterizer.frontFace = frontFace;
 }
 
+void PipelineBuilder::SetDepthBias(float constantFactor, float slopeFactor)
+{
+    m_rasterizer.depthBiasEnable = VK_TRUE;
+    m_rasterizer.depthBiasConstantFactor = constantFactor;
+    m_rasterizer.depthBiasSlopeFactor = slopeFactor;
+}
+
 void PipelineBuilder::SetMultisamplingNone()
 {
     m_multisampling.sampleShadingEnable = VK_FALSE;
@@ -0,0 +1,635 @@
+#include "Vulkan/RenderGraph.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <ranges>
+
+#include "Vulkan/VkCheck.h"
+#include "Vulkan/VkInit.h"
+#include "Vulkan/VkUtils.h"
+
+namespace {
+
+constexpr VkAccessFlags2 WRITE_ACCESS =
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+// Stages a barrier recorded for the compute queue may name
+constexpr VkPipelineStageFlags2 COMPUTE_QUEUE_STAGES =
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT |
+    VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+size_t queue_index(RenderQueue queue) {
+  return static_cast<size_t>(queue);
+}
+
+RenderQueue other_queue(RenderQueue queue) {
+  return queue == RenderQueue::Graphics ? RenderQueue::Compute : RenderQueue::Graphics;
+}
+
+// Stages covered by a dependency declared between passes, buffers are written by shaders and copies
+VkPipelineStageFlags2 pass_stages(PassType type) {
+  switch (type) {
+    case PassType::Graphics:
+      return VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    case PassType::Compute:
+    case PassType::AsyncCompute:
+      return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    case PassType::Transfer:
+      return VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+  }
+  return VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+}
+
+struct AccessState {
+  VkImageLayout layout;
+  VkPipelineStageFlags2 stages;
+  VkAccessFlags2 access;
+  VkImageUsageFlags usage;
+  bool write;
+};
+
+AccessState access_state(ImageAccess access, PassType type) {
+  const bool compute = type == PassType::Compute || type == PassType::AsyncCompute;
+  const VkPipelineStageFlags2 shaderStage = compute ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+  switch (access) {
+    case ImageAccess::ColorAttachment:
+      return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+              VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true};
+    case ImageAccess::DepthAttachment:
+      return {VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true};
+    case ImageAccess::DepthTest:
+      return {VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, false};
+    case ImageAccess::DepthRead:
+      return {VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, shaderStage, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+    case ImageAccess::Sampled:
+      return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shaderStage, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+    case ImageAccess::Storage:
+      return {VK_IMAGE_LAYOUT_GENERAL, shaderStage, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_USAGE_STORAGE_BIT, true};
+    case ImageAccess::TransferSrc:
+      return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false};
+    case ImageAccess::TransferDst:
+      return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true};
+  }
+  return {};
+}
+
+VkImageAspectFlags format_aspect(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool lifetimes_overlap(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+  return firstA <= lastB && firstB <= lastA;
+}
+
+// State of an image while the passes are recorded
+struct TrackedState {
+  VkImageLayout layout;
+  VkPipelineStageFlags2 writeStages;
+  VkAccessFlags2 writeAccess;
+  // Reads since the last write, a following write only has to wait for them
+  VkPipelineStageFlags2 readStages;
+  // Stages and accesses the last write was already made visible to
+  VkPipelineStageFlags2 visibleStages;
+  VkAccessFlags2 visibleAccess;
+  // Queue and pass of the last use, images used before the graph were last used on the graphics queue
+  RenderQueue queue;
+  uint32_t lastPass;
+};
+
+} // namespace
+
+bool RenderGraph::TransientKey::operator==(const TransientKey &other) const {
+  return extent.width == other.extent.width && extent.height == other.extent.height && format == other.format &&
+         usage == other.usage && firstRank == other.firstRank && lastRank == other.lastRank && shared == other.shared;
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<VulkanContext> ctx)
+  : m_ctx{ctx} {
+  if (!m_ctx->HasAsyncCompute())
+    return;
+
+  VkSemaphoreTypeCreateInfo typeInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphoreInfo = VkInit::semaphore_create_info(0);
+  semaphoreInfo.pNext = &typeInfo;
+  for (VkSemaphore &timeline : m_timelines)
+    VK_CHECK(vkCreateSemaphore(m_ctx->GetDevice(), &semaphoreInfo, nullptr, &timeline));
+}
+
+RenderGraph::~RenderGraph() {
+  destroyTransientImages();
+  for (VkSemaphore timeline : m_timelines)
+    vkDestroySemaphore(m_ctx->GetDevice(), timeline, nullptr);
+}
+
+void RenderGraph::Reset() {
+  m_images.clear();
+  m_passes.clear();
+  m_batches.clear();
+}
+
+RenderGraphImage RenderGraph::ImportImage(VkImage image, VkImageView view, VkFormat format, const ImportedImageState &initialState, VkImageLayout finalLayout) {
+  m_images.push_back({
+      .image = image,
+      .view = view,
+      .format = format,
+      .initialState = initialState,
+      .finalLayout = finalLayout,
+  });
+  return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+RenderGraphImage RenderGraph::CreateImage(VkExtent2D extent, VkFormat format) {
+  m_images.push_back({
+      .format = format,
+      .extent = extent,
+      .transient = true,
+  });
+  return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+RenderGraphPass RenderGraph::AddPass(std::string_view name, PassType type, std::initializer_list<ImageUse> uses, std::function<void(VkCommandBuffer)> &&execute) {
+  const bool async = type == PassType::AsyncCompute && m_ctx->HasAsyncCompute();
+  m_passes.push_back({
+      .name = name,
+      .type = type,
+      .queue = async ? RenderQueue::Compute : RenderQueue::Graphics,
+      .uses = uses,
+      .execute = std::move(execute),
+  });
+  return static_cast<RenderGraphPass>(m_passes.size() - 1);
+}
+
+void RenderGraph::AddDependency(RenderGraphPass producer, RenderGraphPass consumer) {
+  m_passes[consumer].dependencies.push_back(producer);
+}
+
+bool RenderGraph::Compile(DeletionQueue &deletionQueue) {
+  for (const auto &[passIndex, pass] : std::views::enumerate(m_passes)) {
+    for (const auto &use : pass.uses) {
+      ImageResource &image = m_images[use.image];
+      const AccessState state = access_state(use.access, pass.type);
+      image.usage |= state.usage;
+      image.firstPass = std::min(image.firstPass, static_cast<uint32_t>(passIndex));
+      image.lastPass = std::max(image.lastPass, static_cast<uint32_t>(passIndex));
+      image.useStages |= state.stages;
+      image.writeAccess |= state.access & WRITE_ACCESS;
+      image.shared |= pass.queue == RenderQueue::Compute;
+    }
+  }
+
+  // Transients no pass uses are never created
+  std::vector<uint32_t> transients;
+  std::vector<uint32_t> lifetimeBounds;
+  for (const auto &[index, image] : std::views::enumerate(m_images)) {
+    if (!image.transient || image.firstPass > image.lastPass)
+      continue;
+    transients.push_back(static_cast<uint32_t>(index));
+    lifetimeBounds.push_back(image.firstPass);
+    lifetimeBounds.push_back(image.lastPass);
+  }
+  std::ranges::sort(lifetimeBounds);
+  const auto [uniqueEnd, boundsEnd] = std::ranges::unique(lifetimeBounds);
+  lifetimeBounds.erase(uniqueEnd, boundsEnd);
+
+  // Passes that only run on some frames, like picking, shift the absolute indices but not how lifetimes overlap
+  auto rank = [&](uint32_t pass) {
+    return static_cast<uint32_t>(std::ranges::lower_bound(lifetimeBounds, pass) - lifetimeBounds.begin());
+  };
+  std::vector<TransientKey> keys;
+  for (uint32_t imageIndex : transients) {
+    const ImageResource &image = m_images[imageIndex];
+    keys.push_back({image.extent, image.format, image.usage, rank(image.firstPass), rank(image.lastPass), image.shared});
+  }
+
+  const bool recreate = keys != m_transientKeys;
+  if (recreate) {
+    retireTransientImages(deletionQueue);
+    createTransientImages(transients);
+    m_transientKeys = std::move(keys);
+  }
+
+  for (const auto &[physicalIndex, imageIndex] : std::views::enumerate(transients)) {
+    ImageResource &image = m_images[imageIndex];
+    const PhysicalImage &physical = m_physicalImages[physicalIndex];
+    image.image = physical.image;
+    image.view = physical.view;
+    image.physical = static_cast<uint32_t>(physicalIndex);
+  }
+
+  // The first use of a transient waits for everything else placed in its memory, earlier in this frame or in the
+  // previous one, its contents are discarded so only the execution order matters
+  for (uint32_t imageIndex : transients) {
+    ImageResource &image = m_images[imageIndex];
+    const PhysicalImage &physical = m_physicalImages[image.physical];
+    for (uint32_t otherIndex : transients) {
+      const ImageResource &other = m_images[otherIndex];
+      const PhysicalImage &otherPhysical = m_physicalImages[other.physical];
+      if (otherPhysical.heap != physical.heap || otherPhysical.offset >= physical.offset + physical.size || physical.offset >= otherPhysical.offset + otherPhysical.size)
+        continue;
+      image.aliasWaitStages |= other.useStages;
+      image.aliasWaitAccess |= other.writeAccess;
+      if (other.lastPass < image.firstPass)
+        image.aliasPass = image.aliasPass == INVALID_GRAPH_PASS ? other.lastPass : std::max(image.aliasPass, other.lastPass);
+    }
+  }
+
+  return recreate;
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd, const CommandBufferSource &nextCommandBuffer) {
+  std::vector<TrackedState> states(m_images.size());
+  for (const auto &[state, image] : std::views::zip(states, m_images)) {
+    if (image.transient) {
+      const RenderQueue aliasQueue = image.aliasPass == INVALID_GRAPH_PASS ? RenderQueue::Graphics : m_passes[image.aliasPass].queue;
+      state = {.layout = VK_IMAGE_LAYOUT_UNDEFINED, .writeStages = image.aliasWaitStages, .writeAccess = image.aliasWaitAccess, .queue = aliasQueue, .lastPass = image.aliasPass};
+    } else {
+      state = {.layout = image.initialState.layout, .writeStages = image.initialState.stages, .writeAccess = image.initialState.access, .queue = RenderQueue::Graphics, .lastPass = INVALID_GRAPH_PASS};
+    }
+  }
+
+  // Earlier frames need no wait, the first batch follows the previous frame's last graphics submission, which
+  // waited for all of its compute work
+  m_batches.clear();
+  m_batches.push_back({.queue = RenderQueue::Graphics, .cmd = cmd, .waitValue = 0, .signalValue = 0});
+  std::array<std::optional<uint32_t>, 2> openBatches{0, std::nullopt};
+  std::array<uint64_t, 2> waitedValues{};
+  std::optional<uint32_t> importBatch;
+
+  auto closeBatch = [&](RenderQueue queue) {
+    std::optional<uint32_t> &open = openBatches[queue_index(queue)];
+    Batch &batch = m_batches[*open];
+    VK_CHECK(vkEndCommandBuffer(batch.cmd));
+    batch.signalValue = ++m_timelineValues[queue_index(queue)];
+    open.reset();
+  };
+  // Work recorded into a batch becomes visible to the other queue once the batch is closed and signaled
+  auto signalValue = [&](uint32_t batchIndex) {
+    const RenderQueue queue = m_batches[batchIndex].queue;
+    if (openBatches[queue_index(queue)] == batchIndex)
+      closeBatch(queue);
+    return m_batches[batchIndex].signalValue;
+  };
+  // The open batch of the queue is kept unless the queue has not waited for the value yet
+  auto batchFor = [&](RenderQueue queue, uint64_t waitValue) {
+    std::optional<uint32_t> &open = openBatches[queue_index(queue)];
+    uint64_t &waited = waitedValues[queue_index(queue)];
+    if (waitValue <= waited)
+      waitValue = 0;
+    if (open.has_value() && waitValue != 0)
+      closeBatch(queue);
+    if (!open.has_value()) {
+      m_batches.push_back({.queue = queue, .cmd = nextCommandBuffer(queue), .waitValue = waitValue, .signalValue = 0});
+      open = static_cast<uint32_t>(m_batches.size() - 1);
+    }
+    waited = std::max(waited, waitValue);
+    return *open;
+  };
+
+  auto makeBarrier = [&](RenderGraphImage imageIndex, RenderQueue queue, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess, VkImageLayout newLayout) {
+    // Only the first use of an aliased transient can inherit graphics stages on the compute queue. Its contents
+    // are discarded, so waiting for all commands without making anything visible is enough
+    if (queue == RenderQueue::Compute && (srcStages & ~COMPUTE_QUEUE_STAGES) != 0) {
+      srcStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+      srcAccess = VK_ACCESS_2_NONE;
+    }
+
+    const ImageResource &image = m_images[imageIndex];
+    VkImageSubresourceRange range = VkInit::image_subresource_range(format_aspect(image.format));
+    range.levelCount = VK_REMAINING_MIP_LEVELS;
+    range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    return VkImageMemoryBarrier2{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = dstStages,
+        .dstAccessMask = dstAccess,
+        .oldLayout = states[imageIndex].layout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.image,
+        .subresourceRange = range,
+    };
+  };
+
+  auto submitBarriers = [&](VkCommandBuffer batchCmd, const std::vector<VkImageMemoryBarrier2> &barriers, const VkMemoryBarrier2 *memoryBarrier) {
+    if (barriers.empty() && memoryBarrier == nullptr)
+      return;
+    VkDependencyInfo dependencyInfo{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = memoryBarrier == nullptr ? 0u : 1u,
+        .pMemoryBarriers = memoryBarrier,
+        .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+        .pImageMemoryBarriers = barriers.data(),
+    };
+    vkCmdPipelineBarrier2(batchCmd, &dependencyInfo);
+  };
+
+  std::vector<VkImageMemoryBarrier2> barriers;
+  for (uint32_t passIndex = 0; passIndex < m_passes.size(); passIndex++) {
+    Pass &pass = m_passes[passIndex];
+
+    // Producers on the other queue are waited on by the batch, those on the same queue get a memory barrier
+    uint64_t waitValue = 0;
+    VkPipelineStageFlags2 producerStages = VK_PIPELINE_STAGE_2_NONE;
+    auto dependOn = [&](uint32_t producer) {
+      const Pass &other = m_passes[producer];
+      if (other.queue == pass.queue)
+        producerStages |= pass_stages(other.type);
+      else
+        waitValue = std::max(waitValue, signalValue(other.batch));
+    };
+    for (RenderGraphPass producer : pass.dependencies)
+      dependOn(producer);
+    for (const auto &use : pass.uses) {
+      const TrackedState &state = states[use.image];
+      if (state.queue != pass.queue && state.lastPass != INVALID_GRAPH_PASS)
+        dependOn(state.lastPass);
+    }
+    // Whatever the frame recorded before the graph, like uploads, is only on the graphics queue
+    if (pass.queue == RenderQueue::Compute)
+      waitValue = std::max(waitValue, signalValue(0));
+
+    pass.batch = batchFor(pass.queue, waitValue);
+    VkCommandBuffer batchCmd = m_batches[pass.batch].cmd;
+    if (!importBatch.has_value() && std::ranges::any_of(pass.uses, [&](const ImageUse &use) { return m_images[use.image].initialState.acquired; }))
+      importBatch = pass.batch;
+
+    barriers.clear();
+    for (const auto &use : pass.uses) {
+      TrackedState &state = states[use.image];
+      const AccessState required = access_state(use.access, pass.type);
+      const bool transition = state.layout != required.layout;
+      const bool foreign = state.queue != pass.queue;
+      state.queue = pass.queue;
+      state.lastPass = passIndex;
+
+      if (foreign) {
+        // The batch waited for the other queue, all it did to the image completed and is visible. A transition
+        // still has to come after that wait and chains to it through all commands
+        if (transition)
+          barriers.push_back(makeBarrier(use.image, pass.queue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE, required.stages, required.access, required.layout));
+        state.layout = required.layout;
+        state.writeStages = required.write || transition ? required.stages : VK_PIPELINE_STAGE_2_NONE;
+        state.writeAccess = required.write ? required.access & WRITE_ACCESS : VK_ACCESS_2_NONE;
+        state.readStages = required.write ? VK_PIPELINE_STAGE_2_NONE : required.stages;
+        state.visibleStages = required.stages;
+        state.visibleAccess = required.access;
+        continue;
+      }
+
+      if (required.write || transition) {
+        // A write or layout change after reads only has to wait for them, they already saw the last write
+        const bool afterReads = state.readStages != VK_PIPELINE_STAGE_2_NONE;
+        const VkPipelineStageFlags2 srcStages = afterReads ? state.readStages : state.writeStages;
+        const VkAccessFlags2 srcAccess = afterReads ? VK_ACCESS_2_NONE : state.writeAccess;
+        if (transition || srcStages != VK_PIPELINE_STAGE_2_NONE)
+          barriers.push_back(makeBarrier(use.image, pass.queue, srcStages, srcAccess, required.stages, required.access, required.layout));
+
+        // A transition counts as a write, later reads in other stages wait for it
+        state.layout = required.layout;
+        state.writeStages = required.stages;
+        state.writeAccess = required.write ? required.access & WRITE_ACCESS : VK_ACCESS_2_NONE;
+        state.readStages = required.write ? VK_PIPELINE_STAGE_2_NONE : required.stages;
+        state.visibleStages = required.stages;
+        state.visibleAccess = required.access;
+        continue;
+      }
+
+      // Reads in the same layout only need the last write made visible to them once
+      const bool visible = (required.stages & ~state.visibleStages) == 0 && (required.access & ~state.visibleAccess) == 0;
+      if (!visible && state.writeStages != VK_PIPELINE_STAGE_2_NONE) {
+        barriers.push_back(makeBarrier(use.image, pass.queue, state.writeStages, state.writeAccess, required.stages, required.access, required.layout));
+        state.visibleStages |= required.stages;
+        state.visibleAccess |= required.access;
+      }
+      state.readStages |= required.stages;
+    }
+
+    const VkMemoryBarrier2 producerBarrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = producerStages,
+        .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+        .dstStageMask = pass_stages(pass.type),
+        .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+    };
+    submitBarriers(batchCmd, barriers, producerStages != VK_PIPELINE_STAGE_2_NONE ? &producerBarrier : nullptr);
+    pass.execute(batchCmd);
+  }
+
+  // The last graphics batch runs after all compute work of the frame, so the frame's fence covers both queues
+  if (openBatches[queue_index(RenderQueue::Compute)].has_value())
+    closeBatch(RenderQueue::Compute);
+  uint64_t computeValue = 0;
+  for (const auto &batch : m_batches) {
+    if (batch.queue == RenderQueue::Compute)
+      computeValue = std::max(computeValue, batch.signalValue);
+  }
+  const uint32_t lastBatch = batchFor(RenderQueue::Graphics, computeValue);
+  VkCommandBuffer lastCmd = m_batches[lastBatch].cmd;
+  m_importBatch = importBatch.value_or(lastBatch);
+
+  // Imported images are handed back in the layout their owner expects
+  barriers.clear();
+  for (const auto &[index, image] : std::views::enumerate(m_images)) {
+    const TrackedState &state = states[index];
+    if (image.transient || image.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || image.finalLayout == state.layout)
+      continue;
+
+    const bool afterReads = state.readStages != VK_PIPELINE_STAGE_2_NONE;
+    VkPipelineStageFlags2 srcStages = afterReads ? state.readStages : state.writeStages;
+    VkAccessFlags2 srcAccess = afterReads ? VK_ACCESS_2_NONE : state.writeAccess;
+    if (state.queue != RenderQueue::Graphics) {
+      srcStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+      srcAccess = VK_ACCESS_2_NONE;
+    }
+    barriers.push_back(makeBarrier(static_cast<RenderGraphImage>(index), RenderQueue::Graphics, srcStages, srcAccess, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, image.finalLayout));
+  }
+  submitBarriers(lastCmd, barriers, nullptr);
+  closeBatch(RenderQueue::Graphics);
+}
+
+void RenderGraph::Submit(const FrameSubmitSync &sync) {
+  uint32_t lastGraphicsBatch = 0;
+  for (const auto &[index, batch] : std::views::enumerate(m_batches)) {
+    if (batch.queue == RenderQueue::Graphics)
+      lastGraphicsBatch = static_cast<uint32_t>(index);
+  }
+
+  // A batch only waits on values signaled by batches recorded before it, so submitting in recording order never
+  // leaves a queue waiting on work that was not submitted yet
+  for (const auto &[index, batch] : std::views::enumerate(m_batches)) {
+    std::array<VkSemaphoreSubmitInfo, 2> waits{};
+    uint32_t waitCount = 0;
+    if (batch.waitValue != 0) {
+      waits[waitCount] = VkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_timelines[queue_index(other_queue(batch.queue))]);
+      waits[waitCount++].value = batch.waitValue;
+    }
+    if (index == m_importBatch && sync.waitSemaphore != VK_NULL_HANDLE)
+      waits[waitCount++] = VkInit::semaphore_submit_info(sync.waitStages, sync.waitSemaphore);
+
+    std::array<VkSemaphoreSubmitInfo, 2> signals{};
+    uint32_t signalCount = 0;
+    const bool last = index == lastGraphicsBatch;
+    if (m_timelines[queue_index(batch.queue)] != VK_NULL_HANDLE) {
+      signals[signalCount] = VkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_timelines[queue_index(batch.queue)]);
+      signals[signalCount++].value = batch.signalValue;
+    }
+    if (last && sync.signalSemaphore != VK_NULL_HANDLE)
+      signals[signalCount++] = VkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, sync.signalSemaphore);
+
+    VkCommandBufferSubmitInfo cmdInfo = VkInit::command_buffer_submit_info(batch.cmd);
+    const VkSubmitInfo2 submit{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .waitSemaphoreInfoCount = waitCount,
+        .pWaitSemaphoreInfos = waits.data(),
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &cmdInfo,
+        .signalSemaphoreInfoCount = signalCount,
+        .pSignalSemaphoreInfos = signals.data(),
+    };
+    VkQueue queue = batch.queue == RenderQueue::Compute ? m_ctx->GetComputeQueue() : m_ctx->GetGraphicsQueue();
+    VK_CHECK(vkQueueSubmit2(queue, 1, &submit, last ? sync.fence : VK_NULL_HANDLE));
+  }
+}
+
+VkImage RenderGraph::GetImage(RenderGraphImage image) const { return m_images[image].image; }
+VkImageView RenderGraph::GetView(RenderGraphImage image) const { return m_images[image].view; }
+VkExtent2D RenderGraph::GetExtent(RenderGraphImage image) const { return m_images[image].extent; }
+VkDeviceSize RenderGraph::GetTransientMemorySize() const { return m_transientMemorySize; }
+VkDeviceSize RenderGraph::GetUnaliasedMemorySize() const { return m_unaliasedMemorySize; }
+
+void RenderGraph::createTransientImages(std::span<const uint32_t> transients) {
+  VkDevice device = m_ctx->GetDevice();
+
+  std::vector<VkMemoryRequirements> requirements(transients.size());
+  m_physicalImages.resize(transients.size());
+  for (const auto &[physical, imageIndex] : std::views::enumerate(transients)) {
+    const ImageResource &image = m_images[imageIndex];
+    VkImageCreateInfo imageInfo = VkInit::image_create_info(image.format, image.usage, {image.extent.width, image.extent.height, 1}, 1);
+    if (image.shared)
+      VkUtil::set_queue_families(imageInfo, m_ctx->GetSharedQueueFamilies());
+    VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &m_physicalImages[physical].image));
+    vkGetImageMemoryRequirements(device, m_physicalImages[physical].image, &requirements[physical]);
+  }
+
+  // Images that accept the same memory types share a heap. Largest first, each one goes to the lowest offset that
+  // no image with an overlapping lifetime occupies
+  std::vector<uint32_t> order(transients.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::sort(order, std::greater{}, [&](uint32_t physical) { return requirements[physical].size; });
+
+  std::map<uint32_t, uint32_t> heapByTypeBits;
+  std::vector<VkMemoryRequirements> heapRequirements;
+  m_unaliasedMemorySize = 0;
+  for (uint32_t physical : order) {
+    const VkMemoryRequirements &imageRequirements = requirements[physical];
+    const ImageResource &image = m_images[transients[physical]];
+    m_unaliasedMemorySize += imageRequirements.size;
+
+    auto [heapIt, inserted] = heapByTypeBits.try_emplace(imageRequirements.memoryTypeBits, static_cast<uint32_t>(heapRequirements.size()));
+    if (inserted)
+      heapRequirements.push_back({.size = 0, .alignment = 1, .memoryTypeBits = imageRequirements.memoryTypeBits});
+    const uint32_t heap = heapIt->second;
+
+    std::vector<const PhysicalImage *> occupied;
+    for (uint32_t placed : order) {
+      if (placed == physical)
+        break;
+      const ImageResource &other = m_images[transients[placed]];
+      if (m_physicalImages[placed].heap == heap && lifetimes_overlap(image.firstPass, image.lastPass, other.firstPass, other.lastPass))
+        occupied.push_back(&m_physicalImages[placed]);
+    }
+    std::ranges::sort(occupied, {}, &PhysicalImage::offset);
+
+    VkDeviceSize offset = 0;
+    for (const PhysicalImage *other : occupied) {
+      if (align_up(offset, imageRequirements.alignment) + imageRequirements.size <= other->offset)
+        break;
+      offset = std::max(offset, other->offset + other->size);
+    }
+
+    PhysicalImage &placement = m_physicalImages[physical];
+    placement.heap = heap;
+    placement.offset = align_up(offset, imageRequirements.alignment);
+    placement.size = imageRequirements.size;
+    heapRequirements[heap].size = std::max(heapRequirements[heap].size, placement.offset + placement.size);
+    heapRequirements[heap].alignment = std::max(heapRequirements[heap].alignment, imageRequirements.alignment);
+  }
+
+  VmaAllocationCreateInfo allocInfo{
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+  };
+  m_heaps.resize(heapRequirements.size());
+  m_transientMemorySize = 0;
+  for (const auto &[heap, heapRequirement] : std::views::enumerate(heapRequirements)) {
+    VK_CHECK(vmaAllocateMemory(m_ctx->GetAllocator(), &heapRequirement, &allocInfo, &m_heaps[heap], nullptr));
+    m_transientMemorySize += heapRequirement.size;
+  }
+
+  for (const auto &[physical, imageIndex] : std::views::enumerate(transients)) {
+    const ImageResource &image = m_images[imageIndex];
+    PhysicalImage &placement = m_physicalImages[physical];
+    VK_CHECK(vmaBindImageMemory2(m_ctx->GetAllocator(), m_heaps[placement.heap], placement.offset, placement.image, nullptr));
+
+    VkImageViewCreateInfo viewInfo = VkInit::imageview_create_info(image.format, placement.image, format_aspect(image.format));
+    VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &placement.view));
+  }
+}
+
+void RenderGraph::retireTransientImages(DeletionQueue &deletionQueue) {
+  std::vector<PhysicalImage> physicalImages;
+  std::vector<VmaAllocation> heaps;
+  physicalImages.swap(m_physicalImages);
+  heaps.swap(m_heaps);
+  deletionQueue.PushFunction([ctx = m_ctx, physicalImages = std::move(physicalImages), heaps = std::move(heaps)] {
+    for (const auto &physical : physicalImages) {
+      vkDestroyImageView(ctx->GetDevice(), physical.view, nullptr);
+      vkDestroyImage(ctx->GetDevice(), physical.image, nullptr);
+    }
+    for (VmaAllocation heap : heaps)
+      vmaFreeMemory(ctx->GetAllocator(), heap);
+  });
+  destroyTransientImages();
+}
+
+void RenderGraph::destroyTransientImages() {
+  VkDevice device = m_ctx->GetDevice();
+  for (const auto &physical : m_physicalImages) {
+    vkDestroyImageView(device, physical.view, nullptr);
+    vkDestroyImage(device, physical.image, nullptr);
+  }
+  for (VmaAllocation heap : m_heaps)
+    vmaFreeMemory(m_ctx->GetAllocator(), heap);
+
+  m_physicalImages.clear();
+  m_heaps.clear();
+  m_transientKeys.clear();
+  m_transientMemorySize = 0;
+  m_unaliasedMemorySize = 0;
+}
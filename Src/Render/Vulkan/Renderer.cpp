@@ -2,8 +2,14 @@
 
 #include <SDL3/SDL_vulkan.h>
 #include <imgui.h>
+#include <algorithm>
+#include <bit>
+#include <execution>
+#include <numeric>
 #include <ranges>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 
 #define IMGUI_IMPL_VULKAN_HAS_DYNAMIC_RENDERING
 #include <imgui_impl_sdl3.h>
@@ -15,6 +21,8 @@
 
 #include "Components/DefaultData.h"
 #include "Components/RenderComponents.h"
+#include "Culling/Frustum.h"
+#include "Vulkan/ComputePipelineBuilder.h"
 #include "Vulkan/Descriptors/DescriptorLayoutBuilder.h"
 #include "Vulkan/Descriptors/DescriptorWriter.h"
 #include "Vulkan/ImGuiStyles.h"
@@ -22,7 +30,23 @@
 #include "Vulkan/RenderObject.h"
 #include "Vulkan/VkInit.h"
 
-constexpr size_t MAX_COMMANDS = 100000;
+constexpr VkDeviceSize UPLOAD_ALLOCATOR_CAPACITY = 4 * 1024 * 1024;
+constexpr uint32_t MAX_RECORDING_WORKERS = 8;
+// Below this many draws per worker, spreading the recording costs more than it saves
+constexpr uint32_t MIN_DRAWS_PER_WORKER = 256;
+// Instance id and triangle id of the front most fragment, cleared to all ones where nothing was drawn
+constexpr VkFormat VISIBILITY_FORMAT = VK_FORMAT_R32G32_UINT;
+// Marks dynamic ring instances in the visibility buffer, static ids are instance table slots
+constexpr uint32_t DYNAMIC_INSTANCE_BIT = 0x80000000u;
+constexpr VkDeviceSize NULL_BUFFER_SIZE = 256;
+// Also keeps the sort scratch that follows the keys aligned
+constexpr uint32_t MIN_DYNAMIC_SORT_CAPACITY = 1024;
+constexpr uint32_t MIN_STATIC_DRAW_CAPACITY = 1024;
+// Bytes per pixel of OFFSCREEN_FORMAT
+constexpr VkDeviceSize CAPTURE_PIXEL_SIZE = 4;
+
+// Each frame slot renders into its own offscreen image, the slot's fence guards both
+static_assert(OFFSCREEN_IMAGE_COUNT >= FRAME_OVERLAP, "every frame in flight needs its own offscreen image");
 
 Renderer::Renderer(SDL_Window *window, std::shared_ptr<VulkanContext> ctx)
     : m_window{window},
@@ -30,12 +54,31 @@ Renderer::Renderer(SDL_Window *window, std::shared_ptr<VulkanContext> ctx)
       m_swapchain{m_ctx, window},
       m_currentFrame{0},
       m_materialConstantsBuffer{m_ctx->GetAllocator(), sizeof(ShaderParameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU} {
+  init();
+}
+
+Renderer::Renderer(std::shared_ptr<VulkanContext> ctx, VkExtent2D extent)
+    : m_window{nullptr},
+      m_ctx{ctx},
+      m_swapchain{m_ctx, extent},
+      m_currentFrame{0},
+      m_materialConstantsBuffer{m_ctx->GetAllocator(), sizeof(ShaderParameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU} {
+  init();
+}
+
+void Renderer::init() {
   initCommands();
+  initProfiler();
   initSyncObjects();
   initImgui();
-  initDescriptorAllocator();
   initDescriptors();
+  initBindless();
   initPicking();
+  initCulling();
+  initVisibility();
+  initTransparency();
+  initLighting();
+  initRenderGraph();
 }
 
 Renderer::~Renderer() {
@@ -44,6 +87,10 @@ Renderer::~Renderer() {
 
   for (size_t i = 0; i < FRAME_OVERLAP; i++) {
     vkDestroyCommandPool(device, m_frames[i].commandPool, nullptr);
+    for (auto &secondaryPool : m_frames[i].secondaryPools)
+      vkDestroyCommandPool(device, secondaryPool.pool, nullptr);
+    vkDestroyCommandPool(device, m_frames[i].graphicsCommands.pool, nullptr);
+    vkDestroyCommandPool(device, m_frames[i].computeCommands.pool, nullptr);
     vkDestroyFence(device, m_frames[i].renderFence, nullptr);
     vkDestroySemaphore(device, m_frames[i].renderSemaphore, nullptr);
     vkDestroySemaphore(device, m_frames[i].swapchainSemaphore, nullptr);
@@ -54,195 +101,848 @@ Renderer::~Renderer() {
   m_deletionQueue.Flush();
 }
 
-void Renderer::BeginRendering() {
-  // Synchronize
-  VK_CHECK(vkWaitForFences(m_ctx->GetDevice(), 1, &getCurrentFrame().renderFence, true, UINT64_MAX));
+bool Renderer::BeginRendering() {
+  // Synchronize, only this frame's previous submission has to be finished
+  auto &frame = getCurrentFrame();
+  VK_CHECK(vkWaitForFences(m_ctx->GetDevice(), 1, &frame.renderFence, true, UINT64_MAX));
+
+  frame.deletionQueue.Flush();
+  m_renderPath = m_requestedRenderPath;
+  for (auto &secondaryPool : frame.secondaryPools) {
+    VK_CHECK(vkResetCommandPool(m_ctx->GetDevice(), secondaryPool.pool, 0));
+    secondaryPool.usedCount = 0;
+  }
+  for (CommandBufferPool *queuePool : {&frame.graphicsCommands, &frame.computeCommands}) {
+    if (queuePool->pool == VK_NULL_HANDLE)
+      continue;
+    VK_CHECK(vkResetCommandPool(m_ctx->GetDevice(), queuePool->pool, 0));
+    queuePool->usedCount = 0;
+  }
+  if (frame.uploadAllocator->Reset())
+    updateUploadDescriptors(frame);
+  syncStaticResources(frame);
+
+  m_gpuLightData.numLocalLights = static_cast<uint32_t>(m_localLights.size());
+  if (m_lightGrid->Upload(m_currentFrame, m_localLights))
+    updateLightDescriptors(m_currentFrame);
 
-  getCurrentFrame().deletionQueue.Flush();
-  VK_CHECK(vkResetFences(m_ctx->GetDevice(), 1, &getCurrentFrame().renderFence));
-  VK_CHECK(vkResetCommandBuffer(getCurrentFrame().commandBuffer, 0));
+  // First allocations of the frame, so they always land in the main block the descriptors point into
+  const VkDeviceSize uniformAlignment = frame.uploadAllocator->GetDescriptorAlignment();
+  frame.sceneDataOffset = static_cast<uint32_t>(frame.uploadAllocator->Push(m_gpuSceneData, uniformAlignment).offset);
+  frame.lightDataOffset = static_cast<uint32_t>(frame.uploadAllocator->Push(m_gpuLightData, uniformAlignment).offset);
 
   // Setup swapchain
-  if (m_swapchain.IsResized()) {
-    m_swapchain.RecreateSwapchain();
-    m_swapchain.SetResized(false);
-  }
+  if (m_swapchain.IsHeadless()) {
+    m_currentImageIndex = m_currentFrame;
+  } else {
+    if (m_swapchain.IsResized()) {
+      m_swapchain.RecreateSwapchain();
+      m_swapchain.SetResized(false);
 
-  VkResult result = vkAcquireNextImageKHR(m_ctx->GetDevice(), m_swapchain.GetSwapchain(), UINT64_MAX, getCurrentFrame().swapchainSemaphore, VK_NULL_HANDLE, &m_currentImageIndex);
-  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    m_swapchain.SetResized(true);
-    return;
+      m_depthPyramid->Resize(m_swapchain.GetDrawExtent());
+      updateDepthPyramidDescriptors();
+    }
+
+    // The fence stays signaled when the frame is skipped, so the next wait on it does not hang
+    VkResult result = vkAcquireNextImageKHR(m_ctx->GetDevice(), m_swapchain.GetSwapchain(), UINT64_MAX, frame.swapchainSemaphore, VK_NULL_HANDLE, &m_currentImageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      m_swapchain.SetResized(true);
+      return false;
+    }
+
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+      throw std::runtime_error("failed to acquire swap chain image!");
   }
 
-  if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
-    throw std::runtime_error("failed to acquire swap chain image!");
+  VK_CHECK(vkResetFences(m_ctx->GetDevice(), 1, &frame.renderFence));
+
+  // Only once the frame is sure to be recorded, skipped frames leave their queries queued
+  m_picker->BeginFrame(m_currentFrame, m_gpuSceneData.viewproj, m_swapchain.GetExtent());
+  VK_CHECK(vkResetCommandBuffer(frame.commandBuffer, 0));
 
   VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
   VkCommandBufferBeginInfo cmdBeginInfo = VkInit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+  m_profiler->BeginFrame(cmd, m_currentFrame);
+  m_frameScope = m_profiler->BeginScope(cmd, "Frame");
+
+  // The frame scope is opened first, so it leads the timings of the completed frame
+  const std::span<const GpuScopeTiming> timings = m_profiler->GetTimings();
+  m_dynamicResolution.Update(timings.empty() ? 0.0 : timings.front().milliseconds);
+  m_renderExtent = m_dynamicResolution.ScaleExtent(m_swapchain.GetDrawExtent());
+
+  // Targets are cleared by the first pass that renders to them, the resolve writes every pixel of the draw image
+  m_graph->Reset();
+  const VkExtent2D drawExtent = m_swapchain.GetDrawExtent();
+  m_drawImage = m_graph->CreateImage(drawExtent, m_swapchain.GetDrawFormat());
+  m_depthImage = m_graph->CreateImage(drawExtent, m_swapchain.GetDepthFormat());
+  m_visibilityImage = m_renderPath == RenderPath::Visibility ? m_graph->CreateImage(drawExtent, VISIBILITY_FORMAT) : INVALID_GRAPH_IMAGE;
+  m_accumulationImage = INVALID_GRAPH_IMAGE;
+  m_revealageImage = INVALID_GRAPH_IMAGE;
+  // The acquire semaphore is waited on at the color output stage, the first transition waits for it there.
+  // An offscreen image was last used by the frame whose fence was just waited on
+  const ImportedImageState acquired{
+      .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .stages = m_swapchain.IsHeadless() ? VK_PIPELINE_STAGE_2_NONE : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+      .acquired = true,
+  };
+  const VkImageLayout finalLayout = m_swapchain.IsHeadless() ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  m_swapchainImage = m_graph->ImportImage(m_swapchain.GetImage(m_currentImageIndex), m_swapchain.GetImageView(m_currentImageIndex), m_swapchain.GetImageFormat(), acquired, finalLayout);
+  // Shading samples the maps every frame, also when no shadow pass drew into them. The cache's layers are only
+  // rendered through the shadow map's own views
+  m_shadowImage = m_graph->ImportImage(m_shadowMap->GetImage(), m_shadowMap->GetView(), SHADOW_MAP_FORMAT, m_shadowMap->GetImportState(), SHADOW_MAP_LAYOUT);
+  m_shadowCacheImage = m_graph->ImportImage(m_shadowMap->GetStaticImage(), VK_NULL_HANDLE, SHADOW_MAP_FORMAT, m_shadowMap->GetStaticImportState(), SHADOW_CACHE_LAYOUT);
+  if (!m_shadowMap->IsCleared()) {
+    m_graph->AddPass("Shadow clear", PassType::Transfer, {{m_shadowImage, ImageAccess::TransferDst}}, [this](VkCommandBuffer cmd) {
+      m_shadowMap->Clear(cmd);
+    });
+  }
+  m_lightClusterPass = INVALID_GRAPH_PASS;
+  m_cullPass = INVALID_GRAPH_PASS;
+  m_dynamicSortPass = INVALID_GRAPH_PASS;
+  m_geometryPass = INVALID_GRAPH_PASS;
+  m_geometryDraws.clear();
+  return true;
+}
+
+void Renderer::Begin3DRendering(bool clearDepth) {
+  m_geometryDraws.clear();
+  m_geometryClear = clearDepth;
+}
 
-  // Setup image layout
-  VkUtil::transition_image(cmd, m_swapchain.GetDrawTexture()->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-  VkUtil::transition_image(cmd, m_swapchain.GetDepthTexture()->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-  VkUtil::transition_image(cmd, m_pickingResources.texture->GetImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+void Renderer::addGeometryPass() {
+  // Color is written by the resolve pass when drawing ids
+  const bool visibility = m_renderPath == RenderPath::Visibility;
+  const RenderGraphImage colorImage = visibility ? m_visibilityImage : m_drawImage;
+
+  m_geometryPass = m_graph->AddPass("Geometry", PassType::Graphics, {{colorImage, ImageAccess::ColorAttachment}, {m_depthImage, ImageAccess::DepthAttachment}, {m_shadowImage, ImageAccess::Sampled}}, [this, clear = m_geometryClear, visibility, colorImage, draws = std::move(m_geometryDraws)](VkCommandBuffer cmd) {
+    // Spans every geometry pass up to the resolve, including the depth pyramid and late culling in between
+    if (clear)
+      m_3dScope = m_profiler->BeginScope(cmd, "3D");
+
+    // Only the first geometry pass clears, the late pass adds to what the early one drew. The whole image is
+    // cleared even when less is rendered, the pyramid then sees far depth around the rendered corner
+    VkClearValue clearValue{};
+    if (visibility)
+      clearValue.color = {.uint32 = {UINT32_MAX, UINT32_MAX, 0, 0}};
+    else
+      clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+    std::array colorAttachments{VkInit::color_attachment_info(m_graph->GetView(colorImage), clear ? &clearValue : nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)};
+    VkRenderingAttachmentInfo depthAttachment = VkInit::depth_attachment_info(m_graph->GetView(m_depthImage), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+    if (!clear)
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+    VkRenderingInfo renderInfo = VkInit::rendering_info(m_graph->GetExtent(colorImage), colorAttachments, &depthAttachment);
+    // Draws are recorded on worker threads, the pass itself only executes their secondary buffers
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+    VkMemoryBarrier2 mb{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .srcAccessMask = VK_ACCESS_2_HOST_WRITE_BIT,
+        .dstStageMask =
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | // for indirect cmd buffer
+            VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,  // for VS SSBO/UBO
+        .dstAccessMask =
+            VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | // indirect commands
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT |   // SSBO
+            VK_ACCESS_2_UNIFORM_READ_BIT            // UBO
+    };
 
-  // Clear image
-  std::array<VkClearValue, 2> clearValues{};
-  clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-  clearValues[1].depthStencil = {1.0f, 0};
-  VkImageSubresourceRange clearRange = VkInit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
-  vkCmdClearColorImage(cmd, m_swapchain.GetDrawTexture()->GetImage(), VK_IMAGE_LAYOUT_GENERAL, &clearValues[0].color, 1, &clearRange);
-  vkCmdClearColorImage(cmd, m_pickingResources.texture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, &clearValues[0].color, 1, &clearRange);
+    VkDependencyInfo dep{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &mb};
+    vkCmdPipelineBarrier2(cmd, &dep);
 
-  // Reset rendering stats
-  m_stats = RenderingStats{0, 0, 0};
+    vkCmdBeginRendering(cmd, &renderInfo);
+    for (const auto &draw : draws)
+      draw(cmd);
+    vkCmdEndRendering(cmd);
+  });
+  // Forward shading reads the light grid, indirect draws what culling and the dynamic sort wrote
+  addDependency(m_lightClusterPass, m_geometryPass);
+  addDependency(m_cullPass, m_geometryPass);
+  addDependency(m_dynamicSortPass, m_geometryPass);
+  m_geometryDraws.clear();
 }
 
-void Renderer::Begin3DRendering() {
-  VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
-  std::array<VkRenderingAttachmentInfo, 2> colorAttachments{
-      VkInit::color_attachment_info(m_swapchain.GetDrawTexture()->GetView(), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
-      VkInit::color_attachment_info(m_pickingResources.texture->GetView(), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+void Renderer::addDependency(RenderGraphPass producer, RenderGraphPass consumer) {
+  if (producer != INVALID_GRAPH_PASS)
+    m_graph->AddDependency(producer, consumer);
+}
+
+void Renderer::CullStaticObjects(const Camera &camera, CullPhase phase) {
+  if (m_staticBatchCount == 0)
+    return;
+
+  auto &frame = getCurrentFrame();
+  if (phase == CullPhase::Early) {
+    Frustum frustum = Frustum::FromMatrix(camera.viewProjection);
+    VkExtent2D pyramidExtent = m_depthPyramid->GetExtent();
+    GPUCullData cullData{
+        .view = camera.view,
+        .frustumPlanes = frustum.planes,
+        .projection = glm::vec4(camera.projection[0][0], std::abs(camera.projection[1][1]), camera.projection[2][2], camera.projection[3][2]),
+        .pyramidSize = glm::vec2(pyramidExtent.width, pyramidExtent.height),
+        .znear = camera.near,
+        .occlusionEnabled = camera.isPerspective,
+        .uvScale = glm::vec2(m_renderExtent.width, m_renderExtent.height) / glm::vec2(m_swapchain.GetDrawExtent().width, m_swapchain.GetDrawExtent().height),
+    };
+    frame.cullDataBuffer->MapMemoryFromScalar(cullData);
+  }
+
+  // Buffers and the depth pyramid are not graph resources, passes around culling declare dependencies instead
+  m_cullPass = m_graph->AddPass(phase == CullPhase::Early ? "Early culling" : "Late culling", PassType::AsyncCompute, {}, [this, phase](VkCommandBuffer cmd) {
+    recordCulling(cmd, phase);
+  });
+  // The early draws still read the commands and instance list that get rewritten
+  if (phase == CullPhase::Late)
+    addDependency(m_geometryPass, m_cullPass);
+}
+
+void Renderer::recordCulling(VkCommandBuffer cmd, CullPhase phase) {
+  auto &frame = getCurrentFrame();
+  const uint32_t scope = m_profiler->BeginScope(cmd, phase == CullPhase::Early ? "Early culling" : "Late culling");
+
+  // The early phase reads the visibility the previous frame's late phase wrote. Both phases always run on the same
+  // queue, the barrier reaches back into its earlier submissions
+  if (phase == CullPhase::Early) {
+    VkUtil::memory_barrier(cmd,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  }
+
+  // Reset draw commands to zero instances and the group counts, the culling pass appends the visible ones
+  VkBufferCopy drawsCopy{
+      .srcOffset = 0,
+      .dstOffset = 0,
+      .size = m_staticBatchCount * sizeof(VkDrawIndexedIndirectCommand),
   };
-  VkRenderingAttachmentInfo depthAttachment = VkInit::depth_attachment_info(m_swapchain.GetDepthTexture()->GetView(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-
-  VkExtent2D drawExtent = {m_swapchain.GetDrawTexture()->GetExtent().width, m_swapchain.GetDrawTexture()->GetExtent().height};
-  VkRenderingInfo renderInfo = VkInit::rendering_info(drawExtent, colorAttachments, &depthAttachment);
-
-  VkMemoryBarrier2 mb{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
-      .srcStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
-      .srcAccessMask = VK_ACCESS_2_HOST_WRITE_BIT,
-      .dstStageMask =
-          VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | // for indirect cmd buffer
-          VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,  // for VS SSBO/UBO
-      .dstAccessMask =
-          VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | // indirect commands
-          VK_ACCESS_2_SHADER_STORAGE_READ_BIT |   // SSBO
-          VK_ACCESS_2_UNIFORM_READ_BIT            // UBO
+  vkCmdCopyBuffer(cmd, m_drawTemplateBuffer->buffer, frame.indirectDrawBuffer->buffer, 1, &drawsCopy);
+  vkCmdFillBuffer(cmd, frame.drawCountBuffer->buffer, 0, (m_mergedCountIndex + 1) * sizeof(uint32_t), 0);
+
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  // Freed slots stay in range with an invalid batch and are skipped by the shader
+  const uint32_t slotCount = m_instanceTable->GetSlotCount();
+  GPUCullPushConstants pushConstants{
+      .instanceCount = slotCount,
+      .phase = phase,
+      .firstTransparentBatch = m_firstTransparentBatch,
+      .batchCount = m_staticBatchCount,
+      .mergedCountIndex = m_mergedCountIndex,
+      .mergeOpaque = m_renderPath == RenderPath::Visibility,
   };
 
-  VkDependencyInfo dep{
-      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-      .memoryBarrierCount = 1,
-      .pMemoryBarriers = &mb};
-  vkCmdPipelineBarrier2(cmd, &dep);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline.pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline.layout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+  vkCmdPushConstants(cmd, m_cullPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (slotCount + 63) / 64, 1, 1);
+
+  // Draws are only compacted once all of their instances were appended
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+  recordDrawCompaction(cmd, pushConstants);
+  m_profiler->EndScope(cmd, scope);
+}
 
-  // Update scene data
+void Renderer::recordDrawCompaction(VkCommandBuffer cmd, const GPUCullPushConstants &pushConstants) {
   auto &frame = getCurrentFrame();
-  frame.gpuSceneDataBuffer->MapMemoryFromScalar(m_gpuSceneData);
-  frame.lightBuffer->MapMemoryFromScalar(m_gpuLightData);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullDrawsPipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline.layout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+  vkCmdPushConstants(cmd, m_cullPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (pushConstants.batchCount + 63) / 64, 1, 1);
+}
 
-  vkCmdBeginRendering(cmd, &renderInfo);
+void Renderer::UploadVisibleStaticObjects(std::span<const uint32_t> visibleInstances, std::span<const IndirectBatch> batches) {
+  m_stats.visibleInstanceCount = static_cast<uint32_t>(visibleInstances.size());
+  m_stats.culledInstanceCount = m_instanceTable->GetInstanceCount() - m_stats.visibleInstanceCount;
+  if (m_staticBatchCount == 0)
+    return;
+
+  auto &frame = getCurrentFrame();
+
+  // One batch per draw slot, packed from the visible instances so their counts are final
+  std::vector<VkDrawIndexedIndirectCommand> drawCommands(m_drawTemplates);
+  for (const auto &[idx, batch] : std::views::enumerate(batches)) {
+    drawCommands[idx].instanceCount = batch.instanceCount;
+    drawCommands[idx].firstInstance = batch.firstInstance;
+  }
+
+  // Staged now, the copies are recorded with the pass
+  const UploadAllocation drawsUpload = frame.uploadAllocator->PushSpan(std::span<const VkDrawIndexedIndirectCommand>(drawCommands));
+  const UploadAllocation instancesUpload = visibleInstances.empty() ? UploadAllocation{} : frame.uploadAllocator->PushSpan(visibleInstances);
+  const VkDeviceSize drawsSize = drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+  const VkDeviceSize instancesSize = visibleInstances.size_bytes();
+
+  // The draws are compacted like after GPU culling, so both paths draw with the same group counts
+  const GPUCullPushConstants pushConstants{
+      .firstTransparentBatch = m_firstTransparentBatch,
+      .batchCount = m_staticBatchCount,
+      .mergedCountIndex = m_mergedCountIndex,
+      .mergeOpaque = m_renderPath == RenderPath::Visibility,
+  };
+  m_cullPass = m_graph->AddPass("Upload visible", PassType::Compute, {}, [this, &frame, drawsUpload, instancesUpload, drawsSize, instancesSize, pushConstants](VkCommandBuffer cmd) {
+    VkBufferCopy drawsCopy{
+        .srcOffset = drawsUpload.offset,
+        .dstOffset = 0,
+        .size = drawsSize,
+    };
+    vkCmdCopyBuffer(cmd, drawsUpload.buffer, frame.indirectDrawBuffer->buffer, 1, &drawsCopy);
+    vkCmdFillBuffer(cmd, frame.drawCountBuffer->buffer, 0, (pushConstants.mergedCountIndex + 1) * sizeof(uint32_t), 0);
+
+    if (instancesSize != 0) {
+      VkBufferCopy instancesCopy{
+          .srcOffset = instancesUpload.offset,
+          .dstOffset = 0,
+          .size = instancesSize,
+      };
+      vkCmdCopyBuffer(cmd, instancesUpload.buffer, frame.compactedInstanceBuffer->buffer, 1, &instancesCopy);
+    }
+
+    VkUtil::memory_barrier(cmd,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    recordDrawCompaction(cmd, pushConstants);
+  });
 }
 
-void Renderer::RenderStaticObjects(std::vector<IndirectBatch> &batches) {
-  VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
+void Renderer::RenderStaticObjects() {
+  m_geometryDraws.emplace_back([this](VkCommandBuffer cmd) {
+    auto &frame = getCurrentFrame();
+    recordDrawGroups(cmd, MeshPassType::Forward, m_drawGroups, frame.descriptorSet, frame.indirectDrawBuffer->buffer, 0, frame.drawCountBuffer->buffer, 0);
+  });
+}
+
+void Renderer::RenderDynamicObjects() {
+  if (m_dynamicDrawGroups.empty())
+    return;
+
+  const VkDeviceSize drawOffset = m_dynamicRing->GetSectionOffset(m_currentFrame) + m_dynamicRing->GetLayout().drawCommands;
+  m_geometryDraws.emplace_back([this, drawOffset](VkCommandBuffer cmd) {
+    recordDrawGroups(cmd, MeshPassType::Forward, m_dynamicDrawGroups, getCurrentFrame().dynamicDescriptorSet, m_dynamicRing->GetBuffer(), drawOffset, VK_NULL_HANDLE, DYNAMIC_INSTANCE_BIT);
+  });
+}
+
+void Renderer::recordDrawGroups(VkCommandBuffer primary, MeshPassType pass, std::span<const DrawGroup> groups, VkDescriptorSet frameSet, VkBuffer drawBuffer, VkDeviceSize drawOffset, VkBuffer countBuffer, uint32_t instanceTag) {
+  if (groups.empty())
+    return;
+
+  auto &frame = getCurrentFrame();
+
+  // Materials do not matter for the visibility pass, all opaque groups collapse into one multi draw
+  DrawGroup visibilityGroup{
+      .pipeline = m_visibilityPipeline,
+      .layout = m_visibilityLayout,
+      .firstDraw = groups.front().firstDraw,
+      .countIndex = m_mergedCountIndex,
+  };
+  if (m_renderPath == RenderPath::Visibility && pass == MeshPassType::Forward) {
+    for (const auto &group : groups) {
+      visibilityGroup.drawCount += group.drawCount;
+      visibilityGroup.triangleCount += group.triangleCount;
+    }
+    groups = {&visibilityGroup, 1};
+  }
+
+  // Draws of a group are independent, so a group may be cut between workers. Each worker gets a contiguous,
+  // equally sized range of draws, gl_DrawID restarts at the first draw of every slice through the push constant.
+  // A counted group is one call whatever its size and stays whole
+  struct DrawSlice {
+    const DrawGroup *group;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+  };
+
+  const uint32_t totalDraws = std::accumulate(groups.begin(), groups.end(), 0u, [](uint32_t sum, const DrawGroup &group) { return sum + group.drawCount; });
+  const auto workerCount = std::clamp(totalDraws / MIN_DRAWS_PER_WORKER, 1u, static_cast<uint32_t>(frame.secondaryPools.size()));
+  const uint32_t drawsPerWorker = (totalDraws + workerCount - 1) / workerCount;
+
+  std::vector<std::vector<DrawSlice>> workerSlices(workerCount);
+  uint32_t worker = 0, workerDraws = 0;
+  for (const auto &group : groups) {
+    uint32_t first = group.firstDraw;
+    uint32_t remaining = group.drawCount;
+    while (remaining > 0) {
+      const uint32_t count = countBuffer != VK_NULL_HANDLE ? remaining : std::min(remaining, drawsPerWorker - workerDraws);
+      workerSlices[worker].push_back({.group = &group, .firstDraw = first, .drawCount = count});
+      first += count;
+      remaining -= count;
+      workerDraws += count;
+      if (workerDraws >= drawsPerWorker && worker + 1 < workerCount) {
+        worker++;
+        workerDraws = 0;
+      }
+    }
 
-  Buffer *indirectBuffer = getCurrentFrame().indirectDrawBuffer.get();
-  VkDrawIndexedIndirectCommand *drawCommands;
-  vmaMapMemory(indirectBuffer->allocator, indirectBuffer->allocation, reinterpret_cast<void **>(&drawCommands));
-  for (const auto &[idx, draw] : std::views::enumerate(batches)) {
-    drawCommands[idx].indexCount = draw.indexCount;
-    drawCommands[idx].instanceCount = draw.instanceCount;
-    drawCommands[idx].firstIndex = draw.firstIndex;
-    drawCommands[idx].vertexOffset = 0;
-    drawCommands[idx].firstInstance = draw.firstInstance;
+    m_stats.triangleCount += group.triangleCount;
   }
-  vmaUnmapMemory(indirectBuffer->allocator, indirectBuffer->allocation);
 
   VkViewport viewport{
       .x = 0.0f,
       .y = 0.0f,
-      .width = static_cast<float>(m_swapchain.GetExtent().width),
-      .height = static_cast<float>(m_swapchain.GetExtent().height),
+      .width = static_cast<float>(m_renderExtent.width),
+      .height = static_cast<float>(m_renderExtent.height),
       .minDepth = 0.0f,
       .maxDepth = 1.0f,
   };
-  vkCmdSetViewport(cmd, 0, 1, &viewport);
-
   VkRect2D scissor{
       .offset = {0, 0},
-      .extent = m_swapchain.GetExtent(),
+      .extent = m_renderExtent,
+  };
+
+  // Materials are read from the bindless set through the draw data, set 1 never changes between groups
+  std::array<VkDescriptorSet, 2> descriptorSets{frameSet, m_bindlessRegistry->GetSet()};
+  std::array<uint32_t, 2> dynamicOffsets{frame.sceneDataOffset, frame.lightDataOffset};
+
+  // Every worker records with its own pool, the pools are only touched by one thread at a time
+  std::vector<VkCommandBuffer> secondaries(workerCount);
+  std::vector<uint32_t> workers(workerCount);
+  std::iota(workers.begin(), workers.end(), 0);
+  std::for_each(std::execution::par, workers.begin(), workers.end(), [&](uint32_t w) {
+    VkCommandBuffer cmd = beginSecondaryCommands(frame.secondaryPools[w], pass);
+
+    // Dynamic state and bindings are not inherited from the primary buffer
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    // Every mesh lives in the merged index buffer, so it is bound once for all groups
+    vkCmdBindIndexBuffer(cmd, m_meshGeometry->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+    const DrawGroup *boundGroup = nullptr;
+    for (const auto &slice : workerSlices[w]) {
+      if (slice.group != boundGroup) {
+        boundGroup = slice.group;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, boundGroup->pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, boundGroup->layout, 0, descriptorSets.size(), descriptorSets.data(), dynamicOffsets.size(), dynamicOffsets.data());
+      }
+
+      GPUIndirectPushConstants pushConstants{
+          .drawOffset = slice.firstDraw,
+          .instanceTag = instanceTag,
+      };
+      vkCmdPushConstants(cmd, boundGroup->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUIndirectPushConstants), &pushConstants);
+
+      // Culling left only the draws with visible instances in the group's range, the count says how many
+      constexpr uint32_t drawStride = sizeof(VkDrawIndexedIndirectCommand);
+      const VkDeviceSize sliceOffset = drawOffset + slice.firstDraw * drawStride;
+      if (countBuffer != VK_NULL_HANDLE)
+        vkCmdDrawIndexedIndirectCount(cmd, drawBuffer, sliceOffset, countBuffer, slice.group->countIndex * sizeof(uint32_t), slice.drawCount, drawStride);
+      else
+        vkCmdDrawIndexedIndirect(cmd, drawBuffer, sliceOffset, slice.drawCount, drawStride);
+    }
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+    secondaries[w] = cmd;
+  });
+
+  // Executed in worker order, which keeps the draw order of the single threaded path
+  vkCmdExecuteCommands(primary, workerCount, secondaries.data());
+
+  for (const auto &slices : workerSlices)
+    m_stats.drawcallCount += static_cast<uint32_t>(slices.size());
+}
+
+VkCommandBuffer Renderer::beginSecondaryCommands(CommandBufferPool &pool, MeshPassType pass) const {
+  if (pool.usedCount == pool.buffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool.pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = 1,
+    };
+    VK_CHECK(vkAllocateCommandBuffers(m_ctx->GetDevice(), &allocInfo, &pool.buffers.emplace_back()));
+  }
+  VkCommandBuffer cmd = pool.buffers[pool.usedCount++];
+
+  // Must match the attachments of the geometry or transparency pass
+  std::vector<VkFormat> colorFormats;
+  if (pass == MeshPassType::Transparency)
+    colorFormats = {OIT_ACCUMULATION_FORMAT, OIT_REVEALAGE_FORMAT};
+  else if (m_renderPath == RenderPath::Visibility)
+    colorFormats = {VISIBILITY_FORMAT};
+  else
+    colorFormats = {m_swapchain.GetDrawFormat()};
+  VkCommandBufferInheritanceRenderingInfo renderingInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+      .colorAttachmentCount = static_cast<uint32_t>(colorFormats.size()),
+      .pColorAttachmentFormats = colorFormats.data(),
+      .depthAttachmentFormat = m_swapchain.GetDepthFormat(),
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+  };
+  VkCommandBufferInheritanceInfo inheritanceInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .pNext = &renderingInfo,
+  };
+  VkCommandBufferBeginInfo beginInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+      .pInheritanceInfo = &inheritanceInfo,
   };
-  vkCmdSetScissor(cmd, 0, 1, &scissor);
+  VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+  return cmd;
+}
 
-  for (int cmdIndex = 0; cmdIndex < batches.size(); cmdIndex++) {
-    auto &[indexCount, firstIndex, firstInstance, instanceCount, mesh, material] = batches[cmdIndex];
+VkCommandBuffer Renderer::beginQueueCommands(RenderQueue queue) {
+  auto &frame = getCurrentFrame();
+  CommandBufferPool &pool = queue == RenderQueue::Compute ? frame.computeCommands : frame.graphicsCommands;
+  if (pool.usedCount == pool.buffers.size()) {
+    VkCommandBufferAllocateInfo allocInfo = VkInit::command_buffer_allocate_info(pool.pool, 1);
+    VK_CHECK(vkAllocateCommandBuffers(m_ctx->GetDevice(), &allocInfo, &pool.buffers.emplace_back()));
+  }
+  VkCommandBuffer cmd = pool.buffers[pool.usedCount++];
 
-    ShaderPass *forwardPass = material->original->passShaders[MeshPassType::Forward].get();
-    VkDescriptorSet forwardDescriptorSet = material->passSets[MeshPassType::Forward];
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, forwardPass->pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, forwardPass->effect->pipelineLayout, 0, 1, &getCurrentFrame().descriptorSet, 0, nullptr);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, forwardPass->effect->pipelineLayout, 1, 1, &forwardDescriptorSet, 0, nullptr);
+  VkCommandBufferBeginInfo beginInfo = VkInit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+  return cmd;
+}
 
-    vkCmdBindIndexBuffer(cmd, mesh->meshBuffers->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+void Renderer::Suspend3DRendering() {
+  addGeometryPass();
+}
 
-    GPUIndirectPushConstants pushConstants{
-        .vertexBuffer = mesh->meshBuffers->vertexBufferAddress};
-    vkCmdPushConstants(cmd, forwardPass->effect->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUIndirectPushConstants), &pushConstants);
+void Renderer::BuildDepthPyramid() {
+  m_graph->AddPass("Depth pyramid", PassType::AsyncCompute, {{m_depthImage, ImageAccess::DepthRead}}, [this](VkCommandBuffer cmd) {
+    const uint32_t scope = m_profiler->BeginScope(cmd, "Depth pyramid");
+    m_depthPyramid->Build(cmd);
+    m_profiler->EndScope(cmd, scope);
+  });
+}
 
-    VkDeviceSize indirectOffset = cmdIndex * sizeof(VkDrawIndexedIndirectCommand);
-    constexpr uint32_t drawCount = 1;
-    constexpr uint32_t drawStride = sizeof(VkDrawIndexedIndirectCommand);
+void Renderer::BuildLightClusters(const Camera &camera) {
+  m_lightClusterPass = m_graph->AddPass("Light clusters", PassType::AsyncCompute, {}, [this, camera](VkCommandBuffer cmd) {
+    const uint32_t scope = m_profiler->BeginScope(cmd, "Light clusters");
+    m_lightGrid->Build(cmd, m_currentFrame, camera);
+    m_profiler->EndScope(cmd, scope);
+  });
+}
 
-    vkCmdDrawIndexedIndirect(cmd, getCurrentFrame().indirectDrawBuffer->buffer, indirectOffset, drawCount, drawStride);
+void Renderer::UpdateShadowCascades(const Camera &camera) {
+  m_gpuLightData.shadowsEnabled = m_gpuLightData.numDirectionalLights > 0 ? 1 : 0;
+  if (m_gpuLightData.shadowsEnabled == 0)
+    return;
 
-    m_stats.drawcallCount++;
-    m_stats.triangleCount += mesh->indices.size() / 3;
+  m_shadowMap->Update(camera, glm::vec3(m_gpuLightData.directionalLights[0].direction));
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    const ShadowCascade &shadowCascade = m_shadowMap->GetCascade(cascade);
+    m_gpuLightData.cascadeViewProj[cascade] = shadowCascade.viewProj;
+    m_gpuLightData.cascadeSplits[cascade] = shadowCascade.splitDepth;
+    m_gpuLightData.cascadeTexelSizes[cascade] = shadowCascade.texelSize;
   }
 }
 
-void Renderer::End3DRendering() {
-  VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
-  vkCmdEndRendering(cmd);
+void Renderer::RenderShadows(std::span<const CulledInstances> staticCasters, std::span<const CulledInstances> dynamicCasters) {
+  if (m_gpuLightData.shadowsEnabled == 0 || !m_meshGeometry->HasBuffers())
+    return;
 
-  // Handle draw image
-  VkUtil::transition_image(cmd, m_swapchain.GetDrawTexture()->GetImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-  VkUtil::transition_image(cmd, m_swapchain.GetImage(m_currentImageIndex), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  auto &frame = getCurrentFrame();
+  m_shadowMap->SetPositionBuffer(m_currentFrame, m_meshGeometry->GetPositionBuffer(), m_meshGeometry->GetPositionBufferSize());
+
+  // Static lists come first in the caster buffer, followed by the dynamic ones
+  std::vector<std::span<const uint32_t>> casterLists;
+  for (const auto &casters : staticCasters)
+    casterLists.emplace_back(casters.instances);
+  for (const auto &casters : dynamicCasters)
+    casterLists.emplace_back(casters.instances);
+  const std::vector<uint32_t> listOffsets = m_shadowMap->UploadCasters(m_currentFrame, casterLists);
+
+  // Static casters are drawn into the cache, the layers that need it are copied into the sampled maps and the
+  // dynamic casters drawn on top. Each step is its own pass, the graph orders them through their image uses
+  std::array<bool, SHADOW_CASCADE_COUNT> renderStatic{};
+  std::array<bool, SHADOW_CASCADE_COUNT> renderDynamic{};
+  std::array<bool, SHADOW_CASCADE_COUNT> compose{};
+  for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+    renderStatic[cascade] = cascade < staticCasters.size() && m_shadowMap->NeedsStaticRender(cascade);
+    renderDynamic[cascade] = cascade < dynamicCasters.size() && !dynamicCasters[cascade].instances.empty();
+    compose[cascade] = m_shadowMap->NeedsCompose(cascade, renderStatic[cascade], renderDynamic[cascade]);
+  }
 
-  // Handle object picking
-  VkUtil::transition_image(cmd, m_pickingResources.texture->GetImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-  VkBufferImageCopy region{};
-  float mouseX, mouseY;
-  SDL_GetMouseState(&mouseX, &mouseY);
-  region.imageOffset = {static_cast<int>(mouseX), static_cast<int>(mouseY), 0};
-  region.imageExtent = {1, 1, 1};
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.layerCount = 1;
-  vkCmdCopyImageToBuffer(cmd, m_pickingResources.texture->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_pickingResources.stagingBuffer->buffer, 1, &region);
+  VkDescriptorSet casterSet = m_shadowMap->GetCasterSet(m_currentFrame);
+  if (std::ranges::contains(renderStatic, true)) {
+    m_graph->AddPass("Static shadows", PassType::Graphics, {{m_shadowCacheImage, ImageAccess::DepthAttachment}}, [this, &frame, staticCasters, listOffsets, casterSet, renderStatic](VkCommandBuffer cmd) {
+      const uint32_t scope = m_profiler->BeginScope(cmd, "Static shadows");
+      for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+        if (!renderStatic[cascade])
+          continue;
+        m_shadowMap->RenderStatic(cmd, cascade, [&](VkCommandBuffer cmd) {
+          drawCulledInstances(cmd, staticCasters[cascade], listOffsets[cascade], frame.descriptorSet, m_shadowMap->GetPipelineLayout(), casterSet);
+        });
+      }
+      m_profiler->EndScope(cmd, scope);
+    });
+  }
+  if (std::ranges::contains(compose, true)) {
+    m_graph->AddPass("Shadow compose", PassType::Transfer, {{m_shadowCacheImage, ImageAccess::TransferSrc}, {m_shadowImage, ImageAccess::TransferDst}}, [this, compose, renderDynamic](VkCommandBuffer cmd) {
+      for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+        if (compose[cascade])
+          m_shadowMap->Compose(cmd, cascade, renderDynamic[cascade]);
+      }
+    });
+  }
+  if (std::ranges::contains(renderDynamic, true)) {
+    m_graph->AddPass("Dynamic shadows", PassType::Graphics, {{m_shadowImage, ImageAccess::DepthAttachment}}, [this, &frame, staticCasters, dynamicCasters, listOffsets, casterSet, renderDynamic](VkCommandBuffer cmd) {
+      const uint32_t scope = m_profiler->BeginScope(cmd, "Dynamic shadows");
+      for (uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++) {
+        if (!renderDynamic[cascade])
+          continue;
+        m_shadowMap->RenderDynamic(cmd, cascade, [&](VkCommandBuffer cmd) {
+          drawCulledInstances(cmd, dynamicCasters[cascade], listOffsets[staticCasters.size() + cascade], frame.dynamicDescriptorSet, m_shadowMap->GetPipelineLayout(), casterSet);
+        });
+      }
+      m_profiler->EndScope(cmd, scope);
+    });
+  }
 }
 
-void Renderer::RenderImGui() {
-  VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
-  VkExtent2D drawExtent = {
-      .width = static_cast<uint32_t>(std::min(m_swapchain.GetExtent().width, m_swapchain.GetDrawTexture()->GetExtent().width) * m_swapchain.GetRenderScale()),
-      .height = static_cast<uint32_t>(std::min(m_swapchain.GetExtent().height, m_swapchain.GetDrawTexture()->GetExtent().height) * m_swapchain.GetRenderScale()),
+uint32_t Renderer::RequestPick(glm::ivec2 pixel, uint32_t radius) {
+  return m_picker->Request(pixel, radius);
+}
+
+std::span<const PickRequest> Renderer::GetFramePickRequests() const {
+  return m_picker->GetFrameRequests(m_currentFrame);
+}
+
+void Renderer::RenderPicks(std::span<const CulledInstances> staticCandidates, std::span<const CulledInstances> dynamicCandidates) {
+  // The tiles are declared every frame, also without queries, so picks coming and going never change the
+  // transients and make the graph place them again
+  const RenderGraphImage idImage = m_graph->CreateImage(PICK_TILES_EXTENT, PICK_ID_FORMAT);
+  const RenderGraphImage depthImage = m_graph->CreateImage(PICK_TILES_EXTENT, PICK_DEPTH_FORMAT);
+  const bool picking = !GetFramePickRequests().empty();
+
+  // Without any mesh the queries still run, they just find nothing
+  auto &frame = getCurrentFrame();
+  std::vector<uint32_t> listOffsets;
+  if (picking && m_meshGeometry->HasBuffers()) {
+    m_picker->SetPositionBuffer(m_currentFrame, m_meshGeometry->GetPositionBuffer(), m_meshGeometry->GetPositionBufferSize());
+
+    std::vector<std::span<const uint32_t>> candidateLists;
+    for (const auto &candidates : staticCandidates)
+      candidateLists.emplace_back(candidates.instances);
+    for (const auto &candidates : dynamicCandidates)
+      candidateLists.emplace_back(candidates.instances);
+    listOffsets = m_picker->UploadCandidates(m_currentFrame, candidateLists);
+  }
+
+  VkDescriptorSet candidateSet = m_picker->GetCandidateSet(m_currentFrame);
+  m_graph->AddPass("Picking", PassType::Graphics, {{idImage, ImageAccess::ColorAttachment}, {depthImage, ImageAccess::DepthAttachment}}, [this, &frame, picking, idImage, depthImage, staticCandidates, dynamicCandidates, listOffsets, candidateSet](VkCommandBuffer primary) {
+    if (!picking)
+      return;
+
+    const uint32_t scope = m_profiler->BeginScope(primary, "Picking");
+    m_picker->Render(primary, m_currentFrame, m_graph->GetView(idImage), m_graph->GetView(depthImage), [&](VkCommandBuffer cmd, uint32_t request) {
+      if (listOffsets.empty())
+        return;
+
+      if (request < staticCandidates.size())
+        drawCulledInstances(cmd, staticCandidates[request], listOffsets[request], frame.descriptorSet, m_picker->GetPipelineLayout(), candidateSet);
+      if (request < dynamicCandidates.size())
+        drawCulledInstances(cmd, dynamicCandidates[request], listOffsets[staticCandidates.size() + request], frame.dynamicDescriptorSet, m_picker->GetPipelineLayout(), candidateSet);
+    });
+    m_profiler->EndScope(primary, scope);
+  });
+  m_graph->AddPass("Pick readback", PassType::Transfer, {{idImage, ImageAccess::TransferSrc}}, [this, idImage](VkCommandBuffer cmd) {
+    m_picker->CopyResults(cmd, m_currentFrame, m_graph->GetImage(idImage));
+  });
+}
+
+std::vector<PickResult> Renderer::TakePickResults() {
+  return m_picker->TakeResults();
+}
+
+void Renderer::drawCulledInstances(VkCommandBuffer cmd, const CulledInstances &culled, uint32_t listOffset, VkDescriptorSet frameSet, VkPipelineLayout layout, VkDescriptorSet instanceSet) {
+  std::vector<VkDrawIndexedIndirectCommand> draws;
+  for (const auto &batch : culled.batches) {
+    if (batch.instanceCount == 0)
+      continue;
+
+    const MeshGeometryRange &geometry = m_meshGeometry->GetRange(batch.mesh->id);
+    draws.push_back({
+        .indexCount = batch.indexCount,
+        .instanceCount = batch.instanceCount,
+        .firstIndex = geometry.firstIndex + batch.firstIndex,
+        .vertexOffset = static_cast<int32_t>(geometry.vertexOffset),
+        .firstInstance = listOffset + batch.firstInstance,
+    });
+    m_stats.triangleCount += batch.indexCount / 3 * batch.instanceCount;
+  }
+  if (draws.empty())
+    return;
+
+  // Position only passes ignore materials, every culled batch goes into one multi draw
+  auto &frame = getCurrentFrame();
+  const UploadAllocation drawAllocation = frame.uploadAllocator->PushSpan<VkDrawIndexedIndirectCommand>(draws);
+  std::array<VkDescriptorSet, 2> descriptorSets{frameSet, instanceSet};
+  std::array<uint32_t, 2> dynamicOffsets{frame.sceneDataOffset, frame.lightDataOffset};
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, descriptorSets.size(), descriptorSets.data(), dynamicOffsets.size(), dynamicOffsets.data());
+  vkCmdBindIndexBuffer(cmd, m_meshGeometry->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+  vkCmdDrawIndexedIndirect(cmd, drawAllocation.buffer, drawAllocation.offset, static_cast<uint32_t>(draws.size()), sizeof(VkDrawIndexedIndirectCommand));
+  m_stats.drawcallCount++;
+}
+
+void Renderer::resolveVisibility(VkCommandBuffer cmd) {
+  auto &frame = getCurrentFrame();
+  syncVisibilityResources(frame);
+
+  // The graph orders the id and draw images, the instance and draw buffers come from culling and transfers earlier in the frame
+  VkUtil::memory_barrier(cmd,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+  std::array<VkDescriptorSet, 4> descriptorSets{frame.descriptorSet, m_bindlessRegistry->GetSet(), frame.dynamicDescriptorSet, frame.resolveDescriptorSet};
+  std::array<uint32_t, 4> dynamicOffsets{frame.sceneDataOffset, frame.lightDataOffset, frame.sceneDataOffset, frame.lightDataOffset};
+
+  GPUResolvePushConstants pushConstants{
+      .renderSize = glm::uvec2(m_renderExtent.width, m_renderExtent.height),
   };
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolvePipeline.pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolvePipeline.layout, 0, descriptorSets.size(), descriptorSets.data(), dynamicOffsets.size(), dynamicOffsets.data());
+  vkCmdPushConstants(cmd, m_resolvePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUResolvePushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (m_renderExtent.width + 7) / 8, (m_renderExtent.height + 7) / 8, 1);
+}
+
+void Renderer::addTransparencyPasses() {
+  if (m_transparentDrawGroups.empty() && m_dynamicTransparentDrawGroups.empty())
+    return;
+
+  // Blended after every opaque surface is known, the composite folds the result into the draw image
+  const VkExtent2D drawExtent = m_swapchain.GetDrawExtent();
+  m_accumulationImage = m_graph->CreateImage(drawExtent, OIT_ACCUMULATION_FORMAT);
+  m_revealageImage = m_graph->CreateImage(drawExtent, OIT_REVEALAGE_FORMAT);
+
+  const VkDeviceSize dynamicDrawOffset = m_dynamicRing->GetSectionOffset(m_currentFrame) + m_dynamicRing->GetLayout().drawCommands;
+  const RenderGraphPass transparencyPass = m_graph->AddPass("Transparency", PassType::Graphics, {{m_accumulationImage, ImageAccess::ColorAttachment}, {m_revealageImage, ImageAccess::ColorAttachment}, {m_depthImage, ImageAccess::DepthTest}, {m_shadowImage, ImageAccess::Sampled}}, [this, dynamicDrawOffset](VkCommandBuffer cmd) {
+    auto &frame = getCurrentFrame();
+    const uint32_t scope = m_profiler->BeginScope(cmd, "Transparency");
+
+    // Nothing accumulated and everything behind fully revealed
+    VkClearValue accumulationClear{.color = {{0.0f, 0.0f, 0.0f, 0.0f}}};
+    VkClearValue revealageClear{.color = {{1.0f, 0.0f, 0.0f, 0.0f}}};
+    std::array colorAttachments{
+        VkInit::color_attachment_info(m_graph->GetView(m_accumulationImage), &accumulationClear, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+        VkInit::color_attachment_info(m_graph->GetView(m_revealageImage), &revealageClear, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+    };
+    // Opaque depth only hides what is behind it, transparent fragments never write it
+    VkRenderingAttachmentInfo depthAttachment = VkInit::depth_attachment_info(m_graph->GetView(m_depthImage), VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+
+    VkRenderingInfo renderInfo = VkInit::rendering_info(m_graph->GetExtent(m_accumulationImage), colorAttachments, &depthAttachment);
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+    recordDrawGroups(cmd, MeshPassType::Transparency, m_transparentDrawGroups, frame.descriptorSet, frame.indirectDrawBuffer->buffer, 0, frame.drawCountBuffer->buffer, 0);
+    // The dynamic ring has no buffer before the first dynamic object
+    if (!m_dynamicTransparentDrawGroups.empty())
+      recordDrawGroups(cmd, MeshPassType::Transparency, m_dynamicTransparentDrawGroups, frame.dynamicDescriptorSet, m_dynamicRing->GetBuffer(), dynamicDrawOffset, VK_NULL_HANDLE, DYNAMIC_INSTANCE_BIT);
+    vkCmdEndRendering(cmd);
+    m_profiler->EndScope(cmd, scope);
+  });
+  addDependency(m_lightClusterPass, transparencyPass);
+  addDependency(m_cullPass, transparencyPass);
+  addDependency(m_dynamicSortPass, transparencyPass);
 
-  VkUtil::copy_image_to_image(cmd, m_swapchain.GetDrawTexture()->GetImage(), m_swapchain.GetImage(m_currentImageIndex), drawExtent, m_swapchain.GetExtent());
-  VkUtil::transition_image(cmd, m_swapchain.GetImage(m_currentImageIndex), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  m_graph->AddPass("Transparency composite", PassType::Compute, {{m_accumulationImage, ImageAccess::Sampled}, {m_revealageImage, ImageAccess::Sampled}, {m_drawImage, ImageAccess::Storage}}, [this](VkCommandBuffer cmd) {
+    compositeTransparency(cmd);
+  });
+}
+
+void Renderer::compositeTransparency(VkCommandBuffer cmd) {
+  auto &frame = getCurrentFrame();
+  syncCompositeResources(frame);
+
+  GPUResolvePushConstants pushConstants{
+      .renderSize = glm::uvec2(m_renderExtent.width, m_renderExtent.height),
+  };
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_compositePipeline.pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_compositePipeline.layout, 0, 1, &frame.compositeDescriptorSet, 0, nullptr);
+  vkCmdPushConstants(cmd, m_compositePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUResolvePushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (m_renderExtent.width + 7) / 8, (m_renderExtent.height + 7) / 8, 1);
+}
+
+void Renderer::End3DRendering() {
+  addGeometryPass();
+
+  if (m_renderPath == RenderPath::Visibility) {
+    const RenderGraphPass resolvePass = m_graph->AddPass("Resolve", PassType::Compute, {{m_visibilityImage, ImageAccess::Sampled}, {m_drawImage, ImageAccess::Storage}, {m_shadowImage, ImageAccess::Sampled}}, [this](VkCommandBuffer cmd) {
+      resolveVisibility(cmd);
+    });
+    addDependency(m_lightClusterPass, resolvePass);
+  }
+  addTransparencyPasses();
+  m_graph->AddPass("End 3D", PassType::Graphics, {}, [this](VkCommandBuffer cmd) {
+    m_profiler->EndScope(cmd, m_3dScope);
+  });
+}
 
-  std::array colorAttachments{VkInit::color_attachment_info(m_swapchain.GetImageView(m_currentImageIndex), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)};
-  VkRenderingInfo renderInfo = VkInit::rendering_info(m_swapchain.GetExtent(), colorAttachments, nullptr);
+void Renderer::RenderImGui() {
+  m_graph->AddPass("Present blit", PassType::Transfer, {{m_drawImage, ImageAccess::TransferSrc}, {m_swapchainImage, ImageAccess::TransferDst}}, [this](VkCommandBuffer cmd) {
+    // Linear filtering upscales the rendered corner to the whole window
+    const uint32_t scope = m_profiler->BeginScope(cmd, "Present blit");
+    VkUtil::copy_image_to_image(cmd, m_graph->GetImage(m_drawImage), m_graph->GetImage(m_swapchainImage), m_renderExtent, m_swapchain.GetExtent());
+    m_profiler->EndScope(cmd, scope);
+  });
 
-  vkCmdBeginRendering(cmd, &renderInfo);
-  ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
-  vkCmdEndRendering(cmd);
+  if (m_swapchain.IsHeadless())
+    return;
+  m_graph->AddPass("ImGui", PassType::Graphics, {{m_swapchainImage, ImageAccess::ColorAttachment}}, [this](VkCommandBuffer cmd) {
+    std::array colorAttachments{VkInit::color_attachment_info(m_graph->GetView(m_swapchainImage), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)};
+    VkRenderingInfo renderInfo = VkInit::rendering_info(m_swapchain.GetExtent(), colorAttachments, nullptr);
+
+    const uint32_t scope = m_profiler->BeginScope(cmd, "ImGui");
+    vkCmdBeginRendering(cmd, &renderInfo);
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+    vkCmdEndRendering(cmd);
+    m_profiler->EndScope(cmd, scope);
+  });
 }
 
 void Renderer::EndRendering() {
-  VkCommandBuffer cmd = getCurrentFrame().commandBuffer;
+  auto &frame = getCurrentFrame();
+  if (m_captureRequested)
+    addCapturePass();
+  m_graph->AddPass("End frame", PassType::Graphics, {}, [this](VkCommandBuffer cmd) {
+    m_profiler->EndScope(cmd, m_frameScope);
+  });
 
-  VkUtil::transition_image(cmd, m_swapchain.GetImage(m_currentImageIndex), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-  VK_CHECK(vkEndCommandBuffer(cmd));
+  // New transients invalidate every view taken from the graph. The frame's own sets are rewritten when it next
+  // binds them, the pyramid's set is shared and waits for the other frames in flight to stop reading it
+  if (m_graph->Compile(frame.deletionQueue)) {
+    for (auto &other : m_frames) {
+      if (&other != &frame)
+        VK_CHECK(vkWaitForFences(m_ctx->GetDevice(), 1, &other.renderFence, true, UINT64_MAX));
+    }
+    m_depthPyramid->SetDepthView(m_graph->GetView(m_depthImage));
+    m_visibilityDataVersion++;
+    m_compositeDataVersion++;
+  }
+  m_stats.transientMemorySize = m_graph->GetTransientMemorySize();
+  m_stats.unaliasedMemorySize = m_graph->GetUnaliasedMemorySize();
 
-  VkCommandBufferSubmitInfo cmdInfo = VkInit::command_buffer_submit_info(getCurrentFrame().commandBuffer);
-  VkSemaphoreSubmitInfo waitInfo = VkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, getCurrentFrame().swapchainSemaphore);
-  VkSemaphoreSubmitInfo signalInfo = VkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, getCurrentFrame().renderSemaphore);
-  VkSubmitInfo2 submit = VkInit::submit_info(&cmdInfo, &signalInfo, &waitInfo);
+  // Counted while the passes record, the GUI of the next frame shows them
+  m_stats.triangleCount = 0;
+  m_stats.drawcallCount = 0;
+  m_graph->Execute(frame.commandBuffer, [this](RenderQueue queue) { return beginQueueCommands(queue); });
 
-  VK_CHECK(vkQueueSubmit2(m_ctx->GetGraphicsQueue(), 1, &submit, getCurrentFrame().renderFence));
+  frame.uploadAllocator->Flush();
+
+  if (m_swapchain.IsHeadless()) {
+    // Nothing is acquired or presented, the frame's fence is all that waits on it
+    m_graph->Submit({.fence = frame.renderFence});
+    m_currentFrame = (m_currentFrame + 1) % FRAME_OVERLAP;
+    return;
+  }
+
+  m_graph->Submit({
+      .waitSemaphore = frame.swapchainSemaphore,
+      .waitStages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+      .signalSemaphore = frame.renderSemaphore,
+      .fence = frame.renderFence,
+  });
 
   VkPresentInfoKHR presentInfo{
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -260,7 +960,6 @@ void Renderer::EndRendering() {
   else if (result != VK_SUCCESS)
     throw std::runtime_error("failed to present swap chain image!");
 
-  m_pickingResources.stagingBuffer->MapMemoryToScalar(m_pickingResources.entityId);
   m_currentFrame = (m_currentFrame + 1) % FRAME_OVERLAP;
 }
 
@@ -268,20 +967,93 @@ Swapchain &Renderer::GetSwapchain() {
   return m_swapchain;
 }
 
+bool Renderer::IsHeadless() const {
+  return m_swapchain.IsHeadless();
+}
+
+void Renderer::CaptureFrame() {
+  if (!m_swapchain.IsHeadless())
+    throw std::runtime_error("only headless renderers can capture frames!");
+
+  const VkExtent2D extent = m_swapchain.GetExtent();
+  if (!m_captureBuffer)
+    m_captureBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), extent.width * extent.height * CAPTURE_PIXEL_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+  m_captureRequested = true;
+}
+
+std::vector<uint8_t> Renderer::ReadCapture() {
+  if (!m_captureRecorded)
+    return {};
+
+  vkDeviceWaitIdle(m_ctx->GetDevice());
+  const VkExtent2D extent = m_swapchain.GetExtent();
+  const VkDeviceSize size = extent.width * extent.height * CAPTURE_PIXEL_SIZE;
+  m_captureBuffer->Invalidate(0, size);
+  const auto *pixels = static_cast<const uint8_t *>(m_captureBuffer->info.pMappedData);
+  return {pixels, pixels + size};
+}
+
+void Renderer::addCapturePass() {
+  m_captureRequested = false;
+  m_captureRecorded = true;
+  m_graph->AddPass("Capture", PassType::Transfer, {{m_swapchainImage, ImageAccess::TransferSrc}}, [this](VkCommandBuffer cmd) {
+    const VkExtent2D extent = m_swapchain.GetExtent();
+    const VkBufferImageCopy region{
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageExtent = {extent.width, extent.height, 1},
+    };
+    vkCmdCopyImageToBuffer(cmd, m_graph->GetImage(m_swapchainImage), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_captureBuffer->buffer, 1, &region);
+
+    VkUtil::memory_barrier(cmd,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+  });
+}
+
+BindlessRegistry &Renderer::GetBindlessRegistry() {
+  return *m_bindlessRegistry;
+}
+
+InstanceTable &Renderer::GetInstanceTable() {
+  return *m_instanceTable;
+}
+
+void Renderer::SetRenderPath(RenderPath path) {
+  m_requestedRenderPath = path;
+}
+
 void Renderer::initCommands() {
-  auto [graphicsFamily, presentFamily] = VkUtil::find_queue_families(m_ctx->GetPhysicalDevice(), m_ctx->GetSurface());
-  VkCommandPoolCreateInfo commandPoolInfo = VkInit::command_pool_create_info(graphicsFamily.value(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  const uint32_t graphicsFamily = m_ctx->GetGraphicsQueueFamily();
+  VkCommandPoolCreateInfo commandPoolInfo = VkInit::command_pool_create_info(graphicsFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
   for (int i = 0; i < FRAME_OVERLAP; i++) {
     VK_CHECK(vkCreateCommandPool(m_ctx->GetDevice(), &commandPoolInfo, nullptr, &m_frames[i].commandPool));
     VkCommandBufferAllocateInfo cmdAllocInfo = VkInit::command_buffer_allocate_info(m_frames[i].commandPool, 1);
     VK_CHECK(vkAllocateCommandBuffers(m_ctx->GetDevice(), &cmdAllocInfo, &m_frames[i].commandBuffer));
 
-    m_frames[i].indirectDrawBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), MAX_COMMANDS * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // One pool per recording worker, pools are reset as a whole once the frame's fence signaled
+    const uint32_t workerCount = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_RECORDING_WORKERS);
+    VkCommandPoolCreateInfo secondaryPoolInfo = VkInit::command_pool_create_info(graphicsFamily, 0);
+    m_frames[i].secondaryPools.resize(workerCount);
+    for (auto &secondaryPool : m_frames[i].secondaryPools)
+      VK_CHECK(vkCreateCommandPool(m_ctx->GetDevice(), &secondaryPoolInfo, nullptr, &secondaryPool.pool));
+
+    // Primaries of the submissions the render graph splits the frame into, reset with the secondary pools
+    VK_CHECK(vkCreateCommandPool(m_ctx->GetDevice(), &secondaryPoolInfo, nullptr, &m_frames[i].graphicsCommands.pool));
+    if (m_ctx->HasAsyncCompute()) {
+      VkCommandPoolCreateInfo computePoolInfo = VkInit::command_pool_create_info(m_ctx->GetComputeQueueFamily(), 0);
+      VK_CHECK(vkCreateCommandPool(m_ctx->GetDevice(), &computePoolInfo, nullptr, &m_frames[i].computeCommands.pool));
+    }
+
+    // The visibility set binds the draw buffer before any batch was uploaded
+    reserveStaticDrawBuffers(m_frames[i], 0);
   }
 }
 
 void Renderer::initImgui() {
+  if (m_swapchain.IsHeadless())
+    return;
+
   VkDescriptorPoolSize pool_sizes[] = {
       {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
@@ -320,6 +1092,7 @@ void Renderer::initImgui() {
       .MinImageCount = 3,
       .ImageCount = 3,
       .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+      .PipelineCache = m_ctx->GetPipelineCache(),
       .UseDynamicRendering = true,
       .PipelineRenderingCreateInfo{
           .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
@@ -338,6 +1111,14 @@ void Renderer::initImgui() {
   });
 }
 
+void Renderer::initProfiler() {
+  m_profiler = std::make_unique<GpuProfiler>(m_ctx, FRAME_OVERLAP);
+
+  m_deletionQueue.PushFunction([this] {
+    m_profiler.reset();
+  });
+}
+
 void Renderer::initSyncObjects() {
   VkFenceCreateInfo fenceCreateInfo = VkInit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
   VkSemaphoreCreateInfo semaphoreCreateInfo = VkInit::semaphore_create_info();
@@ -349,30 +1130,6 @@ void Renderer::initSyncObjects() {
   }
 }
 
-void Renderer::initDescriptorAllocator() {
-  std::vector<DescriptorAllocator::PoolSizeRatio> sizes{
-      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1}};
-
-  m_descriptorAllocator.Init(m_ctx->GetDevice(), 10, sizes);
-
-  {
-    DescriptorLayoutBuilder builder;
-    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-    m_drawImageDescriptorLayout = builder.Build(m_ctx->GetDevice(), VK_SHADER_STAGE_COMPUTE_BIT);
-  }
-
-  m_drawImageDescriptors = m_descriptorAllocator.Allocate(m_ctx->GetDevice(), m_drawImageDescriptorLayout);
-
-  DescriptorWriter writer;
-  writer.WriteImage(0, m_swapchain.GetDrawTexture()->GetView(), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-  writer.UpdateSet(m_ctx->GetDevice(), m_drawImageDescriptors);
-
-  m_deletionQueue.PushFunction([&] {
-    m_descriptorAllocator.DestroyPools(m_ctx->GetDevice());
-    vkDestroyDescriptorSetLayout(m_ctx->GetDevice(), m_drawImageDescriptorLayout, nullptr);
-  });
-}
-
 void Renderer::initDescriptors() {
   {
     DescriptorLayoutBuilder builder;
@@ -386,8 +1143,10 @@ void Renderer::initDescriptors() {
   for (int i = 0; i < FRAME_OVERLAP; i++) {
     std::vector<DescriptorAllocator::PoolSizeRatio> frame_sizes = {
         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8},
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
     };
 
@@ -400,37 +1159,320 @@ void Renderer::initDescriptors() {
 
   {
     DescriptorLayoutBuilder builder;
-    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    // Scene and light data move through the frame's upload allocator, their offsets are given at bind time
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC);
     builder.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
     builder.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    m_gpuSceneDataDescriptorLayout = builder.Build(m_ctx->GetDevice(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    builder.AddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    // Local lights, cluster grid and cluster light indices
+    builder.AddBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    // Cascaded shadow maps of the first directional light
+    builder.AddBinding(9, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    m_gpuSceneDataDescriptorLayout = builder.Build(m_ctx->GetDevice(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
     m_deletionQueue.PushFunction([&] {
       vkDestroyDescriptorSetLayout(m_ctx->GetDevice(), m_gpuSceneDataDescriptorLayout, nullptr);
     });
   }
 
+  // The visibility resolve binds both frame sets, even when there are no static or no dynamic objects yet
+  m_nullBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), NULL_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+  DescriptorWriter nullWriter;
+  for (uint32_t binding = 2; binding <= 5; binding++)
+    nullWriter.WriteBuffer(binding, m_nullBuffer->buffer, NULL_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
   for (int i = 0; i < FRAME_OVERLAP; i++) {
     auto &frame = m_frames[i];
 
-    frame.gpuSceneDataBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.gpuSceneDataBuffer->MapMemoryFromScalar(m_gpuSceneData);
+    frame.uploadAllocator = std::make_unique<UploadAllocator>(m_ctx, UPLOAD_ALLOCATOR_CAPACITY);
+    frame.descriptorSet = frame.frameDescriptorAllocator.Allocate(m_ctx->GetDevice(), m_gpuSceneDataDescriptorLayout);
+    frame.dynamicDescriptorSet = frame.frameDescriptorAllocator.Allocate(m_ctx->GetDevice(), m_gpuSceneDataDescriptorLayout);
+    nullWriter.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+    nullWriter.UpdateSet(m_ctx->GetDevice(), frame.dynamicDescriptorSet);
+    updateUploadDescriptors(frame);
+  }
 
-    frame.lightBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), sizeof(GPULightData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.lightBuffer->MapMemoryFromScalar(m_gpuLightData);
+  m_dynamicRing = std::make_unique<DynamicInstanceRing>(m_ctx, FRAME_OVERLAP);
+  m_primitives = std::make_unique<GpuPrimitives>(m_ctx);
+  m_deletionQueue.PushFunction([this] {
+    m_primitives.reset();
+    m_dynamicRing.reset();
+    m_nullBuffer.reset();
+  });
+}
+
+void Renderer::initBindless() {
+  m_bindlessRegistry = std::make_unique<BindlessRegistry>(m_ctx);
+
+  m_deletionQueue.PushFunction([this] {
+    m_bindlessRegistry.reset();
+  });
+}
+
+void Renderer::initPicking() {
+  m_picker = std::make_unique<ObjectPicker>(m_ctx, m_gpuSceneDataDescriptorLayout, FRAME_OVERLAP);
+
+  m_deletionQueue.PushFunction([this] {
+    m_picker.reset();
+  });
+}
+
+void Renderer::initCulling() {
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    builder.AddBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    builder.AddBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_cullDescriptorLayout = builder.Build(m_ctx->GetDevice(), VK_SHADER_STAGE_COMPUTE_BIT);
+  }
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(GPUCullPushConstants),
+  };
+
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &m_cullDescriptorLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(m_ctx->GetDevice(), &layoutInfo, nullptr, &m_cullPipeline.layout));
+
+  VkShaderModule cullShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("compute/cull.comp", m_ctx->GetDevice(), &cullShader))
+    throw std::runtime_error("failed to load culling shader!");
+  VkShaderModule cullDrawsShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("compute/cull_draws.comp", m_ctx->GetDevice(), &cullDrawsShader))
+    throw std::runtime_error("failed to load draw compaction shader!");
+
+  ComputePipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetLayout(m_cullPipeline.layout);
+  pipelineBuilder.SetShaders(cullShader);
+  m_cullPipeline.pipeline = pipelineBuilder.CreatePipeline();
+  pipelineBuilder.SetShaders(cullDrawsShader);
+  m_cullDrawsPipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(m_ctx->GetDevice(), cullShader, nullptr);
+  vkDestroyShaderModule(m_ctx->GetDevice(), cullDrawsShader, nullptr);
+
+  m_depthPyramid = std::make_unique<DepthPyramid>(m_ctx, m_swapchain.GetDrawExtent());
+  m_instanceTable = std::make_unique<InstanceTable>(m_ctx);
+  m_meshGeometry = std::make_unique<MeshGeometryPool>(m_ctx);
+
+  for (auto &frame : m_frames) {
+    frame.cullDataBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), sizeof(GPUCullData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.cullDescriptorSet = frame.frameDescriptorAllocator.Allocate(m_ctx->GetDevice(), m_cullDescriptorLayout);
 
     DescriptorWriter writer;
-    writer.WriteBuffer(0, frame.gpuSceneDataBuffer->buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.WriteBuffer(1, frame.lightBuffer->buffer, sizeof(GPULightData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.WriteBuffer(5, frame.cullDataBuffer->buffer, sizeof(GPUCullData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    writer.UpdateSet(m_ctx->GetDevice(), frame.cullDescriptorSet);
+  }
+  updateDepthPyramidDescriptors();
+
+  m_deletionQueue.PushFunction([this] {
+    m_depthPyramid.reset();
+    m_instanceTable.reset();
+    m_meshGeometry.reset();
+    vkDestroyPipeline(m_ctx->GetDevice(), m_cullPipeline.pipeline, nullptr);
+    vkDestroyPipeline(m_ctx->GetDevice(), m_cullDrawsPipeline, nullptr);
+    vkDestroyPipelineLayout(m_ctx->GetDevice(), m_cullPipeline.layout, nullptr);
+    vkDestroyDescriptorSetLayout(m_ctx->GetDevice(), m_cullDescriptorLayout, nullptr);
+  });
+}
 
-    frame.descriptorSet = frame.frameDescriptorAllocator.Allocate(m_ctx->GetDevice(), m_gpuSceneDataDescriptorLayout);
-    writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+void Renderer::updateDepthPyramidDescriptors() {
+  DescriptorWriter writer;
+  writer.WriteImage(6, m_depthPyramid->GetView(), m_depthPyramid->GetSampler(), VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+  for (auto &frame : m_frames)
+    writer.UpdateSet(m_ctx->GetDevice(), frame.cullDescriptorSet);
+}
+
+void Renderer::initVisibility() {
+  VkDevice device = m_ctx->GetDevice();
+
+  // Ids are read with texelFetch, the sampler never filters
+  VkSamplerCreateInfo samplerInfo{
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      .magFilter = VK_FILTER_NEAREST,
+      .minFilter = VK_FILTER_NEAREST,
+  };
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_visibilitySampler));
+
+  // Geometry pass, one pipeline for every material
+  {
+    std::array<VkDescriptorSetLayout, 2> setLayouts{m_gpuSceneDataDescriptorLayout, m_bindlessRegistry->GetLayout()};
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(GPUIndirectPushConstants),
+    };
+
+    VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+    layoutInfo.setLayoutCount = setLayouts.size();
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_visibilityLayout));
+
+    VkShaderModule vertShader, fragShader;
+    if (!m_ctx->GetShaderBundle().LoadModule("vertex/visibility.vert", device, &vertShader))
+      throw std::runtime_error("failed to load visibility vertex shader!");
+    if (!m_ctx->GetShaderBundle().LoadModule("fragment/visibility.frag", device, &fragShader))
+      throw std::runtime_error("failed to load visibility fragment shader!");
+
+    PipelineBuilder pipelineBuilder(m_ctx);
+    pipelineBuilder.SetShaders(vertShader, fragShader);
+    pipelineBuilder.SetInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    pipelineBuilder.SetPolygonMode(VK_POLYGON_MODE_FILL);
+    pipelineBuilder.SetCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+    pipelineBuilder.SetMultisamplingNone();
+    pipelineBuilder.EnableDepthTest(true);
+    pipelineBuilder.SetDepthFormat(m_swapchain.GetDepthFormat());
+    pipelineBuilder.SetLayout(m_visibilityLayout);
+
+    std::array<VkPipelineColorBlendAttachmentState, 1> blendAttachments{{{
+        .blendEnable = VK_FALSE,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT,
+    }}};
+    std::array<VkFormat, 1> colorFormats{VISIBILITY_FORMAT};
+    m_visibilityPipeline = pipelineBuilder.CreateMRTPipeline(blendAttachments, colorFormats);
+
+    vkDestroyShaderModule(device, vertShader, nullptr);
+    vkDestroyShaderModule(device, fragShader, nullptr);
+  }
+
+  // Resolve pass, reads both frame sets and the bindless materials
+  {
+    DescriptorLayoutBuilder builder;
+    builder.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    builder.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    builder.AddBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    m_resolveDescriptorLayout = builder.Build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    std::array<VkDescriptorSetLayout, 4> setLayouts{m_gpuSceneDataDescriptorLayout, m_bindlessRegistry->GetLayout(), m_gpuSceneDataDescriptorLayout, m_resolveDescriptorLayout};
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(GPUResolvePushConstants),
+    };
+
+    VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+    layoutInfo.setLayoutCount = setLayouts.size();
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_resolvePipeline.layout));
+
+    VkShaderModule resolveShader;
+    if (!m_ctx->GetShaderBundle().LoadModule("compute/visibility_resolve.comp", device, &resolveShader))
+      throw std::runtime_error("failed to load visibility resolve shader!");
+
+    ComputePipelineBuilder pipelineBuilder(m_ctx);
+    pipelineBuilder.SetLayout(m_resolvePipeline.layout);
+    pipelineBuilder.SetShaders(resolveShader);
+    m_resolvePipeline.pipeline = pipelineBuilder.CreatePipeline();
+    vkDestroyShaderModule(device, resolveShader, nullptr);
   }
+
+  for (auto &frame : m_frames)
+    frame.resolveDescriptorSet = frame.frameDescriptorAllocator.Allocate(device, m_resolveDescriptorLayout);
+
+  m_deletionQueue.PushFunction([this] {
+    VkDevice device = m_ctx->GetDevice();
+    vkDestroySampler(device, m_visibilitySampler, nullptr);
+    vkDestroyPipeline(device, m_visibilityPipeline, nullptr);
+    vkDestroyPipelineLayout(device, m_visibilityLayout, nullptr);
+    vkDestroyPipeline(device, m_resolvePipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, m_resolvePipeline.layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, m_resolveDescriptorLayout, nullptr);
+  });
 }
 
-void Renderer::initPicking() {
-  m_pickingResources.texture = std::make_shared<Texture>(m_ctx, VkExtent3D{m_swapchain.GetExtent().width, m_swapchain.GetExtent().height, 1}, VK_FORMAT_R32_UINT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, false);
-  m_pickingResources.stagingBuffer = std::make_shared<Buffer>(m_ctx->GetAllocator(), sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+void Renderer::initTransparency() {
+  VkDevice device = m_ctx->GetDevice();
+
+  DescriptorLayoutBuilder builder;
+  builder.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  builder.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  builder.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  m_compositeDescriptorLayout = builder.Build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(GPUResolvePushConstants),
+  };
+
+  VkPipelineLayoutCreateInfo layoutInfo = VkInit::pipeline_layout_create_info();
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &m_compositeDescriptorLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_compositePipeline.layout));
+
+  VkShaderModule compositeShader;
+  if (!m_ctx->GetShaderBundle().LoadModule("compute/oit_composite.comp", device, &compositeShader))
+    throw std::runtime_error("failed to load transparency composite shader!");
+
+  ComputePipelineBuilder pipelineBuilder(m_ctx);
+  pipelineBuilder.SetLayout(m_compositePipeline.layout);
+  pipelineBuilder.SetShaders(compositeShader);
+  m_compositePipeline.pipeline = pipelineBuilder.CreatePipeline();
+  vkDestroyShaderModule(device, compositeShader, nullptr);
+
+  for (auto &frame : m_frames)
+    frame.compositeDescriptorSet = frame.frameDescriptorAllocator.Allocate(device, m_compositeDescriptorLayout);
+
+  m_deletionQueue.PushFunction([this] {
+    VkDevice device = m_ctx->GetDevice();
+    vkDestroyPipeline(device, m_compositePipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, m_compositePipeline.layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, m_compositeDescriptorLayout, nullptr);
+  });
+}
+
+void Renderer::initRenderGraph() {
+  m_graph = std::make_unique<RenderGraph>(m_ctx);
+
+  m_deletionQueue.PushFunction([this] {
+    m_graph.reset();
+  });
+}
+
+void Renderer::initLighting() {
+  m_lightGrid = std::make_unique<LightGrid>(m_ctx, FRAME_OVERLAP);
+  for (uint32_t i = 0; i < FRAME_OVERLAP; i++)
+    updateLightDescriptors(i);
+
+  // The shadow maps keep their image for the whole run, every frame set points at it once
+  m_shadowMap = std::make_unique<CascadedShadowMap>(m_ctx, m_gpuSceneDataDescriptorLayout, FRAME_OVERLAP);
+  DescriptorWriter shadowWriter;
+  shadowWriter.WriteImage(9, m_shadowMap->GetView(), m_shadowMap->GetSampler(), SHADOW_MAP_LAYOUT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  for (auto &frame : m_frames) {
+    shadowWriter.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+    shadowWriter.UpdateSet(m_ctx->GetDevice(), frame.dynamicDescriptorSet);
+  }
+
+  m_deletionQueue.PushFunction([this] {
+    m_shadowMap.reset();
+    m_lightGrid.reset();
+  });
 }
 
 VkCommandBuffer Renderer::beginSingleTimeCommands(VkCommandPool &commandPool) const {
@@ -475,25 +1517,323 @@ void Renderer::WaitIdle() {
   vkDeviceWaitIdle(m_ctx->GetDevice());
 }
 
-void Renderer::UpdateStaticObjects(RenderIndirectObjects &objects) {
-  if (m_objectIdsBuffer == nullptr && m_transformsBuffer == nullptr) {
-    m_objectIdsBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), objects.objectIds.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    m_objectIdsBuffer->MapMemoryFromVector(objects.objectIds);
+void Renderer::UpdateStaticBatches(std::span<const IndirectBatch> batches) {
+  acquireMeshGeometry(getCurrentFrame(), batches, m_staticMeshIds);
+
+  // Every draw starts with zero instances, the culling pass appends the visible ones
+  std::vector<GPUDrawData> drawData;
+  buildDraws(batches, m_drawTemplates, drawData, m_drawGroups, m_transparentDrawGroups);
+  for (auto &draw : m_drawTemplates)
+    draw.instanceCount = 0;
+  m_firstTransparentBatch = m_transparentDrawGroups.empty() ? static_cast<uint32_t>(batches.size()) : m_transparentDrawGroups.front().firstDraw;
+
+  // Culling moves the draws with visible instances into their group's range of the compacted draws, which
+  // follow the per batch draws. Each group counts its own, the count after them is for all opaque groups merged
+  const uint32_t batchCount = static_cast<uint32_t>(batches.size());
+  std::vector<GPUBatchGroup> batchGroups(batches.size());
+  uint32_t countIndex = 0;
+  for (auto *groups : {&m_drawGroups, &m_transparentDrawGroups}) {
+    for (auto &group : *groups) {
+      std::fill_n(batchGroups.begin() + group.firstDraw, group.drawCount, GPUBatchGroup{countIndex, batchCount + group.firstDraw});
+      group.firstDraw += batchCount;
+      group.countIndex = countIndex++;
+    }
+  }
+  m_mergedCountIndex = countIndex;
+
+  // Frames still in flight keep reading the previous buffers, they are destroyed once this frame completes
+  retireBuffer(m_drawTemplateBuffer);
+  retireBuffer(m_drawDataBuffer);
+  retireBuffer(m_batchGroupBuffer);
+
+  // Sized to the batches, an empty scene still keeps valid buffers to bind
+  const VkDeviceSize batchSlots = std::max<size_t>(batchCount, 1);
+  m_drawTemplateBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), batchSlots * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_drawDataBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), batchSlots * sizeof(GPUDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_batchGroupBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), batchSlots * sizeof(GPUBatchGroup), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_drawTemplateBuffer->MapMemoryFromVector(m_drawTemplates);
+  m_drawDataBuffer->MapMemoryFromVector(drawData);
+  m_batchGroupBuffer->MapMemoryFromVector(batchGroups);
+
+  m_staticBatchCount = batchCount;
+  m_staticDataVersion++;
+  m_shadowMap->InvalidateStatic();
+  syncStaticResources(getCurrentFrame());
+}
 
-    m_transformsBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), objects.transforms.size() * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    m_transformsBuffer->MapMemoryFromVector(objects.transforms);
+void Renderer::UploadDynamicObjects(std::span<const IndirectBatch> batches, std::span<const glm::mat4> transforms, std::span<const uint32_t> objectIds, std::span<const uint32_t> drawIndices, std::span<const uint32_t> sortKeys, uint32_t sortKeyBits) {
+  m_dynamicDrawGroups.clear();
+  m_dynamicTransparentDrawGroups.clear();
+  // Also without batches, the meshes of the last dynamic objects are released
+  auto &frame = getCurrentFrame();
+  acquireMeshGeometry(frame, batches, m_dynamicMeshIds);
+  if (batches.empty())
+    return;
 
-    DescriptorWriter writer;
-    writer.WriteBuffer(2, m_objectIdsBuffer->buffer, objects.objectIds.size() * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    writer.WriteBuffer(3, m_transformsBuffer->buffer, objects.transforms.size() * sizeof(glm::mat4), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  if (m_dynamicRing->Reserve(static_cast<uint32_t>(transforms.size()), static_cast<uint32_t>(batches.size()), frame.deletionQueue)) {
+    m_dynamicDataVersion++;
+    m_visibilityDataVersion++;
+  }
+  syncDynamicResources(frame);
 
-    for (int i = 0; i < FRAME_OVERLAP; i++) {
-      writer.UpdateSet(m_ctx->GetDevice(), m_frames[i].descriptorSet);
-    }
+  // Nothing is culled, every draw keeps the instance count of its batch
+  std::vector<VkDrawIndexedIndirectCommand> draws;
+  std::vector<GPUDrawData> drawData;
+  buildDraws(batches, draws, drawData, m_dynamicDrawGroups, m_dynamicTransparentDrawGroups);
+
+  m_dynamicRing->Write(m_currentFrame, transforms, objectIds, drawIndices, sortKeys, drawData, draws);
+
+  // Ordering the instances by their keys gives every draw's instances the contiguous range its batch starts at
+  const uint32_t instanceCount = static_cast<uint32_t>(transforms.size());
+  reserveDynamicSortBuffer(frame, instanceCount);
+  m_dynamicSortPass = m_graph->AddPass("Dynamic sort", PassType::AsyncCompute, {}, [this, instanceCount, sortKeyBits](VkCommandBuffer cmd) {
+    sortDynamicInstances(cmd, instanceCount, sortKeyBits);
+  });
+}
+
+void Renderer::reserveDynamicSortBuffer(FrameData &frame, uint32_t instanceCount) {
+  if (frame.dynamicSortBuffer != nullptr && instanceCount <= frame.dynamicSortCapacity)
+    return;
+
+  // The frame's previous submission completed, nothing reads the old buffer anymore
+  frame.dynamicSortCapacity = std::max({std::bit_ceil(instanceCount), frame.dynamicSortCapacity, MIN_DYNAMIC_SORT_CAPACITY});
+  const VkDeviceSize size = frame.dynamicSortCapacity * sizeof(uint32_t) + GpuPrimitives::GetSortScratchSize(frame.dynamicSortCapacity, RadixKeyWidth::Bits32);
+  frame.dynamicSortBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY, m_ctx->GetSharedQueueFamilies());
+}
+
+bool Renderer::reserveStaticDrawBuffers(FrameData &frame, uint32_t batchCount) {
+  if (frame.indirectDrawBuffer != nullptr && batchCount <= frame.staticDrawCapacity)
+    return false;
+
+  // The frame's previous submission completed, nothing reads the old buffers anymore
+  frame.staticDrawCapacity = std::max({std::bit_ceil(batchCount), frame.staticDrawCapacity, MIN_STATIC_DRAW_CAPACITY});
+  const VkDeviceSize capacity = frame.staticDrawCapacity;
+  // Every batch may be visible, so the compacted draws after the per batch ones take as many slots again
+  frame.indirectDrawBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), 2 * capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, m_ctx->GetSharedQueueFamilies());
+  frame.drawDataBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), 2 * capacity * sizeof(GPUDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, m_ctx->GetSharedQueueFamilies());
+  // A group holds at least one batch, so there are never more counts than batches besides the merged one
+  frame.drawCountBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), (capacity + 1) * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, m_ctx->GetSharedQueueFamilies());
+  return true;
+}
+
+void Renderer::sortDynamicInstances(VkCommandBuffer cmd, uint32_t instanceCount, uint32_t keyBits) {
+  auto &frame = getCurrentFrame();
+  const uint32_t scope = m_profiler->BeginScope(cmd, "Dynamic sort");
+
+  // The keys stay in the ring, the sort consumes a copy of them
+  const DynamicSectionLayout &layout = m_dynamicRing->GetLayout();
+  const VkDeviceSize sectionOffset = m_dynamicRing->GetSectionOffset(m_currentFrame);
+  VkBufferCopy keysCopy{
+      .srcOffset = sectionOffset + layout.sortKeys,
+      .dstOffset = 0,
+      .size = instanceCount * sizeof(uint32_t),
+  };
+  vkCmdCopyBuffer(cmd, m_dynamicRing->GetBuffer(), frame.dynamicSortBuffer->buffer, 1, &keysCopy);
+  VkUtil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  const VkDeviceAddress keys = VkUtil::get_buffer_address(m_ctx->GetDevice(), frame.dynamicSortBuffer->buffer);
+  const VkDeviceAddress instanceIndices = m_dynamicRing->GetDeviceAddress() + sectionOffset + layout.instanceIndices;
+  m_primitives->RadixSort(cmd, keys, instanceIndices, instanceCount, RadixKeyWidth::Bits32, SortValues::Indices, keys + frame.dynamicSortCapacity * sizeof(uint32_t), keyBits);
+  m_profiler->EndScope(cmd, scope);
+}
+
+void Renderer::acquireMeshGeometry(FrameData &frame, std::span<const IndirectBatch> batches, std::vector<uint32_t> &meshIds) {
+  // One reference per distinct mesh. Meshes kept by the batches are acquired before the old references go, so
+  // their ranges never move
+  std::vector<const Mesh *> meshes;
+  meshes.reserve(batches.size());
+  for (const auto &batch : batches)
+    meshes.push_back(batch.mesh);
+  std::ranges::sort(meshes, {}, &Mesh::id);
+  const auto duplicates = std::ranges::unique(meshes, {}, &Mesh::id);
+  meshes.erase(duplicates.begin(), duplicates.end());
+
+  std::vector<uint32_t> acquiredIds;
+  acquiredIds.reserve(meshes.size());
+  for (const Mesh *mesh : meshes) {
+    m_meshGeometry->Acquire(*mesh);
+    acquiredIds.push_back(mesh->id);
+  }
+  for (const uint32_t meshId : meshIds)
+    m_meshGeometry->Release(meshId, frame.deletionQueue);
+  meshIds = std::move(acquiredIds);
+
+  // Also read as storage by the visibility resolve, which fetches the triangles itself
+  if (m_meshGeometry->Flush(frame.commandBuffer, *frame.uploadAllocator, frame.deletionQueue))
+    m_visibilityDataVersion++;
+}
+
+void Renderer::buildDraws(std::span<const IndirectBatch> batches, std::vector<VkDrawIndexedIndirectCommand> &draws, std::vector<GPUDrawData> &drawData, std::vector<DrawGroup> &groups, std::vector<DrawGroup> &transparentGroups) {
+  // Batches are sorted by pipeline, so each run of equal pipeline becomes one draw group. Transparent batches come
+  // last and go to their own groups, draw indices keep counting across both
+  draws.resize(batches.size());
+  drawData.resize(batches.size());
+  groups.clear();
+  transparentGroups.clear();
+  for (const auto &[batchId, batch] : std::views::enumerate(batches)) {
+    draws[batchId] = {
+        .indexCount = batch.indexCount,
+        .instanceCount = batch.instanceCount,
+        .firstIndex = m_meshGeometry->GetRange(batch.mesh->id).firstIndex + batch.firstIndex,
+        .vertexOffset = 0,
+        .firstInstance = batch.firstInstance,
+    };
+    drawData[batchId] = {
+        .vertexBuffer = batch.mesh->meshBuffers->vertexBufferAddress,
+        .materialIndex = batch.material->materialIndex,
+    };
+
+    const MeshPassType pass = main_pass(*batch.material->original);
+    ShaderPass *shaderPass = batch.material->original->passShaders[pass].get();
+    auto &passGroups = pass == MeshPassType::Transparency ? transparentGroups : groups;
+    if (passGroups.empty() || passGroups.back().pipeline != shaderPass->pipeline)
+      passGroups.push_back({.pipeline = shaderPass->pipeline, .layout = shaderPass->effect->pipelineLayout, .firstDraw = static_cast<uint32_t>(batchId)});
+    passGroups.back().drawCount++;
+    passGroups.back().triangleCount += batch.indexCount / 3;
+  }
+}
+
+void Renderer::UploadStaticInstances() {
+  // Any static edit may move a caster, the cached static cascades are drawn again
+  if (m_instanceTable->HasPendingChanges())
+    m_shadowMap->InvalidateStatic();
+
+  auto &frame = getCurrentFrame();
+  if (!m_instanceTable->Flush(frame.commandBuffer, *frame.uploadAllocator, frame.deletionQueue))
+    return;
+
+  // The table outgrew its buffers, every frame has to bind the new ones
+  m_staticDataVersion++;
+  m_visibilityDataVersion++;
+  syncStaticResources(frame);
+}
+
+void Renderer::updateUploadDescriptors(FrameData &frame) {
+  DescriptorWriter writer;
+  writer.WriteBuffer(0, frame.uploadAllocator->GetBuffer(), sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+  writer.WriteBuffer(1, frame.uploadAllocator->GetBuffer(), sizeof(GPULightData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.dynamicDescriptorSet);
+}
+
+void Renderer::updateLightDescriptors(uint32_t frameIndex) {
+  DescriptorWriter writer;
+  writer.WriteBuffer(6, m_lightGrid->GetLightBuffer(frameIndex), m_lightGrid->GetLightBufferSize(frameIndex), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(7, m_lightGrid->GetGridBuffer(frameIndex), m_lightGrid->GetGridBufferSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(8, m_lightGrid->GetIndexBuffer(frameIndex), m_lightGrid->GetIndexBufferSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), m_frames[frameIndex].descriptorSet);
+  writer.UpdateSet(m_ctx->GetDevice(), m_frames[frameIndex].dynamicDescriptorSet);
+}
+
+void Renderer::syncStaticResources(FrameData &frame) {
+  if (frame.staticDataVersion == m_staticDataVersion)
+    return;
+
+  // Only called once the frame's previous submission completed, so its own buffers and sets are free to change.
+  // The draw buffers follow the batches even before the instances arrive
+  if (reserveStaticDrawBuffers(frame, m_staticBatchCount))
+    m_visibilityDataVersion++;
+
+  // Nothing to bind until both the batches and the first instances were uploaded
+  const size_t capacity = m_instanceTable->GetCapacity();
+  if (capacity == 0 || m_drawDataBuffer == nullptr)
+    return;
+  frame.staticDataVersion = m_staticDataVersion;
+
+  const VkDeviceSize drawCapacity = frame.staticDrawCapacity;
+  const VkDeviceSize batchSlots = std::max(m_staticBatchCount, 1u);
+  frame.compactedInstanceBuffer = std::make_unique<Buffer>(m_ctx->GetAllocator(), capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, m_ctx->GetSharedQueueFamilies());
+
+  DescriptorWriter writer;
+  writer.WriteBuffer(2, frame.compactedInstanceBuffer->buffer, capacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(3, m_instanceTable->GetTransformBuffer(), capacity * sizeof(glm::mat4), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(4, m_instanceTable->GetObjectIdBuffer(), capacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(5, frame.drawDataBuffer->buffer, 2 * drawCapacity * sizeof(GPUDrawData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.descriptorSet);
+
+  DescriptorWriter cullWriter;
+  cullWriter.WriteBuffer(0, m_instanceTable->GetCullDataBuffer(), capacity * sizeof(GPUInstanceCullData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(1, m_instanceTable->GetTransformBuffer(), capacity * sizeof(glm::mat4), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(2, frame.indirectDrawBuffer->buffer, 2 * drawCapacity * sizeof(VkDrawIndexedIndirectCommand), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(3, frame.compactedInstanceBuffer->buffer, capacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(4, m_instanceTable->GetVisibilityBuffer(), capacity * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(7, m_drawDataBuffer->buffer, batchSlots * sizeof(GPUDrawData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(8, m_batchGroupBuffer->buffer, batchSlots * sizeof(GPUBatchGroup), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(9, frame.drawDataBuffer->buffer, 2 * drawCapacity * sizeof(GPUDrawData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.WriteBuffer(10, frame.drawCountBuffer->buffer, (drawCapacity + 1) * sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  cullWriter.UpdateSet(m_ctx->GetDevice(), frame.cullDescriptorSet);
+}
+
+void Renderer::syncDynamicResources(FrameData &frame) {
+  if (frame.dynamicDataVersion == m_dynamicDataVersion)
+    return;
+  frame.dynamicDataVersion = m_dynamicDataVersion;
+
+  // Bindings 0 and 1 are shared with the static set and were written once at startup
+  const DynamicSectionLayout &layout = m_dynamicRing->GetLayout();
+  const VkDeviceSize sectionOffset = m_dynamicRing->GetSectionOffset(m_currentFrame);
+  const VkDeviceSize instanceCapacity = m_dynamicRing->GetInstanceCapacity();
+
+  DescriptorWriter writer;
+  writer.WriteBuffer(2, m_dynamicRing->GetBuffer(), instanceCapacity * sizeof(uint32_t), sectionOffset + layout.instanceIndices, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(3, m_dynamicRing->GetBuffer(), instanceCapacity * sizeof(glm::mat4), sectionOffset + layout.transforms, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(4, m_dynamicRing->GetBuffer(), instanceCapacity * sizeof(uint32_t), sectionOffset + layout.objectIds, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.WriteBuffer(5, m_dynamicRing->GetBuffer(), m_dynamicRing->GetDrawCapacity() * sizeof(GPUDrawData), sectionOffset + layout.drawData, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.dynamicDescriptorSet);
+}
+
+void Renderer::syncVisibilityResources(FrameData &frame) {
+  if (frame.visibilityDataVersion == m_visibilityDataVersion)
+    return;
+  frame.visibilityDataVersion = m_visibilityDataVersion;
+
+  // Missing static or dynamic data is never referenced by a visibility id, the null buffer only keeps the set valid
+  DescriptorWriter writer;
+  writer.WriteImage(0, m_graph->GetView(m_visibilityImage), m_visibilitySampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  writer.WriteImage(1, m_graph->GetView(m_drawImage), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+  if (m_meshGeometry->HasBuffers())
+    writer.WriteBuffer(3, m_meshGeometry->GetIndexBuffer(), m_meshGeometry->GetIndexBufferSize(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  else
+    writer.WriteBuffer(3, m_nullBuffer->buffer, NULL_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  writer.WriteBuffer(4, frame.indirectDrawBuffer->buffer, 2 * frame.staticDrawCapacity * sizeof(VkDrawIndexedIndirectCommand), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  if (const uint32_t capacity = m_instanceTable->GetCapacity(); capacity != 0)
+    writer.WriteBuffer(5, m_instanceTable->GetCullDataBuffer(), capacity * sizeof(GPUInstanceCullData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  else
+    writer.WriteBuffer(5, m_nullBuffer->buffer, NULL_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  if (m_dynamicRing->GetInstanceCapacity() != 0) {
+    const DynamicSectionLayout &layout = m_dynamicRing->GetLayout();
+    const VkDeviceSize sectionOffset = m_dynamicRing->GetSectionOffset(m_currentFrame);
+    writer.WriteBuffer(6, m_dynamicRing->GetBuffer(), m_dynamicRing->GetDrawCapacity() * sizeof(VkDrawIndexedIndirectCommand), sectionOffset + layout.drawCommands, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.WriteBuffer(7, m_dynamicRing->GetBuffer(), m_dynamicRing->GetInstanceCapacity() * sizeof(uint32_t), sectionOffset + layout.drawIndices, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
   } else {
-    m_objectIdsBuffer->MapMemoryFromVector(objects.objectIds);
-    m_transformsBuffer->MapMemoryFromVector(objects.transforms);
+    writer.WriteBuffer(6, m_nullBuffer->buffer, NULL_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.WriteBuffer(7, m_nullBuffer->buffer, NULL_BUFFER_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
   }
+  writer.UpdateSet(m_ctx->GetDevice(), frame.resolveDescriptorSet);
+}
+
+void Renderer::syncCompositeResources(FrameData &frame) {
+  if (frame.compositeDataVersion == m_compositeDataVersion)
+    return;
+  frame.compositeDataVersion = m_compositeDataVersion;
+
+  // Targets are read with texelFetch, the visibility sampler never filters
+  DescriptorWriter writer;
+  writer.WriteImage(0, m_graph->GetView(m_accumulationImage), m_visibilitySampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  writer.WriteImage(1, m_graph->GetView(m_revealageImage), m_visibilitySampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  writer.WriteImage(2, m_graph->GetView(m_drawImage), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  writer.UpdateSet(m_ctx->GetDevice(), frame.compositeDescriptorSet);
+}
+
+void Renderer::retireBuffer(std::unique_ptr<Buffer> &buffer) {
+  if (buffer == nullptr)
+    return;
+
+  getCurrentFrame().deletionQueue.PushBuffer(std::move(*buffer));
+  buffer.reset();
 }
 
 VkBuffer Renderer::GetMaterialConstantsBuffer() {
@@ -504,18 +1844,38 @@ VkDescriptorSetLayout Renderer::GetSceneDataDescriptorLayout() {
   return m_gpuSceneDataDescriptorLayout;
 }
 
-uint32_t Renderer::GetHoveredEntityId() {
-  return m_pickingResources.entityId;
-}
-
 RenderingStats Renderer::GetRenderingStats() {
   return m_stats;
 }
 
+void Renderer::SetSceneUpdateTime(float milliseconds) {
+  m_stats.sceneUpdateTime = milliseconds;
+}
+
+std::span<const GpuScopeTiming> Renderer::GetGpuTimings() const {
+  return m_profiler->GetTimings();
+}
+
+DynamicResolution &Renderer::GetDynamicResolution() {
+  return m_dynamicResolution;
+}
+
 GPUSceneData &Renderer::GetGpuSceneData() {
   return m_gpuSceneData;
 }
 
 GPULightData &Renderer::GetGpuLightData() {
   return m_gpuLightData;
+}
+
+bool Renderer::ShadowCascadeNeedsStaticRender(uint32_t cascade) const {
+  return m_shadowMap->NeedsStaticRender(cascade);
+}
+
+const ShadowCascade &Renderer::GetShadowCascade(uint32_t cascade) const {
+  return m_shadowMap->GetCascade(cascade);
+}
+
+std::vector<GPULocalLight> &Renderer::GetLocalLights() {
+  return m_localLights;
 }
\ No newline at end of file
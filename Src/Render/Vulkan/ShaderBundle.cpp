@@ -0,0 +1,76 @@
+#include "Vulkan/ShaderBundle.h"
+
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <print>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+std::span<const T> read_array(std::span<const uint32_t> data, size_t &offset, uint32_t count) {
+  const size_t words = count * sizeof(T) / sizeof(uint32_t);
+  if (offset + words > data.size())
+    throw std::runtime_error("failed to read shader bundle, file is truncated!");
+
+  const auto *first = reinterpret_cast<const T *>(data.data() + offset);
+  offset += words;
+  return {first, count};
+}
+
+} // namespace
+
+ShaderBundle::ShaderBundle(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error(std::format("failed to open shader bundle: {}!", std::filesystem::absolute(path).string()));
+
+  const size_t fileSize = file.tellg();
+  m_data.resize(fileSize / sizeof(uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(m_data.data()), static_cast<std::streamsize>(m_data.size() * sizeof(uint32_t)));
+
+  size_t offset = 0;
+  const ShaderBundleHeader &header = read_array<ShaderBundleHeader>(m_data, offset, 1)[0];
+  if (header.magic != SHADER_BUNDLE_MAGIC || header.version != SHADER_BUNDLE_VERSION)
+    throw std::runtime_error("failed to read shader bundle, it was written by another bundler version!");
+
+  for (uint32_t i = 0; i < header.shaderCount; i++) {
+    const ShaderBundleEntryHeader &entry = read_array<ShaderBundleEntryHeader>(m_data, offset, 1)[0];
+    BundledShader shader{
+        .stage = static_cast<VkShaderStageFlagBits>(entry.stage),
+        .code = read_array<uint32_t>(m_data, offset, entry.codeWordCount),
+        .bindings = read_array<ShaderBundleBinding>(m_data, offset, entry.bindingCount),
+        .pushConstantRanges = read_array<ShaderBundlePushConstantRange>(m_data, offset, entry.pushConstantRangeCount),
+    };
+    m_shaders.emplace(std::string{entry.name, strnlen(entry.name, SHADER_BUNDLE_NAME_SIZE)}, shader);
+  }
+}
+
+const BundledShader &ShaderBundle::Get(std::string_view name) const {
+  auto it = m_shaders.find(std::string{name});
+  if (it == m_shaders.end())
+    throw std::runtime_error(std::format("shader bundle has no shader named {}!", name));
+  return it->second;
+}
+
+bool ShaderBundle::LoadModule(std::string_view name, VkDevice device, VkShaderModule *outShaderModule) const {
+  auto it = m_shaders.find(std::string{name});
+  if (it == m_shaders.end()) {
+    std::println("Shader bundle has no shader named {}", name);
+    return false;
+  }
+
+  VkShaderModuleCreateInfo createInfo{
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .pNext = nullptr,
+      .codeSize = it->second.code.size_bytes(),
+      .pCode = it->second.code.data(),
+  };
+  if (vkCreateShaderModule(device, &createInfo, nullptr, outShaderModule) != VK_SUCCESS) {
+    std::println("Failed to create shader module from bundled shader {}", name);
+    return false;
+  }
+  return true;
+}
@@ -13,13 +13,20 @@
 Swapchain::Swapchain(std::shared_ptr<VulkanContext> ctx, SDL_Window *window)
   : m_ctx{ctx},
     m_window{window},
-    m_renderScale{1.f},
     m_resized{false},
     m_allocator{ctx->GetAllocator()} {
   createSwapchain();
   createImageViews();
-  createDrawImage();
-  createDepthImage();
+}
+
+Swapchain::Swapchain(std::shared_ptr<VulkanContext> ctx, VkExtent2D extent)
+  : m_ctx{ctx},
+    m_window{nullptr},
+    m_format{OFFSCREEN_FORMAT},
+    m_extent{extent},
+    m_resized{false},
+    m_allocator{ctx->GetAllocator()} {
+  createOffscreenImages();
 }
 
 Swapchain::~Swapchain() {
@@ -27,6 +34,10 @@ Swapchain::~Swapchain() {
 }
 
 void Swapchain::RecreateSwapchain() {
+  // Offscreen images never go out of date
+  if (IsHeadless())
+    return;
+
   while (SDL_GetWindowFlags(m_window) & SDL_WINDOW_MINIMIZED) {
     SDL_Event event;
     SDL_WaitEvent(&event);
@@ -37,20 +48,20 @@ void Swapchain::RecreateSwapchain() {
 
   createSwapchain();
   createImageViews();
-  createDrawImage();
-  createDepthImage();
 }
 
 VkSwapchainKHR &Swapchain::GetSwapchain() { return m_swapchain; }
 VkFormat &Swapchain::GetImageFormat() { return m_format; }
 VkExtent2D Swapchain::GetExtent() const { return m_extent; }
 bool Swapchain::IsResized() const { return m_resized; }
-float Swapchain::GetRenderScale() const { return m_renderScale; }
 VkImage Swapchain::GetImage(uint32_t idx) const { return m_images[idx]; }
-std::shared_ptr<Texture> Swapchain::GetDrawTexture() { return m_drawImage; }
-std::shared_ptr<Texture> Swapchain::GetDepthTexture() { return m_depthImage; }
+VkFormat Swapchain::GetDrawFormat() const { return DRAW_FORMAT; }
+VkFormat Swapchain::GetDepthFormat() const { return DEPTH_FORMAT; }
+VkExtent2D Swapchain::GetDrawExtent() const { return m_extent; }
 VkImageView Swapchain::GetImageView(uint32_t idx) const { return m_imageViews[idx]; }
 SwapChainSupportDetails Swapchain::GetSwapchainSupport() const { return m_swapchainSupport; }
+uint32_t Swapchain::GetImageCount() const { return static_cast<uint32_t>(m_images.size()); }
+bool Swapchain::IsHeadless() const { return m_window == nullptr; }
 
 void Swapchain::SetResized(bool resized) {
   m_resized = resized;
@@ -80,10 +91,10 @@ void Swapchain::createSwapchain() {
       .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
   };
 
-  auto [graphicsFamily, presentFamily] = VkUtil::find_queue_families(m_ctx->GetPhysicalDevice(), m_ctx->GetSurface());
-  uint32_t queueFamilyIndices[] = {graphicsFamily.value(), presentFamily.value()};
+  const QueueFamilyIndices indices = VkUtil::find_queue_families(m_ctx->GetPhysicalDevice(), m_ctx->GetSurface());
+  uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
-  if (graphicsFamily != presentFamily) {
+  if (indices.graphicsFamily != indices.presentFamily) {
     createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
     createInfo.queueFamilyIndexCount = 2;
     createInfo.pQueueFamilyIndices = queueFamilyIndices;
@@ -115,21 +126,21 @@ void Swapchain::createImageViews() {
   }
 }
 
-void Swapchain::createDrawImage() {
-  VkExtent3D drawImageExtent = {m_extent.width, m_extent.height, 1};
-  VkImageUsageFlags drawImageUsage{
-      VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-      VK_IMAGE_USAGE_STORAGE_BIT |
-      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+void Swapchain::createOffscreenImages() {
+  VmaAllocationCreateInfo allocInfo{
+      .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
   };
-
-  m_drawImage = std::make_shared<Texture>(m_ctx, drawImageExtent, VK_FORMAT_R16G16B16A16_SFLOAT, drawImageUsage, false);
-}
-
-void Swapchain::createDepthImage() {
-  VkImageUsageFlags depthImageUsage{VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
-  m_depthImage = std::make_shared<Texture>(m_ctx, m_drawImage->GetExtent(), VK_FORMAT_D32_SFLOAT, depthImageUsage, false);
+  // Transfer source so the finished frame can be read back
+  VkImageCreateInfo imageInfo = VkInit::image_create_info(m_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, {m_extent.width, m_extent.height, 1}, 1);
+
+  m_images.resize(OFFSCREEN_IMAGE_COUNT);
+  m_imageAllocations.resize(OFFSCREEN_IMAGE_COUNT);
+  m_imageViews.resize(OFFSCREEN_IMAGE_COUNT);
+  for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+    VK_CHECK(vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &m_images[i], &m_imageAllocations[i], nullptr));
+    m_imageViews[i] = createImageView(m_images[i], m_format, VK_IMAGE_ASPECT_COLOR_BIT);
+  }
 }
 
 VkImageView Swapchain::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) const {
@@ -159,6 +170,11 @@ void Swapchain::cleanupSwapchain() {
   for (auto &imageView : m_imageViews)
     vkDestroyImageView(m_ctx->GetDevice(), imageView, nullptr);
 
-  vkDestroySwapchainKHR(m_ctx->GetDevice(), m_swapchain, nullptr);
+  for (auto [image, allocation] : std::views::zip(m_images, m_imageAllocations))
+    vmaDestroyImage(m_allocator, image, allocation);
+
+  // The swapchain entry points do not exist on a headless device
+  if (!IsHeadless())
+    vkDestroySwapchainKHR(m_ctx->GetDevice(), m_swapchain, nullptr);
   m_deletionQueue.Flush();
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "Vulkan/UploadAllocator.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+UploadAllocator::UploadAllocator(std::shared_ptr<VulkanContext> ctx, VkDeviceSize capacity)
+  : m_ctx{ctx} {
+  const VkPhysicalDeviceLimits &limits = m_ctx->GetGpuProperties().limits;
+  m_descriptorAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+
+  m_block = {createBuffer(capacity), 0};
+}
+
+bool UploadAllocator::Reset() {
+  const VkDeviceSize capacity = m_block.buffer->info.size;
+  const VkDeviceSize peakUsage = m_frameUsage;
+
+  m_overflowBlocks.clear();
+  m_block.head = 0;
+  m_frameUsage = 0;
+
+  if (peakUsage <= capacity)
+    return false;
+
+  m_block.buffer = createBuffer(std::bit_ceil(peakUsage));
+  return true;
+}
+
+UploadAllocation UploadAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+  m_frameUsage = align_up(m_frameUsage, alignment) + size;
+
+  if (align_up(m_block.head, alignment) + size <= m_block.buffer->info.size)
+    return allocateFrom(m_block, size, alignment);
+
+  if (m_overflowBlocks.empty() || align_up(m_overflowBlocks.back().head, alignment) + size > m_overflowBlocks.back().buffer->info.size)
+    m_overflowBlocks.push_back({createBuffer(std::max(size, m_block.buffer->info.size)), 0});
+  return allocateFrom(m_overflowBlocks.back(), size, alignment);
+}
+
+void UploadAllocator::Flush() {
+  m_block.buffer->Flush(0, m_block.head);
+  for (auto &block : m_overflowBlocks)
+    block.buffer->Flush(0, block.head);
+}
+
+VkDeviceSize UploadAllocator::GetDescriptorAlignment() const { return m_descriptorAlignment; }
+VkBuffer UploadAllocator::GetBuffer() const { return m_block.buffer->buffer; }
+
+std::unique_ptr<Buffer> UploadAllocator::createBuffer(VkDeviceSize size) const {
+  constexpr VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  return std::make_unique<Buffer>(m_ctx->GetAllocator(), size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+}
+
+UploadAllocation UploadAllocator::allocateFrom(Block &block, VkDeviceSize size, VkDeviceSize alignment) {
+  const VkDeviceSize offset = align_up(block.head, alignment);
+  block.head = offset + size;
+  return {
+      .buffer = block.buffer->buffer,
+      .offset = offset,
+      .data = static_cast<char *>(block.buffer->info.pMappedData) + offset,
+  };
+}
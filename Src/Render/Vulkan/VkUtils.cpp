@@ -41,15 +41,27 @@ QueueFamilyIndices VkUtil::find_queue_families(VkPhysicalDevice physicalDevice,
     int i = 0;
     for (const auto& queueFamily : queueFamilies)
     {
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-        if (presentSupport)
-            indices.presentFamily = i;
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-            indices.graphicsFamily = i;
-
-        if (indices.isComplete())
-            break;
+        // Profiler scopes are written on it as well, so it must support timestamps
+        const bool computeOnly = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        if (computeOnly && queueFamily.timestampValidBits != 0 && !indices.computeFamily.has_value())
+            indices.computeFamily = i;
+
+        // Every family is visited for the compute one, the first complete pair of the others is kept
+        if (!indices.isComplete())
+        {
+            // Without a surface nothing is presented, the graphics family stands in for the present one
+            VkBool32 presentSupport = false;
+            if (surface != VK_NULL_HANDLE)
+                vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                indices.graphicsFamily = i;
+                if (surface == VK_NULL_HANDLE)
+                    presentSupport = true;
+            }
+            if (presentSupport)
+                indices.presentFamily = i;
+        }
         i++;
     }
 
@@ -109,7 +121,10 @@ void VkUtil::copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage de
 }
 
 void VkUtil::transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout) {
-    VkImageAspectFlags aspectMask = newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    auto isDepthLayout = [](VkImageLayout layout) {
+        return layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL || layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    };
+    VkImageAspectFlags aspectMask = isDepthLayout(currentLayout) || isDepthLayout(newLayout) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
     VkImageMemoryBarrier2 imageBarrier {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
         .pNext = nullptr,
@@ -133,44 +148,41 @@ void VkUtil::transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout
     vkCmdPipelineBarrier2(cmd, &depInfo);
 }
 
-bool VkUtil::load_shader_module(const std::filesystem::path& filePath, VkDevice device, VkShaderModule* outShaderModule)
-{
-    if (!std::filesystem::exists(filePath))
-    {
-        std::print("Failed to read file, path doesn't exist: {}", std::filesystem::absolute(filePath).string());
-        return false;
-    }
-    std::ifstream file(filePath, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        std::print("Failed to open file: {}", std::filesystem::absolute(filePath).string());
-        return false;
-    }
-
-    size_t fileSize = file.tellg();
-    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
-
-    file.seekg(0);
-    file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
-    file.close();
+void VkUtil::memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) {
+    VkMemoryBarrier2 memoryBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .pNext = nullptr,
+        .srcStageMask = srcStage,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = dstStage,
+        .dstAccessMask = dstAccess
+    };
 
-    VkShaderModuleCreateInfo createInfo {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+    VkDependencyInfo depInfo {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
         .pNext = nullptr,
-        .codeSize = buffer.size() * sizeof(uint32_t),
-        .pCode = buffer.data()
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &memoryBarrier
     };
 
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-    {
-        std::print("Failed to create shader module from: {}", std::filesystem::absolute(filePath).string());
-        return false;
-    }
-    *outShaderModule = shaderModule;
-    return true;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void VkUtil::set_queue_families(VkImageCreateInfo& info, std::span<const uint32_t> queueFamilies) {
+    if (queueFamilies.size() < 2)
+        return;
+    info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    info.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+    info.pQueueFamilyIndices = queueFamilies.data();
 }
 
+VkDeviceAddress VkUtil::get_buffer_address(VkDevice device, VkBuffer buffer) {
+    const VkBufferDeviceAddressInfo addressInfo{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer,
+    };
+    return vkGetBufferDeviceAddress(device, &addressInfo);
+}
 
 VkSurfaceFormatKHR VkUtil::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
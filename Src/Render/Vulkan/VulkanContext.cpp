@@ -1,5 +1,8 @@
 #include "Vulkan/VulkanContext.h"
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <print>
 #include <set>
 #include <stdexcept>
@@ -15,11 +18,86 @@ constexpr bool g_enableValidationLayers = true;
 #endif
 
 std::vector g_validationLayers{"VK_LAYER_KHRONOS_validation"};
-std::vector g_deviceExtensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_NV_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME};
+std::vector g_deviceExtensions{VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME};
+
+namespace {
+
+const std::filesystem::path PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const std::filesystem::path SHADER_BUNDLE_PATH = "../Shaders/shaders.bundle";
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x59504c43; // "YPLC"
+constexpr uint32_t PIPELINE_CACHE_FILE_VERSION = 2;
+
+// Written in front of the driver's cache data. Drivers are meant to reject foreign data themselves, but some
+// crash on it instead, so a cache from another device or driver build is never handed to them.
+// Compared with memcmp, so every byte is a field and none is padding
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t fileVersion;
+  uint32_t vendorId;
+  uint32_t deviceId;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUuid[VK_UUID_SIZE];
+  uint32_t reserved;
+  uint64_t dataSize;
+};
+static_assert(sizeof(PipelineCacheFileHeader) == 48);
+
+PipelineCacheFileHeader make_cache_header(const VkPhysicalDeviceProperties &properties, uint64_t dataSize) {
+  PipelineCacheFileHeader header{
+      .magic = PIPELINE_CACHE_MAGIC,
+      .fileVersion = PIPELINE_CACHE_FILE_VERSION,
+      .vendorId = properties.vendorID,
+      .deviceId = properties.deviceID,
+      .driverVersion = properties.driverVersion,
+      .reserved = 0,
+      .dataSize = dataSize,
+  };
+  std::memcpy(header.pipelineCacheUuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  return header;
+}
+
+// Returns the driver data of a cache file written on this device and driver, empty otherwise
+std::vector<char> read_pipeline_cache(const VkPhysicalDeviceProperties &properties) {
+  std::ifstream file(PIPELINE_CACHE_PATH, std::ios::binary);
+  if (!file)
+    return {};
+
+  PipelineCacheFileHeader header{};
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    return {};
+
+  const PipelineCacheFileHeader expected = make_cache_header(properties, header.dataSize);
+  if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+    std::println("Pipeline cache was written by another device or driver, starting from an empty cache");
+    return {};
+  }
+
+  std::vector<char> data(header.dataSize);
+  if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+    return {};
+
+  // The driver header leads the data and must match the same device
+  VkPipelineCacheHeaderVersionOne driverHeader{};
+  if (data.size() < sizeof(driverHeader))
+    return {};
+  std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+  if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader.vendorID != properties.vendorID || driverHeader.deviceID != properties.deviceID ||
+      std::memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    return {};
+
+  return data;
+}
+
+} // namespace
+
+VulkanContext::VulkanContext(SDL_Window *window)
+  : m_headless{window == nullptr} {
+  // Read before any Vulkan object exists, so a missing bundle fails without leaking them
+  m_shaderBundle = std::make_unique<ShaderBundle>(SHADER_BUNDLE_PATH);
 
-VulkanContext::VulkanContext(SDL_Window *window) {
   createInstance();
-  createSurface(window);
+  if (!m_headless)
+    createSurface(window);
   pickPhysicalDevice();
   createLogicalDevice();
 
@@ -38,8 +116,7 @@ VulkanContext::VulkanContext(SDL_Window *window) {
   VkFenceCreateInfo fenceCreateInfo = VkInit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
   VK_CHECK(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_immFence));
 
-  auto [graphicsFamily, presentFamily] = VkUtil::find_queue_families(m_physicalDevice, m_surface);
-  VkCommandPoolCreateInfo commandPoolInfo = VkInit::command_pool_create_info(graphicsFamily.value(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  VkCommandPoolCreateInfo commandPoolInfo = VkInit::command_pool_create_info(GetGraphicsQueueFamily(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
   VK_CHECK(vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &m_immCommandPool));
   VkCommandBufferAllocateInfo cmdAllocInfo = VkInit::command_buffer_allocate_info(m_immCommandPool, 1);
   VK_CHECK(vkAllocateCommandBuffers(m_device, &cmdAllocInfo, &m_immCommandBuffer));
@@ -50,16 +127,21 @@ VulkanContext::VulkanContext(SDL_Window *window) {
   });
 
   vkGetPhysicalDeviceProperties(m_physicalDevice, &m_gpuProperties);
+  createPipelineCache();
 }
 
 VulkanContext::~VulkanContext() {
+  savePipelineCache();
+  vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+
   if (g_enableValidationLayers)
     destroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
 
   m_deletionQueue.Flush();
 
   vkDestroyDevice(m_device, nullptr);
-  vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+  if (!m_headless)
+    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
   vkDestroyInstance(m_instance, nullptr);
 }
 
@@ -70,7 +152,15 @@ VkSurfaceKHR VulkanContext::GetSurface() const { return m_surface; }
 VmaAllocator VulkanContext::GetAllocator() const { return m_allocator; }
 VkQueue VulkanContext::GetGraphicsQueue() const { return m_graphicsQueue; }
 VkQueue VulkanContext::GetPresentQueue() const { return m_presentQueue; }
+uint32_t VulkanContext::GetGraphicsQueueFamily() const { return m_queueFamilies.graphicsFamily.value(); }
+bool VulkanContext::HasAsyncCompute() const { return m_queueFamilies.computeFamily.has_value(); }
+VkQueue VulkanContext::GetComputeQueue() const { return m_computeQueue; }
+uint32_t VulkanContext::GetComputeQueueFamily() const { return m_queueFamilies.computeFamily.value(); }
+std::span<const uint32_t> VulkanContext::GetSharedQueueFamilies() const { return m_sharedQueueFamilies; }
 VkPhysicalDeviceProperties VulkanContext::GetGpuProperties() const { return m_gpuProperties; }
+VkPipelineCache VulkanContext::GetPipelineCache() const { return m_pipelineCache; }
+const ShaderBundle &VulkanContext::GetShaderBundle() const { return *m_shaderBundle; }
+bool VulkanContext::IsHeadless() const { return m_headless; }
 
 void VulkanContext::createInstance() {
   // Setup validation layers
@@ -87,10 +177,13 @@ void VulkanContext::createInstance() {
       .apiVersion = VK_API_VERSION_1_3
   };
 
-  // Initialize extensions
-  uint32_t extCount;
-  const char *const *instanceExtensions = SDL_Vulkan_GetInstanceExtensions(&extCount);
-  std::vector extensions(instanceExtensions, instanceExtensions + extCount);
+  // Initialize extensions, SDL video is never initialized without a window so it is not asked for surface ones
+  std::vector<const char *> extensions;
+  if (!m_headless) {
+    uint32_t extCount;
+    const char *const *instanceExtensions = SDL_Vulkan_GetInstanceExtensions(&extCount);
+    extensions.assign(instanceExtensions, instanceExtensions + extCount);
+  }
   extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
   // Initialize debug create info
@@ -117,10 +210,59 @@ void VulkanContext::createSurface(SDL_Window *window) {
     throw std::runtime_error("failed to create surface");
 }
 
+void VulkanContext::createPipelineCache() {
+  const std::vector<char> initialData = read_pipeline_cache(m_gpuProperties);
+  VkPipelineCacheCreateInfo cacheInfo{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = initialData.size(),
+      .pInitialData = initialData.empty() ? nullptr : initialData.data(),
+  };
+
+  // Data the driver still refuses is dropped, compiling from scratch beats failing to start
+  if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache) != VK_SUCCESS) {
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData = nullptr;
+    VK_CHECK(vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache));
+  }
+}
+
+void VulkanContext::savePipelineCache() const {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+    return;
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+    return;
+
+  // Written next to the cache and renamed over it, so a crash mid write never leaves a truncated cache behind
+  std::filesystem::path tempPath = PIPELINE_CACHE_PATH;
+  tempPath += ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    const PipelineCacheFileHeader header = make_cache_header(m_gpuProperties, dataSize);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(data.data(), static_cast<std::streamsize>(dataSize));
+    if (!file.flush()) {
+      std::println("Failed to write the pipeline cache to {}", tempPath.string());
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+  if (error)
+    std::println("Failed to replace the pipeline cache: {}", error.message());
+}
+
 void VulkanContext::createLogicalDevice() {
-  auto [graphicsFamily, presentFamily] = VkUtil::find_queue_families(m_physicalDevice, m_surface);
+  m_queueFamilies = VkUtil::find_queue_families(m_physicalDevice, m_surface);
+  const auto [graphicsFamily, presentFamily, computeFamily] = m_queueFamilies;
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set uniqueQueueFamilies = {graphicsFamily.value(), presentFamily.value()};
+  if (computeFamily.has_value()) {
+    uniqueQueueFamilies.insert(computeFamily.value());
+    m_sharedQueueFamilies = {graphicsFamily.value(), computeFamily.value()};
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -136,6 +278,7 @@ void VulkanContext::createLogicalDevice() {
   VkPhysicalDeviceFeatures deviceFeatures{
     .independentBlend = VK_TRUE,
     .multiDrawIndirect = VK_TRUE,
+    .drawIndirectFirstInstance = VK_TRUE,
     .fillModeNonSolid = VK_TRUE
   };
 
@@ -160,27 +303,32 @@ void VulkanContext::createLogicalDevice() {
       .pNext = &sync2Features,
       .dynamicRendering = VK_TRUE
   };
-  VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{
-      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+  VkPhysicalDeviceVulkan12Features deviceFeatures12{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
       .pNext = &dynamicRenderingFeatures,
+      .drawIndirectCount = VK_TRUE,
+      .descriptorIndexing = VK_TRUE,
+      .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+      .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+      .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+      .descriptorBindingPartiallyBound = VK_TRUE,
+      .runtimeDescriptorArray = VK_TRUE,
+      .samplerFilterMinmax = VK_TRUE,
+      .separateDepthStencilLayouts = VK_TRUE,
+      .timelineSemaphore = VK_TRUE,
       .bufferDeviceAddress = VK_TRUE,
   };
 
-  VkPhysicalDeviceFragmentShaderBarycentricFeaturesNV fragmentShaderBarycentricFeatures{
-      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADER_BARYCENTRIC_FEATURES_NV,
-      .pNext = &bufferDeviceAddressFeatures,
-      .fragmentShaderBarycentric = VK_TRUE
-  };
-
+  const std::vector<const char *> deviceExtensions = getDeviceExtensions();
   const VkDeviceCreateInfo createInfo{
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .pNext = &fragmentShaderBarycentricFeatures,
+      .pNext = &deviceFeatures12,
       .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
       .pQueueCreateInfos = queueCreateInfos.data(),
       .enabledLayerCount = static_cast<uint32_t>(g_validationLayers.size()),
       .ppEnabledLayerNames = g_validationLayers.data(),
-      .enabledExtensionCount = static_cast<uint32_t>(g_deviceExtensions.size()),
-      .ppEnabledExtensionNames = g_deviceExtensions.data(),
+      .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
+      .ppEnabledExtensionNames = deviceExtensions.data(),
       .pEnabledFeatures = nullptr
   };
 
@@ -189,6 +337,8 @@ void VulkanContext::createLogicalDevice() {
 
   vkGetDeviceQueue(m_device, graphicsFamily.value(), 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, presentFamily.value(), 0, &m_presentQueue);
+  if (computeFamily.has_value())
+    vkGetDeviceQueue(m_device, computeFamily.value(), 0, &m_computeQueue);
 }
 
 void VulkanContext::pickPhysicalDevice() {
@@ -216,16 +366,23 @@ bool VulkanContext::isDeviceSuitable(VkPhysicalDevice device) const {
   QueueFamilyIndices indices = VkUtil::find_queue_families(device, m_surface);
   bool extensionsSupported = checkDeviceExtensionsSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  // Nothing is presented without a surface
+  bool swapChainAdequate = m_headless;
+  if (extensionsSupported && !m_headless) {
     SwapChainSupportDetails swapChainSupport = VkUtil::query_swapchain_support(device, m_surface);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
 
-  VkPhysicalDeviceFeatures supportedFeatures;
-  vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+  VkPhysicalDeviceVulkan12Features supportedFeatures12{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  VkPhysicalDeviceFeatures2 supportedFeatures{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &supportedFeatures12
+  };
+  vkGetPhysicalDeviceFeatures2(device, &supportedFeatures);
 
-  return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+  return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.features.samplerAnisotropy && supportedFeatures.features.multiDrawIndirect && supportedFeatures.features.drawIndirectFirstInstance && supportedFeatures12.drawIndirectCount && supportedFeatures12.samplerFilterMinmax && supportedFeatures12.separateDepthStencilLayouts &&
+         supportedFeatures12.descriptorIndexing && supportedFeatures12.shaderSampledImageArrayNonUniformIndexing && supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind &&
+         supportedFeatures12.descriptorBindingUpdateUnusedWhilePending && supportedFeatures12.descriptorBindingPartiallyBound && supportedFeatures12.runtimeDescriptorArray && supportedFeatures12.timelineSemaphore;
 }
 
 void VulkanContext::ImmediateSubmit(std::function<void(VkCommandBuffer cmd)> &&function) const {
@@ -246,14 +403,22 @@ void VulkanContext::ImmediateSubmit(std::function<void(VkCommandBuffer cmd)> &&f
   VK_CHECK(vkWaitForFences(GetDevice(), 1, &m_immFence, true, 9999999999));
 }
 
-bool VulkanContext::checkDeviceExtensionsSupport(VkPhysicalDevice device) {
+std::vector<const char *> VulkanContext::getDeviceExtensions() const {
+  std::vector<const char *> extensions = g_deviceExtensions;
+  if (!m_headless)
+    extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  return extensions;
+}
+
+bool VulkanContext::checkDeviceExtensionsSupport(VkPhysicalDevice device) const {
   uint32_t extensionCount;
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
   std::vector<VkExtensionProperties> availableExtensions(extensionCount);
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-  std::set<std::string> requiredExtensions(g_deviceExtensions.begin(), g_deviceExtensions.end());
+  const std::vector<const char *> deviceExtensions = getDeviceExtensions();
+  std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
   for (const auto &[extensionName, specVersion] : availableExtensions) {
     requiredExtensions.erase(extensionName);
@@ -0,0 +1,157 @@
+// Packs compiled SPIR-V files into a single shader bundle together with their reflection, so the runtime
+// creates modules and layouts without parsing SPIR-V.
+// Usage: YakiShaderBundler <output bundle> <shader root> <spirv files...>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <spirv_cross/spirv_cross.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/ShaderBundleFormat.h"
+
+namespace {
+
+struct ReflectedShader {
+  std::string name;
+  VkShaderStageFlagBits stage;
+  std::vector<uint32_t> code;
+  std::vector<ShaderBundleBinding> bindings;
+  std::vector<ShaderBundlePushConstantRange> pushConstantRanges;
+};
+
+std::vector<uint32_t> read_spirv(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error(std::format("failed to open {}!", path.string()));
+
+  const size_t fileSize = file.tellg();
+  std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(code.data()), static_cast<std::streamsize>(code.size() * sizeof(uint32_t)));
+  return code;
+}
+
+VkShaderStageFlagBits to_stage(spv::ExecutionModel model) {
+  switch (model) {
+    case spv::ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+    case spv::ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case spv::ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+    default: throw std::runtime_error("unsupported shader stage!");
+  }
+}
+
+void reflect_bindings(const spirv_cross::Compiler &compiler, const spirv_cross::SmallVector<spirv_cross::Resource> &resources, VkDescriptorType type, std::vector<ShaderBundleBinding> &bindings) {
+  for (const auto &resource : resources) {
+    const spirv_cross::SPIRType &resourceType = compiler.get_type(resource.type_id);
+
+    // Runtime sized arrays keep a count of 0
+    uint32_t count = 1;
+    for (uint32_t size : resourceType.array)
+      count *= size;
+
+    bindings.push_back({
+        .set = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet),
+        .binding = compiler.get_decoration(resource.id, spv::DecorationBinding),
+        .descriptorType = static_cast<uint32_t>(type),
+        .descriptorCount = count,
+    });
+  }
+}
+
+ReflectedShader reflect(const std::filesystem::path &path, const std::filesystem::path &root) {
+  ReflectedShader shader{
+      .name = std::filesystem::relative(path, root).replace_extension().generic_string(),
+      .code = read_spirv(path),
+  };
+  if (shader.name.size() >= SHADER_BUNDLE_NAME_SIZE)
+    throw std::runtime_error(std::format("shader name {} is too long!", shader.name));
+
+  const spirv_cross::Compiler compiler(shader.code);
+  const spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+  shader.stage = to_stage(compiler.get_execution_model());
+
+  reflect_bindings(compiler, resources.uniform_buffers, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, shader.bindings);
+  reflect_bindings(compiler, resources.storage_buffers, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, shader.bindings);
+  reflect_bindings(compiler, resources.sampled_images, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, shader.bindings);
+  reflect_bindings(compiler, resources.separate_images, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, shader.bindings);
+  reflect_bindings(compiler, resources.separate_samplers, VK_DESCRIPTOR_TYPE_SAMPLER, shader.bindings);
+  reflect_bindings(compiler, resources.storage_images, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, shader.bindings);
+  std::ranges::sort(shader.bindings, {}, [](const ShaderBundleBinding &binding) { return std::pair{binding.set, binding.binding}; });
+
+  // A range starts at 0 and covers every member of the block, the same layout the engine pushes with
+  for (const auto &pc : resources.push_constant_buffers) {
+    const spirv_cross::SPIRType &type = compiler.get_type(pc.base_type_id);
+    size_t size = 0;
+    for (uint32_t i = 0; i < type.member_types.size(); i++)
+      size = std::max(size, compiler.type_struct_member_offset(type, i) + compiler.get_declared_struct_member_size(type, i));
+    shader.pushConstantRanges.push_back({.offset = 0, .size = static_cast<uint32_t>(size)});
+  }
+
+  return shader;
+}
+
+template <typename T>
+void write_array(std::ofstream &file, const T *values, size_t count) {
+  file.write(reinterpret_cast<const char *>(values), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+void write_bundle(const std::filesystem::path &path, std::span<const ReflectedShader> shaders) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw std::runtime_error(std::format("failed to create {}!", path.string()));
+
+  const ShaderBundleHeader header{
+      .magic = SHADER_BUNDLE_MAGIC,
+      .version = SHADER_BUNDLE_VERSION,
+      .shaderCount = static_cast<uint32_t>(shaders.size()),
+  };
+  write_array(file, &header, 1);
+
+  for (const auto &shader : shaders) {
+    ShaderBundleEntryHeader entry{
+        .stage = static_cast<uint32_t>(shader.stage),
+        .codeWordCount = static_cast<uint32_t>(shader.code.size()),
+        .bindingCount = static_cast<uint32_t>(shader.bindings.size()),
+        .pushConstantRangeCount = static_cast<uint32_t>(shader.pushConstantRanges.size()),
+    };
+    std::memcpy(entry.name, shader.name.data(), shader.name.size());
+
+    write_array(file, &entry, 1);
+    write_array(file, shader.code.data(), shader.code.size());
+    write_array(file, shader.bindings.data(), shader.bindings.size());
+    write_array(file, shader.pushConstantRanges.data(), shader.pushConstantRanges.size());
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::println("Usage: YakiShaderBundler <output bundle> <shader root> <spirv files...>");
+    return 1;
+  }
+
+  try {
+    const std::filesystem::path output = argv[1];
+    const std::filesystem::path root = argv[2];
+
+    std::vector<ReflectedShader> shaders;
+    for (int i = 3; i < argc; i++)
+      shaders.push_back(reflect(argv[i], root));
+
+    write_bundle(output, shaders);
+    std::println("Bundled {} shaders into {}", shaders.size(), output.string());
+  } catch (const std::exception &e) {
+    std::println("{}", e.what());
+    return 1;
+  }
+  return 0;
+}